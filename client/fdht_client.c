@@ -21,6 +21,7 @@
 #include "fdht_types.h"
 #include "fdht_proto.h"
 #include "fdht_global.h"
+#include "local_ip_func.h"
 #include "fdht_client.h"
 
 GroupArray g_group_array = {NULL, 0};
@@ -60,6 +61,7 @@ static void fdht_proxy_extra_deal(GroupArray *pGroupArray, bool *bKeepAlive)
 int fdht_client_init(const char *filename)
 {
 	char *pBasePath;
+	char *pUnixSocketPath;
 	IniContext iniContext;
 	char szProxyPrompt[64];
 	int result;
@@ -118,6 +120,16 @@ int fdht_client_init(const char *filename)
 		g_keep_alive = iniGetBoolValue(NULL, "keep_alive", \
 				&iniContext, false);
 
+		pUnixSocketPath = iniGetStrValue(NULL, "unix_socket_path", \
+				&iniContext);
+		if (pUnixSocketPath != NULL && *pUnixSocketPath != '\0')
+		{
+			snprintf(g_fdht_unix_socket_path, \
+				sizeof(g_fdht_unix_socket_path), \
+				"%s", pUnixSocketPath);
+			load_local_host_ip_addrs();
+		}
+
 		if ((result=fdht_load_groups(&iniContext, \
 				&g_group_array)) != 0)
 		{
@@ -140,10 +152,12 @@ int fdht_client_init(const char *filename)
 		logDebug("file: "__FILE__", line: %d, " \
 			"base_path=%s, " \
 			"connect_timeout=%ds, network_timeout=%ds, " \
-			"keep_alive=%d, use_proxy=%d, %s"\
+			"keep_alive=%d, unix_socket_path=%s, " \
+			"use_proxy=%d, %s"\
 			"group_count=%d, server_count=%d", __LINE__, \
 			g_fdht_base_path, g_fdht_connect_timeout, \
 			g_fdht_network_timeout, g_keep_alive, \
+			g_fdht_unix_socket_path, \
 			g_group_array.use_proxy, szProxyPrompt, \
 			g_group_array.group_count, g_group_array.server_count);
 
@@ -223,7 +237,7 @@ static FDHTServerInfo *get_connection(ServerArray *pServerArray, \
 		if ((*err_no=fdht_connect_server_nb(*ppServer, \
 			g_fdht_connect_timeout)) == 0)
 		{
-			if (bKeepAlive)
+			if (bKeepAlive && !(*ppServer)->unix_socket)
 			{
 				tcpsetnodelay((*ppServer)->sock, 3600);
 			}
@@ -242,7 +256,7 @@ static FDHTServerInfo *get_connection(ServerArray *pServerArray, \
 		if ((*err_no=fdht_connect_server_nb(*ppServer, \
 			g_fdht_connect_timeout)) == 0)
 		{
-			if (bKeepAlive)
+			if (bKeepAlive && !(*ppServer)->unix_socket)
 			{
 				tcpsetnodelay((*ppServer)->sock, 3600);
 			}
@@ -510,6 +524,272 @@ int fdht_get_ex1(GroupArray *pGroupArray, const bool bKeepAlive, \
 	return result;
 }
 
+static int pipeline_calc_hash_code(FDHTKeyInfo *pKeyInfo, int *hash_code)
+{
+	char hash_key[FDHT_MAX_FULL_KEY_LEN + 1];
+	int hash_key_len;
+	int key_hash_code;
+
+	CALC_KEY_HASH_CODE(pKeyInfo, hash_key, hash_key_len, key_hash_code)
+	*hash_code = key_hash_code;
+	return 0;
+}
+
+static int pipeline_send_get(FDHTServerInfo *pServer, \
+		FDHTKeyInfo *pKeyInfo, const int key_hash_code, \
+		const time_t expires)
+{
+	FDHTProtoHeader *pHeader;
+	char buff[sizeof(FDHTProtoHeader) + FDHT_MAX_FULL_KEY_LEN + 16];
+	char *p;
+	int result;
+
+	memset(buff, 0, sizeof(FDHTProtoHeader));
+	pHeader = (FDHTProtoHeader *)buff;
+
+	pHeader->cmd = FDHT_PROTO_CMD_GET;
+	pHeader->keep_alive = 1;
+	int2buff((int)time(NULL), pHeader->timestamp);
+	int2buff((int)expires, pHeader->expires);
+	int2buff(key_hash_code, pHeader->key_hash_code);
+	int2buff(12 + pKeyInfo->namespace_len + pKeyInfo->obj_id_len + \
+		pKeyInfo->key_len, pHeader->pkg_len);
+
+	p = buff + sizeof(FDHTProtoHeader);
+	PACK_BODY_UNTIL_KEY(pKeyInfo, p)
+	if ((result=tcpsenddata_nb(pServer->sock, buff, p - buff, \
+		g_fdht_network_timeout)) != 0)
+	{
+		logError("send data to server %s:%d fail, " \
+			"errno: %d, error info: %s", \
+			pServer->ip_addr, pServer->port, \
+			result, STRERROR(result));
+	}
+
+	return result;
+}
+
+/* return: error no, *broken is set to true when the connection
+   can not be used any more */
+static int pipeline_recv_get(FDHTServerInfo *pServer, \
+		FDHTPipelineItem *pItem, MallocFunc malloc_func, bool *broken)
+{
+	int result;
+	int in_bytes;
+	int vlen;
+	char buff[4];
+
+	*broken = true;
+	if ((result=fdht_recv_header(pServer, &in_bytes)) != 0)
+	{
+		if (result < ENETDOWN && result != EINVAL)
+		{
+			*broken = false;  //status of the response
+		}
+		return result;
+	}
+
+	if (in_bytes < 4)
+	{
+		logError("server %s:%d reponse bytes: %d < 4", \
+			pServer->ip_addr, pServer->port, in_bytes);
+		return EINVAL;
+	}
+
+	if ((result=tcprecvdata_nb(pServer->sock, buff, \
+		4, g_fdht_network_timeout)) != 0)
+	{
+		logError("file: "__FILE__", line: %d, " \
+			"server: %s:%d, recv data fail, " \
+			"errno: %d, error info: %s", \
+			__LINE__, pServer->ip_addr, pServer->port, \
+			result, STRERROR(result));
+		return result;
+	}
+
+	vlen = buff2int(buff);
+	if (vlen != in_bytes - 4)
+	{
+		logError("server %s:%d reponse bytes: %d " \
+			"is not correct, %d != %d", pServer->ip_addr, \
+			pServer->port, in_bytes, vlen, in_bytes - 4);
+		return EINVAL;
+	}
+
+	pItem->pValue = (char *)malloc_func(vlen + 1);
+	if (pItem->pValue == NULL)
+	{
+		logError("malloc %d bytes fail, " \
+			"errno: %d, error info: %s", \
+			vlen + 1, errno, STRERROR(errno));
+		return errno != 0 ? errno : ENOMEM;
+	}
+
+	if ((result=tcprecvdata_nb(pServer->sock, pItem->pValue, \
+		vlen, g_fdht_network_timeout)) != 0)
+	{
+		logError("file: "__FILE__", line: %d, " \
+			"server: %s:%d, recv data fail, " \
+			"errno: %d, error info: %s", \
+			__LINE__, pServer->ip_addr, pServer->port, \
+			result, STRERROR(result));
+		return result;
+	}
+
+	*(pItem->pValue + vlen) = '\0';
+	pItem->value_len = vlen;
+	*broken = false;
+	return 0;
+}
+
+/* fail the requests in flight of the broken server */
+static void pipeline_fail_server(FDHTServerInfo *pServer, \
+		FDHTPipelineItem *items, FDHTServerInfo **ppServers, \
+		const int start, const int end, const int result)
+{
+	int i;
+
+	for (i=start; i<end; i++)
+	{
+		if (ppServers[i] == pServer)
+		{
+			ppServers[i] = NULL;
+			items[i].status = result;
+		}
+	}
+
+	fdht_disconnect_server(pServer);
+}
+
+int fdht_pipeline_get_ex(GroupArray *pGroupArray, const bool bKeepAlive, \
+		FDHTPipelineItem *items, const int item_count, \
+		const time_t expires, const int pipeline_depth, \
+		MallocFunc malloc_func, int *success_count)
+{
+	int *hash_codes;
+	FDHTServerInfo **ppServers;
+	FDHTServerInfo *pServer;
+	FDHTPipelineItem *pItem;
+	int send_index;
+	int recv_index;
+	int depth;
+	int result;
+	int i;
+	bool broken;
+
+	*success_count = 0;
+	if (item_count <= 0)
+	{
+		return EINVAL;
+	}
+
+	hash_codes = (int *)malloc((sizeof(int) + sizeof(FDHTServerInfo *)) \
+				* item_count);
+	if (hash_codes == NULL)
+	{
+		logError("malloc %d bytes fail, " \
+			"errno: %d, error info: %s", \
+			(int)(sizeof(int) + sizeof(FDHTServerInfo *)) * \
+			item_count, errno, STRERROR(errno));
+		return errno != 0 ? errno : ENOMEM;
+	}
+	ppServers = (FDHTServerInfo **)(hash_codes + item_count);
+
+	for (i=0; i<item_count; i++)
+	{
+		items[i].pValue = NULL;
+		items[i].value_len = 0;
+		items[i].status = ENOENT;
+		ppServers[i] = NULL;
+		if ((result=pipeline_calc_hash_code(items[i].pKeyInfo, \
+				hash_codes + i)) != 0)
+		{
+			free(hash_codes);
+			return result;
+		}
+	}
+
+	depth = pipeline_depth > 0 ? pipeline_depth : 1;
+	send_index = 0;
+	recv_index = 0;
+	while (recv_index < item_count)
+	{
+		/* keep at most depth requests in flight */
+		while (send_index < item_count && \
+			send_index - recv_index < depth)
+		{
+			pItem = items + send_index;
+			pServer = get_readable_connection(pGroupArray->groups + \
+				((unsigned int)hash_codes[send_index]) % \
+				pGroupArray->group_count, true, \
+				hash_codes[send_index], &result);
+			if (pServer == NULL)
+			{
+				pItem->status = result;
+			}
+			else if ((result=pipeline_send_get(pServer, \
+				pItem->pKeyInfo, hash_codes[send_index], \
+				expires)) != 0)
+			{
+				pItem->status = result;
+				pipeline_fail_server(pServer, items, ppServers,\
+					recv_index, send_index, result);
+			}
+			else
+			{
+				ppServers[send_index] = pServer;
+			}
+
+			send_index++;
+		}
+
+		pItem = items + recv_index;
+		pServer = ppServers[recv_index];
+		if (pServer != NULL)
+		{
+			pItem->status = pipeline_recv_get(pServer, pItem, \
+					malloc_func, &broken);
+			if (pItem->status == 0)
+			{
+				(*success_count)++;
+			}
+			else if (broken)
+			{
+				pipeline_fail_server(pServer, items, ppServers,\
+					recv_index + 1, send_index, \
+					pItem->status);
+			}
+		}
+
+		recv_index++;
+	}
+
+	if (!bKeepAlive)
+	{
+		for (i=0; i<item_count; i++)
+		{
+			if (ppServers[i] != NULL && ppServers[i]->sock >= 0)
+			{
+				fdht_disconnect_server(ppServers[i]);
+			}
+		}
+	}
+
+	free(hash_codes);
+
+	result = 0;
+	for (i=0; i<item_count; i++)
+	{
+		if (items[i].status != 0)
+		{
+			result = items[i].status;  //the first fail
+			break;
+		}
+	}
+
+	return result;
+}
+
 int fdht_batch_set_ex(GroupArray *pGroupArray, const bool bKeepAlive, \
 		FDHTObjectInfo *pObjectInfo, FDHTKeyValuePair *key_list, \
 		const int key_count, const time_t expires, int *success_count)
@@ -1346,7 +1626,8 @@ int fdht_connect_all_servers(GroupArray *pGroupArray, const bool bKeepAlive, \
 		else //connect success
 		{
 			(*success_count)++;
-			if (bKeepAlive || pGroupArray->use_proxy)
+			if ((bKeepAlive || pGroupArray->use_proxy) && \
+				!pServerInfo->unix_socket)
 			{
 				tcpsetnodelay(pServerInfo->sock, 3600);
 			}
@@ -1412,7 +1693,7 @@ int fdht_stat_ex(GroupArray *pGroupArray, const bool bKeepAlive, \
 		return result;
 	}
 
-	if (bKeepAlive)
+	if (bKeepAlive && !pServer->unix_socket)
 	{
 		tcpsetnodelay(pServer->sock, 3600);
 	}
@@ -26,6 +26,14 @@ extern "C" {
 extern GroupArray g_group_array; //group info, including server list
 extern bool g_keep_alive;  //persistent connection flag
 
+typedef struct
+{
+	FDHTKeyInfo *pKeyInfo;  //the key to fetch
+	char *pValue;    //return the value, malloced by malloc_func
+	int value_len;   //return the length of the value (bytes)
+	int status;      //return 0 for success, != 0 for fail (errno)
+} FDHTPipelineItem;
+
 /*
 init function
 param:
@@ -77,6 +85,11 @@ void fdht_client_destroy();
 	 fdht_batch_get_ex1((&g_group_array), g_keep_alive, pObjectInfo, \
 			key_list, key_count, expires, malloc, success_count)
 
+#define fdht_pipeline_get(items, item_count, pipeline_depth, success_count) \
+	fdht_pipeline_get_ex((&g_group_array), g_keep_alive, items, \
+		item_count, FDHT_EXPIRES_NONE, pipeline_depth, \
+		malloc, success_count)
+
 #define fdht_set(pKeyInfo, expires, pValue, value_len) \
 	fdht_set_ex((&g_group_array), g_keep_alive, pKeyInfo, expires, \
 		pValue, value_len)
@@ -141,6 +154,27 @@ int fdht_batch_get_ex1(GroupArray *pGroupArray, const bool bKeepAlive, \
 		const int key_count, const time_t expires, \
 		MallocFunc malloc_func, int *success_count);
 
+/*
+get values of the keys, keep at most pipeline_depth requests in flight
+on each connection without waiting for the responses one by one
+param:
+	pGroupArray: group info, can use &g_group_array
+	bKeepAlive: persistent connection flag, true for persistent connection
+	items:  the keys to fetch, return the values and status
+	item_count: item count
+	expires:  expire time (unix timestamp)
+		FDHT_EXPIRES_NONE - do not change the expire time of the keys
+		FDHT_EXPIRES_NEVER- set the expire time to forever(never expired)
+	pipeline_depth: max requests in flight
+	malloc_func: malloc function, can be standard function named malloc
+	success_count: return the success count
+return: 0 for all success, != 0 for the errno of the first failed item
+*/
+int fdht_pipeline_get_ex(GroupArray *pGroupArray, const bool bKeepAlive, \
+		FDHTPipelineItem *items, const int item_count, \
+		const time_t expires, const int pipeline_depth, \
+		MallocFunc malloc_func, int *success_count);
+
 /*
 set value of the key
 param:
@@ -0,0 +1,314 @@
+/**
+* Copyright (C) 2008 Happy Fish / YuQing
+*
+* FastDFS may be copied only under the terms of the GNU General
+* Public License V3, which may be found in the FastDFS source kit.
+* Please visit the FastDFS Home Page http://www.csource.org/ for more detail.
+**/
+
+//expire_wheel.c
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include "expire_wheel.h"
+#include "logger.h"
+#include "shared_func.h"
+#include "pthread_func.h"
+
+#define EXPIRE_WHEEL_SLOT_INIT_ITEMS  8
+#define EXPIRE_WHEEL_SLOT_KEEP_ITEMS  64  //free the larger empty slot
+
+#define EXPIRE_WHEEL_ENTRY_HOME(pSlot, expires, hash_code) \
+	(((hash_code) ^ ((unsigned int)(expires) * 2654435761U)) & \
+	 ((pSlot)->capacity - 1))
+
+int expire_wheel_init(ExpireWheel *wheel, const int slot_count, \
+		const time_t current_time)
+{
+	int bytes;
+	int result;
+
+	memset(wheel, 0, sizeof(ExpireWheel));
+	if (slot_count <= 0)
+	{
+		return EINVAL;
+	}
+
+	bytes = sizeof(ExpireWheelSlot) * slot_count;
+	wheel->slots = (ExpireWheelSlot *)malloc(bytes);
+	if (wheel->slots == NULL)
+	{
+		logError("file: "__FILE__", line: %d, " \
+			"malloc %d bytes fail, " \
+			"errno: %d, error info: %s", \
+			__LINE__, bytes, errno, STRERROR(errno));
+		return errno != 0 ? errno : ENOMEM;
+	}
+	memset(wheel->slots, 0, bytes);
+
+	if ((result=init_pthread_lock(&wheel->lock)) != 0)
+	{
+		free(wheel->slots);
+		wheel->slots = NULL;
+		return result;
+	}
+
+	wheel->slot_count = slot_count;
+	wheel->current_time = current_time;
+	return 0;
+}
+
+void expire_wheel_destroy(ExpireWheel *wheel)
+{
+	int i;
+
+	if (wheel->slots == NULL)
+	{
+		return;
+	}
+
+	for (i=0; i<wheel->slot_count; i++)
+	{
+		if (wheel->slots[i].entries != NULL)
+		{
+			free(wheel->slots[i].entries);
+		}
+	}
+
+	free(wheel->slots);
+	wheel->slots = NULL;
+	pthread_mutex_destroy(&wheel->lock);
+}
+
+/* the slot of the item, the passed items are popped with the current
+   slot. call with the lock */
+static ExpireWheelSlot *expire_wheel_slot(ExpireWheel *wheel, \
+		const int expires)
+{
+	time_t slot_time;
+
+	slot_time = expires > wheel->current_time ? expires : \
+			wheel->current_time;
+	return wheel->slots + slot_time % wheel->slot_count;
+}
+
+/* return the entry of the item, or the empty entry to insert it */
+static ExpireWheelEntry *expire_wheel_find(ExpireWheelSlot *pSlot, \
+		const int expires, const unsigned int hash_code)
+{
+	ExpireWheelEntry *pEntry;
+	unsigned int index;
+
+	index = EXPIRE_WHEEL_ENTRY_HOME(pSlot, expires, hash_code);
+	while (1)
+	{
+		pEntry = pSlot->entries + index;
+		if (pEntry->ref_count == 0 || (pEntry->hash_code == \
+			hash_code && pEntry->expires == expires))
+		{
+			return pEntry;
+		}
+		index = (index + 1) & (pSlot->capacity - 1);
+	}
+}
+
+/* the load factor is 0.75 at most */
+static int expire_wheel_slot_expand(ExpireWheelSlot *pSlot)
+{
+	ExpireWheelSlot newSlot;
+	ExpireWheelEntry *pEntry;
+	ExpireWheelEntry *pEnd;
+	int bytes;
+
+	newSlot.capacity = pSlot->capacity > 0 ? 2 * pSlot->capacity : \
+				EXPIRE_WHEEL_SLOT_INIT_ITEMS;
+	newSlot.count = pSlot->count;
+	bytes = sizeof(ExpireWheelEntry) * newSlot.capacity;
+	newSlot.entries = (ExpireWheelEntry *)calloc(1, bytes);
+	if (newSlot.entries == NULL)
+	{
+		logError("file: "__FILE__", line: %d, " \
+			"malloc %d bytes fail, " \
+			"errno: %d, error info: %s", __LINE__, \
+			bytes, errno, STRERROR(errno));
+		return errno != 0 ? errno : ENOMEM;
+	}
+
+	pEnd = pSlot->entries + pSlot->capacity;
+	for (pEntry=pSlot->entries; pEntry<pEnd; pEntry++)
+	{
+		if (pEntry->ref_count > 0)
+		{
+			*expire_wheel_find(&newSlot, pEntry->expires, \
+				pEntry->hash_code) = *pEntry;
+		}
+	}
+
+	if (pSlot->entries != NULL)
+	{
+		free(pSlot->entries);
+	}
+	*pSlot = newSlot;
+	return 0;
+}
+
+/* delete the entry by shifting the following entries of the probing
+   sequence back, so the table needs no tombstone */
+static void expire_wheel_slot_delete(ExpireWheelSlot *pSlot, \
+		ExpireWheelEntry *pEntry)
+{
+	ExpireWheelEntry *pNext;
+	unsigned int mask;
+	unsigned int hole;
+	unsigned int index;
+	unsigned int home;
+
+	mask = pSlot->capacity - 1;
+	hole = pEntry - pSlot->entries;
+	index = hole;
+	while (1)
+	{
+		index = (index + 1) & mask;
+		pNext = pSlot->entries + index;
+		if (pNext->ref_count == 0)
+		{
+			break;
+		}
+
+		/* the entry can move to the hole unless its home is
+		   between the hole and it */
+		home = EXPIRE_WHEEL_ENTRY_HOME(pSlot, pNext->expires, \
+				pNext->hash_code);
+		if (((index - home) & mask) >= ((index - hole) & mask))
+		{
+			pSlot->entries[hole] = *pNext;
+			hole = index;
+		}
+	}
+
+	pSlot->entries[hole].ref_count = 0;
+	pSlot->count--;
+}
+
+int expire_wheel_add(ExpireWheel *wheel, const int expires, \
+		const unsigned int hash_code)
+{
+	ExpireWheelSlot *pSlot;
+	ExpireWheelEntry *pEntry;
+	int result;
+
+	pthread_mutex_lock(&wheel->lock);
+
+	pSlot = expire_wheel_slot(wheel, expires);
+	if (4 * (pSlot->count + 1) > 3 * pSlot->capacity && \
+		(result=expire_wheel_slot_expand(pSlot)) != 0)
+	{
+		pthread_mutex_unlock(&wheel->lock);
+		return result;
+	}
+
+	/* the keys of the same hash code and expires share the item */
+	pEntry = expire_wheel_find(pSlot, expires, hash_code);
+	if (pEntry->ref_count == 0)
+	{
+		pEntry->expires = expires;
+		pEntry->hash_code = hash_code;
+		pSlot->count++;
+		wheel->item_count++;
+	}
+	pEntry->ref_count++;
+
+	pthread_mutex_unlock(&wheel->lock);
+	return 0;
+}
+
+int expire_wheel_remove(ExpireWheel *wheel, const int expires, \
+		const unsigned int hash_code)
+{
+	ExpireWheelSlot *pSlot;
+	ExpireWheelEntry *pEntry;
+
+	pthread_mutex_lock(&wheel->lock);
+
+	pSlot = expire_wheel_slot(wheel, expires);
+	if (pSlot->count == 0)
+	{
+		pthread_mutex_unlock(&wheel->lock);
+		return ENOENT;
+	}
+
+	pEntry = expire_wheel_find(pSlot, expires, hash_code);
+	if (pEntry->ref_count == 0)
+	{
+		pthread_mutex_unlock(&wheel->lock);
+		return ENOENT;
+	}
+
+	if (--pEntry->ref_count == 0)
+	{
+		expire_wheel_slot_delete(pSlot, pEntry);
+		wheel->item_count--;
+	}
+
+	pthread_mutex_unlock(&wheel->lock);
+	return 0;
+}
+
+int expire_wheel_pop(ExpireWheel *wheel, const time_t current_time, \
+		ExpireWheelItem *items, const int max_count)
+{
+	ExpireWheelSlot *pSlot;
+	ExpireWheelEntry *pEntry;
+	int count;
+	int i;
+
+	count = 0;
+	pthread_mutex_lock(&wheel->lock);
+	while (wheel->current_time <= current_time)
+	{
+		pSlot = wheel->slots + wheel->current_time % wheel->slot_count;
+
+		/* the items of the next rounds are kept. the entry shifted
+		   back by the delete is checked again, the entries shifted
+		   from the start of the table to its end were checked */
+		i = 0;
+		while (i < pSlot->capacity && pSlot->count > 0 && \
+			count < max_count)
+		{
+			pEntry = pSlot->entries + i;
+			if (pEntry->ref_count > 0 && \
+				pEntry->expires <= current_time)
+			{
+				items[count].expires = pEntry->expires;
+				items[count].hash_code = pEntry->hash_code;
+				count++;
+				expire_wheel_slot_delete(pSlot, pEntry);
+			}
+			else
+			{
+				i++;
+			}
+		}
+
+		if (pSlot->count == 0 && pSlot->capacity > \
+			EXPIRE_WHEEL_SLOT_KEEP_ITEMS)
+		{
+			free(pSlot->entries);
+			pSlot->entries = NULL;
+			pSlot->capacity = 0;
+		}
+
+		/* the current second is popped again for the new items */
+		if (count == max_count || wheel->current_time == current_time)
+		{
+			break;
+		}
+		wheel->current_time++;
+	}
+	wheel->item_count -= count;
+	pthread_mutex_unlock(&wheel->lock);
+
+	return count;
+}
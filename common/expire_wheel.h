@@ -0,0 +1,115 @@
+/**
+* Copyright (C) 2008 Happy Fish / YuQing
+*
+* FastDFS may be copied only under the terms of the GNU General
+* Public License V3, which may be found in the FastDFS source kit.
+* Please visit the FastDFS Home Page http://www.csource.org/ for more detail.
+**/
+
+//expire_wheel.h
+
+/* a coarse expiry index: a time wheel of (expires, hash code) items, one
+   slot per second. the hash code locates the bucket to clear. the items
+   of a slot are an open addressing table, so the item of a key is
+   removed when the key is deleted or its expires is changed. the keys
+   removed by others (such as evicted) leave their items, so the bucket
+   of a popped item may have nothing to clear */
+
+#ifndef _EXPIRE_WHEEL_H
+#define _EXPIRE_WHEEL_H
+
+#include <time.h>
+#include <stdint.h>
+#include <pthread.h>
+#include "common_define.h"
+
+typedef struct expire_wheel_item
+{
+	int expires;
+	unsigned int hash_code;
+} ExpireWheelItem;
+
+typedef struct expire_wheel_entry
+{
+	int expires;
+	unsigned int hash_code;
+	int ref_count;  //the keys of the item, 0 for the empty entry
+} ExpireWheelEntry;
+
+typedef struct expire_wheel_slot
+{
+	ExpireWheelEntry *entries;  //linear probing
+	int count;
+	int capacity;  //power of 2
+} ExpireWheelSlot;
+
+typedef struct expire_wheel
+{
+	ExpireWheelSlot *slots;
+	int slot_count;
+	time_t current_time;  //the slots before it are popped
+	int64_t item_count;
+	pthread_mutex_t lock;
+} ExpireWheel;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * expire wheel init function
+ * parameters:
+ *         wheel: the expire wheel
+ *         slot_count: the slot count, the items expire after
+ *                     slot_count seconds are kept for the next rounds
+ *         current_time: the current time
+ * return 0 for success, != 0 for error
+*/
+int expire_wheel_init(ExpireWheel *wheel, const int slot_count, \
+		const time_t current_time);
+
+/**
+ * expire wheel destroy function
+*/
+void expire_wheel_destroy(ExpireWheel *wheel);
+
+/**
+ * add an item
+ * parameters:
+ *         wheel: the expire wheel
+ *         expires: the expire time of the key
+ *         hash_code: the hash code of the key
+ * return 0 for success, != 0 for error
+*/
+int expire_wheel_add(ExpireWheel *wheel, const int expires, \
+		const unsigned int hash_code);
+
+/**
+ * remove an item added, the item is removed when the keys of it removed
+ * parameters:
+ *         wheel: the expire wheel
+ *         expires: the expire time of the key
+ *         hash_code: the hash code of the key
+ * return 0 for success, ENOENT for not exist (such as popped)
+*/
+int expire_wheel_remove(ExpireWheel *wheel, const int expires, \
+		const unsigned int hash_code);
+
+/**
+ * pop the items expired at the current time
+ * parameters:
+ *         wheel: the expire wheel
+ *         current_time: the current time
+ *         items: return the popped items
+ *         max_count: the element count of items
+ * return the popped item count, less than max_count when no more
+*/
+int expire_wheel_pop(ExpireWheel *wheel, const time_t current_time, \
+		ExpireWheelItem *items, const int max_count);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
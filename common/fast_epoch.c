@@ -0,0 +1,381 @@
+/**
+* Copyright (C) 2008 Happy Fish / YuQing
+*
+* FastDFS may be copied only under the terms of the GNU General
+* Public License V3, which may be found in the FastDFS source kit.
+* Please visit the FastDFS Home Page http://www.csource.org/ for more detail.
+**/
+
+//fast_epoch.c
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sched.h>
+#include "fast_epoch.h"
+#include "logger.h"
+#include "shared_func.h"
+#include "pthread_func.h"
+
+#define FAST_EPOCH_LIST_INIT_ITEMS  64
+
+static void fast_epoch_thread_destroy(void *arg);
+
+int fast_epoch_init(FastEpochDomain *domain, FastEpochFreeFunc free_func, \
+		void *free_args)
+{
+	int result;
+
+	memset(domain, 0, sizeof(FastEpochDomain));
+	domain->global_epoch = 1;  //0 for the threads outside
+	domain->free_func = free_func;
+	domain->free_args = free_args;
+
+	if ((result=init_pthread_lock(&domain->lock)) != 0)
+	{
+		return result;
+	}
+
+	if ((result=pthread_key_create(&domain->thread_key, \
+			fast_epoch_thread_destroy)) != 0)
+	{
+		logError("file: "__FILE__", line: %d, " \
+			"pthread_key_create fail, " \
+			"errno: %d, error info: %s", \
+			__LINE__, result, STRERROR(result));
+		pthread_mutex_destroy(&domain->lock);
+		return result;
+	}
+
+	return 0;
+}
+
+static void fast_epoch_free_list(FastEpochDomain *domain, \
+		FastEpochRetiredList *pList)
+{
+	int i;
+
+	for (i=0; i<pList->count; i++)
+	{
+		domain->free_func(pList->items[i].ptr, domain->free_args);
+	}
+
+	if (pList->items != NULL)
+	{
+		free(pList->items);
+		pList->items = NULL;
+	}
+	pList->count = 0;
+	pList->alloc_count = 0;
+}
+
+void fast_epoch_destroy(FastEpochDomain *domain)
+{
+	FastEpochThread *pThread;
+
+	if (domain->free_func == NULL)
+	{
+		return;
+	}
+
+	pthread_key_delete(domain->thread_key);
+	while (domain->threads != NULL)
+	{
+		pThread = domain->threads;
+		domain->threads = pThread->next;
+		fast_epoch_free_list(domain, &pThread->retired);
+		free(pThread);
+	}
+	fast_epoch_free_list(domain, &domain->orphans);
+
+	pthread_mutex_destroy(&domain->lock);
+	domain->retired_count = 0;
+	domain->free_func = NULL;
+}
+
+static FastEpochThread *fast_epoch_get_thread(FastEpochDomain *domain)
+{
+	FastEpochThread *pThread;
+
+	pThread = (FastEpochThread *)pthread_getspecific(domain->thread_key);
+	if (pThread != NULL)
+	{
+		return pThread;
+	}
+
+	pThread = (FastEpochThread *)calloc(1, sizeof(FastEpochThread));
+	if (pThread == NULL)
+	{
+		logError("file: "__FILE__", line: %d, " \
+			"malloc %d bytes fail, " \
+			"errno: %d, error info: %s", \
+			__LINE__, (int)sizeof(FastEpochThread), \
+			errno, STRERROR(errno));
+		return NULL;
+	}
+	pThread->domain = domain;
+
+	pthread_mutex_lock(&domain->lock);
+	pThread->next = domain->threads;
+	if (domain->threads != NULL)
+	{
+		domain->threads->prev = pThread;
+	}
+	domain->threads = pThread;
+	pthread_mutex_unlock(&domain->lock);
+
+	pthread_setspecific(domain->thread_key, pThread);
+	return pThread;
+}
+
+FastEpochThread *fast_epoch_enter(FastEpochDomain *domain)
+{
+	FastEpochThread *pThread;
+
+	if ((pThread=fast_epoch_get_thread(domain)) == NULL)
+	{
+		return NULL;
+	}
+
+	if (pThread->depth++ == 0)
+	{
+		/* the epoch is announced before any shared node is read */
+		pThread->local_epoch = domain->global_epoch;
+		__sync_synchronize();
+	}
+
+	return pThread;
+}
+
+void fast_epoch_leave(FastEpochThread *pThread)
+{
+	if (--pThread->depth == 0)
+	{
+		__sync_lock_release(&pThread->local_epoch);
+	}
+}
+
+static int fast_epoch_list_add(FastEpochRetiredList *pList, \
+		FastEpochRetired *items, const int count)
+{
+	FastEpochRetired *new_items;
+	int alloc_count;
+
+	if (pList->count + count > pList->alloc_count)
+	{
+		alloc_count = pList->alloc_count > 0 ? pList->alloc_count : \
+				FAST_EPOCH_LIST_INIT_ITEMS;
+		while (alloc_count < pList->count + count)
+		{
+			alloc_count *= 2;
+		}
+
+		new_items = (FastEpochRetired *)realloc(pList->items, \
+				sizeof(FastEpochRetired) * alloc_count);
+		if (new_items == NULL)
+		{
+			logError("file: "__FILE__", line: %d, " \
+				"realloc %d bytes fail, " \
+				"errno: %d, error info: %s", __LINE__, \
+				(int)sizeof(FastEpochRetired) * alloc_count, \
+				errno, STRERROR(errno));
+			return errno != 0 ? errno : ENOMEM;
+		}
+
+		pList->items = new_items;
+		pList->alloc_count = alloc_count;
+	}
+
+	memcpy(pList->items + pList->count, items, \
+		sizeof(FastEpochRetired) * count);
+	pList->count += count;
+	return 0;
+}
+
+/* free the nodes retired two epochs ago at least, no reader can reach
+   them. return the freed count */
+static int fast_epoch_free_retired(FastEpochDomain *domain, \
+		FastEpochRetiredList *pList)
+{
+	int64_t safe_epoch;
+	int count;
+	int i;
+
+	safe_epoch = domain->global_epoch - 2;
+	count = 0;
+	while (count < pList->count && pList->items[count].epoch <= safe_epoch)
+	{
+		count++;
+	}
+	if (count == 0)
+	{
+		return 0;
+	}
+
+	for (i=0; i<count; i++)
+	{
+		domain->free_func(pList->items[i].ptr, domain->free_args);
+	}
+
+	pList->count -= count;
+	if (pList->count > 0)
+	{
+		memmove(pList->items, pList->items + count, \
+			sizeof(FastEpochRetired) * pList->count);
+	}
+	__sync_sub_and_fetch(&domain->retired_count, count);
+
+	return count;
+}
+
+/* the global epoch is advanced when all the readers inside entered it.
+   return true for advanced */
+static bool fast_epoch_try_advance(FastEpochDomain *domain, \
+		const bool wait_lock)
+{
+	FastEpochThread *pThread;
+	int64_t epoch;
+	int64_t local_epoch;
+
+	if (wait_lock)
+	{
+		pthread_mutex_lock(&domain->lock);
+	}
+	else if (pthread_mutex_trylock(&domain->lock) != 0)
+	{
+		return false;
+	}
+
+	__sync_synchronize();
+	epoch = domain->global_epoch;
+	for (pThread=domain->threads; pThread!=NULL; pThread=pThread->next)
+	{
+		local_epoch = pThread->local_epoch;
+		if (local_epoch != 0 && local_epoch != epoch)
+		{
+			pthread_mutex_unlock(&domain->lock);
+			return false;
+		}
+	}
+
+	__sync_add_and_fetch(&domain->global_epoch, 1);
+	if (domain->orphans.count > 0)
+	{
+		fast_epoch_free_retired(domain, &domain->orphans);
+	}
+
+	pthread_mutex_unlock(&domain->lock);
+	return true;
+}
+
+void fast_epoch_retire(FastEpochDomain *domain, void *ptr)
+{
+	FastEpochThread *pThread;
+	FastEpochRetired retired;
+
+	pThread = fast_epoch_get_thread(domain);
+
+	/* the unlink is visible before the epoch read */
+	__sync_synchronize();
+	retired.ptr = ptr;
+	retired.epoch = domain->global_epoch;
+	__sync_add_and_fetch(&domain->retired_count, 1);
+
+	if (pThread == NULL || fast_epoch_list_add(&pThread->retired, \
+			&retired, 1) != 0)
+	{
+		pthread_mutex_lock(&domain->lock);
+		if (fast_epoch_list_add(&domain->orphans, &retired, 1) != 0)
+		{
+			logError("file: "__FILE__", line: %d, " \
+				"the retired node %p is leaked", \
+				__LINE__, ptr);
+		}
+		pthread_mutex_unlock(&domain->lock);
+		return;
+	}
+
+	if (pThread->retired.count % FAST_EPOCH_RECLAIM_COUNT == 0)
+	{
+		fast_epoch_try_advance(domain, false);
+		fast_epoch_free_retired(domain, &pThread->retired);
+	}
+}
+
+int fast_epoch_reclaim(FastEpochDomain *domain, const bool wait)
+{
+	FastEpochThread *pThread;
+	int64_t last_epoch;
+	int yields;
+
+	pThread = (FastEpochThread *)pthread_getspecific(domain->thread_key);
+	if (pThread == NULL || pThread->retired.count == 0)
+	{
+		return 0;
+	}
+
+	/* the epoch can not be advanced when the caller is inside */
+	if (wait && pThread->depth == 0)
+	{
+		last_epoch = pThread->retired.items[ \
+				pThread->retired.count - 1].epoch;
+		yields = 0;
+		while (domain->global_epoch < last_epoch + 2 && \
+			yields < FAST_EPOCH_WAIT_MAX_YIELDS)
+		{
+			if (!fast_epoch_try_advance(domain, true))
+			{
+				sched_yield();
+				yields++;
+			}
+		}
+	}
+	else
+	{
+		fast_epoch_try_advance(domain, false);
+	}
+
+	return fast_epoch_free_retired(domain, &pThread->retired);
+}
+
+/* the nodes retired by the exited thread are freed by the other threads */
+static void fast_epoch_thread_destroy(void *arg)
+{
+	FastEpochThread *pThread;
+	FastEpochDomain *domain;
+
+	pThread = (FastEpochThread *)arg;
+	domain = pThread->domain;
+
+	pthread_mutex_lock(&domain->lock);
+	if (pThread->retired.count > 0 && fast_epoch_list_add( \
+		&domain->orphans, pThread->retired.items, \
+		pThread->retired.count) != 0)
+	{
+		logError("file: "__FILE__", line: %d, " \
+			"%d retired nodes are leaked", \
+			__LINE__, pThread->retired.count);
+	}
+
+	if (pThread->prev != NULL)
+	{
+		pThread->prev->next = pThread->next;
+	}
+	else
+	{
+		domain->threads = pThread->next;
+	}
+	if (pThread->next != NULL)
+	{
+		pThread->next->prev = pThread->prev;
+	}
+	pthread_mutex_unlock(&domain->lock);
+
+	if (pThread->retired.items != NULL)
+	{
+		free(pThread->retired.items);
+	}
+	free(pThread);
+}
+
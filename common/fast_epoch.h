@@ -0,0 +1,126 @@
+/**
+* Copyright (C) 2008 Happy Fish / YuQing
+*
+* FastDFS may be copied only under the terms of the GNU General
+* Public License V3, which may be found in the FastDFS source kit.
+* Please visit the FastDFS Home Page http://www.csource.org/ for more detail.
+**/
+
+//fast_epoch.h
+
+/* epoch based reclamation for the readers without lock: a reader enters
+   the epoch before reading the shared nodes and leaves after, the nodes
+   unlinked by the writers are retired and freed after two epochs, when
+   no reader can reach them any more. the threads are registered on the
+   first use, each thread keeps the nodes retired by itself */
+
+#ifndef _FAST_EPOCH_H
+#define _FAST_EPOCH_H
+
+#include <stdint.h>
+#include <pthread.h>
+#include "common_define.h"
+
+#define FAST_EPOCH_RECLAIM_COUNT   64   //reclaim when retired per thread
+#define FAST_EPOCH_WAIT_MAX_YIELDS 1000 //by fast_epoch_reclaim with wait
+
+typedef void (*FastEpochFreeFunc)(void *ptr, void *args);
+
+typedef struct fast_epoch_retired
+{
+	void *ptr;
+	int64_t epoch;  //the global epoch when retired
+} FastEpochRetired;
+
+typedef struct fast_epoch_retired_list
+{
+	FastEpochRetired *items;  //asc order by epoch
+	int count;
+	int alloc_count;
+} FastEpochRetiredList;
+
+typedef struct fast_epoch_thread
+{
+	volatile int64_t local_epoch;  //the epoch entered, 0 for outside
+	int depth;  //the nested enters
+	FastEpochRetiredList retired;
+	struct fast_epoch_domain *domain;
+	struct fast_epoch_thread *prev;
+	struct fast_epoch_thread *next;
+} FastEpochThread;
+
+typedef struct fast_epoch_domain
+{
+	volatile int64_t global_epoch;
+	volatile int64_t retired_count;  //retired and not freed yet
+	FastEpochFreeFunc free_func;
+	void *free_args;
+	FastEpochThread *threads;
+	FastEpochRetiredList orphans;  //left by the exited threads
+	pthread_key_t thread_key;
+	pthread_mutex_t lock;  //for the threads, the orphans and the advance
+} FastEpochDomain;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * epoch domain init function
+ * parameters:
+ *         domain: the epoch domain
+ *         free_func: the function to free the retired nodes
+ *         free_args: the args of free_func
+ * return 0 for success, != 0 for error
+*/
+int fast_epoch_init(FastEpochDomain *domain, FastEpochFreeFunc free_func, \
+		void *free_args);
+
+/**
+ * free all the retired nodes, the readers must be stopped
+*/
+void fast_epoch_destroy(FastEpochDomain *domain);
+
+/**
+ * enter the epoch before reading, can be nested
+ * parameters:
+ *         domain: the epoch domain
+ * return the epoch thread of the caller, NULL for fail (out of memory),
+ *        then the reader should take the lock
+*/
+FastEpochThread *fast_epoch_enter(FastEpochDomain *domain);
+
+/**
+ * leave the epoch after reading, the nodes read must not be used after
+ * parameters:
+ *         pThread: the epoch thread returned by fast_epoch_enter
+ * return none
+*/
+void fast_epoch_leave(FastEpochThread *pThread);
+
+/**
+ * retire a node unlinked from the shared structure, it is freed by
+ * free_func when the readers can not reach it
+ * parameters:
+ *         domain: the epoch domain
+ *         ptr: the node to free
+ * return none
+*/
+void fast_epoch_retire(FastEpochDomain *domain, void *ptr);
+
+/**
+ * free the nodes retired by the caller thread can be freed
+ * parameters:
+ *         domain: the epoch domain
+ *         wait: wait the readers leave the epochs of the retired nodes,
+ *               FAST_EPOCH_WAIT_MAX_YIELDS times sched_yield at most
+ * return the freed count
+*/
+int fast_epoch_reclaim(FastEpochDomain *domain, const bool wait);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
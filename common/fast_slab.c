@@ -0,0 +1,631 @@
+/**
+* Copyright (C) 2008 Happy Fish / YuQing
+*
+* FastDFS may be copied only under the terms of the GNU General
+* Public License V3, which may be found in the FastDFS source kit.
+* Please visit the FastDFS Home Page http://www.csource.org/ for more detail.
+**/
+
+//fast_slab.c
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include "fast_slab.h"
+#include "logger.h"
+#include "shared_func.h"
+#include "pthread_func.h"
+
+#define ALIGNED_PAGE_HEAD_SIZE  MEM_ALIGN(sizeof(FastSlabPage))
+
+#define CHUNK_NEXT(chunk)  (*((char **)(chunk)))
+
+#define SLAB_CLASS_INDEX(slab, bytes) \
+	(slab)->class_indexes[((bytes) > 0 ? (bytes) - 1 : 0) / 8]
+
+static void fast_slab_cache_destroy(void *arg);
+
+/* the class indexes, the lock and the thread cache key, which are local
+   to the process */
+static int fast_slab_init_process(FastSlabAllocator *slab)
+{
+	int index_count;
+	int class_index;
+	int result;
+	int i;
+
+	index_count = slab->max_chunk_size / 8;
+	slab->class_indexes = (unsigned char *)malloc(index_count);
+	if (slab->class_indexes == NULL)
+	{
+		logError("file: "__FILE__", line: %d, " \
+			"malloc %d bytes fail, " \
+			"errno: %d, error info: %s", \
+			__LINE__, index_count, errno, STRERROR(errno));
+		return errno != 0 ? errno : ENOMEM;
+	}
+
+	class_index = 0;
+	for (i=0; i<index_count; i++)
+	{
+		while (slab->classes[class_index].chunk_size < (i + 1) * 8)
+		{
+			class_index++;
+		}
+		slab->class_indexes[i] = class_index;
+	}
+
+	if ((result=init_pthread_lock(&slab->lock)) != 0)
+	{
+		return result;
+	}
+
+	if ((result=pthread_key_create(&slab->cache_key, \
+			fast_slab_cache_destroy)) != 0)
+	{
+		logError("file: "__FILE__", line: %d, " \
+			"pthread_key_create fail, " \
+			"errno: %d, error info: %s", \
+			__LINE__, result, STRERROR(result));
+		return result;
+	}
+
+	return 0;
+}
+
+static void *fast_slab_malloc(FastSlabAllocator *slab, const int bytes)
+{
+	if (slab->alloc_func != NULL)
+	{
+		return slab->alloc_func(slab->alloc_args, bytes);
+	}
+
+	return malloc(bytes);
+}
+
+static void fast_slab_mfree(FastSlabAllocator *slab, void *ptr, \
+		const int bytes)
+{
+	if (slab->free_func != NULL)
+	{
+		slab->free_func(slab->alloc_args, ptr, bytes);
+	}
+	else
+	{
+		free(ptr);
+	}
+}
+
+int fast_slab_init(FastSlabAllocator *slab, const int min_chunk_size, \
+		const int max_chunk_size, const double grow_factor, \
+		const int page_size, const int64_t max_bytes)
+{
+	FastSlabClass *pClass;
+	int chunk_size;
+	int next_size;
+	int result;
+
+	memset(slab, 0, sizeof(FastSlabAllocator));
+	if (min_chunk_size <= 0 || grow_factor <= 1.00 || \
+		MEM_ALIGN(max_chunk_size) < MEM_ALIGN(min_chunk_size) || \
+		MEM_ALIGN(max_chunk_size) > page_size - ALIGNED_PAGE_HEAD_SIZE)
+	{
+		logError("file: "__FILE__", line: %d, " \
+			"invalid parameters, min_chunk_size: %d, " \
+			"max_chunk_size: %d, grow_factor: %.2f, " \
+			"page_size: %d", __LINE__, min_chunk_size, \
+			max_chunk_size, grow_factor, page_size);
+		return EINVAL;
+	}
+
+	slab->page_size = page_size;
+	slab->max_chunk_size = MEM_ALIGN(max_chunk_size);
+	slab->max_bytes = max_bytes;
+
+	chunk_size = MEM_ALIGN(min_chunk_size);
+	while (1)
+	{
+		if (slab->class_count == FAST_SLAB_MAX_CLASSES)
+		{
+			logError("file: "__FILE__", line: %d, " \
+				"too many size classes, exceeds %d, " \
+				"grow_factor: %.2f is too small", __LINE__, \
+				FAST_SLAB_MAX_CLASSES, grow_factor);
+			return EINVAL;
+		}
+
+		pClass = slab->classes + slab->class_count++;
+		pClass->chunk_size = chunk_size;
+		pClass->chunks_per_page = (page_size - ALIGNED_PAGE_HEAD_SIZE) / \
+					chunk_size;
+		pClass->cache_max = FAST_SLAB_CACHE_MAX_BYTES / chunk_size;
+		if (pClass->cache_max > FAST_SLAB_CACHE_MAX_COUNT)
+		{
+			pClass->cache_max = FAST_SLAB_CACHE_MAX_COUNT;
+		}
+		if ((result=init_pthread_lock(&pClass->lock)) != 0)
+		{
+			return result;
+		}
+
+		if (chunk_size == slab->max_chunk_size)
+		{
+			break;
+		}
+
+		next_size = MEM_ALIGN((int)(chunk_size * grow_factor));
+		if (next_size == chunk_size)
+		{
+			next_size += 8;
+		}
+		chunk_size = next_size < slab->max_chunk_size ? next_size : \
+				slab->max_chunk_size;
+	}
+
+	return fast_slab_init_process(slab);
+}
+
+void fast_slab_destroy(FastSlabAllocator *slab)
+{
+	FastSlabPage *page;
+	FastSlabThreadCache *cache;
+	int i;
+
+	if (slab->class_indexes == NULL)
+	{
+		return;
+	}
+
+	pthread_key_delete(slab->cache_key);
+	while (slab->caches != NULL)
+	{
+		cache = slab->caches;
+		slab->caches = cache->next;
+		free(cache->lists);
+		free(cache);
+	}
+
+	while (slab->pages != NULL)
+	{
+		page = slab->pages;
+		slab->pages = page->next;
+		fast_slab_mfree(slab, page, slab->page_size);
+	}
+
+	for (i=0; i<slab->class_count; i++)
+	{
+		pthread_mutex_destroy(&slab->classes[i].lock);
+	}
+	pthread_mutex_destroy(&slab->lock);
+
+	free(slab->class_indexes);
+	slab->class_indexes = NULL;
+}
+
+void fast_slab_set_allocator(FastSlabAllocator *slab, \
+		FastSlabAllocFunc alloc_func, FastSlabFreeFunc free_func, \
+		void *args)
+{
+	slab->alloc_func = alloc_func;
+	slab->free_func = free_func;
+	slab->alloc_args = args;
+}
+
+/* return the chunks cached by the thread to the classes */
+static void fast_slab_cache_flush(FastSlabAllocator *slab, \
+		FastSlabThreadCache *cache)
+{
+	FastSlabCacheList *pList;
+	FastSlabClass *pClass;
+	char *chunk;
+	int i;
+
+	for (i=0; i<slab->class_count; i++)
+	{
+		pList = cache->lists + i;
+		if (pList->count == 0)
+		{
+			continue;
+		}
+
+		pClass = slab->classes + i;
+		pthread_mutex_lock(&pClass->lock);
+		while (pList->head != NULL)
+		{
+			chunk = pList->head;
+			pList->head = CHUNK_NEXT(chunk);
+			CHUNK_NEXT(chunk) = pClass->free_list;
+			pClass->free_list = chunk;
+			pClass->free_count++;
+		}
+		pList->count = 0;
+		pthread_mutex_unlock(&pClass->lock);
+	}
+}
+
+void fast_slab_detach(FastSlabAllocator *slab)
+{
+	FastSlabThreadCache *cache;
+	int i;
+
+	if (slab->class_indexes == NULL)
+	{
+		return;
+	}
+
+	pthread_key_delete(slab->cache_key);
+	while (slab->caches != NULL)
+	{
+		cache = slab->caches;
+		slab->caches = cache->next;
+		fast_slab_cache_flush(slab, cache);
+		free(cache->lists);
+		free(cache);
+	}
+
+	for (i=0; i<slab->class_count; i++)
+	{
+		pthread_mutex_destroy(&slab->classes[i].lock);
+	}
+	pthread_mutex_destroy(&slab->lock);
+
+	free(slab->class_indexes);
+	slab->class_indexes = NULL;
+	fast_slab_set_allocator(slab, NULL, NULL, NULL);
+}
+
+int fast_slab_attach(FastSlabAllocator *slab)
+{
+	int result;
+	int i;
+
+	slab->caches = NULL;
+	fast_slab_set_allocator(slab, NULL, NULL, NULL);
+	for (i=0; i<slab->class_count; i++)
+	{
+		if ((result=init_pthread_lock(&slab->classes[i].lock)) != 0)
+		{
+			return result;
+		}
+	}
+
+	return fast_slab_init_process(slab);
+}
+
+int fast_slab_alloc_size(FastSlabAllocator *slab, const int bytes)
+{
+	if (bytes > slab->max_chunk_size)
+	{
+		return bytes;
+	}
+
+	return slab->classes[SLAB_CLASS_INDEX(slab, bytes)].chunk_size;
+}
+
+static FastSlabThreadCache *fast_slab_get_cache(FastSlabAllocator *slab)
+{
+	FastSlabThreadCache *cache;
+
+	cache = (FastSlabThreadCache *)pthread_getspecific(slab->cache_key);
+	if (cache != NULL)
+	{
+		return cache;
+	}
+
+	cache = (FastSlabThreadCache *)malloc(sizeof(FastSlabThreadCache));
+	if (cache == NULL)
+	{
+		return NULL;
+	}
+	cache->lists = (FastSlabCacheList *)calloc(slab->class_count, \
+				sizeof(FastSlabCacheList));
+	if (cache->lists == NULL)
+	{
+		free(cache);
+		return NULL;
+	}
+	cache->slab = slab;
+	cache->prev = NULL;
+
+	pthread_mutex_lock(&slab->lock);
+	cache->next = slab->caches;
+	if (slab->caches != NULL)
+	{
+		slab->caches->prev = cache;
+	}
+	slab->caches = cache;
+	pthread_mutex_unlock(&slab->lock);
+
+	pthread_setspecific(slab->cache_key, cache);
+	return cache;
+}
+
+/* return the chunks of the thread to the classes when the thread exits */
+static void fast_slab_cache_destroy(void *arg)
+{
+	FastSlabThreadCache *cache;
+	FastSlabAllocator *slab;
+
+	cache = (FastSlabThreadCache *)arg;
+	slab = cache->slab;
+	fast_slab_cache_flush(slab, cache);
+
+	pthread_mutex_lock(&slab->lock);
+	if (cache->prev != NULL)
+	{
+		cache->prev->next = cache->next;
+	}
+	else
+	{
+		slab->caches = cache->next;
+	}
+	if (cache->next != NULL)
+	{
+		cache->next->prev = cache->prev;
+	}
+	pthread_mutex_unlock(&slab->lock);
+
+	free(cache->lists);
+	free(cache);
+}
+
+static bool fast_slab_reserve(FastSlabAllocator *slab, const int bytes)
+{
+	if (slab->max_bytes > 0 && __sync_add_and_fetch(&slab->total_bytes, \
+		bytes) > slab->max_bytes)
+	{
+		__sync_sub_and_fetch(&slab->total_bytes, bytes);
+		return false;
+	}
+	else if (slab->max_bytes <= 0)
+	{
+		__sync_add_and_fetch(&slab->total_bytes, bytes);
+	}
+
+	return true;
+}
+
+/* carve a new page for the class, the class lock must be held */
+static int fast_slab_alloc_page(FastSlabAllocator *slab, \
+		FastSlabClass *pClass)
+{
+	FastSlabPage *page;
+
+	if (!fast_slab_reserve(slab, slab->page_size))
+	{
+		return ENOSPC;
+	}
+
+	page = (FastSlabPage *)fast_slab_malloc(slab, slab->page_size);
+	if (page == NULL)
+	{
+		__sync_sub_and_fetch(&slab->total_bytes, slab->page_size);
+		if (slab->alloc_func != NULL)
+		{
+			return ENOSPC;
+		}
+		logError("file: "__FILE__", line: %d, " \
+			"malloc %d bytes fail, " \
+			"errno: %d, error info: %s", \
+			__LINE__, slab->page_size, errno, STRERROR(errno));
+		return ENOMEM;
+	}
+
+	pthread_mutex_lock(&slab->lock);
+	page->next = slab->pages;
+	slab->pages = page;
+	pthread_mutex_unlock(&slab->lock);
+
+	pClass->page_count++;
+	pClass->page_ptr = (char *)page + ALIGNED_PAGE_HEAD_SIZE;
+	pClass->page_end = pClass->page_ptr + pClass->chunk_size * \
+				pClass->chunks_per_page;
+	return 0;
+}
+
+static char *fast_slab_class_pop(FastSlabAllocator *slab, \
+		FastSlabClass *pClass, int *result)
+{
+	char *chunk;
+
+	if (pClass->free_list != NULL)
+	{
+		chunk = pClass->free_list;
+		pClass->free_list = CHUNK_NEXT(chunk);
+		pClass->free_count--;
+		return chunk;
+	}
+
+	if (pClass->page_ptr == pClass->page_end)
+	{
+		if ((*result=fast_slab_alloc_page(slab, pClass)) != 0)
+		{
+			return NULL;
+		}
+	}
+
+	chunk = pClass->page_ptr;
+	pClass->page_ptr += pClass->chunk_size;
+	return chunk;
+}
+
+void *fast_slab_alloc(FastSlabAllocator *slab, const int bytes)
+{
+	FastSlabThreadCache *cache;
+	FastSlabCacheList *pList;
+	FastSlabClass *pClass;
+	char *chunk;
+	char *pCached;
+	int class_index;
+	int result;
+	int i;
+
+	if (bytes > slab->max_chunk_size)
+	{
+		if (!fast_slab_reserve(slab, bytes))
+		{
+			errno = ENOSPC;
+			return NULL;
+		}
+
+		chunk = (char *)fast_slab_malloc(slab, bytes);
+		if (chunk == NULL)
+		{
+			/* the memory of the allocator is used up */
+			__sync_sub_and_fetch(&slab->total_bytes, bytes);
+			errno = slab->alloc_func != NULL ? ENOSPC : ENOMEM;
+			return NULL;
+		}
+
+		__sync_add_and_fetch(&slab->large_bytes, bytes);
+		__sync_add_and_fetch(&slab->large_count, 1);
+		return chunk;
+	}
+
+	class_index = SLAB_CLASS_INDEX(slab, bytes);
+	pClass = slab->classes + class_index;
+	cache = pClass->cache_max > 0 ? fast_slab_get_cache(slab) : NULL;
+	if (cache != NULL)
+	{
+		pList = cache->lists + class_index;
+		if (pList->head != NULL)
+		{
+			chunk = pList->head;
+			pList->head = CHUNK_NEXT(chunk);
+			pList->count--;
+			return chunk;
+		}
+	}
+	else
+	{
+		pList = NULL;
+	}
+
+	result = 0;
+	pthread_mutex_lock(&pClass->lock);
+	chunk = fast_slab_class_pop(slab, pClass, &result);
+	if (chunk != NULL && pList != NULL)
+	{
+		/* refill half of the cache with one lock */
+		for (i=1; i<(pClass->cache_max + 1) / 2; i++)
+		{
+			if (pClass->free_list == NULL && \
+				pClass->page_ptr == pClass->page_end)
+			{
+				break;
+			}
+
+			pCached = fast_slab_class_pop(slab, pClass, &result);
+			CHUNK_NEXT(pCached) = pList->head;
+			pList->head = pCached;
+			pList->count++;
+		}
+	}
+	pthread_mutex_unlock(&pClass->lock);
+
+	if (chunk == NULL)
+	{
+		errno = result;
+	}
+	return chunk;
+}
+
+void fast_slab_free(FastSlabAllocator *slab, void *ptr, const int bytes)
+{
+	FastSlabThreadCache *cache;
+	FastSlabCacheList *pList;
+	FastSlabClass *pClass;
+	char *chunk;
+	int class_index;
+
+	if (bytes > slab->max_chunk_size)
+	{
+		fast_slab_mfree(slab, ptr, bytes);
+		__sync_sub_and_fetch(&slab->total_bytes, bytes);
+		__sync_sub_and_fetch(&slab->large_bytes, bytes);
+		__sync_sub_and_fetch(&slab->large_count, 1);
+		return;
+	}
+
+	class_index = SLAB_CLASS_INDEX(slab, bytes);
+	pClass = slab->classes + class_index;
+	cache = pClass->cache_max > 0 ? fast_slab_get_cache(slab) : NULL;
+	if (cache != NULL)
+	{
+		pList = cache->lists + class_index;
+		CHUNK_NEXT(ptr) = pList->head;
+		pList->head = (char *)ptr;
+		pList->count++;
+		if (pList->count <= pClass->cache_max)
+		{
+			return;
+		}
+
+		/* overflow, return the older half to the class */
+		pthread_mutex_lock(&pClass->lock);
+		while (pList->count > pClass->cache_max / 2)
+		{
+			chunk = pList->head;
+			pList->head = CHUNK_NEXT(chunk);
+			pList->count--;
+
+			CHUNK_NEXT(chunk) = pClass->free_list;
+			pClass->free_list = chunk;
+			pClass->free_count++;
+		}
+		pthread_mutex_unlock(&pClass->lock);
+		return;
+	}
+
+	pthread_mutex_lock(&pClass->lock);
+	CHUNK_NEXT(ptr) = pClass->free_list;
+	pClass->free_list = (char *)ptr;
+	pClass->free_count++;
+	pthread_mutex_unlock(&pClass->lock);
+}
+
+int fast_slab_stat(FastSlabAllocator *slab, FastSlabClassStat *stats, \
+		const int max_count)
+{
+	FastSlabClassStat *pStat;
+	FastSlabClass *pClass;
+	FastSlabThreadCache *cache;
+	int64_t free_count;
+	int count;
+	int i;
+
+	count = 0;
+	for (i=0; i<slab->class_count && count<max_count; i++)
+	{
+		pClass = slab->classes + i;
+		pthread_mutex_lock(&pClass->lock);
+		if (pClass->page_count == 0)
+		{
+			pthread_mutex_unlock(&pClass->lock);
+			continue;
+		}
+
+		pStat = stats + count++;
+		pStat->chunk_size = pClass->chunk_size;
+		pStat->page_count = pClass->page_count;
+		pStat->total_chunks = (int64_t)pClass->page_count * \
+					pClass->chunks_per_page;
+		free_count = pClass->free_count + (pClass->page_end - \
+				pClass->page_ptr) / pClass->chunk_size;
+		pthread_mutex_unlock(&pClass->lock);
+
+		/* the counts of the other threads are read without lock */
+		pthread_mutex_lock(&slab->lock);
+		for (cache=slab->caches; cache!=NULL; cache=cache->next)
+		{
+			free_count += cache->lists[i].count;
+		}
+		pthread_mutex_unlock(&slab->lock);
+
+		pStat->used_chunks = pStat->total_chunks - free_count;
+	}
+
+	return count;
+}
+
@@ -0,0 +1,186 @@
+/**
+* Copyright (C) 2008 Happy Fish / YuQing
+*
+* FastDFS may be copied only under the terms of the GNU General
+* Public License V3, which may be found in the FastDFS source kit.
+* Please visit the FastDFS Home Page http://www.csource.org/ for more detail.
+**/
+
+//fast_slab.h
+
+#ifndef _FAST_SLAB_H
+#define _FAST_SLAB_H
+
+#include <stdint.h>
+#include <pthread.h>
+#include "common_define.h"
+
+#define FAST_SLAB_MAX_CLASSES       200  //max size classes of the chunks
+#define FAST_SLAB_CACHE_MAX_COUNT   32   //max chunks of a class per thread
+#define FAST_SLAB_CACHE_MAX_BYTES   (256 * 1024)  //per class per thread
+
+typedef struct fast_slab_class
+{
+	int chunk_size;      //the chunk size of this class
+	int chunks_per_page;
+	int cache_max;       //max chunks cached by a thread
+	int page_count;      //pages alloced
+	int64_t free_count;  //chunks in the free list
+	char *free_list;     //free chunks linked by their first bytes
+	char *page_ptr;      //next never used chunk of the last page
+	char *page_end;
+	pthread_mutex_t lock;
+} FastSlabClass;
+
+typedef struct fast_slab_cache_list
+{
+	char *head;  //cached chunks linked by their first bytes
+	int count;
+} FastSlabCacheList;
+
+typedef struct fast_slab_thread_cache
+{
+	struct fast_slab_allocator *slab;
+	FastSlabCacheList *lists;  //one per class
+	struct fast_slab_thread_cache *prev;
+	struct fast_slab_thread_cache *next;
+} FastSlabThreadCache;
+
+typedef struct fast_slab_page
+{
+	struct fast_slab_page *next;
+} FastSlabPage;
+
+/* the allocator of the pages and the large blocks, such as from a shared
+   memory segment, malloc and free by default */
+typedef void *(*FastSlabAllocFunc)(void *args, const int bytes);
+typedef void (*FastSlabFreeFunc)(void *args, void *ptr, const int bytes);
+
+typedef struct fast_slab_allocator
+{
+	FastSlabClass classes[FAST_SLAB_MAX_CLASSES];
+	int class_count;
+	int page_size;
+	int max_chunk_size;  //the larger blocks are malloced directly
+	unsigned char *class_indexes;  //class index by (bytes - 1) / 8
+	int64_t max_bytes;   //0 for no limit
+	volatile int64_t total_bytes;  //pages and the large blocks
+	volatile int64_t large_bytes;  //the large blocks
+	volatile int large_count;
+	FastSlabPage *pages;
+	FastSlabAllocFunc alloc_func;  //NULL for malloc
+	FastSlabFreeFunc free_func;    //NULL for free
+	void *alloc_args;
+	FastSlabThreadCache *caches;
+	pthread_key_t cache_key;
+	pthread_mutex_t lock;  //for the pages and the thread caches
+} FastSlabAllocator;
+
+typedef struct fast_slab_class_stat
+{
+	int chunk_size;
+	int page_count;
+	int64_t total_chunks;
+	int64_t used_chunks;
+} FastSlabClassStat;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * slab allocator init function
+ * parameters:
+ *         slab: the slab allocator
+ *         min_chunk_size: the chunk size of the smallest class
+ *         max_chunk_size: the chunk size of the largest class, the larger
+ *                         blocks are malloced directly
+ *         grow_factor: the chunk size factor of the neighbor classes
+ *         page_size: the size of the pages carved into chunks
+ *         max_bytes: max memory can be used (bytes), 0 for no limit
+ * return 0 for success, != 0 for error
+*/
+int fast_slab_init(FastSlabAllocator *slab, const int min_chunk_size, \
+		const int max_chunk_size, const double grow_factor, \
+		const int page_size, const int64_t max_bytes);
+
+/**
+ * free all the pages, all the chunks must not be used any more
+*/
+void fast_slab_destroy(FastSlabAllocator *slab);
+
+/**
+ * set the allocator of the pages and the large blocks, call after init
+ * or attach and before any alloc
+ * parameters:
+ *         slab: the slab allocator
+ *         alloc_func: the alloc function, NULL for malloc
+ *         free_func: the free function, NULL for free
+ *         args: the args of alloc_func and free_func
+ * return none
+*/
+void fast_slab_set_allocator(FastSlabAllocator *slab, \
+		FastSlabAllocFunc alloc_func, FastSlabFreeFunc free_func, \
+		void *args);
+
+/**
+ * detach the slab allocator from the process, the chunks cached by the
+ * threads are returned to the classes, the locks are destroyed and the
+ * pages are kept. the chunks must not be alloced or freed concurrently
+*/
+void fast_slab_detach(FastSlabAllocator *slab);
+
+/**
+ * attach the slab allocator detached by fast_slab_detach, such as in a
+ * shared memory segment mapped by another process at the same address.
+ * the allocator should be set again by fast_slab_set_allocator
+ * return 0 for success, != 0 for error
+*/
+int fast_slab_attach(FastSlabAllocator *slab);
+
+/**
+ * the real size of the block to alloc
+ * parameters:
+ *         slab: the slab allocator
+ *         bytes: the size requested
+ * return the chunk size of the class, bytes for the large block
+*/
+int fast_slab_alloc_size(FastSlabAllocator *slab, const int bytes);
+
+/**
+ * alloc a block
+ * parameters:
+ *         slab: the slab allocator
+ *         bytes: the size requested
+ * return the block, NULL for fail and errno is ENOSPC or ENOMEM
+*/
+void *fast_slab_alloc(FastSlabAllocator *slab, const int bytes);
+
+/**
+ * free a block
+ * parameters:
+ *         slab: the slab allocator
+ *         ptr: the block returned by fast_slab_alloc
+ *         bytes: the size requested when alloc
+ * return none
+*/
+void fast_slab_free(FastSlabAllocator *slab, void *ptr, const int bytes);
+
+/**
+ * stat the classes which pages alloced, the chunks cached by the threads
+ * are not counted as used
+ * parameters:
+ *         slab: the slab allocator
+ *         stats: return the class stats
+ *         max_count: the element count of stats
+ * return the class count of stats
+*/
+int fast_slab_stat(FastSlabAllocator *slab, FastSlabClassStat *stats, \
+		const int max_count);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
@@ -1,7 +1,6 @@
 //fast_task_queue.c
 
 #include <errno.h>
-#include <sys/resource.h>
 #include <pthread.h>
 #include "fast_task_queue.h"
 #include "logger.h"
@@ -18,6 +17,35 @@ struct mpool_chain {
 
 #define ALIGNED_TASK_INFO_SIZE  MEM_ALIGN(sizeof(struct fast_task_info))
 
+struct fast_task_buff_class
+{
+	int buff_size;  //the buffer size of this class
+	int max_count;  //max buffers cached
+	int count;      //buffers cached
+	char *head;     //cached buffers linked by their first bytes
+	pthread_mutex_t lock;
+};
+
+static struct fast_task_buff_class g_buff_classes[FAST_TASK_MAX_BUFF_CLASSES];
+static int g_buff_class_count = 0;
+
+/* the global free stack is lock free, the top is the tag (high 32 bits)
+   and the index + 1 of the top task (low 32 bits, 0 for empty),
+   the tag is changed by every push and pop to avoid ABA problem */
+#define FREE_STACK_MAKE_TOP(tag, index) \
+	((((uint64_t)(tag)) << 32) | (uint32_t)((index) + 1))
+#define FREE_STACK_TAG(top)    ((uint32_t)((top) >> 32))
+#define FREE_STACK_INDEX(top)  ((int)((top) & 0xFFFFFFFF) - 1)
+
+#define TASK_AT_INDEX(index) ((struct fast_task_info *) \
+	((char *)g_mpool->blocks + (index) * task_block_size))
+#define TASK_INDEX(pTask) (int)(((char *)(pTask) - \
+	(char *)g_mpool->blocks) / task_block_size)
+
+static volatile uint64_t free_stack_top = 0;
+static volatile int free_stack_count = 0;
+static int task_block_size = 0;
+
 int task_queue_init(struct fast_task_queue *pQueue)
 {
 	int result;
@@ -73,38 +101,7 @@ static struct mpool_chain *malloc_mpool(const int block_size, \
 	for (p=(char *)mpool->blocks; p<pCharEnd; p += block_size)
 	{
 		pTask = (struct fast_task_info *)p;
-		pTask->size = g_free_queue.min_buff_size;
-
 		pTask->arg = p + ALIGNED_TASK_INFO_SIZE;
-		if (g_free_queue.malloc_whole_block)
-		{
-			pTask->data = (char *)pTask->arg + \
-					g_free_queue.arg_size;
-		}
-		else
-		{
-			pTask->data = (char *)malloc(pTask->size);
-			if (pTask->data == NULL)
-			{
-				char *pt;
-
-				logError("file: "__FILE__", line: %d, " \
-					"malloc %d bytes fail, " \
-					"errno: %d, error info: %s", \
-					__LINE__, pTask->size, \
-					errno, STRERROR(errno));
-
-				for (pt=(char *)mpool->blocks; pt < p; \
-					pt += block_size)
-				{
-					free(((struct fast_task_info *)pt)->data);
-				}
-
-				free(mpool->blocks);
-				free(mpool);
-				return NULL;
-			}
-		}
 	}
 
 	mpool->last_block = (struct fast_task_info *)(pCharEnd - block_size);
@@ -118,170 +115,127 @@ static struct mpool_chain *malloc_mpool(const int block_size, \
 	return mpool;
 }
 
-int free_queue_init(const int max_connections, const int min_buff_size, \
-		const int max_buff_size, const int arg_size)
+static int init_buff_classes(const int max_connections)
 {
-	int64_t total_size;
-	struct mpool_chain *mpool;
-	int block_size;
-	int alloc_size;
+	struct fast_task_buff_class *pClass;
+	int buff_size;
 	int result;
-	int loop_count;
-	int aligned_min_size;
-	int aligned_max_size;
-	int aligned_arg_size;
-	rlim_t max_data_size;
-
-	if ((result=init_pthread_lock(&(g_free_queue.lock))) != 0)
-	{
-		logError("file: "__FILE__", line: %d, " \
-			"init_pthread_lock fail, errno: %d, error info: %s", \
-			__LINE__, result, STRERROR(result));
-		return result;
-	}
 
-	aligned_min_size = MEM_ALIGN(min_buff_size);
-	aligned_max_size = MEM_ALIGN(max_buff_size);
-	aligned_arg_size = MEM_ALIGN(arg_size);
-	block_size = ALIGNED_TASK_INFO_SIZE + aligned_arg_size;
-	alloc_size = block_size * max_connections;
-	if (aligned_max_size > aligned_min_size)
-	{
-		total_size = alloc_size;
-		g_free_queue.malloc_whole_block = false;
-		max_data_size = 0;
-	}
-	else
+	g_buff_class_count = 0;
+	buff_size = g_free_queue.min_buff_size;
+	while (g_buff_class_count < FAST_TASK_MAX_BUFF_CLASSES)
 	{
-		struct rlimit rlimit_data;
+		if (buff_size > g_free_queue.max_buff_size || \
+			g_buff_class_count == FAST_TASK_MAX_BUFF_CLASSES - 1)
+		{
+			buff_size = g_free_queue.max_buff_size;
+		}
 
-		if (getrlimit(RLIMIT_DATA, &rlimit_data) < 0)
+		pClass = g_buff_classes + g_buff_class_count;
+		if ((result=init_pthread_lock(&(pClass->lock))) != 0)
 		{
 			logError("file: "__FILE__", line: %d, " \
-				"call getrlimit fail, " \
+				"init_pthread_lock fail, " \
 				"errno: %d, error info: %s", \
-				__LINE__, errno, STRERROR(errno));
-			return errno != 0 ? errno : EPERM;
+				__LINE__, result, STRERROR(result));
+			return result;
 		}
-		if (rlimit_data.rlim_cur == RLIM_INFINITY)
+
+		pClass->buff_size = buff_size;
+		pClass->max_count = FAST_TASK_BUFF_CACHE_BYTES / buff_size;
+		if (pClass->max_count > max_connections)
 		{
-			max_data_size = 256 * 1024 * 1024;
+			pClass->max_count = max_connections;
 		}
-		else
+		else if (pClass->max_count == 0)
 		{
-			max_data_size = rlimit_data.rlim_cur;
-			if (max_data_size > 256 * 1024 * 1024)
-			{
-				max_data_size = 256 * 1024 * 1024;
-			}
+			pClass->max_count = 1;
 		}
+		pClass->count = 0;
+		pClass->head = NULL;
+		g_buff_class_count++;
 
-		if (max_data_size >= (int64_t)(block_size + aligned_min_size) *
-			(int64_t)max_connections)
+		if (buff_size >= g_free_queue.max_buff_size)
 		{
-			total_size = alloc_size + (int64_t)aligned_min_size *
-					max_connections;
-			g_free_queue.malloc_whole_block = true;
-			block_size += aligned_min_size;
-		}
-		else
-		{
-			total_size = alloc_size;
-			g_free_queue.malloc_whole_block = false;
-			max_data_size = 0;
+			break;
 		}
+		buff_size *= 2;
 	}
 
-	logDebug("file: "__FILE__", line: %d, " \
-		"max_connections: %d, min_buff_size: %d, max_buff_size: %d, " \
-		"block_size: %d, arg_size: %d, max_data_size: %d, " \
-		"total_size: "INT64_PRINTF_FORMAT, __LINE__, \
-		max_connections, aligned_min_size, aligned_max_size, \
-		block_size, aligned_arg_size, (int)max_data_size, total_size);
+	return 0;
+}
 
-	g_free_queue.max_connections = max_connections;
-	g_free_queue.min_buff_size = aligned_min_size;
-	g_free_queue.max_buff_size = aligned_max_size;
-	g_free_queue.arg_size = aligned_arg_size;
+static void destroy_buff_classes()
+{
+	struct fast_task_buff_class *pClass;
+	struct fast_task_buff_class *pEnd;
+	char *pBuff;
 
-	if ((!g_free_queue.malloc_whole_block) || \
-		(total_size <= max_data_size))
+	pEnd = g_buff_classes + g_buff_class_count;
+	for (pClass=g_buff_classes; pClass<pEnd; pClass++)
 	{
-		loop_count = 1;
-		mpool = malloc_mpool(block_size, total_size);
-		if (mpool == NULL)
+		while (pClass->head != NULL)
 		{
-			return errno != 0 ? errno : ENOMEM;
+			pBuff = pClass->head;
+			pClass->head = *((char **)pBuff);
+			free(pBuff);
 		}
-		g_mpool = mpool;
-	}
-	else
-	{
-		struct mpool_chain *previous_mpool;
-		int remain_count;
-		int alloc_once;
-		int current_count;
-		int current_alloc_size;
-
-		mpool = NULL;
-		previous_mpool = NULL;
-		loop_count = 0;
-		remain_count = max_connections;
-		alloc_once = max_data_size / block_size;
-		while (remain_count > 0)
-		{
-			current_count = (remain_count > alloc_once) ? \
-					alloc_once : remain_count;
-			current_alloc_size = block_size * current_count;
-			mpool = malloc_mpool(block_size, current_alloc_size);
-			if (mpool == NULL)
-			{
-				free_queue_destroy();
-				return errno != 0 ? errno : ENOMEM;
-			}
+		pClass->count = 0;
 
-			if (previous_mpool == NULL)
-			{
-				g_mpool = mpool;
-			}
-			else
-			{
-				previous_mpool->next = mpool;
-				previous_mpool->last_block->next = mpool->blocks;
-			}
-			previous_mpool = mpool;
+		pthread_mutex_destroy(&(pClass->lock));
+	}
+	g_buff_class_count = 0;
+}
 
-			remain_count -= current_count;
-			loop_count++;
-		}
+int free_queue_init(const int max_connections, const int min_buff_size, \
+		const int max_buff_size, const int arg_size)
+{
+	struct mpool_chain *mpool;
+	int block_size;
+	int alloc_size;
+	int result;
+	int aligned_min_size;
+	int aligned_max_size;
+	int aligned_arg_size;
 
-		logDebug("file: "__FILE__", line: %d, " \
-			"alloc_once: %d", __LINE__, alloc_once);
+	aligned_min_size = MEM_ALIGN(min_buff_size);
+	aligned_max_size = MEM_ALIGN(max_buff_size);
+	if (aligned_max_size < aligned_min_size)
+	{
+		aligned_max_size = aligned_min_size;
 	}
+	aligned_arg_size = MEM_ALIGN(arg_size);
+	block_size = ALIGNED_TASK_INFO_SIZE + aligned_arg_size;
+	alloc_size = block_size * max_connections;
 
 	logDebug("file: "__FILE__", line: %d, " \
-		"malloc task info as whole: %d, malloc loop count: %d", \
-		__LINE__, g_free_queue.malloc_whole_block, loop_count);
+		"max_connections: %d, min_buff_size: %d, max_buff_size: %d, " \
+		"block_size: %d, arg_size: %d, total_size: %d", \
+		__LINE__, max_connections, aligned_min_size, \
+		aligned_max_size, block_size, aligned_arg_size, alloc_size);
 
-	if (g_mpool != NULL)
-	{
-		g_free_queue.head = g_mpool->blocks;
-		g_free_queue.tail = mpool->last_block;
+	g_free_queue.max_connections = max_connections;
+	g_free_queue.min_buff_size = aligned_min_size;
+	g_free_queue.max_buff_size = aligned_max_size;
+	g_free_queue.arg_size = aligned_arg_size;
 
-		/*
-		struct fast_task_info *pTask;
-		int task_count = 0;
+	if ((result=init_buff_classes(max_connections)) != 0)
+	{
+		return result;
+	}
 
-		pTask = g_free_queue.head;
-		while (pTask != NULL)
-		{
-			task_count++;
-			pTask = pTask->next;
-		}
-		logDebug("file: "__FILE__", line: %d, " \
-			"task count: %d", __LINE__, task_count);
-		*/
+	/* the task buffers are allocated when used */
+	mpool = malloc_mpool(block_size, alloc_size);
+	if (mpool == NULL)
+	{
+		return errno != 0 ? errno : ENOMEM;
 	}
+	g_mpool = mpool;
+
+	/* all tasks are linked by malloc_mpool, push them at once */
+	task_block_size = block_size;
+	free_stack_top = FREE_STACK_MAKE_TOP(0, 0);
+	free_stack_count = max_connections;
 
 	return 0;
 }
@@ -296,7 +250,6 @@ void free_queue_destroy()
 		return;
 	}
 
-	if (!g_free_queue.malloc_whole_block)
 	{
 		char *p;
 		char *pCharEnd;
@@ -316,6 +269,7 @@ void free_queue_destroy()
 			}
 		}
 	}
+	destroy_buff_classes();
 
 	mpool = g_mpool;
 	while (mpool != NULL)
@@ -327,73 +281,242 @@ void free_queue_destroy()
 		free(mp);
 	}
 	g_mpool = NULL;
+	free_stack_top = FREE_STACK_MAKE_TOP(0, -1);
+	free_stack_count = 0;
+}
+
+static struct fast_task_buff_class *get_buff_class(const int buff_size)
+{
+	struct fast_task_buff_class *pClass;
+	struct fast_task_buff_class *pEnd;
+
+	pEnd = g_buff_classes + g_buff_class_count;
+	for (pClass=g_buff_classes; pClass<pEnd; pClass++)
+	{
+		if (pClass->buff_size >= buff_size)
+		{
+			return pClass;
+		}
+	}
 
-	pthread_mutex_destroy(&(g_free_queue.lock));
+	return NULL;
 }
 
-struct fast_task_info *free_queue_pop()
+static char *buff_class_pop(struct fast_task_buff_class *pClass)
 {
-	return task_queue_pop(&g_free_queue);;
+	char *pBuff;
+
+	pthread_mutex_lock(&(pClass->lock));
+	pBuff = pClass->head;
+	if (pBuff != NULL)
+	{
+		pClass->head = *((char **)pBuff);
+		pClass->count--;
+	}
+	pthread_mutex_unlock(&(pClass->lock));
+
+	return pBuff;
 }
 
-int free_queue_push(struct fast_task_info *pTask)
+/* cache the buffer to the class of the same size, or free it */
+static void buffer_free(char *pBuff, const int buff_size)
 {
-	char *new_buff;
-	int result;
+	struct fast_task_buff_class *pClass;
 
-	*(pTask->client_ip) = '\0';
-	pTask->length = 0;
-	pTask->offset = 0;
-	pTask->req_count = 0;
+	pClass = get_buff_class(buff_size);
+	if (pClass != NULL && pClass->buff_size == buff_size)
+	{
+		pthread_mutex_lock(&(pClass->lock));
+		if (pClass->count < pClass->max_count)
+		{
+			*((char **)pBuff) = pClass->head;
+			pClass->head = pBuff;
+			pClass->count++;
+			pBuff = NULL;
+		}
+		pthread_mutex_unlock(&(pClass->lock));
+	}
+
+	if (pBuff != NULL)
+	{
+		free(pBuff);
+	}
+}
+
+int free_queue_alloc_buffer(struct fast_task_info *pTask, \
+		const int expect_size)
+{
+	struct fast_task_buff_class *pClass;
+	char *pNewBuff;
+	int new_size;
+
+	if (pTask->data != NULL && pTask->size >= expect_size)
+	{
+		return 0;
+	}
+
+	pClass = get_buff_class(expect_size);
+	if (pClass != NULL)
+	{
+		new_size = pClass->buff_size;
+		pNewBuff = buff_class_pop(pClass);
+	}
+	else
+	{
+		new_size = expect_size;
+		pNewBuff = NULL;
+	}
 
-	if (pTask->size > g_free_queue.min_buff_size) //need thrink
+	if (pNewBuff == NULL)
 	{
-		new_buff = (char *)malloc(g_free_queue.min_buff_size);
-		if (new_buff == NULL)
+		pNewBuff = (char *)malloc(new_size);
+		if (pNewBuff == NULL)
 		{
-			logWarning("file: "__FILE__", line: %d, " \
+			logError("file: "__FILE__", line: %d, " \
 				"malloc %d bytes fail, " \
 				"errno: %d, error info: %s", \
-				__LINE__, g_free_queue.min_buff_size, \
+				__LINE__, new_size, \
 				errno, STRERROR(errno));
-		}
-		else
-		{
-			free(pTask->data);
-			pTask->size = g_free_queue.min_buff_size;
-			pTask->data = new_buff;
+			return errno != 0 ? errno : ENOMEM;
 		}
 	}
 
-	if ((result=pthread_mutex_lock(&g_free_queue.lock)) != 0)
+	if (pTask->data != NULL)
 	{
-		logError("file: "__FILE__", line: %d, " \
-			"call pthread_mutex_lock fail, " \
-			"errno: %d, error info: %s", \
-			__LINE__, result, STRERROR(result));
+		memcpy(pNewBuff, pTask->data, pTask->size);
+		buffer_free(pTask->data, pTask->size);
+	}
+
+	pTask->data = pNewBuff;
+	pTask->size = new_size;
+	return 0;
+}
+
+void free_queue_release_buffer(struct fast_task_info *pTask)
+{
+	if (pTask->data == NULL)
+	{
+		return;
 	}
 
-	pTask->next = g_free_queue.head;
-	g_free_queue.head = pTask;
-	if (g_free_queue.tail == NULL)
+	buffer_free(pTask->data, pTask->size);
+	pTask->data = NULL;
+	pTask->size = 0;
+}
+
+static struct fast_task_info *free_stack_pop()
+{
+	struct fast_task_info *pTask;
+	uint64_t old_top;
+	uint64_t new_top;
+	int next_index;
+
+	do
+	{
+		old_top = free_stack_top;
+		if (FREE_STACK_INDEX(old_top) < 0)
+		{
+			return NULL;
+		}
+
+		/* the next may be changed by other thread after the task
+		   popped, then the tag of the top is changed too */
+		pTask = TASK_AT_INDEX(FREE_STACK_INDEX(old_top));
+		next_index = pTask->next != NULL ? TASK_INDEX(pTask->next) : -1;
+		new_top = FREE_STACK_MAKE_TOP(FREE_STACK_TAG(old_top) + 1, \
+				next_index);
+	} while (!__sync_bool_compare_and_swap(&free_stack_top, \
+			old_top, new_top));
+
+	__sync_sub_and_fetch(&free_stack_count, 1);
+	return pTask;
+}
+
+static void free_stack_push(struct fast_task_info *pTask)
+{
+	uint64_t old_top;
+	uint64_t new_top;
+	int index;
+
+	index = TASK_INDEX(pTask);
+	do
+	{
+		old_top = free_stack_top;
+		pTask->next = FREE_STACK_INDEX(old_top) >= 0 ? \
+			TASK_AT_INDEX(FREE_STACK_INDEX(old_top)) : NULL;
+		new_top = FREE_STACK_MAKE_TOP(FREE_STACK_TAG(old_top) + 1, \
+				index);
+	} while (!__sync_bool_compare_and_swap(&free_stack_top, \
+			old_top, new_top));
+
+	__sync_add_and_fetch(&free_stack_count, 1);
+}
+
+static void task_reset(struct fast_task_info *pTask)
+{
+	*(pTask->client_ip) = '\0';
+	pTask->length = 0;
+	pTask->offset = 0;
+	pTask->req_count = 0;
+	pTask->nio_stage = 0;
+
+	free_queue_release_buffer(pTask);
+}
+
+struct fast_task_info *free_queue_pop()
+{
+	return free_stack_pop();
+}
+
+int free_queue_push(struct fast_task_info *pTask)
+{
+	task_reset(pTask);
+	free_stack_push(pTask);
+	return 0;
+}
+
+struct fast_task_info *free_queue_pop_ex(struct nio_thread_data *pThreadData)
+{
+	struct fast_task_info *pTask;
+
+	pTask = pThreadData->free_list;
+	if (pTask == NULL)
 	{
-		g_free_queue.tail = pTask;
+		return free_stack_pop();
 	}
 
-	if ((result=pthread_mutex_unlock(&g_free_queue.lock)) != 0)
+	pThreadData->free_list = pTask->next;
+	pThreadData->free_count--;
+	return pTask;
+}
+
+int free_queue_push_ex(struct nio_thread_data *pThreadData, \
+		struct fast_task_info *pTask)
+{
+	task_reset(pTask);
+
+	pTask->next = pThreadData->free_list;
+	pThreadData->free_list = pTask;
+	pThreadData->free_count++;
+
+	/* rebalance, return the half to the global stack */
+	if (pThreadData->free_count > FAST_TASK_LOCAL_FREE_MAX)
 	{
-		logError("file: "__FILE__", line: %d, " \
-			"call pthread_mutex_unlock fail, " \
-			"errno: %d, error info: %s", \
-			__LINE__, result, STRERROR(result));
+		while (pThreadData->free_count > FAST_TASK_LOCAL_FREE_MAX / 2)
+		{
+			pTask = pThreadData->free_list;
+			pThreadData->free_list = pTask->next;
+			pThreadData->free_count--;
+			free_stack_push(pTask);
+		}
 	}
 
-	return result;
+	return 0;
 }
 
 int free_queue_count()
 {
-	return task_queue_count(&g_free_queue);
+	return free_stack_count;
 }
 
 int task_queue_push(struct fast_task_queue *pQueue, \
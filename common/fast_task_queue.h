@@ -19,6 +19,10 @@
 #include "ioevent.h"
 #include "fast_timer.h"
 
+#define FAST_TASK_MAX_BUFF_CLASSES  16  //max size classes of task buffers
+#define FAST_TASK_BUFF_CACHE_BYTES  (16 * 1024 * 1024) //cache of each class
+#define FAST_TASK_LOCAL_FREE_MAX    32  //max free tasks of a nio thread
+
 struct fast_task_info;
 
 typedef int (*TaskFinishCallBack) (struct fast_task_info *pTask);
@@ -39,6 +43,10 @@ struct nio_thread_data
 	struct fast_timer timer;
         int pipe_fds[2];
 	struct fast_task_info *deleted_list;
+	volatile int connection_count; //current connections of this thread
+	volatile int in_flight_count;  //requests dealing or sending
+	struct fast_task_info *free_list; //free tasks of this thread
+	int free_count;                   //count of the free tasks
 };
 
 struct fast_task_info
@@ -51,6 +59,8 @@ struct fast_task_info
 	int length; //data length
 	int offset; //current offset
 	int req_count; //request count
+	short nio_stage; //stage for network IO
+	time_t last_active; //last IO time, the timer is refreshed lazily
 	TaskFinishCallBack finish_callback;
 	struct nio_thread_data *thread_data;
 	struct fast_task_info *next;
@@ -65,7 +75,6 @@ struct fast_task_queue
 	int min_buff_size;
 	int max_buff_size;
 	int arg_size;
-	bool malloc_whole_block;
 };
 
 #ifdef __cplusplus
@@ -79,8 +88,57 @@ void free_queue_destroy();
 
 int free_queue_push(struct fast_task_info *pTask);
 struct fast_task_info *free_queue_pop();
+
+/**
+* get the count of the free tasks in the global stack,
+* the free tasks of the nio threads are not included
+* return: the count of the free tasks
+*/
 int free_queue_count();
 
+/**
+* pop a free task from the free list of the nio thread, the global
+* stack is used when the free list is empty.
+* should be called by the nio thread only
+* params:
+*	pThreadData: the nio thread
+* return: the free task, NULL for none
+*/
+struct fast_task_info *free_queue_pop_ex(struct nio_thread_data *pThreadData);
+
+/**
+* push the task to the free list of the nio thread, the tasks
+* exceed FAST_TASK_LOCAL_FREE_MAX are returned to the global stack.
+* should be called by the nio thread only
+* params:
+*	pThreadData: the nio thread
+*	pTask: the task to push
+* return: error no, 0 for success, != 0 fail
+*/
+int free_queue_push_ex(struct nio_thread_data *pThreadData, \
+		struct fast_task_info *pTask);
+
+/**
+* make sure the task buffer can hold the expect size, the buffer is
+* taken from the size class which is the smallest one can hold it,
+* the data in the old buffer is kept.
+* params:
+*	pTask: the task
+*	expect_size: the expect buffer size
+* return: error no, 0 for success, != 0 fail
+*/
+int free_queue_alloc_buffer(struct fast_task_info *pTask, \
+		const int expect_size);
+
+/**
+* return the task buffer to its size class, the buffer is freed
+* when the class caches enough buffers
+* params:
+*	pTask: the task
+* return: none
+*/
+void free_queue_release_buffer(struct fast_task_info *pTask);
+
 
 int task_queue_init(struct fast_task_queue *pQueue);
 int task_queue_push(struct fast_task_queue *pQueue, \
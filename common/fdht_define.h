@@ -30,11 +30,57 @@
 
 #define FDHT_STORE_TYPE_BDB      1
 #define FDHT_STORE_TYPE_MPOOL    2
+#define FDHT_STORE_TYPE_MPOOL_FLAT  3  //mpool by the open addressing table
+#define FDHT_STORE_TYPE_HYBRID   4  //BDB with an mpool cache of the hot keys
+
+/* the keys are stored by BDB */
+#define FDHT_STORE_TYPE_IS_BDB(store_type) \
+	((store_type) == FDHT_STORE_TYPE_BDB || \
+	 (store_type) == FDHT_STORE_TYPE_HYBRID)
+
+#define FDHT_PLACEMENT_FD_MOD        0  //socket fd % max_threads
+#define FDHT_PLACEMENT_LEAST_LOADED  1  //scan all the work threads
+#define FDHT_PLACEMENT_TWO_CHOICES   2  //the less loaded one of two randoms
 
 #define FDHT_DEFAULT_MPOOL_INIT_CAPACITY    10000
 #define FDHT_DEFAULT_MPOOL_LOAD_FACTOR       0.75
 #define FDHT_DEFAULT_MPOOL_CLEAR_MIN_INTEVAL  300
 #define FDHT_DEFAULT_MPOOL_HTABLE_LOCK_COUNT 1361
+#define FDHT_DEFAULT_MPOOL_SLAB_PAGE_SIZE   (1024 * 1024)
+#define FDHT_MPOOL_REHASH_BATCH_BUCKETS     1024 //buckets per write lock
+#define FDHT_MPOOL_REHASH_MAX_MSEC          100  //per second
+#define FDHT_DEFAULT_MPOOL_CLEAR_STEP_MSEC   10
+#define FDHT_MPOOL_EXPIRE_WHEEL_SLOTS       4096 //one slot per second
+#define FDHT_MPOOL_EXPIRE_ENOSPC_MSEC       5    //clear when no space to set
+
+#define FDHT_MPOOL_EVICT_NONE   0
+#define FDHT_MPOOL_EVICT_CLOCK  1  //evict the keys not visited recently
+#define FDHT_MPOOL_MAX_EVICT_NAMESPACES     32
+#define FDHT_MPOOL_EVICT_MAX_BUCKETS        4096 //buckets walked per set
+#define FDHT_MPOOL_MAX_NAMESPACES           128  //the namespaces accounted
+#define FDHT_MPOOL_MAX_QUOTA_NAMESPACES     32
+#define FDHT_MPOOL_QUOTA_EVICT_TIMES        8    //hash_evict calls per set
+
+#define FDHT_MPOOL_SNAPSHOT_LOAD_THREADS    4  //with the bucket locks only
+
+/* the address the shared memory file of the mpool mapped at, out of the
+   range of the heap and the libraries */
+#ifdef __LP64__
+#define FDHT_MPOOL_SHM_BASE_ADDR  0x600000000000ULL
+#endif
+
+#define FDHT_DEFAULT_HYBRID_CACHE_SIZE  (64 * 1024 * 1024)
+#define FDHT_HYBRID_AVG_ITEM_BYTES      256  //the bucket count of the cache
+#define FDHT_HYBRID_KEY_LOCK_COUNT      1361 //the DB and the cache writes
+#define FDHT_HYBRID_DOORKEEPER_BITS     8    //per bucket of the cache
+#define FDHT_HYBRID_EVICT_TIMES         8    //hash_evict calls per fill
+#define FDHT_HYBRID_EXPIRE_BATCH_KEYS   128  //expired keys per delete batch
+
+#define FDHT_HYBRID_ADMIT_ALWAYS      0  //cache the keys on the first miss
+#define FDHT_HYBRID_ADMIT_SECOND_HIT  1  //on the second miss or write
+
+#define FDHT_MPOOL_HASH_TIME33  0
+#define FDHT_MPOOL_HASH_WYHASH  1  //8 bytes per round
 
 #ifdef __cplusplus
 extern "C" {
@@ -14,5 +14,6 @@
 int g_fdht_connect_timeout = DEFAULT_CONNECT_TIMEOUT;
 int g_fdht_network_timeout = DEFAULT_NETWORK_TIMEOUT;
 char g_fdht_base_path[MAX_PATH_SIZE] = {'/', 't', 'm', 'p', '\0'};
+char g_fdht_unix_socket_path[MAX_PATH_SIZE] = {0};
 Version g_fdht_version = {2, 0};
 
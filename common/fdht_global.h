@@ -27,6 +27,7 @@ extern "C" {
 extern int g_fdht_connect_timeout;
 extern int g_fdht_network_timeout;
 extern char g_fdht_base_path[MAX_PATH_SIZE];
+extern char g_fdht_unix_socket_path[MAX_PATH_SIZE]; //for the local server
 extern Version g_fdht_version;
 
 #ifdef __cplusplus
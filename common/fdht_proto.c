@@ -19,6 +19,8 @@
 #include "shared_func.h"
 #include "logger.h"
 #include "sockopt.h"
+#include "local_ip_func.h"
+#include "fdht_global.h"
 #include "fdht_types.h"
 #include "fdht_proto.h"
 
@@ -164,6 +166,43 @@ void fdht_disconnect_server(FDHTServerInfo *pServer)
 	}
 }
 
+/* connect to the local server by the unix domain socket,
+   return 0 for success, != 0 to connect by TCP */
+static int fdht_connect_unix_socket(FDHTServerInfo *pServer)
+{
+	int result;
+
+	if (*g_fdht_unix_socket_path == '\0' || !(strncmp(pServer->ip_addr, \
+		"127.", 4) == 0 || is_local_host_ip(pServer->ip_addr)))
+	{
+		return ENOENT;
+	}
+
+	pServer->sock = socket(AF_UNIX, SOCK_STREAM, 0);
+	if(pServer->sock < 0)
+	{
+		return errno != 0 ? errno : EPERM;
+	}
+
+	if ((result=connectserverbyunix(pServer->sock, \
+		g_fdht_unix_socket_path)) != 0 || \
+		(result=tcpsetnonblockopt(pServer->sock)) != 0)
+	{
+		logWarning("file: "__FILE__", line: %d, " \
+			"connect to unix socket %s fail, errno: %d, " \
+			"error info: %s, connect to %s:%d instead", \
+			__LINE__, g_fdht_unix_socket_path, result, \
+			STRERROR(result), pServer->ip_addr, pServer->port);
+
+		close(pServer->sock);
+		pServer->sock = -1;
+		return result;
+	}
+
+	pServer->unix_socket = true;
+	return 0;
+}
+
 int fdht_connect_server_nb(FDHTServerInfo *pServer, const int connect_timeout)
 {
 	int result;
@@ -172,6 +211,12 @@ int fdht_connect_server_nb(FDHTServerInfo *pServer, const int connect_timeout)
 	{
 		close(pServer->sock);
 	}
+	if (fdht_connect_unix_socket(pServer) == 0)
+	{
+		return 0;
+	}
+
+	pServer->unix_socket = false;
 	pServer->sock = socket(AF_INET, SOCK_STREAM, 0);
 	if(pServer->sock < 0)
 	{
@@ -213,6 +258,12 @@ int fdht_connect_server(FDHTServerInfo *pServer)
 	{
 		close(pServer->sock);
 	}
+	if (fdht_connect_unix_socket(pServer) == 0)
+	{
+		return 0;
+	}
+
+	pServer->unix_socket = false;
 	pServer->sock = socket(AF_INET, SOCK_STREAM, 0);
 	if(pServer->sock < 0)
 	{
@@ -92,6 +92,7 @@ typedef struct
 	int sock;
 	int port;
 	char ip_addr[IP_ADDRESS_SIZE];
+	bool unix_socket;  //connected by the unix domain socket
 } FDHTServerInfo;
 
 typedef struct
@@ -0,0 +1,629 @@
+/**
+* Copyright (C) 2008 Happy Fish / YuQing
+*
+* FastDFS may be copied only under the terms of the GNU General
+* Public License V3, which may be found in the FastDFS source kit.
+* Please visit the FastDFS Home Page http://www.csource.org/ for more detail.
+**/
+
+//flat_hash.c
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#include "flat_hash.h"
+
+/* the low 7 bits are stored in the control byte, the others choose
+   the first group to probe */
+#define FLAT_HASH_H1(hash_code)  ((hash_code) >> 7)
+#define FLAT_HASH_H2(hash_code)  ((signed char)((hash_code) & 0x7F))
+
+#define FLAT_HASH_SLOTS_BYTES(capacity) \
+	((int64_t)(capacity) * (1 + sizeof(FlatHashSlot)))
+
+/* the finalizer of murmur3, the low bits of the user hash function
+   such as Time33Hash are not well distributed */
+static inline unsigned int _flat_hash_mix(unsigned int h)
+{
+	h ^= h >> 16;
+	h *= 0x85EBCA6B;
+	h ^= h >> 13;
+	h *= 0xC2B2AE35;
+	h ^= h >> 16;
+	return h;
+}
+
+/* bit i set when the control byte i of the group equals to the value */
+static inline unsigned int _group_match(const signed char *ctrl, \
+		const signed char value)
+{
+#ifdef __SSE2__
+	__m128i group;
+	group = _mm_loadu_si128((const __m128i *)ctrl);
+	return (unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(group, \
+				_mm_set1_epi8(value)));
+#else
+	unsigned int mask;
+	int i;
+
+	mask = 0;
+	for (i=0; i<FLAT_HASH_GROUP_WIDTH; i++)
+	{
+		mask |= (unsigned int)(ctrl[i] == value) << i;
+	}
+	return mask;
+#endif
+}
+
+/* the empty and the deleted control bytes are negative */
+static inline unsigned int _group_match_empty_or_deleted( \
+		const signed char *ctrl)
+{
+#ifdef __SSE2__
+	return (unsigned int)_mm_movemask_epi8(_mm_loadu_si128( \
+				(const __m128i *)ctrl));
+#else
+	unsigned int mask;
+	int i;
+
+	mask = 0;
+	for (i=0; i<FLAT_HASH_GROUP_WIDTH; i++)
+	{
+		mask |= (unsigned int)(ctrl[i] < 0) << i;
+	}
+	return mask;
+#endif
+}
+
+#define _group_match_empty(ctrl) _group_match(ctrl, FLAT_HASH_CTRL_EMPTY)
+
+/* triangular probing, visits all the groups when the group count
+   is power of 2 */
+#define FLAT_HASH_PROBE_NEXT(pTable, group, step) \
+	step++; \
+	group = (group + step) & (pTable)->group_mask
+
+static int _flat_hash_alloc_slots(FlatHashTable *pTable, \
+		const unsigned int capacity)
+{
+	int64_t bytes;
+	char *pBuff;
+
+	bytes = FLAT_HASH_SLOTS_BYTES(capacity);
+	if (pTable->max_bytes > 0 && pTable->bytes_used + bytes - \
+		FLAT_HASH_SLOTS_BYTES(pTable->capacity) > pTable->max_bytes)
+	{
+		return ENOSPC;
+	}
+
+	pBuff = (char *)malloc(bytes);
+	if (pBuff == NULL)
+	{
+		return ENOMEM;
+	}
+
+	memset(pBuff, FLAT_HASH_CTRL_EMPTY, capacity);
+	pTable->bytes_used += bytes - FLAT_HASH_SLOTS_BYTES(pTable->capacity);
+	pTable->ctrl = (signed char *)pBuff;
+	pTable->slots = (FlatHashSlot *)(pBuff + capacity);
+	pTable->capacity = capacity;
+	pTable->group_mask = capacity / FLAT_HASH_GROUP_WIDTH - 1;
+	pTable->deleted_count = 0;
+	pTable->growth_left = FLAT_HASH_MAX_LOAD(capacity) - \
+				pTable->item_count;
+	return 0;
+}
+
+int flat_hash_init(FlatHashTable *pTable, HashFunc hash_func, \
+		const unsigned int capacity, const int64_t max_bytes)
+{
+	unsigned int slot_count;
+
+	memset(pTable, 0, sizeof(FlatHashTable));
+	slot_count = FLAT_HASH_MIN_CAPACITY;
+	while (FLAT_HASH_MAX_LOAD(slot_count) < capacity)
+	{
+		if (slot_count >= 0x40000000)
+		{
+			return EINVAL;
+		}
+		slot_count *= 2;
+	}
+
+	pTable->hash_func = hash_func;
+	pTable->max_bytes = max_bytes;
+	return _flat_hash_alloc_slots(pTable, slot_count);
+}
+
+int flat_hash_set_slab(FlatHashTable *pTable, const int page_size)
+{
+	int64_t max_bytes;
+	int result;
+
+	if (pTable->slab != NULL || pTable->item_count > 0)
+	{
+		return EEXIST;
+	}
+
+	pTable->slab = (FastSlabAllocator *)malloc(sizeof(FastSlabAllocator));
+	if (pTable->slab == NULL)
+	{
+		return ENOMEM;
+	}
+
+	/* the slots are not alloced from the slab */
+	if (pTable->max_bytes > 0)
+	{
+		max_bytes = pTable->max_bytes - pTable->bytes_used;
+		if (max_bytes <= 0)
+		{
+			max_bytes = 1;
+		}
+	}
+	else
+	{
+		max_bytes = 0;
+	}
+
+	if ((result=fast_slab_init(pTable->slab, sizeof(FlatHashEntry) + 8, \
+			page_size / 8, HASH_SLAB_GROW_FACTOR, page_size, \
+			max_bytes)) != 0)
+	{
+		fast_slab_destroy(pTable->slab);
+		free(pTable->slab);
+		pTable->slab = NULL;
+		return result;
+	}
+
+	return 0;
+}
+
+static void _flat_hash_free_entry(FlatHashTable *pTable, FlatHashEntry *entry)
+{
+	int bytes;
+
+	bytes = FLAT_HASH_ENTRY_BYTES(entry->key_len, entry->malloc_value_size);
+	if (pTable->slab != NULL)
+	{
+		fast_slab_free(pTable->slab, entry, bytes);
+	}
+	else
+	{
+		pTable->bytes_used -= bytes;
+		free(entry);
+	}
+}
+
+void flat_hash_destroy(FlatHashTable *pTable)
+{
+	unsigned int i;
+
+	if (pTable == NULL || pTable->ctrl == NULL)
+	{
+		return;
+	}
+
+	for (i=0; i<pTable->capacity; i++)
+	{
+		if (pTable->ctrl[i] >= 0)
+		{
+			_flat_hash_free_entry(pTable, pTable->slots[i].entry);
+		}
+	}
+
+	if (pTable->slab != NULL)
+	{
+		fast_slab_destroy(pTable->slab);
+		free(pTable->slab);
+		pTable->slab = NULL;
+	}
+
+	free(pTable->ctrl);
+	pTable->ctrl = NULL;
+	pTable->slots = NULL;
+	pTable->capacity = 0;
+	pTable->item_count = 0;
+	pTable->bytes_used = 0;
+}
+
+/* return the slot index of the key, -1 for not found */
+static int _flat_hash_find_index(FlatHashTable *pTable, const void *key, \
+		const int key_len, const unsigned int hash_code)
+{
+	const signed char *ctrl;
+	FlatHashSlot *pSlot;
+	unsigned int group;
+	unsigned int step;
+	unsigned int mask;
+	unsigned int index;
+
+	group = FLAT_HASH_H1(hash_code) & pTable->group_mask;
+	step = 0;
+	while (1)
+	{
+		ctrl = pTable->ctrl + group * FLAT_HASH_GROUP_WIDTH;
+		mask = _group_match(ctrl, FLAT_HASH_H2(hash_code));
+		while (mask != 0)
+		{
+			index = group * FLAT_HASH_GROUP_WIDTH + \
+				__builtin_ctz(mask);
+			pSlot = pTable->slots + index;
+			if (pSlot->hash_code == hash_code && \
+				pSlot->entry->key_len == key_len && \
+				memcmp(pSlot->entry->key, key, key_len) == 0)
+			{
+				return index;
+			}
+			mask &= mask - 1;
+		}
+
+		/* the probe sequence of the key stops at a group with
+		   an empty slot */
+		if (_group_match_empty(ctrl) != 0)
+		{
+			return -1;
+		}
+
+		FLAT_HASH_PROBE_NEXT(pTable, group, step);
+	}
+}
+
+/* the first empty or deleted slot of the probe sequence, the table
+   always keeps some empty slots */
+static unsigned int _flat_hash_find_insert_index(FlatHashTable *pTable, \
+		const unsigned int hash_code)
+{
+	unsigned int group;
+	unsigned int step;
+	unsigned int mask;
+
+	group = FLAT_HASH_H1(hash_code) & pTable->group_mask;
+	step = 0;
+	while (1)
+	{
+		mask = _group_match_empty_or_deleted(pTable->ctrl + \
+				group * FLAT_HASH_GROUP_WIDTH);
+		if (mask != 0)
+		{
+			return group * FLAT_HASH_GROUP_WIDTH + \
+				__builtin_ctz(mask);
+		}
+
+		FLAT_HASH_PROBE_NEXT(pTable, group, step);
+	}
+}
+
+/* grow the table or drop the deleted slots by rebuilding it */
+static int _flat_hash_resize(FlatHashTable *pTable)
+{
+	signed char *old_ctrl;
+	FlatHashSlot *old_slots;
+	unsigned int old_capacity;
+	unsigned int new_capacity;
+	unsigned int index;
+	unsigned int i;
+	int result;
+
+	old_ctrl = pTable->ctrl;
+	old_slots = pTable->slots;
+	old_capacity = pTable->capacity;
+
+	/* the deleted slots are the majority, just drop them */
+	if (pTable->item_count < FLAT_HASH_MAX_LOAD(old_capacity) / 2)
+	{
+		new_capacity = old_capacity;
+	}
+	else if (old_capacity >= 0x40000000)
+	{
+		return ENOSPC;
+	}
+	else
+	{
+		new_capacity = old_capacity * 2;
+	}
+
+	if ((result=_flat_hash_alloc_slots(pTable, new_capacity)) != 0)
+	{
+		return result;
+	}
+
+	for (i=0; i<old_capacity; i++)
+	{
+		if (old_ctrl[i] < 0)
+		{
+			continue;
+		}
+
+		index = _flat_hash_find_insert_index(pTable, \
+				old_slots[i].hash_code);
+		pTable->ctrl[index] = old_ctrl[i];
+		pTable->slots[index] = old_slots[i];
+	}
+
+	free(old_ctrl);
+	return 0;
+}
+
+static void _flat_hash_erase(FlatHashTable *pTable, const unsigned int index)
+{
+	const signed char *ctrl;
+
+	ctrl = pTable->ctrl + (index & ~(FLAT_HASH_GROUP_WIDTH - 1));
+
+	/* no probe sequence passed the group which has an empty slot,
+	   the slot can be empty again */
+	if (_group_match_empty(ctrl) != 0)
+	{
+		pTable->ctrl[index] = FLAT_HASH_CTRL_EMPTY;
+		pTable->growth_left++;
+	}
+	else
+	{
+		pTable->ctrl[index] = FLAT_HASH_CTRL_DELETED;
+		pTable->deleted_count++;
+	}
+
+	pTable->item_count--;
+	_flat_hash_free_entry(pTable, pTable->slots[index].entry);
+	pTable->slots[index].entry = NULL;
+}
+
+static FlatHashEntry *_flat_hash_alloc_entry(FlatHashTable *pTable, \
+		const void *key, const int key_len, \
+		const void *value, const int value_len, int *result)
+{
+	FlatHashEntry *entry;
+	int malloc_value_size;
+	int bytes;
+
+	malloc_value_size = MEM_ALIGN(value_len);
+	bytes = FLAT_HASH_ENTRY_BYTES(key_len, malloc_value_size);
+	if (pTable->slab != NULL)
+	{
+		/* the slack of the chunk is usable by the value */
+		bytes = fast_slab_alloc_size(pTable->slab, bytes);
+		malloc_value_size = bytes - sizeof(FlatHashEntry) - key_len;
+		entry = (FlatHashEntry *)fast_slab_alloc(pTable->slab, bytes);
+		if (entry == NULL)
+		{
+			*result = errno == ENOSPC ? ENOSPC : ENOMEM;
+			return NULL;
+		}
+	}
+	else
+	{
+		if (pTable->max_bytes > 0 && pTable->bytes_used + bytes > \
+			pTable->max_bytes)
+		{
+			*result = ENOSPC;
+			return NULL;
+		}
+
+		entry = (FlatHashEntry *)malloc(bytes);
+		if (entry == NULL)
+		{
+			*result = ENOMEM;
+			return NULL;
+		}
+		pTable->bytes_used += bytes;
+	}
+
+	entry->key_len = key_len;
+	entry->value_len = value_len;
+	entry->malloc_value_size = malloc_value_size;
+	memcpy(entry->key, key, key_len);
+	memcpy(FLAT_HASH_ENTRY_VALUE(entry), value, value_len);
+	*result = 0;
+	return entry;
+}
+
+FlatHashEntry *flat_hash_find(FlatHashTable *pTable, const void *key, \
+		const int key_len)
+{
+	int index;
+
+	index = _flat_hash_find_index(pTable, key, key_len, \
+		_flat_hash_mix(pTable->hash_func(key, key_len)));
+	return index >= 0 ? pTable->slots[index].entry : NULL;
+}
+
+int flat_hash_insert(FlatHashTable *pTable, const void *key, \
+		const int key_len, const void *value, const int value_len)
+{
+	FlatHashEntry *entry;
+	unsigned int hash_code;
+	unsigned int index;
+	int found;
+	int result;
+
+	hash_code = _flat_hash_mix(pTable->hash_func(key, key_len));
+	found = _flat_hash_find_index(pTable, key, key_len, hash_code);
+	if (found >= 0)
+	{
+		entry = pTable->slots[found].entry;
+		if (entry->malloc_value_size >= value_len && \
+			(entry->malloc_value_size <= 128 || \
+			 entry->malloc_value_size / 2 < value_len))
+		{
+			entry->value_len = value_len;
+			memcpy(FLAT_HASH_ENTRY_VALUE(entry), value, value_len);
+			return 0;
+		}
+
+		/* the slot is kept, only the entry is replaced */
+		_flat_hash_free_entry(pTable, entry);
+		entry = _flat_hash_alloc_entry(pTable, key, key_len, \
+				value, value_len, &result);
+		if (entry == NULL)
+		{
+			pTable->slots[found].entry = NULL;
+			pTable->ctrl[found] = FLAT_HASH_CTRL_DELETED;
+			pTable->deleted_count++;
+			pTable->item_count--;
+			return -1 * result;
+		}
+
+		pTable->slots[found].entry = entry;
+		return 0;
+	}
+
+	index = _flat_hash_find_insert_index(pTable, hash_code);
+	if (pTable->growth_left == 0 && \
+		pTable->ctrl[index] == FLAT_HASH_CTRL_EMPTY)
+	{
+		if ((result=_flat_hash_resize(pTable)) != 0)
+		{
+			return -1 * result;
+		}
+		index = _flat_hash_find_insert_index(pTable, hash_code);
+	}
+
+	entry = _flat_hash_alloc_entry(pTable, key, key_len, \
+			value, value_len, &result);
+	if (entry == NULL)
+	{
+		return -1 * result;
+	}
+
+	if (pTable->ctrl[index] == FLAT_HASH_CTRL_EMPTY)
+	{
+		pTable->growth_left--;
+	}
+	else
+	{
+		pTable->deleted_count--;
+	}
+	pTable->ctrl[index] = FLAT_HASH_H2(hash_code);
+	pTable->slots[index].hash_code = hash_code;
+	pTable->slots[index].entry = entry;
+	pTable->item_count++;
+
+	return 1;
+}
+
+int flat_hash_delete(FlatHashTable *pTable, const void *key, \
+		const int key_len)
+{
+	int index;
+
+	index = _flat_hash_find_index(pTable, key, key_len, \
+		_flat_hash_mix(pTable->hash_func(key, key_len)));
+	if (index < 0)
+	{
+		return ENOENT;
+	}
+
+	_flat_hash_erase(pTable, index);
+	return 0;
+}
+
+int flat_hash_delete_if_groups(FlatHashTable *pTable, \
+		unsigned int *group_index, const unsigned int group_count, \
+		FlatHashFilterFunc filter_func, void *args)
+{
+	unsigned int i;
+	unsigned int end;
+	int count;
+
+	count = 0;
+	if (*group_index > pTable->group_mask)
+	{
+		return 0;
+	}
+
+	end = *group_index + group_count;
+	if (end > pTable->group_mask + 1)
+	{
+		end = pTable->group_mask + 1;
+	}
+
+	for (i=*group_index * FLAT_HASH_GROUP_WIDTH; \
+		i<end * FLAT_HASH_GROUP_WIDTH; i++)
+	{
+		if (pTable->ctrl[i] >= 0 && filter_func( \
+			pTable->slots[i].entry, args))
+		{
+			_flat_hash_erase(pTable, i);
+			count++;
+		}
+	}
+
+	*group_index = end;
+	return count;
+}
+
+int flat_hash_delete_if(FlatHashTable *pTable, \
+		FlatHashFilterFunc filter_func, void *args)
+{
+	unsigned int group_index;
+
+	group_index = 0;
+	return flat_hash_delete_if_groups(pTable, &group_index, \
+			pTable->group_mask + 1, filter_func, args);
+}
+
+int64_t flat_hash_bytes_used(FlatHashTable *pTable)
+{
+	if (pTable->slab == NULL)
+	{
+		return pTable->bytes_used;
+	}
+
+	return pTable->slab->total_bytes + pTable->bytes_used;
+}
+
+int flat_hash_stat(FlatHashTable *pTable, FlatHashStat *pStat)
+{
+	unsigned int group;
+	unsigned int home;
+	unsigned int step;
+	unsigned int i;
+	int64_t total_groups;
+
+	memset(pStat, 0, sizeof(FlatHashStat));
+	total_groups = 0;
+	for (group=0; group<=pTable->group_mask; group++)
+	{
+		if (_group_match_empty_or_deleted(pTable->ctrl + group * \
+			FLAT_HASH_GROUP_WIDTH) != (1 << FLAT_HASH_GROUP_WIDTH) - 1)
+		{
+			pStat->group_used++;
+		}
+	}
+
+	for (i=0; i<pTable->capacity; i++)
+	{
+		if (pTable->ctrl[i] < 0)
+		{
+			continue;
+		}
+
+		/* the groups probed before reaching the slot */
+		group = i / FLAT_HASH_GROUP_WIDTH;
+		home = FLAT_HASH_H1(pTable->slots[i].hash_code) & \
+			pTable->group_mask;
+		step = 0;
+		while (home != group)
+		{
+			FLAT_HASH_PROBE_NEXT(pTable, home, step);
+		}
+
+		total_groups += step + 1;
+		if ((int)step + 1 > pStat->probe_max_groups)
+		{
+			pStat->probe_max_groups = step + 1;
+		}
+	}
+
+	pStat->capacity = pTable->capacity;
+	pStat->item_count = pTable->item_count;
+	pStat->deleted_count = pTable->deleted_count;
+	pStat->probe_avg_groups = pTable->item_count > 0 ? \
+		(double)total_groups / pTable->item_count : 0.00;
+	return 0;
+}
+
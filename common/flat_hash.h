@@ -0,0 +1,211 @@
+/**
+* Copyright (C) 2008 Happy Fish / YuQing
+*
+* FastDFS may be copied only under the terms of the GNU General
+* Public License V3, which may be found in the FastDFS source kit.
+* Please visit the FastDFS Home Page http://www.csource.org/ for more detail.
+**/
+
+//flat_hash.h
+
+/* open addressing hash table (Swiss table style): the slots are divided
+   into groups of FLAT_HASH_GROUP_WIDTH, each slot has one control byte
+   holding 7 bits of the hash code (or empty / deleted flag). a lookup
+   compares the control bytes of a whole group at once (by SSE2 when
+   available), so the entries of the other keys are rarely touched */
+
+#ifndef _FLAT_HASH_H
+#define _FLAT_HASH_H
+
+#include <stdint.h>
+#include "common_define.h"
+#include "hash.h"
+#include "fast_slab.h"
+
+#define FLAT_HASH_GROUP_WIDTH   16
+#define FLAT_HASH_MIN_CAPACITY  FLAT_HASH_GROUP_WIDTH
+
+#define FLAT_HASH_CTRL_EMPTY    ((signed char)-128)
+#define FLAT_HASH_CTRL_DELETED  ((signed char)-2)
+
+/* the max load factor is 7 / 8 */
+#define FLAT_HASH_MAX_LOAD(capacity)  ((capacity) - (capacity) / 8)
+
+typedef struct flat_hash_entry
+{
+	int key_len;
+	int value_len;
+	int malloc_value_size;
+	char key[0];  //the value follows the key
+} FlatHashEntry;
+
+#define FLAT_HASH_ENTRY_VALUE(entry)  ((entry)->key + (entry)->key_len)
+
+#define FLAT_HASH_ENTRY_BYTES(key_len, value_size) \
+	(sizeof(FlatHashEntry) + key_len + value_size)
+
+typedef struct flat_hash_slot
+{
+	unsigned int hash_code;  //the mixed hash code
+	FlatHashEntry *entry;
+} FlatHashSlot;
+
+typedef struct flat_hash_table
+{
+	signed char *ctrl;     //the control bytes, one per slot
+	FlatHashSlot *slots;   //alloced with the control bytes
+	unsigned int capacity; //the slot count, power of 2
+	unsigned int group_mask;
+	int item_count;
+	int deleted_count;
+	int growth_left;       //the empty slots can be used before resize
+	HashFunc hash_func;
+	int64_t max_bytes;     //0 for no limit
+	int64_t bytes_used;    //the slots and the entries
+	FastSlabAllocator *slab;  //the entries alloced from, NULL for malloc
+} FlatHashTable;
+
+typedef struct flat_hash_stat
+{
+	unsigned int capacity;
+	int item_count;
+	int deleted_count;
+	int group_used;
+	int probe_max_groups;       //the max groups probed to find a key
+	double probe_avg_groups;
+} FlatHashStat;
+
+/**
+ * the filter function of flat_hash_delete_if
+ * parameters:
+ *         entry: the entry
+ *         args: passed by flat_hash_delete_if function
+ * return true for delete the entry
+*/
+typedef bool (*FlatHashFilterFunc)(const FlatHashEntry *entry, void *args);
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * flat hash init function
+ * parameters:
+ *         pTable: the hash table
+ *         hash_func: hash function
+ *         capacity: init capacity (the expected key count)
+ *         max_bytes: max memory can be used (bytes), 0 for no limit
+ * return 0 for success, != 0 for error
+*/
+int flat_hash_init(FlatHashTable *pTable, HashFunc hash_func, \
+		const unsigned int capacity, const int64_t max_bytes);
+
+/**
+ * alloc the entries from the size classes of a slab allocator instead of
+ * malloc, must be called before any insert
+ * parameters:
+ *         pTable: the hash table
+ *         page_size: the page size of the slab allocator
+ * return 0 for success, != 0 for error
+*/
+int flat_hash_set_slab(FlatHashTable *pTable, const int page_size);
+
+/**
+ * flat hash destroy function
+ * parameters:
+ *         pTable: the hash table
+ * return none
+*/
+void flat_hash_destroy(FlatHashTable *pTable);
+
+/**
+ * find the entry of the key, the entry can be changed in place
+ * by the caller until the next insert or delete
+ * parameters:
+ *         pTable: the hash table
+ *         key: the key to find
+ *         key_len: length of the key
+ * return the entry, NULL when the key not exist
+*/
+FlatHashEntry *flat_hash_find(FlatHashTable *pTable, const void *key, \
+		const int key_len);
+
+/**
+ * insert or update the key
+ * parameters:
+ *         pTable: the hash table
+ *         key: the key to insert
+ *         key_len: length of the key
+ *         value: the value
+ *         value_len: length of the value
+ * return 0 for key already exist (update), 1 for new key (insert),
+ *        < 0 for error (-errno), the old value is deleted when the
+ *        new one can't be stored
+*/
+int flat_hash_insert(FlatHashTable *pTable, const void *key, \
+		const int key_len, const void *value, const int value_len);
+
+/**
+ * delete the key
+ * parameters:
+ *         pTable: the hash table
+ *         key: the key to delete
+ *         key_len: length of the key
+ * return 0 for success, != 0 fail (errno)
+*/
+int flat_hash_delete(FlatHashTable *pTable, const void *key, \
+		const int key_len);
+
+/**
+ * delete the entries which the filter function returns true
+ * parameters:
+ *         pTable: the hash table
+ *         filter_func: the filter function
+ *         args: extra args which will be passed to filter_func
+ * return the deleted entry count
+*/
+int flat_hash_delete_if(FlatHashTable *pTable, \
+		FlatHashFilterFunc filter_func, void *args);
+
+/**
+ * delete the entries which the filter function returns true in a batch
+ * of the groups, so the caller can release its lock between the batches.
+ * the groups are changed by the resize between the batches, the entries
+ * moved before the group index are missed until the next pass
+ * parameters:
+ *         pTable: the hash table
+ *         group_index: the group index to start, return the next one,
+ *                      greater than group_mask when all groups done
+ *         group_count: the max groups to check
+ *         filter_func: the filter function
+ *         args: extra args which will be passed to filter_func
+ * return the deleted entry count
+*/
+int flat_hash_delete_if_groups(FlatHashTable *pTable, \
+		unsigned int *group_index, const unsigned int group_count, \
+		FlatHashFilterFunc filter_func, void *args);
+
+/**
+ * the memory used by the hash table, including the slots, the slab pages
+ * when the slab allocator used
+ * parameters:
+ *         pTable: the hash table
+ * return the bytes used
+*/
+int64_t flat_hash_bytes_used(FlatHashTable *pTable);
+
+/**
+ * flat hash stat
+ * parameters:
+ *         pTable: the hash table
+ *         pStat: return stat info
+ * return 0 for success, != 0 fail (errno)
+*/
+int flat_hash_stat(FlatHashTable *pTable, FlatHashStat *pStat);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
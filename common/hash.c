@@ -10,9 +10,30 @@
 #include <stdio.h>
 #include <string.h>
 #include <errno.h>
+#include <stdint.h>
 #include "pthread_func.h"
 #include "hash.h"
 
+#ifdef HASH_WITHOUT_SLAB_EPOCH
+/* built without the slab allocator and the epoch based reclamation, such
+   as for the client library. the slab and the epoch of the table stay
+   NULL, hash_set_slab, hash_set_shared and hash_set_epoch fail */
+#define fast_slab_init(slab, min_chunk_size, max_chunk_size, grow_factor, \
+		page_size, max_bytes)  ENOTSUP
+#define fast_slab_destroy(slab)
+#define fast_slab_set_allocator(slab, alloc_func, free_func, args)
+#define fast_slab_detach(slab)
+#define fast_slab_attach(slab)  ENOTSUP
+#define fast_slab_alloc_size(slab, bytes)  (bytes)
+#define fast_slab_alloc(slab, bytes)  NULL
+#define fast_slab_free(slab, ptr, bytes)
+#define fast_epoch_init(domain, free_func, free_args)  \
+	((void)(free_func), ENOTSUP)
+#define fast_epoch_destroy(domain)
+#define fast_epoch_retire(domain, ptr)
+#define fast_epoch_reclaim(domain, wait)  0
+#endif
+
 static unsigned int prime_array[] = {
     1,              /* 0 */
     3,              /* 1 */
@@ -58,18 +79,36 @@ static int _hash_alloc_buckets(HashArray *pHash, const unsigned int old_capacity
 		return ENOSPC;
 	}
 
-	pHash->buckets = (HashData **)malloc(bytes);
+	/* calloc gets the zero pages of the large array without touching */
+	pHash->buckets = (HashData **)calloc(1, bytes);
 	if (pHash->buckets == NULL)
 	{
 		return ENOMEM;
 	}
 
-	memset(pHash->buckets, 0, bytes);
 	pHash->bytes_used += bytes - sizeof(HashData *) * old_capacity;
 
 	return 0;
 }
 
+/* the old bucket when it is not migrated yet, otherwise the new one */
+static inline HashData **_hash_bucket(HashArray *pHash, \
+		const unsigned int hash_code)
+{
+	unsigned int old_index;
+
+	if (pHash->old_buckets != NULL)
+	{
+		old_index = hash_code % pHash->old_capacity;
+		if (old_index >= pHash->rehash_index)
+		{
+			return pHash->old_buckets + old_index;
+		}
+	}
+
+	return pHash->buckets + (hash_code % (*pHash->capacity));
+}
+
 int hash_init_ex(HashArray *pHash, HashFunc hash_func, \
 		const unsigned int capacity, const double load_factor, \
 		const int64_t max_bytes, const bool bMallocValue)
@@ -153,32 +192,288 @@ int hash_set_locks(HashArray *pHash, const int lock_count)
 	return 0;
 }
 
-void hash_destroy(HashArray *pHash)
+static int _hash_init_slab(HashArray *pHash, FastSlabAllocator *slab, \
+		const int page_size)
+{
+	int64_t max_bytes;
+
+	/* the buckets are not alloced from the slab */
+	if (pHash->max_bytes > 0)
+	{
+		max_bytes = pHash->max_bytes - pHash->bytes_used;
+		if (max_bytes <= 0)
+		{
+			max_bytes = 1;
+		}
+	}
+	else
+	{
+		max_bytes = 0;
+	}
+
+	return fast_slab_init(slab, sizeof(HashData) + 8, page_size / 8, \
+			HASH_SLAB_GROW_FACTOR, page_size, max_bytes);
+}
+
+int hash_set_slab(HashArray *pHash, const int page_size)
+{
+	int result;
+
+	if (pHash->slab != NULL || pHash->item_count > 0)
+	{
+		return EEXIST;
+	}
+
+	pHash->slab = (FastSlabAllocator *)malloc(sizeof(FastSlabAllocator));
+	if (pHash->slab == NULL)
+	{
+		return ENOMEM;
+	}
+
+	if ((result=_hash_init_slab(pHash, pHash->slab, page_size)) != 0)
+	{
+		fast_slab_destroy(pHash->slab);
+		free(pHash->slab);
+		pHash->slab = NULL;
+		return result;
+	}
+
+	return 0;
+}
+
+int hash_set_shared(HashArray *pHash, HashSharedState *state, \
+		const int page_size, FastSlabAllocFunc alloc_func, \
+		FastSlabFreeFunc free_func, void *args)
+{
+	HashData **buckets;
+	int bytes;
+	int result;
+
+	if (pHash->slab != NULL || pHash->item_count > 0)
+	{
+		return EEXIST;
+	}
+
+	/* the bucket array is never reallocated */
+	if (pHash->load_factor >= 0.10)
+	{
+		return EINVAL;
+	}
+
+	bytes = sizeof(HashData *) * (*pHash->capacity);
+	if (state->buckets == NULL)
+	{
+		buckets = (HashData **)alloc_func(args, bytes);
+		if (buckets == NULL)
+		{
+			return ENOSPC;
+		}
+		memset(buckets, 0, bytes);
+
+		if ((result=_hash_init_slab(pHash, &state->slab, \
+				page_size)) != 0)
+		{
+			return result;
+		}
+		state->capacity = *pHash->capacity;
+		state->item_count = 0;
+		state->bytes_used = pHash->bytes_used;
+		state->buckets = buckets;
+	}
+	else
+	{
+		if (state->capacity != *pHash->capacity || \
+			state->slab.page_size != page_size)
+		{
+			return EINVAL;
+		}
+
+		if ((result=fast_slab_attach(&state->slab)) != 0)
+		{
+			return result;
+		}
+	}
+	fast_slab_set_allocator(&state->slab, alloc_func, free_func, args);
+
+	free(pHash->buckets);
+	pHash->buckets = state->buckets;
+	pHash->item_count = state->item_count;
+	pHash->bytes_used = state->bytes_used;
+	pHash->slab = &state->slab;
+	pHash->shared = state;
+	return 0;
+}
+
+static void _hash_free_node(void *ptr, void *args)
+{
+	HashArray *pHash;
+	HashData *hash_data;
+
+	pHash = (HashArray *)args;
+	hash_data = (HashData *)ptr;
+	if (pHash->slab != NULL)
+	{
+		fast_slab_free(pHash->slab, hash_data, \
+			CALC_NODE_MALLOC_BYTES(hash_data->key_len, \
+			hash_data->malloc_value_size));
+	}
+	else
+	{
+		free(hash_data);
+	}
+}
+
+int hash_set_epoch(HashArray *pHash)
+{
+	int result;
+
+	if (pHash->epoch != NULL)
+	{
+		return EEXIST;
+	}
+
+	/* the readers without lock can not follow the migrated nodes */
+	if (pHash->load_factor >= 0.10)
+	{
+		return EINVAL;
+	}
+
+	pHash->epoch = (FastEpochDomain *)malloc(sizeof(FastEpochDomain));
+	if (pHash->epoch == NULL)
+	{
+		return ENOMEM;
+	}
+
+	if ((result=fast_epoch_init(pHash->epoch, _hash_free_node, \
+			pHash)) != 0)
+	{
+		free(pHash->epoch);
+		pHash->epoch = NULL;
+		return result;
+	}
+
+	return 0;
+}
+
+int hash_reclaim(HashArray *pHash, const bool wait)
+{
+	if (pHash->epoch == NULL)
+	{
+		return 0;
+	}
+
+	return fast_epoch_reclaim(pHash->epoch, wait);
+}
+
+static int _hash_account_walk(const int index, const HashData *data, \
+		void *args)
+{
+	HashArray *pHash;
+
+	pHash = (HashArray *)args;
+	HASH_ACCOUNT(pHash, data, 1)
+	return 0;
+}
+
+void hash_set_account(HashArray *pHash, HashAccountFunc account_func, \
+		void *args)
+{
+	pHash->account_func = account_func;
+	pHash->account_args = args;
+	if (account_func != NULL && pHash->item_count > 0)
+	{
+		hash_walk(pHash, _hash_account_walk, pHash);
+	}
+}
+
+int64_t hash_bytes_used(HashArray *pHash)
+{
+	if (pHash->slab == NULL)
+	{
+		return pHash->bytes_used;
+	}
+
+	return pHash->slab->total_bytes + sizeof(HashData *) * \
+		((*pHash->capacity) + pHash->old_capacity);
+}
+
+static void _hash_free_nodes(HashArray *pHash, HashData **buckets, \
+		HashData **bucket_end)
 {
 	HashData **ppBucket;
-	HashData **bucket_end;
 	HashData *pNode;
 	HashData *pDelete;
 
+	for (ppBucket=buckets; ppBucket<bucket_end; ppBucket++)
+	{
+		pNode = *ppBucket;
+		while (pNode != NULL)
+		{
+			pDelete = pNode;
+			pNode = pNode->next;
+			if (pHash->slab != NULL)
+			{
+				fast_slab_free(pHash->slab, pDelete, \
+					CALC_NODE_MALLOC_BYTES(pDelete->key_len,\
+					pDelete->malloc_value_size));
+			}
+			else
+			{
+				free(pDelete);
+			}
+		}
+	}
+}
+
+void hash_destroy(HashArray *pHash)
+{
 	if (pHash == NULL || pHash->buckets == NULL)
 	{
 		return;
 	}
 
-	bucket_end = pHash->buckets + (*pHash->capacity);
-	for (ppBucket=pHash->buckets; ppBucket<bucket_end; ppBucket++)
+	/* the retired nodes are freed to the slab */
+	if (pHash->epoch != NULL)
 	{
-		pNode = *ppBucket;
-		while (pNode != NULL)
+		fast_epoch_destroy(pHash->epoch);
+		free(pHash->epoch);
+		pHash->epoch = NULL;
+	}
+
+	/* the nodes are kept for attaching again */
+	if (pHash->shared != NULL)
+	{
+		pHash->shared->item_count = pHash->item_count;
+		pHash->shared->bytes_used = pHash->bytes_used;
+		fast_slab_detach(pHash->slab);
+		pHash->slab = NULL;
+		pHash->shared = NULL;
+	}
+	else
+	{
+		_hash_free_nodes(pHash, pHash->buckets, \
+			pHash->buckets + (*pHash->capacity));
+		if (pHash->old_buckets != NULL)
 		{
-			pDelete = pNode;
-			pNode = pNode->next;
-			free(pDelete);
+			_hash_free_nodes(pHash, pHash->old_buckets + \
+				pHash->rehash_index, pHash->old_buckets + \
+				pHash->old_capacity);
+			free(pHash->old_buckets);
+			pHash->old_buckets = NULL;
+			pHash->old_capacity = 0;
+			pHash->rehash_index = 0;
 		}
+
+		free(pHash->buckets);
 	}
 
-	free(pHash->buckets);
 	pHash->buckets = NULL;
+	if (pHash->slab != NULL)
+	{
+		fast_slab_destroy(pHash->slab);
+		free(pHash->slab);
+		pHash->slab = NULL;
+	}
 	if (pHash->is_malloc_capacity)
 	{
 		free(pHash->capacity);
@@ -190,11 +485,31 @@ void hash_destroy(HashArray *pHash)
 	pHash->bytes_used = 0;
 }
 
+/* the node is initialized before published to the readers without lock */
 #define ADD_TO_BUCKET(pHash, ppBucket, hash_data) \
 	hash_data->next = *ppBucket; \
+	__sync_synchronize(); \
 	*ppBucket = hash_data; \
 	pHash->item_count++;
 
+/* the old node is unlinked and the new one linked by one store, so the
+   readers without lock find either of them */
+#define REPLACE_IN_BUCKET(pHash, ppBucket, previous, old_data, new_data) \
+	new_data->next = old_data->next; \
+	__sync_synchronize(); \
+	if (previous == NULL) \
+	{ \
+		*ppBucket = new_data; \
+	} \
+	else \
+	{ \
+		previous->next = new_data; \
+	} \
+	pHash->bytes_used -= CALC_NODE_MALLOC_BYTES(old_data->key_len, \
+				old_data->malloc_value_size); \
+	HASH_ACCOUNT(pHash, old_data, -1) \
+	HASH_DATA_RELEASE(pHash, old_data)
+
 
 #define DELETE_FROM_BUCKET(pHash, ppBucket, previous, hash_data) \
 	if (previous == NULL) \
@@ -208,7 +523,8 @@ void hash_destroy(HashArray *pHash)
 	pHash->item_count--; \
 	pHash->bytes_used -= CALC_NODE_MALLOC_BYTES(hash_data->key_len, \
 				hash_data->malloc_value_size); \
-	free(hash_data);
+	HASH_ACCOUNT(pHash, hash_data, -1) \
+	HASH_DATA_RELEASE(pHash, hash_data)
 
 #define HASH_LOCK(pHash, index) \
 	if (pHash->lock_count > 0) \
@@ -223,12 +539,29 @@ void hash_destroy(HashArray *pHash)
 	}
 
 
+/* the bucket ranges: the new array and the not migrated old buckets */
+#define HASH_RANGES_INIT(pHash, ranges) \
+	ranges[0] = pHash->buckets; \
+	ranges[1] = pHash->buckets + (*pHash->capacity); \
+	if (pHash->old_buckets != NULL) \
+	{ \
+		ranges[2] = pHash->old_buckets + pHash->rehash_index; \
+		ranges[3] = pHash->old_buckets + pHash->old_capacity; \
+	} \
+	else \
+	{ \
+		ranges[2] = NULL; \
+		ranges[3] = NULL; \
+	}
+
 int hash_stat(HashArray *pHash, HashStat *pStat, \
 		int *stat_by_lens, const int stat_size)
 {
 	HashData **ppBucket;
 	HashData **bucket_end;
 	HashData *hash_data;
+	HashData **ranges[4];
+	int r;
 	int totalLength;
 	int last;
 	int count;
@@ -238,32 +571,36 @@ int hash_stat(HashArray *pHash, HashStat *pStat, \
 	pStat->bucket_max_length = 0;
 	pStat->bucket_used = 0;
 	last = stat_size - 1;
-	bucket_end = pHash->buckets + (*pHash->capacity);
-	for (ppBucket=pHash->buckets; ppBucket<bucket_end; ppBucket++)
+	HASH_RANGES_INIT(pHash, ranges)
+	for (r=0; r<4 && ranges[r]!=NULL; r+=2)
 	{
-		if (*ppBucket == NULL)
+		bucket_end = ranges[r + 1];
+		for (ppBucket=ranges[r]; ppBucket<bucket_end; ppBucket++)
 		{
-			continue;
-		}
+			if (*ppBucket == NULL)
+			{
+				continue;
+			}
 
-		count = 0;
-		hash_data = *ppBucket;
-		while (hash_data != NULL)
-		{
-			count++;
-			hash_data = hash_data->next;
-		}
+			count = 0;
+			hash_data = *ppBucket;
+			while (hash_data != NULL)
+			{
+				count++;
+				hash_data = hash_data->next;
+			}
 
-		pStat->bucket_used++;
-		if (count > last)
-		{
-			return ENOSPC;
-		}
-		stat_by_lens[count]++;
+			pStat->bucket_used++;
+			if (count > last)
+			{
+				return ENOSPC;
+			}
+			stat_by_lens[count]++;
 
-		if (count > pStat->bucket_max_length)
-		{
-			pStat->bucket_max_length = count;
+			if (count > pStat->bucket_max_length)
+			{
+				pStat->bucket_max_length = count;
+			}
 		}
 	}
 
@@ -358,10 +695,19 @@ static int _rehash1(HashArray *pHash, const int old_capacity, \
 	return 0;
 }
 
+#define HASH_REHASH_STEP(pHash) \
+	if (pHash->old_buckets != NULL && !pHash->rehash_paused) \
+	{ \
+		_rehash_step(pHash, HASH_REHASH_STEP_BUCKETS); \
+	}
+
+/* start the incremental rehash, the buckets of the old array are migrated
+   by _rehash_step */
 static int _rehash(HashArray *pHash)
 {
 	int result;
 	unsigned int *pOldCapacity;
+	HashData **old_buckets;
 
 	pOldCapacity = pHash->capacity;
 	if (pHash->is_malloc_capacity)
@@ -386,23 +732,121 @@ static int _rehash(HashArray *pHash)
 		pHash->capacity++;
 	}
 
-	if ((result=_rehash1(pHash, *pOldCapacity, pHash->capacity)) != 0)
+	old_buckets = pHash->buckets;
+	if (pHash->capacity == NULL || pHash->capacity == \
+		prime_array + PRIME_ARRAY_SIZE)
 	{
-		pHash->capacity = pOldCapacity;  //rollback
+		result = ENOSPC;
 	}
 	else
 	{
-		if (pHash->is_malloc_capacity)
-		{
-			free(pOldCapacity);
-			pHash->is_malloc_capacity = false;
-		}
+		result = _hash_alloc_buckets(pHash, 0);
+	}
+	if (result != 0)
+	{
+		pHash->buckets = old_buckets;
+		pHash->capacity = pOldCapacity;  //rollback
+		return result;
+	}
+
+	pHash->old_buckets = old_buckets;
+	pHash->old_capacity = *pOldCapacity;
+	pHash->rehash_index = 0;
+	if (pHash->is_malloc_capacity)
+	{
+		free(pOldCapacity);
+		pHash->is_malloc_capacity = false;
 	}
 
 	/*printf("rehash, old_capacity=%d, new_capacity=%d\n", \
-		old_capacity, *pHash->capacity);
+		pHash->old_capacity, *pHash->capacity);
 	*/
-	return result;
+	return 0;
+}
+
+/* migrate bucket_count non-empty buckets at most from the old array,
+   return 1 when more buckets to migrate */
+static int _rehash_step(HashArray *pHash, const int bucket_count)
+{
+	HashData **ppBucket;
+	HashData **bucket_end;
+	HashData **ppNewBucket;
+	HashData *hash_data;
+	HashData *pNext;
+	int count;
+	int empty_visits;
+
+	if (pHash->old_buckets == NULL)
+	{
+		return 0;
+	}
+
+	count = bucket_count;
+	empty_visits = 10 * bucket_count;
+	ppBucket = pHash->old_buckets + pHash->rehash_index;
+	bucket_end = pHash->old_buckets + pHash->old_capacity;
+	while (ppBucket < bucket_end && count > 0)
+	{
+		if (*ppBucket == NULL)
+		{
+			ppBucket++;
+			if (--empty_visits == 0)
+			{
+				break;
+			}
+			continue;
+		}
+
+		hash_data = *ppBucket;
+		while (hash_data != NULL)
+		{
+			pNext = hash_data->next;
+			ppNewBucket = pHash->buckets + (HASH_CODE(pHash, \
+					hash_data) % (*pHash->capacity));
+			hash_data->next = *ppNewBucket;
+			*ppNewBucket = hash_data;
+			hash_data = pNext;
+		}
+		*ppBucket = NULL;
+
+		ppBucket++;
+		count--;
+	}
+	pHash->rehash_index = ppBucket - pHash->old_buckets;
+
+	if (ppBucket < bucket_end)
+	{
+		return 1;
+	}
+
+	free(pHash->old_buckets);
+	pHash->bytes_used -= sizeof(HashData *) * pHash->old_capacity;
+	pHash->old_buckets = NULL;
+	pHash->old_capacity = 0;
+	pHash->rehash_index = 0;
+	return 0;
+}
+
+static void _rehash_finish(HashArray *pHash)
+{
+	while (_rehash_step(pHash, 64 * 1024) != 0)
+	{
+	}
+}
+
+int hash_rehash_step(HashArray *pHash, const int bucket_count)
+{
+	if (pHash->rehash_paused)
+	{
+		return pHash->old_buckets != NULL ? 1 : 0;
+	}
+
+	return _rehash_step(pHash, bucket_count);
+}
+
+void hash_pause_rehash(HashArray *pHash, const bool paused)
+{
+	pHash->rehash_paused = paused;
 }
 
 static int _hash_conflict_count(HashArray *pHash)
@@ -461,6 +905,7 @@ int hash_best_op(HashArray *pHash, const int suggest_capacity)
 	unsigned int *new_capacity;
 	int result;
 
+	_rehash_finish(pHash);
 	if ((conflict_count=_hash_conflict_count(pHash)) == 0)
 	{
 		return 0;
@@ -515,42 +960,192 @@ int hash_best_op(HashArray *pHash, const int suggest_capacity)
 	return 1;
 }
 
-static HashData *_chain_find_entry(HashData **ppBucket, const void *key, \
-		const int key_len, const unsigned int hash_code)
+static HashData *_chain_find_entry(HashData **ppBucket, const void *key, \
+		const int key_len, const unsigned int hash_code)
+{
+	HashData *hash_data;
+
+	hash_data = *ppBucket;
+	while (hash_data != NULL)
+	{
+		if (HASH_KEY_EQUALS(hash_data, key, key_len, hash_code))
+		{
+			/* not written when set, keep the cache line clean */
+			if (!hash_data->visited)
+			{
+				hash_data->visited = 1;
+			}
+			return hash_data;
+		}
+
+		hash_data = hash_data->next;
+	}
+
+	return NULL;
+}
+
+HashData *hash_find_ex(HashArray *pHash, const void *key, const int key_len)
+{
+	unsigned int hash_code;
+	HashData **ppBucket;
+	HashData *hash_data;
+
+	hash_code = pHash->hash_func(key, key_len);
+	ppBucket = _hash_bucket(pHash, hash_code);
+
+	HASH_LOCK(pHash, ppBucket - pHash->buckets)
+	hash_data = _chain_find_entry(ppBucket, key, key_len, hash_code);
+	HASH_UNLOCK(pHash, ppBucket - pHash->buckets)
+
+	return hash_data;
+}
+
+/* the node and its previous one in the chain, the lock must be held */
+static HashData *_chain_find_prev(HashData **ppBucket, const void *key, \
+		const int key_len, const unsigned int hash_code, \
+		HashData **previous)
 {
 	HashData *hash_data;
 
+	*previous = NULL;
 	hash_data = *ppBucket;
 	while (hash_data != NULL)
 	{
-		if (key_len == hash_data->key_len && \
-			memcmp(key, hash_data->key, key_len) == 0)
+		if (HASH_KEY_EQUALS(hash_data, key, key_len, hash_code))
 		{
 			return hash_data;
 		}
 
+		*previous = hash_data;
 		hash_data = hash_data->next;
 	}
 
 	return NULL;
 }
 
-HashData *hash_find_ex(HashArray *pHash, const void *key, const int key_len)
+HashData *hash_find_lockfree(HashArray *pHash, const void *key, \
+		const int key_len)
+{
+	unsigned int hash_code;
+
+	hash_code = pHash->hash_func(key, key_len);
+	return _chain_find_entry(_hash_bucket(pHash, hash_code), \
+			key, key_len, hash_code);
+}
+
+/* the node unlinked may be found without lock, it can not be referenced
+   after the last reference released */
+static inline bool _hash_data_hold(HashData *hash_data)
+{
+	int ref_count;
+
+	while ((ref_count=hash_data->ref_count) > 0)
+	{
+		if (__sync_bool_compare_and_swap(&hash_data->ref_count, \
+			ref_count, ref_count + 1))
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+HashData *hash_find_ref_lockfree(HashArray *pHash, const void *key, \
+		const int key_len)
+{
+	unsigned int hash_code;
+	HashData **ppBucket;
+	HashData *hash_data;
+
+	hash_code = pHash->hash_func(key, key_len);
+	ppBucket = _hash_bucket(pHash, hash_code);
+	while (1)
+	{
+		hash_data = _chain_find_entry(ppBucket, key, key_len, \
+				hash_code);
+		if (hash_data == NULL || _hash_data_hold(hash_data))
+		{
+			return hash_data;
+		}
+
+		/* replaced or deleted, find again */
+	}
+}
+
+HashData *hash_find_ref(HashArray *pHash, const void *key, const int key_len)
 {
 	unsigned int hash_code;
 	HashData **ppBucket;
 	HashData *hash_data;
 
 	hash_code = pHash->hash_func(key, key_len);
-	ppBucket = pHash->buckets + (hash_code % (*pHash->capacity));
+	ppBucket = _hash_bucket(pHash, hash_code);
 
 	HASH_LOCK(pHash, ppBucket - pHash->buckets)
 	hash_data = _chain_find_entry(ppBucket, key, key_len, hash_code);
+	if (hash_data != NULL)
+	{
+		__sync_add_and_fetch(&hash_data->ref_count, 1);
+	}
 	HASH_UNLOCK(pHash, ppBucket - pHash->buckets)
 
 	return hash_data;
 }
 
+void hash_find_ref_batch(HashArray *pHash, HashFindItem *items, \
+		const int count)
+{
+	HashFindItem *pItem;
+	HashFindItem *pEnd;
+	HashFindItem *p;
+	long bucket_index;
+
+	pEnd = items + count;
+	for (pItem=items; pItem<pEnd; pItem++)
+	{
+		pItem->hash_code = pHash->hash_func(pItem->key, \
+					pItem->key_len);
+		pItem->ppBucket = _hash_bucket(pHash, pItem->hash_code);
+	}
+
+	for (pItem=items; pItem<pEnd; pItem++)
+	{
+		if (pItem->ppBucket == NULL)  //found under a lock before
+		{
+			continue;
+		}
+
+		/* find the keys after with the same lock too */
+		bucket_index = pItem->ppBucket - pHash->buckets;
+		HASH_LOCK(pHash, bucket_index)
+		for (p=pItem; p<pEnd; p++)
+		{
+			if (p->ppBucket == NULL || (pHash->lock_count > 0 && \
+				(p->ppBucket - pHash->buckets) % \
+				pHash->lock_count != bucket_index % \
+				pHash->lock_count))
+			{
+				continue;
+			}
+
+			p->hash_data = _chain_find_entry(p->ppBucket, \
+				p->key, p->key_len, p->hash_code);
+			if (p->hash_data != NULL)
+			{
+				__sync_add_and_fetch(&p->hash_data->ref_count, 1);
+			}
+			p->ppBucket = NULL;
+		}
+		HASH_UNLOCK(pHash, bucket_index)
+	}
+}
+
+void hash_release(HashArray *pHash, HashData *hash_data)
+{
+	HASH_DATA_RELEASE(pHash, hash_data)
+}
+
 void *hash_find(HashArray *pHash, const void *key, const int key_len)
 {
 	unsigned int hash_code;
@@ -558,7 +1153,7 @@ void *hash_find(HashArray *pHash, const void *key, const int key_len)
 	HashData *hash_data;
 
 	hash_code = pHash->hash_func(key, key_len);
-	ppBucket = pHash->buckets + (hash_code % (*pHash->capacity));
+	ppBucket = _hash_bucket(pHash, hash_code);
 
 	HASH_LOCK(pHash, ppBucket - pHash->buckets)
 	hash_data = _chain_find_entry(ppBucket, key, key_len, hash_code);
@@ -583,7 +1178,7 @@ int hash_get(HashArray *pHash, const void *key, const int key_len,
 	HashData *hash_data;
 
 	hash_code = pHash->hash_func(key, key_len);
-	ppBucket = pHash->buckets + (hash_code % (*pHash->capacity));
+	ppBucket = _hash_bucket(pHash, hash_code);
 
 	HASH_LOCK(pHash, ppBucket - pHash->buckets)
 	hash_data = _chain_find_entry(ppBucket, key, key_len, hash_code);
@@ -615,37 +1210,36 @@ int hash_insert_ex(HashArray *pHash, const void *key, const int key_len, \
 	HashData **ppBucket;
 	HashData *hash_data;
 	HashData *previous;
+	HashData *new_data;
 	char *pBuff;
 	int bytes;
 	int malloc_value_size;
 
+	HASH_REHASH_STEP(pHash)
 	hash_code = pHash->hash_func(key, key_len);
-	ppBucket = pHash->buckets + (hash_code % (*pHash->capacity));
-
-	previous = NULL;
+	ppBucket = _hash_bucket(pHash, hash_code);
 
 	if (needLock)
 	{
 		HASH_LOCK(pHash, ppBucket - pHash->buckets)
 	}
 
-	hash_data = *ppBucket;
-	while (hash_data != NULL)
+	hash_data = _chain_find_prev(ppBucket, key, key_len, hash_code, \
+			&previous);
+	if (hash_data != NULL) //exists
 	{
-		if (key_len == hash_data->key_len && \
-			memcmp(key, hash_data->key, key_len) == 0)
+		if (pHash->epoch != NULL)
 		{
-			break;
+			/* read without lock, replaced by the new node later */
 		}
-
-		previous = hash_data;
-		hash_data = hash_data->next;
-	}
-
-	if (hash_data != NULL) //exists
-	{
-		if (!pHash->is_malloc_value)
+		else if (hash_data->ref_count > 1)  //referenced, replace it
 		{
+			DELETE_FROM_BUCKET(pHash, ppBucket, previous, hash_data)
+			hash_data = NULL;
+		}
+		else if (!pHash->is_malloc_value)
+		{
+			hash_data->visited = 1;
 			hash_data->value_len = value_len;
 			hash_data->value = (char *)value;
 			if (needLock)
@@ -660,6 +1254,7 @@ int hash_insert_ex(HashArray *pHash, const void *key, const int key_len, \
 				(hash_data->malloc_value_size <= 128 ||
 				 hash_data->malloc_value_size / 2 < value_len))
 			{
+				hash_data->visited = 1;
 				hash_data->value_len = value_len;
 				memcpy(hash_data->value, value, value_len);
 				if (needLock)
@@ -670,6 +1265,7 @@ int hash_insert_ex(HashArray *pHash, const void *key, const int key_len, \
 			}
 
 			DELETE_FROM_BUCKET(pHash, ppBucket, previous, hash_data)
+			hash_data = NULL;
 		}
 	}
 	if (needLock)
@@ -687,51 +1283,88 @@ int hash_insert_ex(HashArray *pHash, const void *key, const int key_len, \
 	}
 
 	bytes = CALC_NODE_MALLOC_BYTES(key_len, malloc_value_size);
-	if (pHash->max_bytes > 0 && pHash->bytes_used+bytes > pHash->max_bytes)
+	if (pHash->slab != NULL)
 	{
-		return -ENOSPC;
-	}
+		/* the slack of the chunk is usable by the value */
+		bytes = fast_slab_alloc_size(pHash->slab, bytes);
+		if (pHash->is_malloc_value)
+		{
+			malloc_value_size = bytes - sizeof(HashData) - key_len;
+		}
 
-	pBuff = (char *)malloc(bytes);
-	if (pBuff == NULL)
+		pBuff = (char *)fast_slab_alloc(pHash->slab, bytes);
+		if (pBuff == NULL)
+		{
+			return errno == ENOSPC ? -ENOSPC : -ENOMEM;
+		}
+	}
+	else
 	{
-		return -ENOMEM;
+		if (pHash->max_bytes > 0 && pHash->bytes_used + bytes > \
+			pHash->max_bytes)
+		{
+			return -ENOSPC;
+		}
+
+		pBuff = (char *)malloc(bytes);
+		if (pBuff == NULL)
+		{
+			return -ENOMEM;
+		}
 	}
 
 	pHash->bytes_used += bytes;
 
-	hash_data = (HashData *)pBuff;
-	hash_data->malloc_value_size = malloc_value_size;
+	new_data = (HashData *)pBuff;
+	new_data->malloc_value_size = malloc_value_size;
+	new_data->ref_count = 1;
+	new_data->visited = 0;  //not visited until found or updated
 
-	hash_data->key_len = key_len;
-	memcpy(hash_data->key, key, key_len);
+	new_data->key_len = key_len;
+	memcpy(new_data->key, key, key_len);
 #ifdef HASH_STORE_HASH_CODE
-	hash_data->hash_code = hash_code;
+	new_data->hash_code = hash_code;
 #endif
-	hash_data->value_len = value_len;
+	new_data->value_len = value_len;
 
 	if (!pHash->is_malloc_value)
 	{
-		hash_data->value = (char *)value;
+		new_data->value = (char *)value;
 	}
 	else
 	{
-		hash_data->value = hash_data->key + hash_data->key_len;
-		memcpy(hash_data->value, value, value_len);
+		new_data->value = new_data->key + new_data->key_len;
+		memcpy(new_data->value, value, value_len);
 	}
 
 	if (needLock)
 	{
 		HASH_LOCK(pHash, ppBucket - pHash->buckets)
-		ADD_TO_BUCKET(pHash, ppBucket, hash_data)
-		HASH_UNLOCK(pHash, ppBucket - pHash->buckets)
+
+		/* the same key may be set by other thread when unlocked */
+		hash_data = _chain_find_prev(ppBucket, key, key_len, \
+				hash_code, &previous);
+	}
+
+	if (hash_data != NULL)
+	{
+		new_data->visited = 1;  //updated
+		REPLACE_IN_BUCKET(pHash, ppBucket, previous, \
+				hash_data, new_data)
 	}
 	else
 	{
-		ADD_TO_BUCKET(pHash, ppBucket, hash_data)
+		ADD_TO_BUCKET(pHash, ppBucket, new_data)
+	}
+	HASH_ACCOUNT(pHash, new_data, 1)
+
+	if (needLock)
+	{
+		HASH_UNLOCK(pHash, ppBucket - pHash->buckets)
 	}
 
-	if (pHash->load_factor >= 0.10 && (double)pHash->item_count /
+	if (pHash->load_factor >= 0.10 && pHash->old_buckets == NULL && \
+		!pHash->rehash_paused && (double)pHash->item_count / \
 		(double)*pHash->capacity >= pHash->load_factor)
 	{
 		_rehash(pHash);
@@ -777,13 +1410,15 @@ int hash_inc_ex(HashArray *pHash, const void *key, const int key_len,
 	HashData **ppBucket;
 	HashData *hash_data;
 
+	HASH_REHASH_STEP(pHash)
 	hash_code = pHash->hash_func(key, key_len);
-	ppBucket = pHash->buckets + (hash_code % (*pHash->capacity));
+	ppBucket = _hash_bucket(pHash, hash_code);
 
 	HASH_LOCK(pHash, ppBucket - pHash->buckets)
 	hash_data = _chain_find_entry(ppBucket, key, key_len, hash_code);
 	convert_func(hash_data, inc, value, value_len, arg);
-	if (hash_data != NULL)
+	if (hash_data != NULL && hash_data->ref_count == 1 && \
+		pHash->epoch == NULL)
 	{
 		if (!pHash->is_malloc_value)
 		{
@@ -827,9 +1462,11 @@ int hash_partial_set(HashArray *pHash, const void *key, const int key_len,
 	HashData **ppBucket;
 	HashData *hash_data;
 	char *pNewBuff;
+	int new_len;
 
+	HASH_REHASH_STEP(pHash)
 	hash_code = pHash->hash_func(key, key_len);
-	ppBucket = pHash->buckets + (hash_code % (*pHash->capacity));
+	ppBucket = _hash_bucket(pHash, hash_code);
 
 	HASH_LOCK(pHash, ppBucket - pHash->buckets)
 	hash_data = _chain_find_entry(ppBucket, key, key_len, hash_code);
@@ -844,12 +1481,22 @@ int hash_partial_set(HashArray *pHash, const void *key, const int key_len,
 			}
 			if (offset + value_len <= hash_data->value_len)
 			{
-				memcpy(hash_data->value+offset, value, value_len);
-				result = 0;
-				break;
+				if (hash_data->ref_count == 1 && \
+					pHash->epoch == NULL)
+				{
+					memcpy(hash_data->value+offset, value,
+						value_len);
+					result = 0;
+					break;
+				}
+				new_len = hash_data->value_len;
+			}
+			else
+			{
+				new_len = offset + value_len;
 			}
 
-			pNewBuff = (char *)malloc(offset + value_len);
+			pNewBuff = (char *)malloc(new_len);
 			if (pNewBuff == NULL)
 			{
 				result = errno != 0 ? errno : ENOMEM;
@@ -861,8 +1508,14 @@ int hash_partial_set(HashArray *pHash, const void *key, const int key_len,
 				memcpy(pNewBuff, hash_data->value, offset);
 			}
 			memcpy(pNewBuff + offset, value, value_len);
+			if (new_len > offset + value_len)
+			{
+				memcpy(pNewBuff + offset + value_len,
+					hash_data->value + offset + value_len,
+					new_len - (offset + value_len));
+			}
 			result = hash_insert_ex(pHash, key, key_len, pNewBuff,
-				offset + value_len, false);
+				new_len, false);
 			free(pNewBuff);
 		}
 		else
@@ -898,8 +1551,9 @@ int hash_delete(HashArray *pHash, const void *key, const int key_len)
 	unsigned int hash_code;
 	int result;
 
+	HASH_REHASH_STEP(pHash)
 	hash_code = pHash->hash_func(key, key_len);
-	ppBucket = pHash->buckets + (hash_code % (*pHash->capacity));
+	ppBucket = _hash_bucket(pHash, hash_code);
 
 	result = ENOENT;
 	previous = NULL;
@@ -907,8 +1561,7 @@ int hash_delete(HashArray *pHash, const void *key, const int key_len)
 	hash_data = *ppBucket;
 	while (hash_data != NULL)
 	{
-		if (key_len == hash_data->key_len && \
-			memcmp(key, hash_data->key, key_len) == 0)
+		if (HASH_KEY_EQUALS(hash_data, key, key_len, hash_code))
 		{
 			DELETE_FROM_BUCKET(pHash, ppBucket, previous, hash_data)
 			result = 0;
@@ -928,28 +1581,221 @@ int hash_walk(HashArray *pHash, HashWalkFunc walkFunc, void *args)
 	HashData **ppBucket;
 	HashData **bucket_end;
 	HashData *hash_data;
+	HashData **ranges[4];
+	int r;
 	int index;
 	int result;
 
 	index = 0;
-	bucket_end = pHash->buckets + (*pHash->capacity);
-	for (ppBucket=pHash->buckets; ppBucket<bucket_end; ppBucket++)
+	HASH_RANGES_INIT(pHash, ranges)
+	for (r=0; r<4 && ranges[r]!=NULL; r+=2)
+	{
+		bucket_end = ranges[r + 1];
+		for (ppBucket=ranges[r]; ppBucket<bucket_end; ppBucket++)
+		{
+			hash_data = *ppBucket;
+			while (hash_data != NULL)
+			{
+				result = walkFunc(index, hash_data, args);
+				if (result != 0)
+				{
+					return result;
+				}
+
+				index++;
+				hash_data = hash_data->next;
+			}
+		}
+	}
+
+	return 0;
+}
+
+int hash_walk_buckets(HashArray *pHash, unsigned int *bucket_index, \
+		const int bucket_count, HashWalkFunc walkFunc, void *args)
+{
+	HashData **ppBucket;
+	HashData *hash_data;
+	unsigned int capacity;
+	unsigned int total_count;
+	unsigned int index;
+	unsigned int end;
+	int result;
+
+	capacity = *pHash->capacity;
+	total_count = capacity;
+	if (pHash->old_buckets != NULL)
+	{
+		total_count += pHash->old_capacity;
+	}
+
+	end = *bucket_index + bucket_count;
+	if (end > total_count)
+	{
+		end = total_count;
+	}
+
+	for (index=*bucket_index; index<end; index++)
+	{
+		if (index < capacity)
+		{
+			ppBucket = pHash->buckets + index;
+		}
+		else if (index - capacity >= pHash->rehash_index)
+		{
+			ppBucket = pHash->old_buckets + (index - capacity);
+		}
+		else
+		{
+			continue;
+		}
+
+		result = 0;
+		HASH_LOCK(pHash, index)
+		hash_data = *ppBucket;
+		while (hash_data != NULL)
+		{
+			if ((result=walkFunc(index, hash_data, args)) != 0)
+			{
+				break;
+			}
+			hash_data = hash_data->next;
+		}
+		HASH_UNLOCK(pHash, index)
+
+		if (result != 0)
+		{
+			*bucket_index = index;
+			return -1 * result;
+		}
+	}
+
+	*bucket_index = end;
+	return end < total_count ? 1 : 0;
+}
+
+#define HASH_EVICT_SIZE_MATCH(pHash, same_class, node_bytes, bytes) \
+	(pHash->slab == NULL || (same_class ? node_bytes == bytes : \
+	 node_bytes > pHash->slab->max_chunk_size))
+
+/* the room is enough for a new node, the slab nodes of the size classes
+   are not checked here */
+static bool _hash_has_room(HashArray *pHash, const int bytes)
+{
+	if (pHash->slab != NULL)
+	{
+		return pHash->slab->max_bytes <= 0 || \
+			pHash->slab->total_bytes + bytes <= \
+			pHash->slab->max_bytes;
+	}
+
+	return pHash->max_bytes <= 0 || \
+		pHash->bytes_used + bytes <= pHash->max_bytes;
+}
+
+int hash_evict(HashArray *pHash, const int key_len, const int value_len, \
+		const int max_buckets, HashEvictFunc filterFunc, void *args, \
+		int64_t *evicted_bytes)
+{
+	HashData **ppBucket;
+	HashData *hash_data;
+	HashData *previous;
+	HashData *pDeleted;
+	unsigned int capacity;
+	unsigned int total_count;
+	unsigned int index;
+	int bytes;
+	int malloc_value_size;
+	int node_bytes;
+	int evicted_count;
+	int i;
+	bool same_class;
+
+	malloc_value_size = pHash->is_malloc_value ? MEM_ALIGN(value_len) : 0;
+	bytes = CALC_NODE_MALLOC_BYTES(key_len, malloc_value_size);
+	same_class = false;
+	if (pHash->slab != NULL)
+	{
+		/* the freed chunk is reused by the same size class only, and
+		   the pages are never freed, so a large block (malloced
+		   directly) replaces the large blocks only */
+		bytes = fast_slab_alloc_size(pHash->slab, bytes);
+		same_class = bytes <= pHash->slab->max_chunk_size;
+	}
+
+	*evicted_bytes = 0;
+	evicted_count = 0;
+
+	/* the hand walks the new buckets then the not migrated old ones */
+	capacity = *pHash->capacity;
+	total_count = capacity;
+	if (pHash->old_buckets != NULL)
+	{
+		total_count += pHash->old_capacity;
+	}
+
+	for (i=0; i<max_buckets; i++)
 	{
+		/* the hand may be moved by other threads with bucket locks */
+		index = pHash->evict_cursor;
+		if (index >= total_count)
+		{
+			index = 0;
+		}
+		pHash->evict_cursor = index + 1;
+
+		if (index < capacity)
+		{
+			ppBucket = pHash->buckets + index;
+		}
+		else if (index - capacity >= pHash->rehash_index)
+		{
+			ppBucket = pHash->old_buckets + (index - capacity);
+		}
+		else
+		{
+			continue;
+		}
+
+		HASH_LOCK(pHash, index)
+		previous = NULL;
 		hash_data = *ppBucket;
 		while (hash_data != NULL)
 		{
-			result = walkFunc(index, hash_data, args);
-			if (result != 0)
+			node_bytes = CALC_NODE_MALLOC_BYTES(hash_data->key_len, \
+					hash_data->malloc_value_size);
+			if (hash_data->visited)
+			{
+				hash_data->visited = 0;
+			}
+			else if (!(hash_data->ref_count > 1 || \
+				!HASH_EVICT_SIZE_MATCH(pHash, same_class, \
+					node_bytes, bytes) || \
+				(filterFunc != NULL && \
+				!filterFunc(hash_data, args))))
 			{
-				return result;
+				pDeleted = hash_data;
+				hash_data = hash_data->next;
+				DELETE_FROM_BUCKET(pHash, ppBucket, previous, \
+						pDeleted)
+
+				evicted_count++;
+				*evicted_bytes += node_bytes;
+				if (same_class || _hash_has_room(pHash, bytes))
+				{
+					HASH_UNLOCK(pHash, index)
+					return evicted_count;
+				}
+				continue;
 			}
 
-			index++;
+			previous = hash_data;
 			hash_data = hash_data->next;
 		}
+		HASH_UNLOCK(pHash, index)
 	}
 
-	return 0;
+	return evicted_count;
 }
 
 int hash_count(HashArray *pHash)
@@ -957,6 +1803,11 @@ int hash_count(HashArray *pHash)
 	return pHash->item_count;
 }
 
+HashData **hash_bucket_of(HashArray *pHash, const unsigned int hash_code)
+{
+	return _hash_bucket(pHash, hash_code);
+}
+
 int hash_bucket_lock(HashArray *pHash, const unsigned int bucket_index)
 {
 	if (pHash->lock_count <= 0)
@@ -1176,6 +2027,161 @@ int Time33Hash_ex(const void *key, const int key_len, \
 	TIME33_HASH_FUNC(init_value)
 }
 
+#define WYHASH_SECRET0  0x2d358dccaa6c78a5ULL
+#define WYHASH_SECRET1  0x8bb84b93962eacc9ULL
+#define WYHASH_SECRET2  0x4b33a62ed433d4a3ULL
+#define WYHASH_SECRET3  0x4d5a2da51de1aa47ULL
+
+/* the 128 bits product of *a and *b, the low 64 bits to *a */
+static inline void _wymum(uint64_t *a, uint64_t *b)
+{
+#ifdef __SIZEOF_INT128__
+	__uint128_t r;
+
+	r = (__uint128_t)(*a) * (*b);
+	*a = (uint64_t)r;
+	*b = (uint64_t)(r >> 64);
+#else
+	uint64_t ha;
+	uint64_t hb;
+	uint64_t la;
+	uint64_t lb;
+	uint64_t rh;
+	uint64_t rm0;
+	uint64_t rm1;
+	uint64_t rl;
+	uint64_t t;
+	uint64_t lo;
+	uint64_t c;
+
+	ha = *a >> 32;
+	hb = *b >> 32;
+	la = (uint32_t)(*a);
+	lb = (uint32_t)(*b);
+	rh = ha * hb;
+	rm0 = ha * lb;
+	rm1 = hb * la;
+	rl = la * lb;
+	t = rl + (rm0 << 32);
+	c = t < rl;
+	lo = t + (rm1 << 32);
+	c += lo < t;
+	*a = lo;
+	*b = rh + (rm0 >> 32) + (rm1 >> 32) + c;
+#endif
+}
+
+static inline uint64_t _wymix(uint64_t a, uint64_t b)
+{
+	_wymum(&a, &b);
+	return a ^ b;
+}
+
+static inline uint64_t _wyr8(const unsigned char *p)
+{
+	uint64_t v;
+	memcpy(&v, p, 8);
+	return v;
+}
+
+static inline uint64_t _wyr4(const unsigned char *p)
+{
+	uint32_t v;
+	memcpy(&v, p, 4);
+	return v;
+}
+
+static inline uint64_t _wyr3(const unsigned char *p, const int k)
+{
+	return (((uint64_t)p[0]) << 16) | (((uint64_t)p[k >> 1]) << 8) | \
+		p[k - 1];
+}
+
+static uint64_t _wyhash(const void *key, const int key_len, uint64_t seed)
+{
+	const unsigned char *p;
+	uint64_t a;
+	uint64_t b;
+	uint64_t see1;
+	uint64_t see2;
+	int i;
+
+	p = (const unsigned char *)key;
+	seed ^= _wymix(seed ^ WYHASH_SECRET0, WYHASH_SECRET1);
+	if (key_len <= 16)
+	{
+		if (key_len >= 4)
+		{
+			a = (_wyr4(p) << 32) | _wyr4(p + ((key_len >> 3) << 2));
+			b = (_wyr4(p + key_len - 4) << 32) | \
+				_wyr4(p + key_len - 4 - ((key_len >> 3) << 2));
+		}
+		else if (key_len > 0)
+		{
+			a = _wyr3(p, key_len);
+			b = 0;
+		}
+		else
+		{
+			a = b = 0;
+		}
+	}
+	else
+	{
+		i = key_len;
+		if (i > 48)
+		{
+			see1 = seed;
+			see2 = seed;
+			do
+			{
+				seed = _wymix(_wyr8(p) ^ WYHASH_SECRET1, \
+					_wyr8(p + 8) ^ seed);
+				see1 = _wymix(_wyr8(p + 16) ^ WYHASH_SECRET2, \
+					_wyr8(p + 24) ^ see1);
+				see2 = _wymix(_wyr8(p + 32) ^ WYHASH_SECRET3, \
+					_wyr8(p + 40) ^ see2);
+				p += 48;
+				i -= 48;
+			} while (i > 48);
+			seed ^= see1 ^ see2;
+		}
+
+		while (i > 16)
+		{
+			seed = _wymix(_wyr8(p) ^ WYHASH_SECRET1, \
+				_wyr8(p + 8) ^ seed);
+			p += 16;
+			i -= 16;
+		}
+
+		a = _wyr8(p + i - 16);
+		b = _wyr8(p + i - 8);
+	}
+
+	a ^= WYHASH_SECRET1;
+	b ^= seed;
+	_wymum(&a, &b);
+	return _wymix(a ^ WYHASH_SECRET0 ^ key_len, b ^ WYHASH_SECRET1);
+}
+
+int WyHash(const void *key, const int key_len)
+{
+	uint64_t h;
+
+	h = _wyhash(key, key_len, 0);
+	return (int)(h ^ (h >> 32));
+}
+
+int WyHash_ex(const void *key, const int key_len, \
+	const int init_value)
+{
+	uint64_t h;
+
+	h = _wyhash(key, key_len, (uint32_t)init_value);
+	return (int)(h ^ (h >> 32));
+}
+
 #define DJB_HASH_FUNC(init_value) \
     unsigned char *pKey; \
     unsigned char *pEnd; \
@@ -12,6 +12,8 @@
 #include <sys/types.h>
 #include <pthread.h>
 #include "common_define.h"
+#include "fast_slab.h"
+#include "fast_epoch.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -22,21 +24,70 @@ extern "C" {
 
 typedef int (*HashFunc) (const void *key, const int key_len);
 
+/* the hash code is kept in the padding of HashData, so the rehash never
+   hashes the keys again and the chain walk skips the key compare of the
+   nodes with another hash code */
+#ifndef HASH_STORE_HASH_CODE
+#define HASH_STORE_HASH_CODE
+#endif
+
 #ifdef HASH_STORE_HASH_CODE
 #define HASH_CODE(pHash, hash_data)   hash_data->hash_code
+#define HASH_KEY_EQUALS(hash_data, pKey, nKeyLen, nHashCode) \
+	(hash_data->hash_code == nHashCode && \
+	 hash_data->key_len == nKeyLen && \
+	 memcmp(pKey, hash_data->key, nKeyLen) == 0)
 #else
 #define HASH_CODE(pHash, hash_data)   ((unsigned int)pHash->hash_func( \
 					hash_data->key, hash_data->key_len))
+#define HASH_KEY_EQUALS(hash_data, pKey, nKeyLen, nHashCode) \
+	(hash_data->key_len == nKeyLen && \
+	 memcmp(pKey, hash_data->key, nKeyLen) == 0)
 #endif
 
 #define CALC_NODE_MALLOC_BYTES(key_len, value_size) \
 		sizeof(HashData) + key_len + value_size
 
+#define HASH_REHASH_STEP_BUCKETS   16  //old buckets migrated per write
+
+#define HASH_SLAB_GROW_FACTOR      1.25
+#define HASH_SLAB_DEFAULT_PAGE_SIZE  (1024 * 1024)
+
+/* release the reference of the node, free it when the last one released,
+   after the readers without lock leave when the epoch set */
+#define HASH_DATA_RELEASE(pHash, hash_data) \
+	if (__sync_sub_and_fetch(&hash_data->ref_count, 1) == 0) \
+	{ \
+		if (pHash->epoch != NULL) \
+		{ \
+			fast_epoch_retire(pHash->epoch, hash_data); \
+		} \
+		else if (pHash->slab != NULL) \
+		{ \
+			fast_slab_free(pHash->slab, hash_data, \
+				CALC_NODE_MALLOC_BYTES(hash_data->key_len, \
+				hash_data->malloc_value_size)); \
+		} \
+		else \
+		{ \
+			free(hash_data); \
+		} \
+	}
+
+/* call the account function when a node linked (sign 1) or
+   unlinked (sign -1) */
+#define HASH_ACCOUNT(pHash, hash_data, sign) \
+	if (pHash->account_func != NULL) \
+	{ \
+		pHash->account_func(hash_data, sign, pHash->account_args); \
+	}
+
 #define FREE_HASH_DATA(pHash, hash_data) \
 	pHash->item_count--; \
 	pHash->bytes_used -= CALC_NODE_MALLOC_BYTES(hash_data->key_len, \
 				hash_data->malloc_value_size); \
-	free(hash_data);
+	HASH_ACCOUNT(pHash, hash_data, -1) \
+	HASH_DATA_RELEASE(pHash, hash_data)
 
 
 typedef struct tagHashData
@@ -44,6 +95,8 @@ typedef struct tagHashData
 	int key_len;
 	int value_len;
 	int malloc_value_size;
+	volatile int ref_count;  //one by the hash table and one per reader
+	volatile char visited;   //the CLOCK reference bit, set when found
 
 #ifdef HASH_STORE_HASH_CODE
 	unsigned int hash_code;
@@ -57,6 +110,28 @@ typedef struct tagHashData
 typedef int64_t (*ConvertValueFunc)(const HashData *old_data, const int inc,
 	char *new_value, int *new_value_len, void *arg);
 
+/**
+ * hash account function, called under the bucket lock
+ * parameters:
+ *         data: the hash data linked or unlinked
+ *         sign: 1 for linked, -1 for unlinked
+ *         args: passed by hash_set_account function
+ * return none
+*/
+typedef void (*HashAccountFunc)(const HashData *data, const int sign, \
+		void *args);
+
+/* the state of the table kept in the shared memory, so the table can be
+   attached by another process which maps the memory at the same address */
+typedef struct tagHashSharedState
+{
+	unsigned int capacity;
+	int item_count;    //saved by hash_destroy
+	int64_t bytes_used;  //saved by hash_destroy
+	HashData **buckets;  //NULL for not inited
+	FastSlabAllocator slab;
+} HashSharedState;
+
 typedef struct tagHashArray
 {
 	HashData **buckets;
@@ -70,8 +145,28 @@ typedef struct tagHashArray
 	bool is_malloc_value;
 	unsigned int lock_count;
 	pthread_mutex_t *locks;
+	FastSlabAllocator *slab;  //the nodes alloced from, NULL for malloc
+	HashData **old_buckets;     //migrating to buckets, NULL for none
+	unsigned int old_capacity;
+	unsigned int rehash_index;  //the old buckets before it are migrated
+	unsigned int evict_cursor;  //the CLOCK hand of hash_evict
+	bool rehash_paused;  //the buckets are not changed by the rehash
+	FastEpochDomain *epoch;  //not NULL for the reads without lock
+	HashAccountFunc account_func;  //NULL for no accounting
+	void *account_args;
+	HashSharedState *shared;  //NULL for the table in the process memory
 } HashArray;
 
+/* a key of hash_find_ref_batch */
+typedef struct tagHashFindItem
+{
+	const void *key;
+	int key_len;
+	HashData *hash_data;  //the hash data found, NULL for not exist
+	unsigned int hash_code;  //internal use
+	HashData **ppBucket;     //internal use, NULL when found
+} HashFindItem;
+
 typedef struct tagHashStat
 {
 	unsigned int capacity;
@@ -91,6 +186,15 @@ typedef struct tagHashStat
 */
 typedef int (*HashWalkFunc)(const int index, const HashData *data, void *args);
 
+/**
+ * hash evict filter function
+ * parameters:
+ *         data: the hash data to evict
+ *         args: passed by hash_evict function
+ * return true for evict the hash data, false for keep it
+*/
+typedef bool (*HashEvictFunc)(const HashData *data, void *args);
+
 #define hash_init(pHash, hash_func, capacity, load_factor) \
 	hash_init_ex(pHash, hash_func, capacity, load_factor, 0, false)
 
@@ -120,6 +224,102 @@ int hash_init_ex(HashArray *pHash, HashFunc hash_func, \
 */
 int hash_set_locks(HashArray *pHash, const int lock_count);
 
+/**
+ * migrate the buckets of the incremental rehash, the write operations
+ * migrate HASH_REHASH_STEP_BUCKETS buckets each, this function is for
+ * the background migration. the caller must exclude the other operations
+ * parameters:
+ *         pHash: the hash table
+ *         bucket_count: the max non-empty buckets to migrate
+ * return 1 for more buckets to migrate, 0 for rehash done
+*/
+int hash_rehash_step(HashArray *pHash, const int bucket_count);
+
+#define hash_is_rehashing(pHash)  ((pHash)->old_buckets != NULL)
+
+/**
+ * pause or resume the rehash, the rehash is not started and the old
+ * buckets are not migrated when paused, so the key stays in its bucket.
+ * the caller must exclude the other operations
+ * parameters:
+ *         pHash: the hash table
+ *         paused: true for pause, false for resume
+ * return none
+*/
+void hash_pause_rehash(HashArray *pHash, const bool paused);
+
+/**
+ * alloc the nodes from the size classes of a slab allocator instead of
+ * malloc, must be called before any insert
+ * parameters:
+ *         page_size: the page size of the slab allocator
+ * return 0 for success, != 0 for error
+*/
+int hash_set_slab(HashArray *pHash, const int page_size);
+
+/**
+ * read the table without lock by hash_find_lockfree and
+ * hash_find_ref_lockfree,
+ * the nodes unlinked are freed by the epoch based reclamation and the
+ * values are never changed in place (copy on write). the table must not
+ * be rehashed, so the load factor must be less than 0.10
+ * parameters:
+ *         pHash: the hash table
+ * return 0 for success, != 0 for error
+*/
+int hash_set_epoch(HashArray *pHash);
+
+/**
+ * free the nodes unlinked by the caller thread which no reader can reach,
+ * such as after the eviction when the memory is full
+ * parameters:
+ *         pHash: the hash table
+ *         wait: wait the readers without lock leave
+ * return the freed count
+*/
+int hash_reclaim(HashArray *pHash, const bool wait);
+
+/**
+ * keep the buckets and the nodes in the memory of the allocator, such as
+ * a shared memory segment mapped at the same address by every process.
+ * the state is inited when its buckets is NULL, otherwise the table is
+ * attached with the nodes of the state. hash_destroy saves the state and
+ * keeps the nodes. the table must not be rehashed, so the load factor
+ * must be less than 0.10
+ * parameters:
+ *         pHash: the hash table inited by hash_init_ex, empty
+ *         state: the state in the memory of the allocator
+ *         page_size: the slab page size, as hash_set_slab
+ *         alloc_func: alloc the buckets, the slab pages and the large nodes
+ *         free_func: free the large nodes
+ *         args: the args of alloc_func and free_func
+ * return 0 for success, != 0 for error
+*/
+int hash_set_shared(HashArray *pHash, HashSharedState *state, \
+		const int page_size, FastSlabAllocFunc alloc_func, \
+		FastSlabFreeFunc free_func, void *args);
+
+/**
+ * set the function to account the nodes, such as by the key prefix.
+ * the nodes linked before are accounted when set
+ * parameters:
+ *         pHash: the hash table
+ *         account_func: the account function, NULL for no accounting
+ *         args: the args of account_func
+ * return none
+*/
+void hash_set_account(HashArray *pHash, HashAccountFunc account_func, \
+		void *args);
+
+/**
+ * the memory used by the hash table, including the buckets, the slab pages
+ * when the slab allocator used
+ * parameters:
+ *         pHash: the hash table
+ * return the bytes used
+*/
+int64_t hash_bytes_used(HashArray *pHash);
+
 /**
  * convert the value
  * parameters:
@@ -198,6 +398,65 @@ void *hash_find(HashArray *pHash, const void *key, const int key_len);
 */
 HashData *hash_find_ex(HashArray *pHash, const void *key, const int key_len);
 
+/**
+ * hash find key and hold a reference of the hash data, the value of
+ * the referenced hash data will not be changed or freed until released.
+ * the hash data should be released by hash_release
+ * parameters:
+ *         pHash: the hash table
+ *         key: the key to find
+ *         key_len: length of th key 
+ * return hash data, return NULL when the key not exist
+*/
+HashData *hash_find_ref(HashArray *pHash, const void *key, const int key_len);
+
+/**
+ * hash find key without lock, the caller must enter the epoch of the table
+ * by fast_epoch_enter, and the hash data must not be used after leaving
+ * parameters:
+ *         pHash: the hash table, the epoch set by hash_set_epoch
+ *         key: the key to find
+ *         key_len: length of th key 
+ * return hash data, return NULL when the key not exist
+*/
+HashData *hash_find_lockfree(HashArray *pHash, const void *key, \
+		const int key_len);
+
+/**
+ * hash find key without lock and hold a reference of the hash data as
+ * hash_find_ref, the caller must enter the epoch of the table by
+ * fast_epoch_enter, the referenced hash data can be used after leaving
+ * parameters:
+ *         pHash: the hash table, the epoch set by hash_set_epoch
+ *         key: the key to find
+ *         key_len: length of th key 
+ * return hash data, return NULL when the key not exist
+*/
+HashData *hash_find_ref_lockfree(HashArray *pHash, const void *key, \
+		const int key_len);
+
+/**
+ * hash find the keys and hold the references of the hash data as
+ * hash_find_ref, the keys of the buckets with the same lock are found
+ * under one lock
+ * parameters:
+ *         pHash: the hash table
+ *         items: the keys to find, the hash data found are returned
+ *         count: the key count
+ * return none
+*/
+void hash_find_ref_batch(HashArray *pHash, HashFindItem *items, \
+		const int count);
+
+/**
+ * release the reference of the hash data returned by hash_find_ref
+ * parameters:
+ *         pHash: the hash table
+ *         hash_data: the hash data to release
+ * return none
+*/
+void hash_release(HashArray *pHash, HashData *hash_data);
+
 
 /**
  * hash get the value of the key
@@ -248,6 +507,22 @@ int hash_delete(HashArray *pHash, const void *key, const int key_len);
 */
 int hash_walk(HashArray *pHash, HashWalkFunc walkFunc, void *args);
 
+/**
+ * walk a batch of the buckets, the new buckets then the old buckets not
+ * migrated. the bucket is locked when walking it. the rehash should be
+ * paused between the batches, or the migrated keys may be missed
+ * parameters:
+ *         pHash: the hash table
+ *         bucket_index: the bucket index to start, return the next one
+ *         bucket_count: the max buckets to walk
+ *         walkFunc: walk (interator) function, index is the bucket index
+ *         args: extra args which will be passed to walkFunc
+ * return 1 for more buckets to walk, 0 for done, < 0 for the error of
+ *        walkFunc (negative errno)
+*/
+int hash_walk_buckets(HashArray *pHash, unsigned int *bucket_index, \
+		const int bucket_count, HashWalkFunc walkFunc, void *args);
+
 /**
  * get hash item count
  * parameters:
@@ -288,6 +563,40 @@ int hash_stat(HashArray *pHash, HashStat *pStat, \
 */
 void hash_stat_print(HashArray *pHash);
 
+/**
+ * get the bucket of the hash code, the old bucket when it is not migrated
+ * by the incremental rehash yet. the caller must lock the bucket (by the
+ * index to buckets) or exclude the other operations
+ * parameters:
+ *         pHash: the hash table
+ *         hash_code: the hash code of the key
+ * return the bucket
+*/
+HashData **hash_bucket_of(HashArray *pHash, const unsigned int hash_code);
+
+/**
+ * evict the hash data not visited recently to make room for a new node
+ * by the CLOCK algorithm: the hand walks the buckets, clears the visited
+ * bit of the hash data and evicts the ones not visited since the last
+ * pass. with the slab, the evicted node must be the same size class as
+ * the new node unless the new node is malloced directly. the referenced
+ * hash data are skipped. the caller must exclude the other operations
+ * when the table has no bucket locks
+ * parameters:
+ *         pHash: the hash table
+ *         key_len: the key length of the new node
+ *         value_len: the value length of the new node
+ *         max_buckets: the max buckets to walk
+ *         filterFunc: called before evicting a hash data, NULL for evict
+ *                     all hash data
+ *         args: passed to filterFunc
+ *         evicted_bytes: return the bytes of the evicted nodes
+ * return the evicted count, 0 for nothing evicted
+*/
+int hash_evict(HashArray *pHash, const int key_len, const int value_len, \
+		const int max_buckets, HashEvictFunc filterFunc, void *args, \
+		int64_t *evicted_bytes);
+
 /**
  * lock the bucket of hash table
  * parameters:
@@ -332,6 +641,12 @@ int Time33Hash(const void *key, const int key_len);
 int Time33Hash_ex(const void *key, const int key_len, \
 	const int init_value);
 
+/* wyhash (final version 4) folded to 32 bits, 8 bytes per round,
+   much faster than the byte by byte functions for the long keys */
+int WyHash(const void *key, const int key_len);
+int WyHash_ex(const void *key, const int key_len, \
+	const int init_value);
+
 int DJBHash(const void *key, const int key_len);
 int DJBHash_ex(const void *key, const int key_len, \
 	const int init_value);
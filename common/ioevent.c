@@ -5,6 +5,221 @@
 #include <errno.h>
 #include "ioevent.h"
 
+#if IOEVENT_USE_IOURING
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#define IOEVENT_URING_SQ_ENTRIES  1024
+
+static int uring_enter(IOEventPoller *ioevent, const unsigned min_complete,
+    const unsigned flags, void *arg, const size_t arg_size)
+{
+  int ret;
+
+  ret = syscall(__NR_io_uring_enter, ioevent->poll_fd,
+      ioevent->submit_count, min_complete, flags, arg, arg_size);
+  if (ret > 0) {
+    ioevent->submit_count -= ret;
+  }
+  return ret;
+}
+
+#define uring_submit(ioevent) uring_enter(ioevent, 0, 0, NULL, 0)
+
+static int uring_setup(IOEventPoller *ioevent)
+{
+  struct io_uring_params params;
+  struct ioevent_uring_sq *sq;
+  struct ioevent_uring_cq *cq;
+  unsigned *array;
+  unsigned i;
+
+  sq = &ioevent->sq;
+  cq = &ioevent->cq;
+  memset(sq, 0, sizeof(*sq));
+  memset(cq, 0, sizeof(*cq));
+  memset(&params, 0, sizeof(params));
+  params.flags = IORING_SETUP_CQSIZE | IORING_SETUP_CLAMP;
+  params.cq_entries = 2 * ioevent->size;
+  ioevent->poll_fd = syscall(__NR_io_uring_setup,
+      IOEVENT_URING_SQ_ENTRIES, &params);
+  if (ioevent->poll_fd < 0) {
+    return errno != 0 ? errno : ENOSYS;
+  }
+
+  /* the timeout of ioevent_poll is passed by IORING_ENTER_EXT_ARG */
+  if ((params.features & IORING_FEAT_EXT_ARG) == 0) {
+    return EOPNOTSUPP;
+  }
+
+  sq->ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+  sq->ring_ptr = mmap(NULL, sq->ring_size, PROT_READ | PROT_WRITE,
+      MAP_SHARED | MAP_POPULATE, ioevent->poll_fd, IORING_OFF_SQ_RING);
+  if (sq->ring_ptr == MAP_FAILED) {
+    sq->ring_ptr = NULL;
+    return errno != 0 ? errno : ENOMEM;
+  }
+
+  cq->ring_size = params.cq_off.cqes +
+    params.cq_entries * sizeof(struct io_uring_cqe);
+  cq->ring_ptr = mmap(NULL, cq->ring_size, PROT_READ | PROT_WRITE,
+      MAP_SHARED | MAP_POPULATE, ioevent->poll_fd, IORING_OFF_CQ_RING);
+  if (cq->ring_ptr == MAP_FAILED) {
+    cq->ring_ptr = NULL;
+    return errno != 0 ? errno : ENOMEM;
+  }
+
+  sq->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+  sq->sqes = (struct io_uring_sqe *)mmap(NULL, sq->sqes_size,
+      PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+      ioevent->poll_fd, IORING_OFF_SQES);
+  if (sq->sqes == MAP_FAILED) {
+    sq->sqes = NULL;
+    return errno != 0 ? errno : ENOMEM;
+  }
+
+  sq->head = (unsigned *)((char *)sq->ring_ptr + params.sq_off.head);
+  sq->tail = (unsigned *)((char *)sq->ring_ptr + params.sq_off.tail);
+  sq->ring_mask = (unsigned *)((char *)sq->ring_ptr +
+      params.sq_off.ring_mask);
+  sq->ring_entries = (unsigned *)((char *)sq->ring_ptr +
+      params.sq_off.ring_entries);
+  sq->sqe_tail = *sq->tail;
+
+  /* the sqes are used in ring order */
+  array = (unsigned *)((char *)sq->ring_ptr + params.sq_off.array);
+  for (i=0; i<params.sq_entries; i++) {
+    array[i] = i;
+  }
+
+  cq->head = (unsigned *)((char *)cq->ring_ptr + params.cq_off.head);
+  cq->tail = (unsigned *)((char *)cq->ring_ptr + params.cq_off.tail);
+  cq->ring_mask = (unsigned *)((char *)cq->ring_ptr +
+      params.cq_off.ring_mask);
+  cq->cqes = (struct io_uring_cqe *)((char *)cq->ring_ptr +
+      params.cq_off.cqes);
+  return 0;
+}
+
+static struct io_uring_sqe *uring_get_sqe(IOEventPoller *ioevent)
+{
+  struct ioevent_uring_sq *sq;
+  struct io_uring_sqe *sqe;
+
+  sq = &ioevent->sq;
+  if (sq->sqe_tail - __atomic_load_n(sq->head, __ATOMIC_ACQUIRE) >=
+      *sq->ring_entries) {
+    if (uring_submit(ioevent) < 0) {
+      return NULL;
+    }
+    if (sq->sqe_tail - __atomic_load_n(sq->head, __ATOMIC_ACQUIRE) >=
+        *sq->ring_entries) {
+      errno = EBUSY;
+      return NULL;
+    }
+  }
+
+  sqe = sq->sqes + (sq->sqe_tail & *sq->ring_mask);
+  memset(sqe, 0, sizeof(*sqe));
+  return sqe;
+}
+
+/* the sqe is submitted with the next io_uring_enter */
+static void uring_commit_sqe(IOEventPoller *ioevent)
+{
+  ioevent->sq.sqe_tail++;
+  __atomic_store_n(ioevent->sq.tail, ioevent->sq.sqe_tail, __ATOMIC_RELEASE);
+  ioevent->submit_count++;
+}
+
+/* the user_data of the poll: the generation and the fd, never 0 */
+#define URING_POLL_USER_DATA(fd, gen) \
+  ((((__u64)(gen)) << 32) | (unsigned int)(fd))
+#define URING_POLL_FD(user_data)   ((int)(unsigned int)(user_data))
+#define URING_POLL_GEN(user_data)  ((unsigned int)((user_data) >> 32))
+
+static int uring_set_fd(IOEventPoller *ioevent, const int fd,
+    const int e, void *data)
+{
+  struct ioevent_uring_fd *new_fds;
+  struct ioevent_uring_fd *entry;
+  int new_capacity;
+
+  if (fd >= ioevent->fd_capacity) {
+    new_capacity = ioevent->fd_capacity > 0 ?
+      ioevent->fd_capacity : ioevent->size;
+    while (new_capacity <= fd) {
+      new_capacity *= 2;
+    }
+
+    new_fds = (struct ioevent_uring_fd *)realloc(ioevent->fds,
+        sizeof(struct ioevent_uring_fd) * new_capacity);
+    if (new_fds == NULL) {
+      return -1;
+    }
+    memset(new_fds + ioevent->fd_capacity, 0,
+        sizeof(struct ioevent_uring_fd) *
+        (new_capacity - ioevent->fd_capacity));
+    ioevent->fds = new_fds;
+    ioevent->fd_capacity = new_capacity;
+  }
+
+  entry = ioevent->fds + fd;
+  entry->data = data;
+  entry->events = e;
+  if (++entry->gen == 0) {
+    entry->gen = 1;
+  }
+  return 0;
+}
+
+/* multishot poll with the events registered, the handlers should read
+ * or write until EAGAIN or call ioevent_modify which polls the fd again */
+static int uring_poll_add(IOEventPoller *ioevent, const int fd)
+{
+  struct io_uring_sqe *sqe;
+
+  if ((sqe=uring_get_sqe(ioevent)) == NULL) {
+    return -1;
+  }
+  sqe->opcode = IORING_OP_POLL_ADD;
+  sqe->fd = fd;
+  sqe->poll32_events = ioevent->fds[fd].events | ioevent->extra_events;
+  sqe->len = IORING_POLL_ADD_MULTI;
+  sqe->user_data = URING_POLL_USER_DATA(fd, ioevent->fds[fd].gen);
+  uring_commit_sqe(ioevent);
+  return 0;
+}
+
+static int uring_poll_cancel(IOEventPoller *ioevent, const int fd)
+{
+  struct io_uring_sqe *sqe;
+
+  if ((sqe=uring_get_sqe(ioevent)) == NULL) {
+    return -1;
+  }
+  sqe->opcode = IORING_OP_ASYNC_CANCEL;
+  sqe->fd = fd;
+  sqe->cancel_flags = IORING_ASYNC_CANCEL_FD | IORING_ASYNC_CANCEL_ALL;
+  uring_commit_sqe(ioevent);
+  return 0;
+}
+
+/* the events polled of the detached fd which not dealt yet are dropped,
+ * the events in the ring are skipped by the generation */
+static void uring_drop_events(IOEventPoller *ioevent, void *data)
+{
+  int i;
+
+  for (i=0; i<ioevent->count; i++) {
+    if (ioevent->events[i].user_data == (unsigned long)data) {
+      ioevent->events[i].user_data = 0;
+    }
+  }
+}
+#endif
+
 #if IOEVENT_USE_KQUEUE
 /* we define these here as numbers, because for kqueue mapping them to a combination of
      * filters / flags is hard to do. */
@@ -54,6 +269,25 @@ int ioevent_init(IOEventPoller *ioevent, const int size,
   ioevent->poll_fd = port_create();
   bytes = sizeof(port_event_t) * size;
   ioevent->events = (port_event_t *)malloc(bytes);
+#elif IOEVENT_USE_IOURING
+  {
+    int result;
+
+    ioevent->timeout.tv_sec = timeout / 1000;
+    ioevent->timeout.tv_nsec = 1000000 * (timeout % 1000);
+    ioevent->count = 0;
+    ioevent->submit_count = 0;
+    ioevent->fd_capacity = 0;
+    ioevent->fds = NULL;
+    ioevent->events = NULL;
+    if ((result=uring_setup(ioevent)) != 0) {
+      ioevent_destroy(ioevent);
+      errno = result;
+      return result;
+    }
+  }
+  bytes = sizeof(struct io_uring_cqe) * size;
+  ioevent->events = (struct io_uring_cqe *)malloc(bytes);
 #endif
   if (ioevent->events == NULL) {
     return errno != 0 ? errno : ENOMEM;
@@ -68,6 +302,26 @@ void ioevent_destroy(IOEventPoller *ioevent)
     ioevent->events = NULL;
   }
 
+#if IOEVENT_USE_IOURING
+  if (ioevent->sq.sqes != NULL) {
+    munmap(ioevent->sq.sqes, ioevent->sq.sqes_size);
+    ioevent->sq.sqes = NULL;
+  }
+  if (ioevent->sq.ring_ptr != NULL) {
+    munmap(ioevent->sq.ring_ptr, ioevent->sq.ring_size);
+    ioevent->sq.ring_ptr = NULL;
+  }
+  if (ioevent->cq.ring_ptr != NULL) {
+    munmap(ioevent->cq.ring_ptr, ioevent->cq.ring_size);
+    ioevent->cq.ring_ptr = NULL;
+  }
+  if (ioevent->fds != NULL) {
+    free(ioevent->fds);
+    ioevent->fds = NULL;
+    ioevent->fd_capacity = 0;
+  }
+#endif
+
   if (ioevent->poll_fd >=0) {
     close(ioevent->poll_fd);
     ioevent->poll_fd = -1;
@@ -95,6 +349,11 @@ int ioevent_attach(IOEventPoller *ioevent, const int fd, const int e,
   return kevent(ioevent->poll_fd, ev, n, NULL, 0, NULL);
 #elif IOEVENT_USE_PORT
   return port_associate(ioevent->poll_fd, PORT_SOURCE_FD, fd, e, data);
+#elif IOEVENT_USE_IOURING
+  if (uring_set_fd(ioevent, fd, e, data) != 0) {
+    return -1;
+  }
+  return uring_poll_add(ioevent, fd);
 #endif
 }
 
@@ -126,6 +385,29 @@ int ioevent_modify(IOEventPoller *ioevent, const int fd, const int e,
   return kevent(ioevent->poll_fd, ev, n, NULL, 0, NULL);
 #elif IOEVENT_USE_PORT
   return port_associate(ioevent->poll_fd, PORT_SOURCE_FD, fd, e, data);
+#elif IOEVENT_USE_IOURING
+  void *old_data;
+
+  old_data = fd < ioevent->fd_capacity ? ioevent->fds[fd].data : NULL;
+  if (old_data == NULL) {
+    errno = ENOENT;
+    return -1;
+  }
+
+  /* the poll update fails with EALREADY when the poll is triggering,
+   * so cancel the old poll and poll the fd again with the new events,
+   * the events of the old poll are skipped by the new generation */
+  if (uring_poll_cancel(ioevent, fd) != 0) {
+    return -1;
+  }
+  if (uring_set_fd(ioevent, fd, e, data) != 0) {
+    return -1;
+  }
+  if (old_data != data) {
+    uring_drop_events(ioevent, old_data);
+  }
+
+  return uring_poll_add(ioevent, fd);
 #endif
 }
 
@@ -133,9 +415,39 @@ int ioevent_detach(IOEventPoller *ioevent, const int fd)
 {
 #if IOEVENT_USE_EPOLL
   return epoll_ctl(ioevent->poll_fd, EPOLL_CTL_DEL, fd, NULL);
+#elif IOEVENT_USE_KQUEUE
+  struct kevent ev;
+  int r;
+  int w;
+  EV_SET(&ev, fd, EVFILT_READ, EV_DELETE, 0, 0, NULL);
+  r = kevent(ioevent->poll_fd, &ev, 1, NULL, 0, NULL);
+  EV_SET(&ev, fd, EVFILT_WRITE, EV_DELETE, 0, 0, NULL);
+  w = kevent(ioevent->poll_fd, &ev, 1, NULL, 0, NULL);
+  return (r == 0 || w == 0) ? 0 : -1;
 #elif IOEVENT_USE_PORT
   return port_dissociate(ioevent->poll_fd, PORT_SOURCE_FD, fd);
-#else
+#elif IOEVENT_USE_IOURING
+  void *data;
+
+  data = fd < ioevent->fd_capacity ? ioevent->fds[fd].data : NULL;
+  if (data == NULL) {
+    errno = ENOENT;
+    return -1;
+  }
+  ioevent->fds[fd].data = NULL;
+  if (++ioevent->fds[fd].gen == 0) {
+    ioevent->fds[fd].gen = 1;
+  }
+
+  if (uring_poll_cancel(ioevent, fd) != 0) {
+    return -1;
+  }
+
+  /* submit at once, the poll holds the file until canceled */
+  if (uring_submit(ioevent) < 0) {
+    return -1;
+  }
+  uring_drop_events(ioevent, data);
   return 0;
 #endif
 }
@@ -172,6 +484,66 @@ int ioevent_poll(IOEventPoller *ioevent)
     }
   }
   return result;
+#elif IOEVENT_USE_IOURING
+  struct ioevent_uring_cq *cq;
+  struct io_uring_cqe *cqe;
+  struct io_uring_getevents_arg arg;
+  unsigned head;
+  unsigned tail;
+  int count;
+  int fd;
+
+  cq = &ioevent->cq;
+  head = *cq->head;
+  if (head == __atomic_load_n(cq->tail, __ATOMIC_ACQUIRE)) {
+    /* submit the queued sqes and wait in one syscall */
+    memset(&arg, 0, sizeof(arg));
+    arg.sigmask_sz = _NSIG / 8;
+    arg.ts = (unsigned long)&ioevent->timeout;
+    if (uring_enter(ioevent, 1, IORING_ENTER_GETEVENTS |
+          IORING_ENTER_EXT_ARG, &arg, sizeof(arg)) < 0 &&
+        errno != ETIME) {
+      ioevent->count = 0;
+      return -1;
+    }
+  }
+  else if (ioevent->submit_count > 0) {
+    uring_submit(ioevent);
+  }
+
+  count = 0;
+  tail = __atomic_load_n(cq->tail, __ATOMIC_ACQUIRE);
+  while (head != tail && count < ioevent->size) {
+    cqe = cq->cqes + (head & *cq->ring_mask);
+    head++;
+
+    /* the result of cancel, or the poll canceled */
+    if (cqe->user_data == 0 || cqe->res < 0) {
+      continue;
+    }
+
+    /* the poll of the fd detached or modified */
+    fd = URING_POLL_FD(cqe->user_data);
+    if (fd >= ioevent->fd_capacity || ioevent->fds[fd].data == NULL ||
+        ioevent->fds[fd].gen != URING_POLL_GEN(cqe->user_data)) {
+      continue;
+    }
+
+    /* the multishot poll terminated, poll again with the events
+     * registered */
+    if ((cqe->flags & IORING_CQE_F_MORE) == 0) {
+      uring_poll_add(ioevent, fd);
+    }
+
+    ioevent->events[count] = *cqe;
+    ioevent->events[count].user_data = (unsigned long)
+      ioevent->fds[fd].data;
+    count++;
+  }
+  __atomic_store_n(cq->head, head, __ATOMIC_RELEASE);
+
+  ioevent->count = count;
+  return count;
 #else
 #error port me
 #endif
@@ -45,6 +45,43 @@ int kqueue_ev_convert(int16_t event, uint16_t flags);
 #define IOEVENT_READ  POLLIN
 #define IOEVENT_WRITE POLLOUT
 #define IOEVENT_ERROR (POLLERR | POLLPRI | POLLHUP)
+
+#elif IOEVENT_USE_IOURING
+#include <linux/io_uring.h>
+#define IOEVENT_EDGE_TRIGGER 0
+
+#define IOEVENT_READ  POLLIN
+#define IOEVENT_WRITE POLLOUT
+#define IOEVENT_ERROR (POLLERR | POLLPRI | POLLHUP)
+
+struct ioevent_uring_sq {
+    unsigned *head;
+    unsigned *tail;
+    unsigned *ring_mask;
+    unsigned *ring_entries;
+    unsigned sqe_tail;  //local tail, published when submit
+    struct io_uring_sqe *sqes;
+    void *ring_ptr;
+    size_t ring_size;
+    size_t sqes_size;
+};
+
+/* the fd registered, the poll of the fd is tagged by the generation
+ * which changes on each attach, modify and detach */
+struct ioevent_uring_fd {
+    void *data;
+    int events;        //the events registered
+    unsigned int gen;
+};
+
+struct ioevent_uring_cq {
+    unsigned *head;
+    unsigned *tail;
+    unsigned *ring_mask;
+    struct io_uring_cqe *cqes;
+    void *ring_ptr;
+    size_t ring_size;
+};
 #endif
 
 typedef struct ioevent_puller {
@@ -61,6 +98,15 @@ typedef struct ioevent_puller {
 #elif IOEVENT_USE_PORT
     port_event_t *events;
     timespec_t timeout;
+#elif IOEVENT_USE_IOURING
+    struct io_uring_cqe *events;
+    struct __kernel_timespec timeout;
+    int count;        //events count of the last poll
+    int submit_count; //sqes queued but not submitted
+    int fd_capacity;  //the size of fds
+    struct ioevent_uring_fd *fds;  //indexed by fd
+    struct ioevent_uring_sq sq;
+    struct ioevent_uring_cq cq;
 #endif
 } IOEventPoller;
 
@@ -73,6 +119,9 @@ typedef struct ioevent_puller {
 #elif IOEVENT_USE_PORT
   #define IOEVENT_GET_EVENTS(ioevent, index) \
       ioevent->events[index].portev_events
+#elif IOEVENT_USE_IOURING
+  #define IOEVENT_GET_EVENTS(ioevent, index) \
+      ioevent->events[index].res
 #else
 #error port me
 #endif
@@ -86,6 +135,9 @@ typedef struct ioevent_puller {
 #elif IOEVENT_USE_PORT
   #define IOEVENT_GET_DATA(ioevent, index)  \
       ioevent->events[index].portev_user
+#elif IOEVENT_USE_IOURING
+  #define IOEVENT_GET_DATA(ioevent, index)  \
+      ((void *)(long)ioevent->events[index].user_data)
 #else
 #error port me
 #endif
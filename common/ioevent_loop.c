@@ -11,6 +11,10 @@ static void deal_ioevents(IOEventPoller *ioevent, const int count)
 	{
 		event = IOEVENT_GET_EVENTS(ioevent, i);
 		pEntry = (IOEventEntry *)IOEVENT_GET_DATA(ioevent, i);
+		if (pEntry == NULL)  //dropped by ioevent_detach
+		{
+			continue;
+		}
 
 		pEntry->callback(pEntry->fd, event, pEntry->timer.data);
 	}
@@ -51,6 +55,7 @@ int ioevent_loop(struct nio_thread_data *pThreadData,
 	memset(&ev_notify, 0, sizeof(ev_notify));
 	ev_notify.fd = pThreadData->pipe_fds[0];
 	ev_notify.callback = recv_notify_callback;
+	ev_notify.timer.data = pThreadData;
 	if (ioevent_attach(&pThreadData->ev_puller,
 		pThreadData->pipe_fds[0], IOEVENT_READ,
 		&ev_notify) != 0)
@@ -134,6 +139,7 @@ int ioevent_set(struct fast_task_info *pTask, struct nio_thread_data *pThread,
 	}
 
 	pTask->event.timer.data = pTask;
+	pTask->last_active = g_current_time;
 	pTask->event.timer.expires = g_current_time + timeout;
 	result = fast_timer_add(&pThread->timer, &pTask->event.timer);
 	if (result != 0)
@@ -0,0 +1,352 @@
+/**
+* Copyright (C) 2008 Happy Fish / YuQing
+*
+* FastDFS may be copied only under the terms of the GNU General
+* Public License V3, which may be found in the FastDFS source kit.
+* Please visit the FastDFS Home Page http://www.csource.org/ for more detail.
+**/
+
+//shm_arena.c
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/file.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include "shm_arena.h"
+#include "logger.h"
+#include "shared_func.h"
+#include "pthread_func.h"
+
+#define SHM_ARENA_HEADER_SIZE  ((sizeof(ShmArenaHeader) + \
+		SHM_ARENA_ALIGN_SIZE - 1) & (~(SHM_ARENA_ALIGN_SIZE - 1)))
+
+#define SHM_ARENA_BLOCK_INDEX(units) \
+	((units) <= SHM_ARENA_BLOCK_CLASSES - 1 ? (units) - 1 : \
+	 SHM_ARENA_BLOCK_CLASSES - 1)
+
+static int shm_arena_map(ShmArena *arena)
+{
+	void *addr;
+
+	/* the address is a hint, the mapped one is checked */
+	addr = mmap(arena->base, arena->size, PROT_READ | PROT_WRITE, \
+			MAP_SHARED, arena->fd, 0);
+	if (addr == MAP_FAILED)
+	{
+		logError("file: "__FILE__", line: %d, " \
+			"mmap file \"%s\" fail, size: "INT64_PRINTF_FORMAT", " \
+			"errno: %d, error info: %s", __LINE__, \
+			arena->filename, arena->size, errno, STRERROR(errno));
+		return errno != 0 ? errno : ENOMEM;
+	}
+
+	if (addr != arena->base)
+	{
+		munmap(addr, arena->size);
+		logError("file: "__FILE__", line: %d, " \
+			"mmap file \"%s\" fail, the address %p is in use", \
+			__LINE__, arena->filename, arena->base);
+		return EADDRINUSE;
+	}
+
+	arena->header = (ShmArenaHeader *)addr;
+	return 0;
+}
+
+/* truncate the file and reserve the memory, so the writes never get
+   SIGBUS when the file system is full */
+static int shm_arena_create(ShmArena *arena)
+{
+	int result;
+
+	if (ftruncate(arena->fd, 0) != 0 || \
+		ftruncate(arena->fd, arena->size) != 0)
+	{
+		logError("file: "__FILE__", line: %d, " \
+			"truncate file \"%s\" fail, errno: %d, error info: %s",\
+			__LINE__, arena->filename, errno, STRERROR(errno));
+		return errno != 0 ? errno : EIO;
+	}
+
+	result = posix_fallocate(arena->fd, 0, arena->size);
+	if (result != 0 && result != EOPNOTSUPP && result != EINVAL)
+	{
+		logError("file: "__FILE__", line: %d, " \
+			"reserve "INT64_PRINTF_FORMAT" bytes of file \"%s\" " \
+			"fail, errno: %d, error info: %s", __LINE__, \
+			arena->size, arena->filename, result, STRERROR(result));
+		return result;
+	}
+
+	if ((result=shm_arena_map(arena)) != 0)
+	{
+		return result;
+	}
+
+	shm_arena_reset(arena);
+	return 0;
+}
+
+int shm_arena_open(ShmArena *arena, const char *filename, void *base, \
+		const int64_t size, bool *attached)
+{
+	struct stat file_stat;
+	ShmArenaHeader *header;
+	int result;
+
+	memset(arena, 0, sizeof(ShmArena));
+	snprintf(arena->filename, sizeof(arena->filename), "%s", filename);
+	arena->base = base;
+	arena->size = (size + SHM_ARENA_SIZE_UNIT - 1) / \
+			SHM_ARENA_SIZE_UNIT * SHM_ARENA_SIZE_UNIT;
+	*attached = false;
+
+	if ((result=init_pthread_lock(&arena->lock)) != 0)
+	{
+		return result;
+	}
+
+	arena->fd = open(filename, O_RDWR | O_CREAT, 0600);
+	if (arena->fd < 0)
+	{
+		result = errno != 0 ? errno : EACCES;
+		logError("file: "__FILE__", line: %d, " \
+			"open file \"%s\" fail, errno: %d, error info: %s", \
+			__LINE__, filename, result, STRERROR(result));
+		pthread_mutex_destroy(&arena->lock);
+		return result;
+	}
+
+	/* unlocked when the fd closed, even on crash */
+	if (flock(arena->fd, LOCK_EX | LOCK_NB) != 0)
+	{
+		logError("file: "__FILE__", line: %d, " \
+			"lock file \"%s\" fail, it is used by another process",\
+			__LINE__, filename);
+		shm_arena_close(arena, false);
+		return EBUSY;
+	}
+
+	if (fstat(arena->fd, &file_stat) != 0)
+	{
+		result = errno != 0 ? errno : EIO;
+		logError("file: "__FILE__", line: %d, " \
+			"stat file \"%s\" fail, errno: %d, error info: %s", \
+			__LINE__, filename, result, STRERROR(result));
+		shm_arena_close(arena, false);
+		return result;
+	}
+
+	if (file_stat.st_size == arena->size)
+	{
+		if ((result=shm_arena_map(arena)) != 0)
+		{
+			shm_arena_close(arena, false);
+			return result;
+		}
+
+		header = arena->header;
+		if (memcmp(header->magic, SHM_ARENA_MAGIC, \
+			sizeof(header->magic)) == 0 && \
+			header->version == SHM_ARENA_VERSION && \
+			header->base == arena->base && \
+			header->size == arena->size && header->clean)
+		{
+			/* dirty until closed cleanly */
+			header->clean = 0;
+			__sync_synchronize();
+			*attached = true;
+			return 0;
+		}
+
+		logWarning("file: "__FILE__", line: %d, " \
+			"file \"%s\" was not closed cleanly or is invalid, " \
+			"discarded", __LINE__, filename);
+		munmap(arena->header, arena->size);
+		arena->header = NULL;
+	}
+	else if (file_stat.st_size > 0)
+	{
+		logWarning("file: "__FILE__", line: %d, " \
+			"the size of file \"%s\": "INT64_PRINTF_FORMAT \
+			" != "INT64_PRINTF_FORMAT", discarded", __LINE__, \
+			filename, (int64_t)file_stat.st_size, arena->size);
+	}
+
+	if ((result=shm_arena_create(arena)) != 0)
+	{
+		shm_arena_close(arena, false);
+		return result;
+	}
+
+	return 0;
+}
+
+void shm_arena_reset(ShmArena *arena)
+{
+	ShmArenaHeader *header;
+
+	header = arena->header;
+	memset(header, 0, sizeof(ShmArenaHeader));
+	memcpy(header->magic, SHM_ARENA_MAGIC, sizeof(header->magic));
+	header->version = SHM_ARENA_VERSION;
+	header->base = arena->base;
+	header->size = arena->size;
+	header->used = SHM_ARENA_HEADER_SIZE;
+}
+
+void shm_arena_close(ShmArena *arena, const bool clean)
+{
+	if (arena->header != NULL)
+	{
+		if (clean)
+		{
+			__sync_synchronize();
+			arena->header->clean = 1;
+		}
+
+		munmap(arena->header, arena->size);
+		arena->header = NULL;
+	}
+
+	if (arena->fd >= 0)
+	{
+		close(arena->fd);
+		arena->fd = -1;
+	}
+
+	pthread_mutex_destroy(&arena->lock);
+}
+
+/* call with the lock */
+static void *shm_arena_bump(ShmArena *arena, const int64_t bytes)
+{
+	ShmArenaHeader *header;
+	int64_t aligned_bytes;
+	char *ptr;
+
+	header = arena->header;
+	aligned_bytes = (bytes + SHM_ARENA_ALIGN_SIZE - 1) & \
+			(~(SHM_ARENA_ALIGN_SIZE - 1));
+	if (header->used + aligned_bytes > header->size)
+	{
+		return NULL;
+	}
+
+	ptr = (char *)header + header->used;
+	header->used += aligned_bytes;
+	return ptr;
+}
+
+void *shm_arena_alloc(ShmArena *arena, const int64_t bytes)
+{
+	void *ptr;
+
+	pthread_mutex_lock(&arena->lock);
+	ptr = shm_arena_bump(arena, bytes);
+	pthread_mutex_unlock(&arena->lock);
+
+	return ptr;
+}
+
+/* call with the lock */
+static void shm_arena_push_block(ShmArena *arena, void *ptr, \
+		const int64_t units)
+{
+	ShmArenaFreeBlock **ppList;
+	ShmArenaFreeBlock *pBlock;
+
+	ppList = arena->header->free_blocks + SHM_ARENA_BLOCK_INDEX(units);
+	pBlock = (ShmArenaFreeBlock *)ptr;
+	pBlock->units = units;
+	pBlock->next = *ppList;
+	*ppList = pBlock;
+}
+
+/* pop the block of the units, or a larger one split when the arena is
+   full. call with the lock */
+static void *shm_arena_pop_block(ShmArena *arena, const int64_t units, \
+		const bool split)
+{
+	ShmArenaFreeBlock **ppList;
+	ShmArenaFreeBlock **ppPrevious;
+	ShmArenaFreeBlock *pBlock;
+	int index;
+
+	for (index=SHM_ARENA_BLOCK_INDEX(units); \
+		index<SHM_ARENA_BLOCK_CLASSES; index++)
+	{
+		ppList = arena->header->free_blocks + index;
+		for (ppPrevious=ppList; *ppPrevious!=NULL; \
+			ppPrevious=&(*ppPrevious)->next)
+		{
+			pBlock = *ppPrevious;
+			if (pBlock->units == units || (split && \
+				pBlock->units > units))
+			{
+				*ppPrevious = pBlock->next;
+				if (pBlock->units > units)
+				{
+					shm_arena_push_block(arena, \
+						(char *)pBlock + units * \
+						SHM_ARENA_BLOCK_UNIT, \
+						pBlock->units - units);
+				}
+				return pBlock;
+			}
+
+			/* the lists of the units are exact */
+			if (index < SHM_ARENA_BLOCK_CLASSES - 1)
+			{
+				break;
+			}
+		}
+
+		if (!split)
+		{
+			break;
+		}
+	}
+
+	return NULL;
+}
+
+void *shm_arena_alloc_block(ShmArena *arena, const int64_t bytes)
+{
+	int64_t units;
+	void *ptr;
+
+	units = (bytes + SHM_ARENA_BLOCK_UNIT - 1) / SHM_ARENA_BLOCK_UNIT;
+	pthread_mutex_lock(&arena->lock);
+	if ((ptr=shm_arena_pop_block(arena, units, false)) == NULL && \
+		(ptr=shm_arena_bump(arena, units * \
+			SHM_ARENA_BLOCK_UNIT)) == NULL)
+	{
+		ptr = shm_arena_pop_block(arena, units, true);
+	}
+	if (ptr != NULL)
+	{
+		arena->header->block_bytes += units * SHM_ARENA_BLOCK_UNIT;
+	}
+	pthread_mutex_unlock(&arena->lock);
+
+	return ptr;
+}
+
+void shm_arena_free_block(ShmArena *arena, void *ptr, const int64_t bytes)
+{
+	int64_t units;
+
+	units = (bytes + SHM_ARENA_BLOCK_UNIT - 1) / SHM_ARENA_BLOCK_UNIT;
+	pthread_mutex_lock(&arena->lock);
+	shm_arena_push_block(arena, ptr, units);
+	arena->header->block_bytes -= units * SHM_ARENA_BLOCK_UNIT;
+	pthread_mutex_unlock(&arena->lock);
+}
+
@@ -0,0 +1,126 @@
+/**
+* Copyright (C) 2008 Happy Fish / YuQing
+*
+* FastDFS may be copied only under the terms of the GNU General
+* Public License V3, which may be found in the FastDFS source kit.
+* Please visit the FastDFS Home Page http://www.csource.org/ for more detail.
+**/
+
+//shm_arena.h
+
+/* the memory arena of a file mapped shared, such as in /dev/shm or on
+   hugetlbfs. the file is mapped at the same address by every process, so
+   the raw pointers in the arena are valid after attached again. the data
+   is trusted only when the arena was closed cleanly */
+
+#ifndef _SHM_ARENA_H
+#define _SHM_ARENA_H
+
+#include <stdint.h>
+#include <pthread.h>
+#include "common_define.h"
+
+#define SHM_ARENA_MAGIC          "SHMARENA"
+#define SHM_ARENA_VERSION        1
+#define SHM_ARENA_ALIGN_SIZE     64
+#define SHM_ARENA_SIZE_UNIT      (2 * 1024 * 1024)  //the huge page size
+#define SHM_ARENA_BLOCK_UNIT     4096  //the freed blocks are reused by units
+#define SHM_ARENA_BLOCK_CLASSES  1024  //the last one for the larger blocks
+
+typedef struct shm_arena_free_block
+{
+	struct shm_arena_free_block *next;
+	int64_t units;
+} ShmArenaFreeBlock;
+
+typedef struct shm_arena_header
+{
+	char magic[8];
+	int version;
+	volatile int clean;  //closed cleanly, the data is consistent
+	void *base;     //the address mapped at
+	int64_t size;
+	int64_t used;   //the bytes alloced by the bump pointer
+	int64_t block_bytes;  //the blocks in use
+	void *root;     //the root object of the user
+	ShmArenaFreeBlock *free_blocks[SHM_ARENA_BLOCK_CLASSES];
+} ShmArenaHeader;
+
+typedef struct shm_arena
+{
+	ShmArenaHeader *header;  //NULL for not opened
+	char filename[MAX_PATH_SIZE];
+	void *base;
+	int64_t size;
+	int fd;
+	pthread_mutex_t lock;
+} ShmArena;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * open the arena, the file is attached when it was closed cleanly with
+ * the same base and size, otherwise it is created again and reserved
+ * parameters:
+ *         arena: the arena
+ *         filename: the file to map
+ *         base: the address to map at
+ *         size: the size of the file, rounded up to SHM_ARENA_SIZE_UNIT
+ *         attached: return true for attached, false for created
+ * return 0 for success, != 0 for error
+*/
+int shm_arena_open(ShmArena *arena, const char *filename, void *base, \
+		const int64_t size, bool *attached);
+
+/**
+ * discard the data of the arena attached, such as when its root object
+ * is invalid
+ * return none
+*/
+void shm_arena_reset(ShmArena *arena);
+
+/**
+ * close the arena, the data is attached by next open when clean
+ * parameters:
+ *         arena: the arena
+ *         clean: the data is consistent, no writer is running
+ * return none
+*/
+void shm_arena_close(ShmArena *arena, const bool clean);
+
+/**
+ * alloc the memory which is never freed, aligned by SHM_ARENA_ALIGN_SIZE
+ * parameters:
+ *         arena: the arena
+ *         bytes: the size to alloc
+ * return the memory, NULL for the arena is full
+*/
+void *shm_arena_alloc(ShmArena *arena, const int64_t bytes);
+
+/**
+ * alloc a block which can be freed, rounded up to SHM_ARENA_BLOCK_UNIT
+ * parameters:
+ *         arena: the arena
+ *         bytes: the size to alloc
+ * return the block, NULL for the arena is full
+*/
+void *shm_arena_alloc_block(ShmArena *arena, const int64_t bytes);
+
+/**
+ * free the block alloced by shm_arena_alloc_block
+ * parameters:
+ *         arena: the arena
+ *         ptr: the block
+ *         bytes: the size when alloc
+ * return none
+*/
+void shm_arena_free_block(ShmArena *arena, void *ptr, const int64_t bytes);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
@@ -16,6 +16,7 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <sys/socket.h>
+#include <sys/un.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <netinet/tcp.h>
@@ -156,7 +157,8 @@ int tcprecvdata_ex(int sock, void *data, const int size, \
 		}
 #else
 		res = poll(&pollfds, 1, 1000 * timeout);
-		if (pollfds.revents & POLLHUP)
+		/* the data sent before the peer closed is still readable */
+		if ((pollfds.revents & POLLHUP) && !(pollfds.revents & POLLIN))
 		{
 			ret_code = ENOTCONN;
 			break;
@@ -330,7 +332,8 @@ int tcprecvdata_nb_ex(int sock, void *data, const int size, \
 		}
 #else
 		res = poll(&pollfds, 1, 1000 * timeout);
-		if (pollfds.revents & POLLHUP)
+		/* the data sent before the peer closed is still readable */
+		if ((pollfds.revents & POLLHUP) && !(pollfds.revents & POLLIN))
 		{
 			ret_code = ENOTCONN;
 			break;
@@ -451,6 +454,26 @@ int connectserverbyip(int sock, const char *server_ip, const short server_port)
 	return 0;
 }
 
+int connectserverbyunix(int sock, const char *path)
+{
+	struct sockaddr_un addr;
+
+	if (strlen(path) >= sizeof(addr.sun_path))
+	{
+		return ENAMETOOLONG;
+	}
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, path);
+	if (connect(sock, (const struct sockaddr*)&addr, sizeof(addr)) < 0)
+	{
+		return errno != 0 ? errno : EINTR;
+	}
+
+	return 0;
+}
+
 int connectserverbyip_nb_ex(int sock, const char *server_ip, \
 		const short server_port, const int timeout, \
 		const bool auto_detect)
@@ -747,6 +770,12 @@ int socketBind(int sock, const char *bind_ipaddr, const int port)
 }
 
 int socketServer(const char *bind_ipaddr, const int port, int *err_no)
+{
+	return socketServerEx(bind_ipaddr, port, false, err_no);
+}
+
+int socketServerEx(const char *bind_ipaddr, const int port, \
+		const bool reuse_port, int *err_no)
 {
 	int sock;
 	int result;
@@ -772,6 +801,29 @@ int socketServer(const char *bind_ipaddr, const int port, int *err_no)
 		return -2;
 	}
 
+	if (reuse_port)
+	{
+#ifdef SO_REUSEPORT
+		if (setsockopt(sock, SOL_SOCKET, SO_REUSEPORT, \
+			&result, sizeof(int)) < 0)
+		{
+			*err_no = errno != 0 ? errno : ENOMEM;
+			logError("file: "__FILE__", line: %d, " \
+				"setsockopt SO_REUSEPORT failed, " \
+				"errno: %d, error info: %s", \
+				__LINE__, errno, STRERROR(errno));
+			close(sock);
+			return -2;
+		}
+#else
+		*err_no = EOPNOTSUPP;
+		logError("file: "__FILE__", line: %d, " \
+			"SO_REUSEPORT is not supported", __LINE__);
+		close(sock);
+		return -2;
+#endif
+	}
+
 	if ((*err_no=socketBind(sock, bind_ipaddr, port)) != 0)
 	{
 		close(sock);
@@ -1768,3 +1820,66 @@ int gethostaddrs(char **if_alias_prefixes, const int prefix_count, \
 	return 0;
 }
 
+int socketUnixServer(const char *path, int *err_no)
+{
+	struct sockaddr_un addr;
+	int sock;
+
+	if (strlen(path) >= sizeof(addr.sun_path))
+	{
+		*err_no = ENAMETOOLONG;
+		logError("file: "__FILE__", line: %d, " \
+			"unix socket path: %s is too long, " \
+			"exceeds %d", __LINE__, path, \
+			(int)sizeof(addr.sun_path) - 1);
+		return -1;
+	}
+
+	sock = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (sock < 0)
+	{
+		*err_no = errno != 0 ? errno : EMFILE;
+		logError("file: "__FILE__", line: %d, " \
+			"socket create failed, errno: %d, error info: %s", \
+			__LINE__, errno, STRERROR(errno));
+		return -1;
+	}
+
+	if (unlink(path) != 0 && errno != ENOENT)
+	{
+		*err_no = errno != 0 ? errno : EPERM;
+		logError("file: "__FILE__", line: %d, " \
+			"unlink file: %s fail, errno: %d, error info: %s", \
+			__LINE__, path, errno, STRERROR(errno));
+		close(sock);
+		return -2;
+	}
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, path);
+	if (bind(sock, (struct sockaddr*)&addr, sizeof(addr)) < 0)
+	{
+		*err_no = errno != 0 ? errno : ENOMEM;
+		logError("file: "__FILE__", line: %d, " \
+			"bind unix socket %s failed, " \
+			"errno: %d, error info: %s.", \
+			__LINE__, path, errno, STRERROR(errno));
+		close(sock);
+		return -3;
+	}
+
+	if (listen(sock, 1024) < 0)
+	{
+		*err_no = errno != 0 ? errno : EINVAL;
+		logError("file: "__FILE__", line: %d, " \
+			"listen unix socket %s failed, " \
+			"errno: %d, error info: %s", \
+			__LINE__, path, errno, STRERROR(errno));
+		close(sock);
+		return -4;
+	}
+
+	*err_no = 0;
+	return sock;
+}
@@ -97,6 +97,14 @@ int tcpsenddata_nb(int sock, void* data, const int size, const int timeout);
 */
 int connectserverbyip(int sock, const char *server_ip, const short server_port);
 
+/** connect to the unix domain socket server by block mode
+ *  parameters:
+ *          sock: the unix domain socket
+ *          path: the socket file path of the server
+ *  return: error no, 0 success, != 0 fail
+*/
+int connectserverbyunix(int sock, const char *path);
+
 /** connect to server by non-block mode
  *  parameters:
  *          sock: the socket
@@ -227,6 +235,27 @@ int socketBind(int sock, const char *bind_ipaddr, const int port);
 */
 int socketServer(const char *bind_ipaddr, const int port, int *err_no);
 
+/** start a socket server (socket, bind and listen)
+ *  parameters:
+ *          bind_ipaddr: the ip address to bind
+ *          port: the port to bind
+ *          reuse_port: if set SO_REUSEPORT, so that more than one
+ *                      socket can listen on the same port
+ *          err_no: store the error no
+ *  return: >= 0 server socket, < 0 fail
+*/
+int socketServerEx(const char *bind_ipaddr, const int port, \
+		const bool reuse_port, int *err_no);
+
+/** start a unix domain socket server (socket, bind and listen),
+ *  the stale socket file is removed before bind
+ *  parameters:
+ *          path: the socket file path to bind
+ *          err_no: store the error no
+ *  return: >= 0 server socket, < 0 fail
+*/
+int socketUnixServer(const char *path, int *err_no);
+
 #define tcprecvdata(sock, data, size, timeout) \
 	tcprecvdata_ex(sock, data, size, timeout, NULL)
 
@@ -31,6 +31,7 @@ TARGET_PREFIX=/usr/local
 TARGET_CONF_PATH=/etc/fdht
 
 #WITH_LINUX_SERVICE=1
+#WITH_IOURING=1
 DEBUG_FLAG=1
 
 CFLAGS='-Wall -D_FILE_OFFSET_BITS=64 -D_GNU_SOURCE'
@@ -43,7 +44,11 @@ fi
 LIBS=''
 uname=`uname`
 if [ "$uname" = "Linux" ]; then
-  CFLAGS="$CFLAGS -DOS_LINUX -DIOEVENT_USE_EPOLL"
+  if [ "$WITH_IOURING" = "1" ] && [ -f /usr/include/linux/io_uring.h ]; then
+    CFLAGS="$CFLAGS -DOS_LINUX -DIOEVENT_USE_IOURING"
+  else
+    CFLAGS="$CFLAGS -DOS_LINUX -DIOEVENT_USE_EPOLL"
+  fi
 elif [ "$uname" = "FreeBSD" ]; then
   CFLAGS="$CFLAGS -DOS_FREEBSD -DIOEVENT_USE_KQUEUE"
 elif [ "$uname" = "SunOS" ]; then
@@ -23,6 +23,7 @@
 #include <logger.h>
 #include "fdht_global.h"
 #include "shared_func.h"
+#include "local_ip_func.h"
 #include "fastdht_client.h"
 
 #define FDHT_STAT_MAX_ROWS   32
@@ -1479,12 +1480,14 @@ static int load_config_files()
 	#define ITEM_NAME_NETWORK_TIMEOUT "fastdht_client.network_timeout"
 	#define ITEM_NAME_LOG_LEVEL      "fastdht_client.log_level"
 	#define ITEM_NAME_LOG_FILENAME   "fastdht_client.log_filename"
+	#define ITEM_NAME_UNIX_SOCKET_PATH "fastdht_client.unix_socket_path"
 	zval conf_c;
 	zval base_path;
 	zval connect_timeout;
 	zval network_timeout;
 	zval log_level;
 	zval log_filename;
+	zval unix_socket_path;
 	zval conf_filename;
 	char szItemName[sizeof(ITEM_NAME_CONF_FILE) + 10];
 	char szProxyPrompt[64];
@@ -1583,6 +1586,17 @@ static int load_config_files()
 		}
 	}
 
+	if (zend_get_configuration_directive(ITEM_NAME_UNIX_SOCKET_PATH, \
+			sizeof(ITEM_NAME_UNIX_SOCKET_PATH), \
+			&unix_socket_path) == SUCCESS && \
+			unix_socket_path.value.str.len > 0)
+	{
+		snprintf(g_fdht_unix_socket_path, \
+			sizeof(g_fdht_unix_socket_path), "%s", \
+			unix_socket_path.value.str.val);
+		load_local_host_ip_addrs();
+	}
+
 	config_list = (FDHTConfigInfo *)malloc(sizeof(FDHTConfigInfo) * \
 			config_count);
 	if (config_list == NULL)
@@ -1665,12 +1679,13 @@ static int load_config_files()
 		*szProxyPrompt = '\0';
 	}
 
-	logDebug("base_path=%s, connect_timeout=%ds, network_timeout=%ds. " \
+	logDebug("base_path=%s, connect_timeout=%ds, network_timeout=%ds, " \
+		"unix_socket_path=%s. " \
 		"in the first(default) config file: keep_alive=%d, " \
 		"use_proxy=%d, %s" \
 		"group_count=%d, server_count=%d", \
 		g_fdht_base_path, g_fdht_connect_timeout, \
-		g_fdht_network_timeout, g_keep_alive, \
+		g_fdht_network_timeout, g_fdht_unix_socket_path, g_keep_alive, \
 		g_group_array.use_proxy, szProxyPrompt, \
 		g_group_array.group_count, g_group_array.server_count);
 
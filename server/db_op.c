@@ -6,6 +6,7 @@
 #include <limits.h>
 #include <fcntl.h>
 #include <errno.h>
+#include <pthread.h>
 #include <db.h>
 #include "logger.h"
 #include "shared_func.h"
@@ -14,7 +15,29 @@
 #include "global.h"
 #include "func.h"
 
+#define DB_BULK_BUFF_SIZE  (64 * 1024)  //not less than the max page size
+#define DB_GET_BUFF_KEEP_SIZE  (256 * 1024)  //larger is freed after the get
+
+#define DB_EXPIRE_INDEX_SUFFIX  "_expires"
+#define DB_EXPIRE_POP_BATCH     256  //the index keys read per cursor
+#define DB_EXPIRE_INDEX_KEY_SIZE  (4 + FDHT_MAX_FULL_KEY_LEN)
+
+/* the expire index of the group: the key is the expires (big endian)
+   followed by the key, the value is empty. it is kept by the writes
+   instead of DB->associate, the env has no transaction, so the index
+   entries may be stale and are checked by the primary when cleared */
+#define DB_EXPIRE_INDEX(pHandle)  ((DB *)((DB *)(pHandle))->app_private)
+
+/* the value buffer of the get ex per thread, enlarged by DB_DBT_REALLOC */
+typedef struct
+{
+	char *data;
+	u_int32_t size;  //the last value length, the buffer is not smaller
+} DBGetBuffer;
+
 static DB_ENV *g_db_env = NULL;
+static DBType g_db_type = DB_BTREE;
+static pthread_key_t g_db_get_buff_key;
 
 static void db_errcall(const DB_ENV *dbenv, const char *errpfx, const char *msg)
 {
@@ -23,6 +46,18 @@ static void db_errcall(const DB_ENV *dbenv, const char *errpfx, const char *msg)
 		__LINE__, msg);
 }
 
+static void db_get_buff_destroy(void *arg)
+{
+	DBGetBuffer *pGetBuff;
+
+	pGetBuff = (DBGetBuffer *)arg;
+	if (pGetBuff->data != NULL)
+	{
+		free(pGetBuff->data);
+	}
+	free(pGetBuff);
+}
+
 static int db_env_init(DB_ENV **ppDBEnv, const u_int64_t nCacheSize, \
 		const u_int32_t page_size, const char *base_path)
 {
@@ -69,6 +104,16 @@ static int db_env_init(DB_ENV **ppDBEnv, const u_int64_t nCacheSize, \
 		return result;
 	}
 
+	if ((result=pthread_key_create(&g_db_get_buff_key, \
+			db_get_buff_destroy)) != 0)
+	{
+		logError("file: "__FILE__", line: %d, " \
+			"pthread_key_create fail, " \
+			"errno: %d, error info: %s", \
+			__LINE__, result, STRERROR(result));
+		return result;
+	}
+
 	(*ppDBEnv)->set_tmp_dir((*ppDBEnv), "tmp");
 	(*ppDBEnv)->set_lg_dir((*ppDBEnv), "logs");
 	(*ppDBEnv)->set_data_dir((*ppDBEnv), "data");
@@ -112,6 +157,321 @@ static int db_env_init(DB_ENV **ppDBEnv, const u_int64_t nCacheSize, \
 	return 0;
 }
 
+static int db_expire_index_put(DB *pIndex, const char *pKey, \
+		const int key_len, const int expires)
+{
+	int result;
+	char szIndexKey[DB_EXPIRE_INDEX_KEY_SIZE];
+	DBT key;
+	DBT value;
+
+	memset(&key, 0, sizeof(key));
+	memset(&value, 0, sizeof(value));
+
+	int2buff(expires, szIndexKey);
+	memcpy(szIndexKey + 4, pKey, key_len);
+	key.data = szIndexKey;
+	key.size = 4 + key_len;
+
+	if ((result=pIndex->put(pIndex, NULL, &key, &value, 0)) != 0)
+	{
+		logError("file: "__FILE__", line: %d, " \
+			"put the expire index fail, " \
+			"errno: %d, error info: %s", \
+			__LINE__, result, db_strerror(result));
+		return EFAULT;
+	}
+
+	return 0;
+}
+
+static int db_expire_index_delete(DB *pIndex, const char *pKey, \
+		const int key_len, const int expires)
+{
+	int result;
+	char szIndexKey[DB_EXPIRE_INDEX_KEY_SIZE];
+	DBT key;
+
+	memset(&key, 0, sizeof(key));
+	int2buff(expires, szIndexKey);
+	memcpy(szIndexKey + 4, pKey, key_len);
+	key.data = szIndexKey;
+	key.size = 4 + key_len;
+
+	if ((result=pIndex->del(pIndex, NULL, &key, 0)) != 0 && \
+		result != DB_NOTFOUND)
+	{
+		logError("file: "__FILE__", line: %d, " \
+			"delete the expire index fail, " \
+			"errno: %d, error info: %s", \
+			__LINE__, result, db_strerror(result));
+		return EFAULT;
+	}
+
+	return 0;
+}
+
+/* the index is changed after the primary, so a failed write of the
+   index only leaves a stale entry or the key cleared by GET only */
+static void db_expire_index_update(DB *pIndex, const char *pKey, \
+		const int key_len, const int old_expires, const int new_expires)
+{
+	if (old_expires == new_expires)
+	{
+		return;
+	}
+
+	if (old_expires != FDHT_EXPIRES_NEVER)
+	{
+		db_expire_index_delete(pIndex, pKey, key_len, old_expires);
+	}
+	if (new_expires != FDHT_EXPIRES_NEVER)
+	{
+		db_expire_index_put(pIndex, pKey, key_len, new_expires);
+	}
+}
+
+/* read the expires of the key, the first 4 bytes of the value.
+   return 0 for success, ENOENT for the key not exist */
+static int db_get_expires(DB *db, const char *pKey, const int key_len, \
+		int *expires)
+{
+	int result;
+	char szValue[4];
+	DBT key;
+	DBT value;
+
+	memset(&key, 0, sizeof(key));
+	memset(&value, 0, sizeof(value));
+
+	key.data = (char *)pKey;
+	key.size = key_len;
+
+	value.flags = DB_DBT_USERMEM | DB_DBT_PARTIAL;
+	value.data = szValue;
+	value.ulen = sizeof(szValue);
+	value.dlen = sizeof(szValue);
+
+	if ((result=db->get(db, NULL, &key, &value, 0)) != 0)
+	{
+		if (result == DB_NOTFOUND)
+		{
+			return ENOENT;
+		}
+
+		logError("file: "__FILE__", line: %d, " \
+			"db_get fail, " \
+			"errno: %d, error info: %s", \
+			__LINE__, result, db_strerror(result));
+		return EFAULT;
+	}
+
+	*expires = value.size == sizeof(szValue) ? buff2int(szValue) : \
+			FDHT_EXPIRES_NEVER;
+	return 0;
+}
+
+/* the expires of the key before the write, FDHT_EXPIRES_NEVER for not
+   exist or fail */
+static int db_get_old_expires(DB *db, const char *pKey, const int key_len)
+{
+	int expires;
+
+	if (db_get_expires(db, pKey, key_len, &expires) != 0)
+	{
+		return FDHT_EXPIRES_NEVER;
+	}
+
+	return expires;
+}
+
+/* index the keys with the expires of the group */
+static int db_expire_index_build(DB *db, DB *pIndex)
+{
+	DBC *cursor;
+	int result;
+	DBT key;
+	DBT value;
+	char szKey[FDHT_MAX_FULL_KEY_LEN];
+	char szValue[4];
+	int64_t total_count;
+	int64_t index_count;
+	int expires;
+
+	if ((result=db->cursor(db, NULL, &cursor, 0)) != 0)
+	{
+		logError("file: "__FILE__", line: %d, " \
+			"db->cursor fail, errno: %d, error info: %s", \
+			__LINE__, result, db_strerror(result));
+		return EFAULT;
+	}
+
+	memset(&key, 0, sizeof(key));
+	memset(&value, 0, sizeof(value));
+
+	key.flags = DB_DBT_USERMEM;
+	key.data = szKey;
+	key.ulen = sizeof(szKey);
+
+	value.flags = DB_DBT_USERMEM | DB_DBT_PARTIAL;
+	value.data = szValue;
+	value.ulen = sizeof(szValue);
+	value.dlen = sizeof(szValue);
+
+	total_count = 0;
+	index_count = 0;
+	while ((result=cursor->get(cursor, &key, &value, DB_NEXT)) == 0)
+	{
+		total_count++;
+		if (value.size < sizeof(szValue))
+		{
+			continue;
+		}
+
+		expires = buff2int(szValue);
+		if (expires == FDHT_EXPIRES_NEVER)
+		{
+			continue;
+		}
+
+		if ((result=db_expire_index_put(pIndex, szKey, \
+				key.size, expires)) != 0)
+		{
+			break;
+		}
+		index_count++;
+	}
+
+	cursor->close(cursor);
+	if (result != 0 && result != DB_NOTFOUND)
+	{
+		if (result != EFAULT)
+		{
+			logError("file: "__FILE__", line: %d, " \
+				"cursor->get fail, " \
+				"errno: %d, error info: %s", \
+				__LINE__, result, db_strerror(result));
+		}
+		return EFAULT;
+	}
+
+	logInfo("build the expire index, total key count: " \
+		INT64_PRINTF_FORMAT", indexed key count: " \
+		INT64_PRINTF_FORMAT, total_count, index_count);
+	return 0;
+}
+
+static int db_expire_index_handle(DB **ppIndex, const u_int32_t page_size, \
+		const char *index_filename, const u_int32_t flags)
+{
+	int result;
+
+	if ((result=db_create(ppIndex, g_db_env, 0)) != 0)
+	{
+		logError("file: "__FILE__", line: %d, " \
+			"db_create fail, errno: %d, error info: %s", \
+			__LINE__, result, db_strerror(result));
+		return result;
+	}
+
+	if ((result=(*ppIndex)->set_pagesize(*ppIndex, page_size)) != 0)
+	{
+		logError("file: "__FILE__", line: %d, " \
+			"db->set_pagesize, errno: %d, error info: %s", \
+			__LINE__, result, db_strerror(result));
+		(*ppIndex)->close(*ppIndex, 0);
+		return result;
+	}
+
+	if ((result=(*ppIndex)->open(*ppIndex, NULL, index_filename, NULL, \
+		DB_BTREE, flags, 0644)) != 0)
+	{
+		logError("file: "__FILE__", line: %d, " \
+			"db->open %s fail, errno: %d, error info: %s", \
+			__LINE__, index_filename, result, db_strerror(result));
+		(*ppIndex)->close(*ppIndex, 0);
+		return result;
+	}
+
+	return 0;
+}
+
+/* build the index into the temp file then rename it, so an index file
+   partially built by a failed or interrupted build is never opened as
+   a complete one, the temp file left is truncated by the next build */
+static int db_expire_index_create(DB *db, const u_int32_t page_size, \
+		const char *index_filename)
+{
+	int result;
+	int close_result;
+	DB *pIndex;
+	char tmp_filename[MAX_PATH_SIZE + sizeof(".tmp")];
+
+	snprintf(tmp_filename, sizeof(tmp_filename), "%s.tmp", \
+		index_filename);
+	if ((result=db_expire_index_handle(&pIndex, page_size, \
+		tmp_filename, DB_CREATE | DB_TRUNCATE | DB_THREAD)) != 0)
+	{
+		return result;
+	}
+
+	result = db_expire_index_build(db, pIndex);
+	if ((close_result=pIndex->close(pIndex, 0)) != 0 && result == 0)
+	{
+		logError("file: "__FILE__", line: %d, " \
+			"db->close %s fail, errno: %d, error info: %s", \
+			__LINE__, tmp_filename, close_result, \
+			db_strerror(close_result));
+		result = close_result;
+	}
+	if (result != 0)
+	{
+		g_db_env->dbremove(g_db_env, NULL, tmp_filename, NULL, 0);
+		return result;
+	}
+
+	if ((result=g_db_env->dbrename(g_db_env, NULL, tmp_filename, \
+			NULL, index_filename, 0)) != 0)
+	{
+		logError("file: "__FILE__", line: %d, " \
+			"rename %s to %s fail, errno: %d, error info: %s", \
+			__LINE__, tmp_filename, index_filename, \
+			result, db_strerror(result));
+		return result;
+	}
+
+	return 0;
+}
+
+static int db_expire_index_open(DB *db, const u_int32_t page_size, \
+		const char *base_path, const char *filename)
+{
+	int result;
+	DB *pIndex;
+	char index_filename[MAX_PATH_SIZE];
+	char full_filename[MAX_PATH_SIZE + sizeof("/data/") + \
+			MAX_PATH_SIZE];
+
+	snprintf(index_filename, sizeof(index_filename), "%s%s", \
+		filename, DB_EXPIRE_INDEX_SUFFIX);
+	snprintf(full_filename, sizeof(full_filename), "%s/data/%s", \
+		base_path, index_filename);
+	if (!fileExists(full_filename) && (result=db_expire_index_create( \
+			db, page_size, index_filename)) != 0)
+	{
+		return result;
+	}
+
+	if ((result=db_expire_index_handle(&pIndex, page_size, \
+		index_filename, DB_CREATE | DB_THREAD)) != 0)
+	{
+		return result;
+	}
+
+	db->app_private = pIndex;
+	return 0;
+}
+
 int db_init(StoreHandle **ppHandle, const DBType type, \
 	const u_int64_t nCacheSize, const u_int32_t page_size, \
 	const char *base_path, const char *filename)
@@ -155,6 +515,15 @@ int db_init(StoreHandle **ppHandle, const DBType type, \
 		return result;
 	}
 
+	db->app_private = NULL;
+	if (g_db_expire_index && (result=db_expire_index_open(db, \
+			page_size, base_path, filename)) != 0)
+	{
+		db->close(db, 0);
+		return result;
+	}
+
+	g_db_type = type;
 	*ppHandle = db;
 	return 0;
 }
@@ -165,6 +534,13 @@ int db_destroy_instance(StoreHandle **ppHandle)
 
 	if (*ppHandle != NULL)
 	{
+		if (DB_EXPIRE_INDEX(*ppHandle) != NULL)
+		{
+			DB_EXPIRE_INDEX(*ppHandle)->close( \
+				DB_EXPIRE_INDEX(*ppHandle), 0);
+			((DB *)*ppHandle)->app_private = NULL;
+		}
+
 		if ((result=((DB *)*ppHandle)->close((DB *)*ppHandle, 0)) != 0)
 		{
 			logError("file: "__FILE__", line: %d, " \
@@ -194,6 +570,7 @@ int db_destroy()
 		}
 
 		g_db_env = NULL;
+		pthread_key_delete(g_db_get_buff_key);
 		return result;
 	}
 
@@ -212,6 +589,15 @@ int db_sync(StoreHandle *pHandle)
 				"errno: %d, error info: %s", \
 				__LINE__, result, db_strerror(result));
 		}
+		else if (DB_EXPIRE_INDEX(pHandle) != NULL && (result= \
+			DB_EXPIRE_INDEX(pHandle)->sync( \
+			DB_EXPIRE_INDEX(pHandle), 0)) != 0)
+		{
+			logError("file: "__FILE__", line: %d, " \
+				"sync the expire index fail, " \
+				"errno: %d, error info: %s", \
+				__LINE__, result, db_strerror(result));
+		}
 	}
 	else
 	{
@@ -251,33 +637,126 @@ int db_memp_trickle(int *nwrotep)
 	return result;
 }
 
-int db_set(StoreHandle *pHandle, const char *pKey, const int key_len, \
-	const char *pValue, const int value_len)
+/* write or delete (value NULL) the key by the cursor under the DB_RMW
+   write lock, the expires before the write is read by the same cursor,
+   so the concurrent writes of the key read the expires in the order of
+   the writes and the index entry of the last value is never lost.
+   return 0 for success, DB_NOTFOUND for deleting the key not exist,
+   other for the BDB error */
+static int db_rmw_write(DB *db, DBT *key, DBT *value, int *old_expires)
 {
+	DBC *cursor;
 	int result;
-	DBT key;
-	DBT value;
-
-	g_server_stat.total_set_count++;
+	int close_result;
+	char szValue[4];
+	DBT old_value;
 
-	memset(&key, 0, sizeof(key));
-	memset(&value, 0, sizeof(value));
+	while (1)
+	{
+		if ((result=db->cursor(db, NULL, &cursor, 0)) != 0)
+		{
+			return result;
+		}
 
-	key.data = (char *)pKey;
-	key.size = key_len;
+		memset(&old_value, 0, sizeof(old_value));
+		old_value.flags = DB_DBT_USERMEM | DB_DBT_PARTIAL;
+		old_value.data = szValue;
+		old_value.ulen = sizeof(szValue);
+		old_value.dlen = sizeof(szValue);
 
-	value.data = (char *)pValue;
-	value.size = value_len;
+		*old_expires = FDHT_EXPIRES_NEVER;
+		result = cursor->get(cursor, key, &old_value, DB_SET | DB_RMW);
+		if (result == 0)
+		{
+			if (old_value.size == sizeof(szValue))
+			{
+				*old_expires = buff2int(szValue);
+			}
 
-	if ((result=((DB *)pHandle)->put((DB *)pHandle, NULL, &key,  &value, 0)) != 0)
-	{
-		logError("file: "__FILE__", line: %d, " \
-			"db_put fail, " \
-			"errno: %d, error info: %s", \
-			__LINE__, result, db_strerror(result));
+			if (value == NULL)
+			{
+				result = cursor->del(cursor, 0);
+			}
+			else
+			{
+				result = cursor->put(cursor, key, value, \
+						DB_CURRENT);
+			}
+			close_result = cursor->close(cursor);
+			if (result == 0)
+			{
+				result = close_result;
+			}
+		}
+		else
+		{
+			/* release the cursor locks before the put, the new
+			   key must not have been added by another thread */
+			cursor->close(cursor);
+			if (result == DB_NOTFOUND && value != NULL)
+			{
+				result = db->put(db, NULL, key, value, \
+						DB_NOOVERWRITE);
+				if (result == DB_KEYEXIST)
+				{
+					continue;
+				}
+			}
+		}
+
+		if (result == DB_LOCK_DEADLOCK)
+		{
+			continue;
+		}
+
+		return result;
+	}
+}
+
+int db_set(StoreHandle *pHandle, const char *pKey, const int key_len, \
+	const char *pValue, const int value_len)
+{
+	int result;
+	int old_expires;
+	DBT key;
+	DBT value;
+
+	g_server_stat.total_set_count++;
+
+	memset(&key, 0, sizeof(key));
+	memset(&value, 0, sizeof(value));
+
+	key.data = (char *)pKey;
+	key.size = key_len;
+
+	value.data = (char *)pValue;
+	value.size = value_len;
+
+	if (DB_EXPIRE_INDEX(pHandle) != NULL)
+	{
+		result = db_rmw_write((DB *)pHandle, &key, &value, \
+				&old_expires);
+	}
+	else
+	{
+		result = ((DB *)pHandle)->put((DB *)pHandle, NULL, \
+				&key, &value, 0);
+	}
+	if (result != 0)
+	{
+		logError("file: "__FILE__", line: %d, " \
+			"db_put fail, " \
+			"errno: %d, error info: %s", \
+			__LINE__, result, db_strerror(result));
 		return EFAULT;
 	}
 
+	if (DB_EXPIRE_INDEX(pHandle) != NULL && value_len >= 4)
+	{
+		db_expire_index_update(DB_EXPIRE_INDEX(pHandle), pKey, \
+			key_len, old_expires, buff2int(pValue));
+	}
+
 	g_server_stat.success_set_count++;
 	return result;
 }
@@ -286,11 +765,17 @@ int db_partial_set(StoreHandle *pHandle, const char *pKey, const int key_len, \
 	const char *pValue, const int offset, const int value_len)
 {
 	int result;
+	int old_expires;
+	bool bIndexed;
 	DBT key;
 	DBT value;
 
 	g_server_stat.total_set_count++;
 
+	/* the expires is the first 4 bytes of the value */
+	bIndexed = DB_EXPIRE_INDEX(pHandle) != NULL && offset == 0 && \
+			value_len >= 4;
+
 	memset(&key, 0, sizeof(key));
 	memset(&value, 0, sizeof(value));
 
@@ -303,7 +788,17 @@ int db_partial_set(StoreHandle *pHandle, const char *pKey, const int key_len, \
 	value.dlen = value_len;
 	value.size = value_len;
 
-	if ((result=((DB *)pHandle)->put((DB *)pHandle, NULL, &key,  &value, 0)) != 0)
+	if (bIndexed)
+	{
+		result = db_rmw_write((DB *)pHandle, &key, &value, \
+				&old_expires);
+	}
+	else
+	{
+		result = ((DB *)pHandle)->put((DB *)pHandle, NULL, \
+				&key, &value, 0);
+	}
+	if (result != 0)
 	{
 		logError("file: "__FILE__", line: %d, " \
 			"db_put fail, " \
@@ -312,6 +807,12 @@ int db_partial_set(StoreHandle *pHandle, const char *pKey, const int key_len, \
 		return EFAULT;
 	}
 
+	if (bIndexed)
+	{
+		db_expire_index_update(DB_EXPIRE_INDEX(pHandle), pKey, \
+			key_len, old_expires, buff2int(pValue));
+	}
+
 	g_server_stat.success_set_count++;
 	return result;
 }
@@ -382,148 +883,512 @@ int db_get(StoreHandle *pHandle, const char *pKey, const int key_len, \
 	return result;
 }
 
-int db_delete(StoreHandle *pHandle, const char *pKey, const int key_len)
+/* the value is read once by DB_DBT_REALLOC to the buffer of the thread,
+   then copied to the buffer enlarged when smaller */
+static int _db_do_get_ex(StoreHandle *pHandle, const char *pKey, \
+		const int key_len, FDHTGetBuffer *pBuffer)
 {
+	DBGetBuffer *pGetBuff;
 	int result;
 	DBT key;
+	DBT value;
 
-	g_server_stat.total_delete_count++;
+	pGetBuff = (DBGetBuffer *)pthread_getspecific(g_db_get_buff_key);
+	if (pGetBuff == NULL)
+	{
+		pGetBuff = (DBGetBuffer *)calloc(1, sizeof(DBGetBuffer));
+		if (pGetBuff == NULL)
+		{
+			logError("file: "__FILE__", line: %d, " \
+				"malloc %d bytes fail, " \
+				"errno: %d, error info: %s", \
+				__LINE__, (int)sizeof(DBGetBuffer), \
+				errno, STRERROR(errno));
+			return errno != 0 ? errno : ENOMEM;
+		}
+		pthread_setspecific(g_db_get_buff_key, pGetBuff);
+	}
 
 	memset(&key, 0, sizeof(key));
+	memset(&value, 0, sizeof(value));
+
 	key.data = (char *)pKey;
 	key.size = key_len;
 
-	if ((result=((DB *)pHandle)->del((DB *)pHandle, NULL, &key, 0)) != 0)
+	value.flags = DB_DBT_REALLOC;
+	value.data = pGetBuff->data;
+	value.size = pGetBuff->size;
+
+	result = ((DB *)pHandle)->get((DB *)pHandle, NULL, &key, &value, 0);
+	pGetBuff->data = value.data;
+	if (result != 0)
 	{
 		if (result == DB_NOTFOUND)
 		{
 			return ENOENT;
 		}
-		else
-		{
-			logError("file: "__FILE__", line: %d, " \
-				"db_del fail, " \
-				"errno: %d, error info: %s", \
-				__LINE__, result, db_strerror(result));
-	
-			return EFAULT;
-		}
+
+		logError("file: "__FILE__", line: %d, " \
+			"db_get fail, " \
+			"errno: %d, error info: %s", \
+			__LINE__, result, db_strerror(result));
+		return EFAULT;
+	}
+
+	pGetBuff->size = value.size;
+	if ((result=store_get_buffer_reserve(pBuffer, value.size)) == 0)
+	{
+		memcpy(pBuffer->buff, value.data, value.size);
+		pBuffer->value_len = value.size;
+	}
+
+	if (pGetBuff->size > DB_GET_BUFF_KEEP_SIZE)
+	{
+		free(pGetBuff->data);
+		pGetBuff->data = NULL;
+		pGetBuff->size = 0;
 	}
 
-	g_server_stat.success_delete_count++;
 	return result;
 }
 
-int db_inc(StoreHandle *pHandle, const char *pKey, const int key_len, \
-	const int inc, char *pValue, int *value_len)
+int db_get_ex(StoreHandle *pHandle, const char *pKey, const int key_len, \
+		FDHTGetBuffer *pBuffer)
+{
+	int result;
+
+	g_server_stat.total_get_count++;
+	if ((result=_db_do_get_ex(pHandle, pKey, key_len, pBuffer)) == 0)
+	{
+		g_server_stat.success_get_count++;
+	}
+
+	return result;
+}
+
+/* the order of the btree keys: byte by byte, then the shorter first */
+static int db_key_compare(const void *key1, const int key_len1, \
+		const void *key2, const int key_len2)
 {
-	int64_t n;
 	int result;
+
+	result = memcmp(key1, key2, key_len1 < key_len2 ? key_len1 : key_len2);
+	if (result != 0)
+	{
+		return result;
+	}
+
+	return key_len1 - key_len2;
+}
+
+static int db_batch_item_compare(const void *p1, const void *p2)
+{
+	FDHTBatchGetItem *pItem1;
+	FDHTBatchGetItem *pItem2;
+
+	pItem1 = *((FDHTBatchGetItem **)p1);
+	pItem2 = *((FDHTBatchGetItem **)p2);
+	return db_key_compare(pItem1->pKey, pItem1->key_len, \
+			pItem2->pKey, pItem2->key_len);
+}
+
+static void db_batch_copy_value(FDHTBatchGetItem *pItem, \
+		FDHTBatchGetBuffer *pBuffer, const void *pData, \
+		const int data_len)
+{
+	char *pValue;
+
+	if ((pValue=store_batch_value_alloc(pBuffer, pItem, \
+			data_len)) == NULL)
+	{
+		pItem->status = ENOMEM;
+		return;
+	}
+
+	memcpy(pValue, pData, data_len);
+	pItem->status = 0;
+	g_server_stat.success_get_count++;
+}
+
+/* get the key not in the bulk buffer, such as the record is larger */
+static void db_batch_get_one(StoreHandle *pHandle, FDHTBatchGetItem *pItem, \
+		FDHTBatchGetBuffer *pBuffer)
+{
+	char *pValue;
+	int value_len;
+
+	pValue = NULL;
+	if ((pItem->status=_db_do_get(pHandle, pItem->pKey, \
+		pItem->key_len, &pValue, &value_len)) != 0)
+	{
+		return;
+	}
+
+	db_batch_copy_value(pItem, pBuffer, pValue, value_len);
+	free(pValue);
+}
+
+/* the keys of a batch share the prefix namespace and object id, so they
+   are adjacent in the btree. the keys are sorted and read by the cursor
+   in the bulk buffer, the cursor is positioned again only when a key is
+   after the records read */
+int db_batch_get(StoreHandle *pHandle, FDHTBatchGetItem *items, \
+		const int count, FDHTBatchGetBuffer *pBuffer)
+{
+	DB *db;
+	DBC *cursor;
+	FDHTBatchGetItem *sorted[FDHT_MAX_KEY_COUNT_PER_REQ];
+	FDHTBatchGetItem *pItem;
+	u_int32_t *bulk_buff;
+	void *p;
+	void *pRetKey;
+	void *pRetData;
+	u_int32_t ret_key_len;
+	u_int32_t ret_data_len;
+	int result;
+	int i;
 	DBT key;
 	DBT value;
 
-	g_server_stat.total_inc_count++;
+	if (g_db_type != DB_BTREE || count > FDHT_MAX_KEY_COUNT_PER_REQ)
+	{
+		return store_batch_get(pHandle, items, count, pBuffer);
+	}
 
-	if ((result=_db_do_get(pHandle, pKey, key_len, \
-               	&pValue, value_len)) != 0)
+	bulk_buff = (u_int32_t *)malloc(DB_BULK_BUFF_SIZE);
+	if (bulk_buff == NULL)
 	{
-		if (result != ENOENT)
+		logError("file: "__FILE__", line: %d, " \
+			"malloc %d bytes fail, " \
+			"errno: %d, error info: %s", \
+			__LINE__, DB_BULK_BUFF_SIZE, \
+			errno, STRERROR(errno));
+		return store_batch_get(pHandle, items, count, pBuffer);
+	}
+
+	db = (DB *)pHandle;
+	if ((result=db->cursor(db, NULL, &cursor, 0)) != 0)
+	{
+		logError("file: "__FILE__", line: %d, " \
+			"db->cursor fail, errno: %d, error info: %s", \
+			__LINE__, result, db_strerror(result));
+		free(bulk_buff);
+		return store_batch_get(pHandle, items, count, pBuffer);
+	}
+
+	g_server_stat.total_get_count += count;
+	for (i=0; i<count; i++)
+	{
+		sorted[i] = items + i;
+	}
+	qsort(sorted, count, sizeof(FDHTBatchGetItem *), \
+		db_batch_item_compare);
+
+	i = 0;
+	while (i < count)
+	{
+		memset(&key, 0, sizeof(key));
+		memset(&value, 0, sizeof(value));
+		key.data = (char *)sorted[i]->pKey;
+		key.size = sorted[i]->key_len;
+
+		value.flags = DB_DBT_USERMEM;
+		value.data = bulk_buff;
+		value.ulen = DB_BULK_BUFF_SIZE;
+
+		result = cursor->get(cursor, &key, &value, \
+				DB_SET_RANGE | DB_MULTIPLE_KEY);
+		if (result == DB_NOTFOUND)  //after the last record
 		{
-			return result;
+			while (i < count)
+			{
+				sorted[i++]->status = ENOENT;
+			}
+			break;
+		}
+		else if (result == DB_BUFFER_SMALL)
+		{
+			db_batch_get_one(pHandle, sorted[i++], pBuffer);
+			continue;
+		}
+		else if (result != 0)
+		{
+			if (result != DB_LOCK_DEADLOCK)
+			{
+				logError("file: "__FILE__", line: %d, " \
+					"cursor->get fail, " \
+					"errno: %d, error info: %s", \
+					__LINE__, result, db_strerror(result));
+			}
+			break;
 		}
 
-		n = inc;
+		/* the keys before or equal to the record are done */
+		DB_MULTIPLE_INIT(p, &value);
+		while (i < count)
+		{
+			DB_MULTIPLE_KEY_NEXT(p, &value, pRetKey, ret_key_len, \
+					pRetData, ret_data_len);
+			if (p == NULL)
+			{
+				break;
+			}
+
+			while (i < count && (result=db_key_compare( \
+				sorted[i]->pKey, sorted[i]->key_len, \
+				pRetKey, ret_key_len)) <= 0)
+			{
+				pItem = sorted[i++];
+				if (result == 0)
+				{
+					db_batch_copy_value(pItem, pBuffer, \
+						pRetData, ret_data_len);
+				}
+				else
+				{
+					pItem->status = ENOENT;
+				}
+			}
+		}
 	}
-	else
+
+	cursor->close(cursor);
+	free(bulk_buff);
+
+	/* the cursor failed, such as deadlock, get the others one by one */
+	while (i < count)
 	{
-		pValue[*value_len] = '\0';
-		n = strtoll(pValue, NULL, 10);
-		n += inc;
+		db_batch_get_one(pHandle, sorted[i++], pBuffer);
 	}
 
-	*value_len = sprintf(pValue, INT64_PRINTF_FORMAT, n);
+	return 0;
+}
 
-	memset(&key, 0, sizeof(key));
-	memset(&value, 0, sizeof(value));
+int db_delete(StoreHandle *pHandle, const char *pKey, const int key_len)
+{
+	int result;
+	int old_expires;
+	DBT key;
+
+	g_server_stat.total_delete_count++;
 
+	memset(&key, 0, sizeof(key));
 	key.data = (char *)pKey;
 	key.size = key_len;
 
-	value.data = (char *)pValue;
-	value.size = *value_len;
+	old_expires = FDHT_EXPIRES_NEVER;
+	if (DB_EXPIRE_INDEX(pHandle) != NULL)
+	{
+		result = db_rmw_write((DB *)pHandle, &key, NULL, \
+				&old_expires);
+	}
+	else
+	{
+		result = ((DB *)pHandle)->del((DB *)pHandle, NULL, &key, 0);
+	}
+	if (result != 0)
+	{
+		if (result == DB_NOTFOUND)
+		{
+			return ENOENT;
+		}
+		else
+		{
+			logError("file: "__FILE__", line: %d, " \
+				"db_del fail, " \
+				"errno: %d, error info: %s", \
+				__LINE__, result, db_strerror(result));
+	
+			return EFAULT;
+		}
+	}
 
-	if ((result=((DB *)pHandle)->put((DB *)pHandle, NULL, &key,  &value, 0)) != 0)
+	if (old_expires != FDHT_EXPIRES_NEVER)
 	{
-		logError("file: "__FILE__", line: %d, " \
-			"db_put fail, " \
-			"errno: %d, error info: %s", \
-			__LINE__, result, db_strerror(result));
-		return EFAULT;
+		db_expire_index_delete(DB_EXPIRE_INDEX(pHandle), pKey, \
+			key_len, old_expires);
 	}
 
-	g_server_stat.success_inc_count++;
+	g_server_stat.success_delete_count++;
 	return result;
 }
 
-int db_inc_ex(StoreHandle *pHandle, const char *pKey, const int key_len, \
-	const int inc, char *pValue, int *value_len, const int expires)
+/* read-modify-write the counter under the DB_RMW write lock of the cursor,
+   so concurrent INCs of the same key never lose an update and INCs of
+   different keys only contend on the BDB page locks */
+static int _db_do_inc(StoreHandle *pHandle, const char *pKey, \
+	const int key_len, const int inc, char *pValue, int *value_len, \
+	const int expires, const bool with_expires)
 {
+	DB *db;
+	DBC *cursor;
 	int64_t n;
 	int result;
+	int close_result;
+	int buff_size;
+	int head_len;
 	int old_expires;
 	DBT key;
 	DBT value;
 
-	g_server_stat.total_inc_count++;
+	db = (DB *)pHandle;
+	buff_size = *value_len;
+	head_len = with_expires ? 4 : 0;
 
-	if ((result=_db_do_get(pHandle, pKey, key_len, \
-               	&pValue, value_len)) != 0)
+	memset(&key, 0, sizeof(key));
+	key.data = (char *)pKey;
+	key.size = key_len;
+
+	while (1)
 	{
-		if (result != ENOENT && result != ENOSPC)
+		if ((result=db->cursor(db, NULL, &cursor, 0)) != 0)
 		{
-			return result;
+			logError("file: "__FILE__", line: %d, " \
+				"db->cursor fail, " \
+				"errno: %d, error info: %s", \
+				__LINE__, result, db_strerror(result));
+			return EFAULT;
 		}
 
-		n = inc;
-	}
-	else
-	{
-		old_expires = buff2int(pValue);
-		if (old_expires != FDHT_EXPIRES_NEVER && \
-			old_expires < g_current_time) //expired
+		memset(&value, 0, sizeof(value));
+		value.flags = DB_DBT_USERMEM;
+		value.data = pValue;
+		value.ulen = buff_size;
+
+		result = cursor->get(cursor, &key, &value, DB_SET | DB_RMW);
+		if (result == 0)
+		{
+			old_expires = with_expires ? buff2int(pValue) : \
+					FDHT_EXPIRES_NEVER;
+			if (old_expires != FDHT_EXPIRES_NEVER && \
+				old_expires < g_current_time) //expired
+			{
+				n = inc;
+			}
+			else
+			{
+				pValue[value.size] = '\0';
+				n = strtoll(pValue + head_len, NULL, 10);
+				n += inc;
+			}
+		}
+		else if (result == DB_NOTFOUND || (result == DB_BUFFER_SMALL \
+				&& with_expires))
 		{
 			n = inc;
+			old_expires = FDHT_EXPIRES_NEVER;
+			if (result == DB_BUFFER_SMALL && \
+				DB_EXPIRE_INDEX(db) != NULL)
+			{
+				old_expires = db_get_old_expires(db, \
+						pKey, key_len);
+			}
 		}
 		else
 		{
-			pValue[*value_len] = '\0';
-			n = strtoll(pValue+4, NULL, 10);
-			n += inc;
+			cursor->close(cursor);
+			if (result == DB_LOCK_DEADLOCK)
+			{
+				continue;
+			}
+			if (result == DB_BUFFER_SMALL)
+			{
+				*value_len = value.size;
+				return ENOSPC;
+			}
+
+			logError("file: "__FILE__", line: %d, " \
+				"cursor->get fail, " \
+				"errno: %d, error info: %s", \
+				__LINE__, result, db_strerror(result));
+			return EFAULT;
+		}
+
+		if (with_expires)
+		{
+			int2buff(expires, pValue);
+		}
+		*value_len = head_len + sprintf(pValue + head_len, \
+				INT64_PRINTF_FORMAT, n);
+
+		memset(&value, 0, sizeof(value));
+		value.data = pValue;
+		value.size = *value_len;
+
+		if (result == 0)
+		{
+			result = cursor->put(cursor, &key, &value, DB_CURRENT);
+			close_result = cursor->close(cursor);
+			if (result == 0)
+			{
+				result = close_result;
+			}
+		}
+		else
+		{
+			/* release the cursor locks before the put, the new
+			   key must not have been added by another thread */
+			cursor->close(cursor);
+			result = db->put(db, NULL, &key, &value, \
+				result == DB_NOTFOUND ? DB_NOOVERWRITE : 0);
+			if (result == DB_KEYEXIST)
+			{
+				continue;
+			}
 		}
+
+		if (result == DB_LOCK_DEADLOCK)
+		{
+			continue;
+		}
+		if (result != 0)
+		{
+			logError("file: "__FILE__", line: %d, " \
+				"db_put fail, " \
+				"errno: %d, error info: %s", \
+				__LINE__, result, db_strerror(result));
+			return EFAULT;
+		}
+
+		if (with_expires && DB_EXPIRE_INDEX(db) != NULL)
+		{
+			db_expire_index_update(DB_EXPIRE_INDEX(db), pKey, \
+				key_len, old_expires, expires);
+		}
+
+		return 0;
 	}
+}
 
-	int2buff(expires, pValue);
-	*value_len = 4 + sprintf(pValue+4, INT64_PRINTF_FORMAT, n);
+int db_inc(StoreHandle *pHandle, const char *pKey, const int key_len, \
+	const int inc, char *pValue, int *value_len)
+{
+	int result;
 
-	memset(&key, 0, sizeof(key));
-	memset(&value, 0, sizeof(value));
+	g_server_stat.total_inc_count++;
 
-	key.data = (char *)pKey;
-	key.size = key_len;
+	if ((result=_db_do_inc(pHandle, pKey, key_len, inc, \
+			pValue, value_len, FDHT_EXPIRES_NEVER, false)) == 0)
+	{
+		g_server_stat.success_inc_count++;
+	}
 
-	value.data = (char *)pValue;
-	value.size = *value_len;
+	return result;
+}
+
+int db_inc_ex(StoreHandle *pHandle, const char *pKey, const int key_len, \
+	const int inc, char *pValue, int *value_len, const int expires)
+{
+	int result;
 
-	if ((result=((DB *)pHandle)->put((DB *)pHandle, NULL, &key,  &value, 0)) != 0)
+	g_server_stat.total_inc_count++;
+
+	if ((result=_db_do_inc(pHandle, pKey, key_len, inc, \
+			pValue, value_len, expires, true)) == 0)
 	{
-		logError("file: "__FILE__", line: %d, " \
-			"db_put fail, " \
-			"errno: %d, error info: %s", \
-			__LINE__, result, db_strerror(result));
-		return EFAULT;
+		g_server_stat.success_inc_count++;
 	}
 
-	g_server_stat.success_inc_count++;
 	return result;
 }
 
@@ -548,41 +1413,254 @@ void *bdb_dl_detect_entrance(void *arg)
 	return NULL;
 }
 
-int db_clear_expired_keys(void *arg)
+/* delete the key when its expires is the same as the index. the expires
+   is read and the key deleted by the cursor under the DB_RMW write lock,
+   so a concurrent write of the key is never deleted. when the expires
+   was changed, the index entry of the current expires is put again, so
+   the index entry lost by the concurrent writes is healed.
+   return 0 for deleted, ENOENT for the key not exist or changed */
+static int db_delete_expired_key(DB *db, const char *pKey, \
+		const int key_len, const int expires)
 {
-	int db_index;
-	DB *db;
 	DBC *cursor;
 	int result;
+	int current_expires;
+	char szValue[4];
 	DBT key;
 	DBT value;
-	char szKey[FDHT_MAX_NAMESPACE_LEN + FDHT_MAX_OBJECT_ID_LEN + \
-		   FDHT_MAX_SUB_KEY_LEN + 2];
-	char szValue[4];
-	time_t current_time;
-	struct timeval tv_start;
-	struct timeval tv_end;
-	int64_t total_count;
-	int64_t expired_count;
-	int64_t success_count;
-	int expires;
 
-	if (gettimeofday(&tv_start, NULL) != 0)
+	memset(&key, 0, sizeof(key));
+	key.data = (char *)pKey;
+	key.size = key_len;
+
+	while (1)
 	{
+		if ((result=db->cursor(db, NULL, &cursor, 0)) != 0)
+		{
+			logError("file: "__FILE__", line: %d, " \
+				"db->cursor fail, " \
+				"errno: %d, error info: %s", \
+				__LINE__, result, db_strerror(result));
+			return EFAULT;
+		}
+
+		memset(&value, 0, sizeof(value));
+		value.flags = DB_DBT_USERMEM | DB_DBT_PARTIAL;
+		value.data = szValue;
+		value.ulen = sizeof(szValue);
+		value.dlen = sizeof(szValue);
+
+		current_expires = FDHT_EXPIRES_NEVER;
+		result = cursor->get(cursor, &key, &value, DB_SET | DB_RMW);
+		if (result == 0)
+		{
+			if (value.size == sizeof(szValue))
+			{
+				current_expires = buff2int(szValue);
+			}
+
+			if (current_expires == expires)
+			{
+				result = cursor->del(cursor, 0);
+			}
+			else
+			{
+				result = DB_NOTFOUND;
+			}
+		}
+		cursor->close(cursor);
+
+		if (result == DB_LOCK_DEADLOCK)
+		{
+			continue;
+		}
+		if (result == DB_NOTFOUND && current_expires != expires && \
+			current_expires != FDHT_EXPIRES_NEVER)
+		{
+			db_expire_index_put(DB_EXPIRE_INDEX(db), pKey, \
+				key_len, current_expires);
+		}
+		if (result == 0 || result == DB_NOTFOUND)
+		{
+			return result == 0 ? 0 : ENOENT;
+		}
+
 		logError("file: "__FILE__", line: %d, " \
-			"call gettimeofday fail, errno: %d, error info: %s", \
-			__LINE__, errno, STRERROR(errno));
-		return -1;
+			"delete the expired key fail, " \
+			"errno: %d, error info: %s", \
+			__LINE__, result, db_strerror(result));
+		return EFAULT;
 	}
+}
+
+/* read the index keys due by the cursor in a batch, then delete the keys
+   after the cursor closed, so the cursor does not hold the index page
+   locks when deleting. the index key is deleted even if the primary key
+   was changed (stale entry), the primary key is deleted only when its
+   expires is the same. the next batch starts after the last index key
+   read, so the index keys failed to delete are not read again */
+static int db_clear_expired_by_index(DB *db, DB *pIndex, \
+		const time_t current_time, int64_t *total_count, \
+		int64_t *expired_count, int64_t *success_count)
+{
+	DBC *cursor;
+	char *index_keys;
+	int key_lens[DB_EXPIRE_POP_BATCH];
+	char last_key[DB_EXPIRE_INDEX_KEY_SIZE];
+	int last_key_len;
+	char *pIndexKey;
+	u_int32_t flags;
+	int count;
+	int result;
+	int i;
+	DBT key;
+	DBT value;
+
+	index_keys = (char *)malloc(DB_EXPIRE_INDEX_KEY_SIZE * \
+				DB_EXPIRE_POP_BATCH);
+	if (index_keys == NULL)
+	{
+		logError("file: "__FILE__", line: %d, " \
+			"malloc %d bytes fail, " \
+			"errno: %d, error info: %s", __LINE__, \
+			DB_EXPIRE_INDEX_KEY_SIZE * DB_EXPIRE_POP_BATCH, \
+			errno, STRERROR(errno));
+		return errno != 0 ? errno : ENOMEM;
+	}
+
+	result = 0;
+	last_key_len = 0;
+	while (g_continue_flag)
+	{
+		if ((result=pIndex->cursor(pIndex, NULL, &cursor, 0)) != 0)
+		{
+			logError("file: "__FILE__", line: %d, " \
+				"db->cursor fail, errno: %d, error info: %s", \
+				__LINE__, result, db_strerror(result));
+			result = EFAULT;
+			break;
+		}
+
+		memset(&key, 0, sizeof(key));
+		memset(&value, 0, sizeof(value));
+		key.flags = DB_DBT_USERMEM;
+		key.ulen = DB_EXPIRE_INDEX_KEY_SIZE;
+		value.flags = DB_DBT_USERMEM | DB_DBT_PARTIAL;
+
+		count = 0;
+		pIndexKey = index_keys;
+		key.data = pIndexKey;
+		if (last_key_len > 0)
+		{
+			memcpy(pIndexKey, last_key, last_key_len);
+			key.size = last_key_len;
+			flags = DB_SET_RANGE;
+		}
+		else
+		{
+			flags = DB_NEXT;
+		}
+		while (count < DB_EXPIRE_POP_BATCH && (result=cursor->get( \
+			cursor, &key, &value, flags)) == 0)
+		{
+			flags = DB_NEXT;
+			if (key.size == last_key_len && memcmp(pIndexKey, \
+				last_key, last_key_len) == 0)
+			{
+				continue;
+			}
+			if (key.size <= 4 || buff2int(pIndexKey) > current_time)
+			{
+				break;
+			}
+
+			key_lens[count++] = key.size;
+			pIndexKey += DB_EXPIRE_INDEX_KEY_SIZE;
+			key.data = pIndexKey;
+		}
+		cursor->close(cursor);
+
+		if (result == DB_LOCK_DEADLOCK)
+		{
+			continue;
+		}
+		if (result != 0 && result != DB_NOTFOUND)
+		{
+			logError("file: "__FILE__", line: %d, " \
+				"cursor->get fail, errno: %d, error info: %s", \
+				__LINE__, result, db_strerror(result));
+			result = EFAULT;
+			break;
+		}
+		result = 0;
+
+		pIndexKey = index_keys;
+		for (i=0; i<count; i++)
+		{
+			(*total_count)++;
+			result = db_delete_expired_key(db, pIndexKey + 4, \
+				key_lens[i] - 4, buff2int(pIndexKey));
+			if (result != ENOENT)
+			{
+				(*expired_count)++;
+				if (result == 0)
+				{
+					(*success_count)++;
+				}
+			}
+
+			memset(&key, 0, sizeof(key));
+			key.data = pIndexKey;
+			key.size = key_lens[i];
+			if ((result=pIndex->del(pIndex, NULL, &key, 0)) != 0 \
+				&& result != DB_NOTFOUND)
+			{
+				logError("file: "__FILE__", line: %d, " \
+					"delete the expire index fail, " \
+					"errno: %d, error info: %s", __LINE__, \
+					result, db_strerror(result));
+			}
+			pIndexKey += DB_EXPIRE_INDEX_KEY_SIZE;
+		}
+		result = 0;
+
+		if (count > 0)
+		{
+			last_key_len = key_lens[count - 1];
+			memcpy(last_key, index_keys + DB_EXPIRE_INDEX_KEY_SIZE * \
+				(count - 1), last_key_len);
+		}
+
+		if (count < DB_EXPIRE_POP_BATCH)
+		{
+			break;
+		}
+	}
+
+	free(index_keys);
+	return result;
+}
+
+/* read the expires of all the keys by the cursor */
+static int db_clear_expired_by_scan(DB *db, const time_t current_time, \
+		int64_t *total_count, int64_t *expired_count, \
+		int64_t *success_count)
+{
+	DBC *cursor;
+	int result;
+	DBT key;
+	DBT value;
+	char szKey[FDHT_MAX_NAMESPACE_LEN + FDHT_MAX_OBJECT_ID_LEN + \
+		   FDHT_MAX_SUB_KEY_LEN + 2];
+	char szValue[4];
+	int expires;
 
-	db_index = (long)arg;
-	db = (DB *)(g_db_list[db_index]);
 	if ((result=db->cursor(db, NULL, &cursor, 0)) != 0)
 	{
 		logError("file: "__FILE__", line: %d, " \
 			"db->cursor fail, errno: %d, error info: %s", \
 			__LINE__, result, db_strerror(result));
-		return -1;
+		return EFAULT;
 	}
 	
 	memset(&key, 0, sizeof(key));
@@ -597,11 +1675,6 @@ int db_clear_expired_keys(void *arg)
 	value.ulen = sizeof(szValue);
 	value.dlen = sizeof(szValue);
 
-	total_count = 0;
-	expired_count = 0;
-	success_count = 0;
-	current_time = tv_start.tv_sec;
-
 	while (g_continue_flag && (result=cursor->get(cursor, &key, &value, \
 		DB_NEXT)) == 0)
 	{
@@ -611,7 +1684,7 @@ int db_clear_expired_keys(void *arg)
 			buff2int((char *)value.data), value.size);
 		*/
 
-		total_count++;
+		(*total_count)++;
 
 		expires = buff2int((char *)value.data);
 		if (expires == FDHT_EXPIRES_NEVER || expires > current_time)
@@ -619,10 +1692,10 @@ int db_clear_expired_keys(void *arg)
 			continue;
 		}
 
-		expired_count++;
+		(*expired_count)++;
 		if ((result=cursor->del(cursor, 0)) == 0)
 		{
-			success_count++;
+			(*success_count)++;
 		}
 		else
 		{
@@ -633,13 +1706,62 @@ int db_clear_expired_keys(void *arg)
 	}
 
 	cursor->close(cursor);
+	return 0;
+}
+
+int db_clear_expired_keys(void *arg)
+{
+	int db_index;
+	DB *db;
+	int result;
+	time_t current_time;
+	struct timeval tv_start;
+	struct timeval tv_end;
+	int64_t total_count;
+	int64_t expired_count;
+	int64_t success_count;
+
+	if (gettimeofday(&tv_start, NULL) != 0)
+	{
+		logError("file: "__FILE__", line: %d, " \
+			"call gettimeofday fail, errno: %d, error info: %s", \
+			__LINE__, errno, STRERROR(errno));
+		return -1;
+	}
+
+	db_index = (long)arg;
+	db = (DB *)(g_db_list[db_index]);
+
+	total_count = 0;
+	expired_count = 0;
+	success_count = 0;
+	current_time = tv_start.tv_sec;
+
+	/* the index has the keys with the expires only, sorted by the
+	   expires, so only the keys due are read */
+	if (DB_EXPIRE_INDEX(db) != NULL)
+	{
+		result = db_clear_expired_by_index(db, DB_EXPIRE_INDEX(db), \
+			current_time, &total_count, &expired_count, \
+			&success_count);
+	}
+	else
+	{
+		result = db_clear_expired_by_scan(db, current_time, \
+			&total_count, &expired_count, &success_count);
+	}
+	if (result != 0 && total_count == 0)
+	{
+		return -1;
+	}
 
 	gettimeofday(&tv_end, NULL);
 
-	logInfo("clear expired keys, db %d, total count: "INT64_PRINTF_FORMAT \
-		", expired key count: "INT64_PRINTF_FORMAT \
+	logInfo("clear expired keys, db %d%s, total count: " \
+		INT64_PRINTF_FORMAT", expired key count: "INT64_PRINTF_FORMAT \
 		", success count: "INT64_PRINTF_FORMAT \
 		", time used: %dms", db_index + 1, \
+		DB_EXPIRE_INDEX(db) != NULL ? " by the expire index" : "", \
 		total_count, expired_count, success_count, \
 		(int)((tv_end.tv_sec - tv_start.tv_sec) * 1000 + \
 		(tv_end.tv_usec - tv_start.tv_usec) / 1000));
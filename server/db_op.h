@@ -37,6 +37,10 @@ int db_memp_sync();
 
 int db_get(StoreHandle *pHandle, const char *pKey, const int key_len, \
 		char **ppValue, int *size);
+int db_get_ex(StoreHandle *pHandle, const char *pKey, const int key_len, \
+		FDHTGetBuffer *pBuffer);
+int db_batch_get(StoreHandle *pHandle, FDHTBatchGetItem *items, \
+		const int count, FDHTBatchGetBuffer *pBuffer);
 int db_set(StoreHandle *pHandle, const char *pKey, const int key_len, \
 	const char *pValue, const int value_len);
 int db_partial_set(StoreHandle *pHandle, const char *pKey, const int key_len, \
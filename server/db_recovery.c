@@ -22,6 +22,7 @@
 #include "fast_task_queue.h"
 #include "sync.h"
 #include "func.h"
+#include "store.h"
 #include "db_recovery.h"
 
 #define LOCAL_DB_SYNC_MARK_FILENAME	"db_recovery_mark.dat"
@@ -38,8 +39,6 @@ static char *fdht_get_db_recovery_mark_filename(const void *pArg, \
 static int fdht_write_to_db_recovery_mark_file(const time_t timestamp, \
 		const int binlog_index, const int64_t binlog_offset, \
 		const int written_pages, const int time_used_ms);
-static int fdht_recover_data(const int start_binlog_index, \
-		const int64_t start_binlog_offset);
 
 int fdht_db_recovery_init()
 {
@@ -122,7 +121,7 @@ int fdht_db_recovery_init()
 	{
 		bRecovery = true;
 		result = fdht_recover_data(synced_binlog_index, \
-					synced_binlog_offset);
+				synced_binlog_offset, fdht_db_recovery_mark_fd);
 	}
 	else
 	{
@@ -278,7 +277,7 @@ static int recover_cmd_set(BinLogRecord *pRecord, BinField *pFullValue)
 	int2buff(pRecord->expires, pFullValue->data);
 	memcpy(pFullValue->data+4, pRecord->value.data, pRecord->value.length);
 	pFullValue->length = 4 + pRecord->value.length;
-	return db_set(g_db_list[group_id], full_key, full_key_len, \
+	return g_func_set(g_db_list[group_id], full_key, full_key_len, \
 			pFullValue->data, pFullValue->length);
 }
 
@@ -292,11 +291,11 @@ static int recover_cmd_del(BinLogRecord *pRecord)
 	CHECK_GROUP_ID(pRecord, group_id)
 	FDHT_PACK_FULL_KEY(pRecord->key_info, full_key, full_key_len, p)
 
-	return db_delete(g_db_list[group_id], full_key, full_key_len);
+	return g_func_delete(g_db_list[group_id], full_key, full_key_len);
 }
 
-static int fdht_recover_data(const int start_binlog_index, \
-		const int64_t start_binlog_offset)
+int fdht_recover_data(const int start_binlog_index, \
+		const int64_t start_binlog_offset, const int mark_fd)
 {
 	int result;
 	BinLogReader reader;
@@ -324,7 +323,7 @@ static int fdht_recover_data(const int start_binlog_index, \
 	reader.binlog_index = start_binlog_index;
 	reader.binlog_offset = start_binlog_offset;
 	reader.binlog_fd = -1;
-	reader.mark_fd = fdht_db_recovery_mark_fd;
+	reader.mark_fd = mark_fd;
 	if ((result=fdht_open_readable_binlog(&reader)) != 0)
 	{
 		return result;
@@ -24,6 +24,18 @@ extern "C" {
 int fdht_db_recovery_init();
 int fdht_memp_trickle_dbs(void *args);
 
+/**
+* replay the local binlog from the position by the store functions
+* params:
+*	start_binlog_index: the binlog file index to start
+*	start_binlog_offset: the offset in the binlog file to start
+*	mark_fd: the file to write the position when the binlog file
+*		rotated, -1 for none
+* return: error no, 0 for success, != 0 fail
+*/
+int fdht_recover_data(const int start_binlog_index, \
+		const int64_t start_binlog_offset, const int mark_fd);
+
 #ifdef __cplusplus
 }
 #endif
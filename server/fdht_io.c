@@ -19,6 +19,7 @@
 #include <sys/types.h>
 #include <sys/time.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <netinet/in.h>
 #include <pthread.h>
 #include "shared_func.h"
@@ -31,14 +32,81 @@
 #include "fdht_proto.h"
 #include "fast_task_queue.h"
 #include "work_thread.h"
+#include "store_thread.h"
+#include "mpool_op.h"
 #include "ioevent_loop.h"
 #include "fdht_io.h"
 
+static volatile int curr_connections = 0;  //the connections accepted
+
 static void client_sock_read(int sock, short event, void *arg);
 static void client_sock_write(int sock, short event, void *arg);
+static void deal_request(struct fast_task_info *pTask);
+
+bool task_connection_acquire(const int sock)
+{
+	if (__sync_add_and_fetch(&curr_connections, 1) > g_max_connections)
+	{
+		__sync_sub_and_fetch(&curr_connections, 1);
+		logWarning("file: "__FILE__", line: %d, " \
+			"max connections: %d reached, close the " \
+			"connection", __LINE__, g_max_connections);
+		close(sock);
+		return false;
+	}
+
+	return true;
+}
+
+void task_connection_release()
+{
+	__sync_sub_and_fetch(&curr_connections, 1);
+}
+
+static void task_release_value(FDHTTaskArg *pArg)
+{
+	if (pArg->value_ref != NULL)
+	{
+		mp_release(pArg->value_ref);
+		pArg->value_ref = NULL;
+	}
+
+	pArg->value_buff = NULL;
+	pArg->value_length = 0;
+}
+
+static void task_arg_reset(FDHTTaskArg *pArg)
+{
+	task_release_value(pArg);
+	if (pArg->pending_size > g_min_buff_size)
+	{
+		free(pArg->pending_buff);
+		pArg->pending_buff = NULL;
+		pArg->pending_size = 0;
+	}
+
+	if (pArg->resp_size > g_min_buff_size)
+	{
+		free(pArg->resp_buff);
+		pArg->resp_buff = NULL;
+		pArg->resp_size = 0;
+	}
+
+	pArg->pending_offset = 0;
+	pArg->pending_length = 0;
+	pArg->resp_length = 0;
+	pArg->keep_alive = false;
+}
 
 void task_finish_clean_up(struct fast_task_info *pTask)
 {
+	if (pTask->nio_stage == FDHT_NIO_STAGE_SEND)
+	{
+		pTask->thread_data->in_flight_count--;
+	}
+	__sync_sub_and_fetch(&pTask->thread_data->connection_count, 1);
+	task_connection_release();
+
 	ioevent_detach(&pTask->thread_data->ev_puller, pTask->event.fd);
 	close(pTask->event.fd);
 	pTask->event.fd = -1;
@@ -50,87 +118,466 @@ void task_finish_clean_up(struct fast_task_info *pTask)
 		pTask->event.timer.expires = 0;
 	}
 
+	task_arg_reset(TASK_ARG(pTask));
+	free_queue_push_ex(pTask->thread_data, pTask);
+}
+
+void task_release(struct fast_task_info *pTask)
+{
+	close(pTask->event.fd);
+	pTask->event.fd = -1;
+	task_connection_release();
+
+	task_arg_reset(TASK_ARG(pTask));
 	free_queue_push(pTask);
 }
 
-void recv_notify_read(int sock, short event, void *arg)
+int task_notify_nio(struct fast_task_info *pTask)
 {
-	int bytes;
-	int incomesock;
-	struct nio_thread_data *pThreadData;
-	struct fast_task_info *pTask;
-	char szClientIp[IP_ADDRESS_SIZE];
-	in_addr_t client_addr;
+	long task_addr;
+	int result;
+
+	task_addr = (long)pTask;
+	if (write(pTask->thread_data->pipe_fds[1], &task_addr, \
+		sizeof(task_addr)) != sizeof(task_addr))
+	{
+		result = errno != 0 ? errno : EIO;
+		logError("file: "__FILE__", line: %d, " \
+			"call write failed, " \
+			"errno: %d, error info: %s", \
+			__LINE__, result, STRERROR(result));
+		return result;
+	}
+
+	return 0;
+}
+
+static int check_pkg_len(struct fast_task_info *pTask, const int pkg_len)
+{
+	if (pkg_len < 0)
+	{
+		logError("file: "__FILE__", line: %d, " \
+			"client ip: %s, pkg length: %d < 0", \
+			__LINE__, pTask->client_ip, pkg_len);
+		return EINVAL;
+	}
+
+	if (pkg_len + (int)sizeof(FDHTProtoHeader) > g_max_pkg_size)
+	{
+		logError("file: "__FILE__", line: %d, " \
+			"client ip: %s, pkg length: %d > " \
+			"max pkg size: %d", __LINE__, \
+			pTask->client_ip, pkg_len + \
+			(int)sizeof(FDHTProtoHeader), g_max_pkg_size);
+		return EINVAL;
+	}
+
+	return 0;
+}
+
+static int check_buff_size(char **buff, int *size, const int expect_size)
+{
+	char *pTemp;
+	int new_size;
+
+	if (*size >= expect_size)
+	{
+		return 0;
+	}
+
+	new_size = *size > 0 ? *size : g_min_buff_size;
+	while (new_size < expect_size)
+	{
+		new_size *= 2;
+	}
+
+	pTemp = (char *)realloc(*buff, new_size);
+	if (pTemp == NULL)
+	{
+		logError("file: "__FILE__", line: %d, " \
+			"realloc %d bytes failed, " \
+			"errno: %d, error info: %s", \
+			__LINE__, new_size, errno, STRERROR(errno));
+		return errno != 0 ? errno : ENOMEM;
+	}
+
+	*buff = pTemp;
+	*size = new_size;
+	return 0;
+}
+
+/* move the next pipelined request to the task buffer
+   return: true if a whole request is moved */
+static bool fetch_pending_request(struct fast_task_info *pTask, int *result)
+{
+	FDHTTaskArg *pArg;
+	char *pStart;
+	int remain;
+	int req_len;
+
+	*result = 0;
+	pArg = TASK_ARG(pTask);
+	pStart = pArg->pending_buff + pArg->pending_offset;
+	remain = pArg->pending_length - pArg->pending_offset;
+	if (remain < (int)sizeof(FDHTProtoHeader))
+	{
+		return false;
+	}
+
+	req_len = buff2int(((FDHTProtoHeader *)pStart)->pkg_len);
+	if ((*result=check_pkg_len(pTask, req_len)) != 0)
+	{
+		return false;
+	}
+
+	req_len += sizeof(FDHTProtoHeader);
+	if (remain < req_len)
+	{
+		return false;
+	}
+
+	if ((*result=free_queue_alloc_buffer(pTask, req_len)) != 0)
+	{
+		return false;
+	}
+
+	memcpy(pTask->data, pStart, req_len);
+	pTask->length = req_len;
+	pTask->offset = req_len;
+	pArg->pending_offset += req_len;
+	if (pArg->pending_offset == pArg->pending_length)
+	{
+		pArg->pending_offset = 0;
+		pArg->pending_length = 0;
+	}
+
+	return true;
+}
+
+void task_deal_requests(struct fast_task_info *pTask)
+{
+	FDHTTaskArg *pArg;
+	int extra_bytes;
+	int result;
+
+	pArg = TASK_ARG(pTask);
+	pArg->resp_length = 0;
+
+	/* save the pipelined requests after the first one */
+	extra_bytes = pTask->offset - pTask->length;
+	if (extra_bytes > 0)
+	{
+		if (check_buff_size(&pArg->pending_buff, &pArg->pending_size, \
+			pArg->pending_length + extra_bytes) != 0)
+		{
+			pArg->keep_alive = false;
+			pTask->length = 0;
+			return;
+		}
+
+		memcpy(pArg->pending_buff + pArg->pending_length, \
+			pTask->data + pTask->length, extra_bytes);
+		pArg->pending_length += extra_bytes;
+		pTask->offset = pTask->length;
+	}
 
 	while (1)
 	{
-		if ((bytes=read(sock, &incomesock, sizeof(incomesock))) < 0)
+		pArg->keep_alive = ((FDHTProtoHeader *)pTask->data)->keep_alive;
+		work_deal_task(pTask);
+		if (pTask->length == 0)  //quit
 		{
-			if (!(errno == EAGAIN || errno == EWOULDBLOCK))
-			{
-				logError("file: "__FILE__", line: %d, " \
-					"call read failed, " \
-					"errno: %d, error info: %s", \
-					__LINE__, errno, STRERROR(errno));
-			}
+			pArg->keep_alive = false;
+			break;
+		}
 
+		if (!pArg->keep_alive || pArg->pending_length == 0 || \
+			pArg->resp_length >= g_max_pkg_size)
+		{
 			break;
 		}
-		else if (bytes == 0)
+
+		/* queue the response and deal the next request */
+		if (check_buff_size(&pArg->resp_buff, &pArg->resp_size, \
+			pArg->resp_length + pTask->length + \
+			pArg->value_length) != 0)
 		{
 			break;
 		}
+		memcpy(pArg->resp_buff + pArg->resp_length, pTask->data, \
+			pTask->length);
+		pArg->resp_length += pTask->length;
+		pTask->length = 0;
+		if (pArg->value_length > 0)
+		{
+			memcpy(pArg->resp_buff + pArg->resp_length, \
+				pArg->value_buff, pArg->value_length);
+			pArg->resp_length += pArg->value_length;
+		}
+		task_release_value(pArg);
 
-		if (incomesock < 0)
+		if (!fetch_pending_request(pTask, &result))
+		{
+			if (result != 0)
+			{
+				pArg->keep_alive = false;
+			}
+			break;
+		}
+	}
+}
+
+static bool is_unix_socket(const int sock)
+{
+	struct sockaddr addr;
+	socklen_t addrlen;
+
+	addrlen = sizeof(addr);
+	return getsockname(sock, &addr, &addrlen) == 0 && \
+		addr.sa_family == AF_UNIX;
+}
+
+static void deal_new_connection(struct fast_task_info *pTask)
+{
+	in_addr_t client_addr;
+
+	/* the unix socket clients are on the same host */
+	if (*g_unix_socket_path != '\0' && is_unix_socket(pTask->event.fd))
+	{
+		strcpy(pTask->client_ip, "127.0.0.1");
+	}
+	else
+	{
+		client_addr = getPeerIpaddr(pTask->event.fd, \
+				pTask->client_ip, IP_ADDRESS_SIZE);
+		if (g_allow_ip_count >= 0 && bsearch(&client_addr, \
+			g_allow_ip_addrs, g_allow_ip_count, \
+			sizeof(in_addr_t), cmp_by_ip_addr_t) == NULL)
 		{
+			logError("file: "__FILE__", line: %d, " \
+				"ip addr %s is not allowed to access", \
+				__LINE__, pTask->client_ip);
+
+			task_finish_clean_up(pTask);
 			return;
 		}
+	}
+
+	if (tcpsetnonblockopt(pTask->event.fd) != 0)
+	{
+		task_finish_clean_up(pTask);
+		return;
+	}
+
+	pTask->nio_stage = FDHT_NIO_STAGE_RECV;
+	if (ioevent_set(pTask, pTask->thread_data, pTask->event.fd, \
+		IOEVENT_READ, client_sock_read, g_fdht_network_timeout) != 0)
+	{
+		task_finish_clean_up(pTask);
+	}
+}
+
+static void deal_store_done(struct fast_task_info *pTask)
+{
+	int result;
+
+	pTask->nio_stage = FDHT_NIO_STAGE_SEND;
+	if (pTask->length == 0 && TASK_ARG(pTask)->resp_length == 0) //quit
+	{
+		task_finish_clean_up(pTask);
+		return;
+	}
+
+	pTask->event.callback = client_sock_write;
+	if (ioevent_attach(&pTask->thread_data->ev_puller, \
+		pTask->event.fd, IOEVENT_WRITE, pTask) != 0)
+	{
+		result = errno != 0 ? errno : ENOENT;
+		logError("file: "__FILE__", line: %d, "\
+			"ioevent_attach fail, " \
+			"errno: %d, error info: %s", \
+			__LINE__, result, STRERROR(result));
 
-		client_addr = getPeerIpaddr(incomesock, \
-				szClientIp, IP_ADDRESS_SIZE);
-		if (g_allow_ip_count >= 0)
+		task_finish_clean_up(pTask);
+		return;
+	}
+
+	send_add_event(pTask);
+}
+
+static void deal_request(struct fast_task_info *pTask)
+{
+	pTask->thread_data->in_flight_count++;
+	if (g_store_threads == 0)
+	{
+		pTask->nio_stage = FDHT_NIO_STAGE_SEND;
+		task_deal_requests(pTask);
+		if (pTask->length == 0 && TASK_ARG(pTask)->resp_length == 0)
 		{
-			if (bsearch(&client_addr, g_allow_ip_addrs, \
-					g_allow_ip_count, sizeof(in_addr_t), \
-					cmp_by_ip_addr_t) == NULL)
-			{
-				logError("file: "__FILE__", line: %d, " \
-					"ip addr %s is not allowed to access", \
-					__LINE__, szClientIp);
+			task_finish_clean_up(pTask);  //quit
+		}
+		else
+		{
+			send_add_event(pTask);
+		}
+		return;
+	}
+
+	ioevent_detach(&pTask->thread_data->ev_puller, pTask->event.fd);
+	pTask->nio_stage = FDHT_NIO_STAGE_STORE;
+	if (store_thread_push(pTask) != 0)
+	{
+		pTask->nio_stage = FDHT_NIO_STAGE_SEND;
+		task_finish_clean_up(pTask);
+	}
+}
 
-				close(incomesock);
+void accept_sock_read(int sock, short event, void *arg)
+{
+	int incomesock;
+	struct sockaddr_in inaddr;
+	socklen_t sockaddr_len;
+	struct fast_task_info *pTask;
+
+	while (1)
+	{
+		sockaddr_len = sizeof(inaddr);
+		incomesock = accept(sock, (struct sockaddr*)&inaddr, \
+				&sockaddr_len);
+		if (incomesock < 0)
+		{
+			if (errno == EINTR)
+			{
 				continue;
 			}
+
+			if (!(errno == EAGAIN || errno == EWOULDBLOCK))
+			{
+				logError("file: "__FILE__", line: %d, " \
+					"accept failed, " \
+					"errno: %d, error info: %s", \
+					__LINE__, errno, STRERROR(errno));
+			}
+
+			break;
 		}
 
-		if (tcpsetnonblockopt(incomesock) != 0)
+		if (!task_connection_acquire(incomesock))
 		{
-			close(incomesock);
 			continue;
 		}
 
-		pTask = free_queue_pop();
+		pTask = free_queue_pop_ex((struct nio_thread_data *)arg);
 		if (pTask == NULL)
 		{
 			logError("file: "__FILE__", line: %d, " \
 				"malloc task buff failed", \
 				__LINE__);
 			close(incomesock);
+			task_connection_release();
 			continue;
 		}
 
-		strcpy(pTask->client_ip, szClientIp);
+		pTask->event.fd = incomesock;
+		pTask->thread_data = (struct nio_thread_data *)arg;
+		__sync_add_and_fetch(&pTask->thread_data->connection_count, 1);
+		pTask->nio_stage = FDHT_NIO_STAGE_INIT;
+		deal_new_connection(pTask);
+	}
+}
+
+static void deal_new_sock(struct nio_thread_data *pThreadData, \
+		const int incomesock)
+{
+	struct fast_task_info *pTask;
+
+	pTask = free_queue_pop_ex(pThreadData);
+	if (pTask == NULL)
+	{
+		logError("file: "__FILE__", line: %d, " \
+			"malloc task buff failed", \
+			__LINE__);
+		close(incomesock);
+		__sync_sub_and_fetch(&pThreadData->connection_count, 1);
+		task_connection_release();
+		return;
+	}
+
+	pTask->event.fd = incomesock;
+	pTask->thread_data = pThreadData;
+	pTask->nio_stage = FDHT_NIO_STAGE_INIT;
+	deal_new_connection(pTask);
+}
+
+void recv_notify_read(int sock, short event, void *arg)
+{
+	int bytes;
+	long task_addr;
+	struct fast_task_info *pTask;
+
+	while (1)
+	{
+		if ((bytes=read(sock, &task_addr, sizeof(task_addr))) < 0)
+		{
+			if (!(errno == EAGAIN || errno == EWOULDBLOCK))
+			{
+				logError("file: "__FILE__", line: %d, " \
+					"call read failed, " \
+					"errno: %d, error info: %s", \
+					__LINE__, errno, STRERROR(errno));
+			}
+
+			break;
+		}
+		else if (bytes == 0)
+		{
+			break;
+		}
+
+		if (task_addr < 0)
+		{
+			return;
+		}
 
-		pThreadData = g_thread_data + incomesock % g_max_threads;
-		if (ioevent_set(pTask, pThreadData, incomesock, IOEVENT_READ,
-			client_sock_read, g_fdht_network_timeout) != 0)
+		if (FDHT_NOTIFY_IS_SOCK(task_addr))
 		{
-			task_finish_clean_up(pTask);
+			deal_new_sock((struct nio_thread_data *)arg, \
+				FDHT_NOTIFY_GET_SOCK(task_addr));
 			continue;
 		}
+
+		/* the other tasks are notified by the store threads only */
+		pTask = (struct fast_task_info *)task_addr;
+		if (pTask->nio_stage != FDHT_NIO_STAGE_STORE)
+		{
+			logError("file: "__FILE__", line: %d, " \
+				"unexpected notify value: %ld, " \
+				"nio stage: %d, ignore it", __LINE__, \
+				task_addr, pTask->nio_stage);
+			continue;
+		}
+
+		deal_store_done(pTask);
 	}
 }
 
+/* the IO callbacks only record the last active time instead of moving
+   the timer entry, the entry is re-armed here when it expires early */
+static bool task_timer_rearm(struct fast_task_info *pTask)
+{
+	time_t expires;
+
+	expires = pTask->last_active + g_fdht_network_timeout;
+	if (expires < g_current_time)
+	{
+		return false;
+	}
+
+	pTask->event.timer.expires = expires;
+	fast_timer_add(&pTask->thread_data->timer, &pTask->event.timer);
+	return true;
+}
+
 static int set_send_event(struct fast_task_info *pTask)
 {
 	int result;
@@ -169,14 +616,30 @@ static void client_sock_read(int sock, short event, void *arg)
 {
 	int bytes;
 	int recv_bytes;
+	int result;
 	struct fast_task_info *pTask;
 
 	pTask = (struct fast_task_info *)arg;
+	if (pTask->nio_stage == FDHT_NIO_STAGE_STORE)
+	{
+		if (event & IOEVENT_TIMEOUT)  //wait for the store thread
+		{
+			pTask->event.timer.expires = g_current_time +
+				g_fdht_network_timeout;
+			fast_timer_add(&pTask->thread_data->timer,
+				&pTask->event.timer);
+		}
+		return;
+	}
 
 	if (event & IOEVENT_TIMEOUT)
 	{
-		if (pTask->offset == 0 && \
-			((FDHTProtoHeader *)pTask->data)->keep_alive)
+		if (task_timer_rearm(pTask))
+		{
+			return;
+		}
+
+		if (pTask->offset == 0 && TASK_ARG(pTask)->keep_alive)
 		{
 			pTask->event.timer.expires = g_current_time +
 				g_fdht_network_timeout;
@@ -197,7 +660,9 @@ static void client_sock_read(int sock, short event, void *arg)
 		return;
 	}
 
-	if (event & IOEVENT_ERROR)
+	/* the unix socket reports hang up with the readable event when
+	   the client closed, the recv below deals it */
+	if ((event & IOEVENT_ERROR) && !(event & IOEVENT_READ))
 	{
 		logError("file: "__FILE__", line: %d, " \
 			"client ip: %s, recv error event: %d, "
@@ -207,42 +672,20 @@ static void client_sock_read(int sock, short event, void *arg)
 		return;
 	}
 
+	pTask->last_active = g_current_time;
 	while (1)
 	{
-		fast_timer_modify(&pTask->thread_data->timer,
-			&pTask->event.timer, g_current_time +
-			g_fdht_network_timeout);
-		if (pTask->length == 0) //recv header
-		{
-			recv_bytes = sizeof(FDHTProtoHeader) - pTask->offset;
-		}
-		else
-		{
-			recv_bytes = pTask->length - pTask->offset;
-		}
-
-		if (pTask->offset + recv_bytes > pTask->size)
+		/* recv as many bytes as the buffer can hold, so the
+		   pipelined requests can be dealt in one batch */
+		if (pTask->data == NULL || pTask->length > pTask->size)
 		{
-			char *pTemp;
-
-			pTemp = pTask->data;
-			pTask->data = realloc(pTask->data, \
-				pTask->size + recv_bytes);
-			if (pTask->data == NULL)
+			if (free_queue_alloc_buffer(pTask, pTask->length) != 0)
 			{
-				logError("file: "__FILE__", line: %d, " \
-					"malloc failed, " \
-					"errno: %d, error info: %s", \
-					__LINE__, errno, STRERROR(errno));
-
-				pTask->data = pTemp;  //restore old data
-
 				task_finish_clean_up(pTask);
 				return;
 			}
-
-			pTask->size += recv_bytes;
 		}
+		recv_bytes = pTask->size - pTask->offset;
 
 		bytes = recv(sock, pTask->data + pTask->offset, recv_bytes, 0);
 		if (bytes < 0)
@@ -272,43 +715,28 @@ static void client_sock_read(int sock, short event, void *arg)
 			return;
 		}
 
+		pTask->offset += bytes;
 		if (pTask->length == 0) //header
 		{
-			if (pTask->offset + bytes < sizeof(FDHTProtoHeader))
+			if (pTask->offset < sizeof(FDHTProtoHeader))
 			{
-				pTask->offset += bytes;
 				return;
 			}
 
 			pTask->length = buff2int(((FDHTProtoHeader *) \
 						pTask->data)->pkg_len);
-			if (pTask->length < 0)
+			if ((result=check_pkg_len(pTask, pTask->length)) != 0)
 			{
-				logError("file: "__FILE__", line: %d, " \
-					"client ip: %s, pkg length: %d < 0", \
-					__LINE__, pTask->client_ip, \
-					pTask->length);
 				task_finish_clean_up(pTask);
 				return;
 			}
 
 			pTask->length += sizeof(FDHTProtoHeader);
-			if (pTask->length > g_max_pkg_size)
-			{
-				logError("file: "__FILE__", line: %d, " \
-					"client ip: %s, pkg length: %d > " \
-					"max pkg size: %d", __LINE__, \
-					pTask->client_ip, pTask->length, \
-					g_max_pkg_size);
-				task_finish_clean_up(pTask);
-				return;
-			}
 		}
 
-		pTask->offset += bytes;
 		if (pTask->offset >= pTask->length) //recv done
 		{
-			work_deal_task(pTask);
+			deal_request(pTask);
 			return;
 		}
 	}
@@ -316,15 +744,120 @@ static void client_sock_read(int sock, short event, void *arg)
 	return;
 }
 
+/* the task is ready for the next request after the responses sent,
+   the pipelined requests left are moved to the task buffer */
+static void deal_send_done(struct fast_task_info *pTask)
+{
+	FDHTTaskArg *pArg;
+	int remain;
+	int result;
+
+	pArg = TASK_ARG(pTask);
+	pArg->resp_length = 0;
+	task_release_value(pArg);
+	pTask->offset = 0;
+	pTask->length  = 0;
+
+	pTask->thread_data->in_flight_count--;
+	pTask->nio_stage = FDHT_NIO_STAGE_RECV;
+	pTask->event.callback = client_sock_read;
+	if (ioevent_modify(&pTask->thread_data->ev_puller,
+		pTask->event.fd, IOEVENT_READ, pTask) != 0)
+	{
+		result = errno != 0 ? errno : ENOENT;
+		task_finish_clean_up(pTask);
+
+		logError("file: "__FILE__", line: %d, "\
+			"ioevent_modify fail, " \
+			"errno: %d, error info: %s", \
+			__LINE__, result, STRERROR(result));
+		return;
+	}
+
+	if (pArg->pending_length == 0)
+	{
+		/* the idle connection holds no buffer */
+		free_queue_release_buffer(pTask);
+		return;
+	}
+
+	if (fetch_pending_request(pTask, &result))
+	{
+		deal_request(pTask);
+		return;
+	}
+
+	if (result != 0)
+	{
+		task_finish_clean_up(pTask);
+		return;
+	}
+
+	/* a part of the next request */
+	remain = pArg->pending_length - pArg->pending_offset;
+	if (free_queue_alloc_buffer(pTask, remain) != 0)
+	{
+		task_finish_clean_up(pTask);
+		return;
+	}
+
+	memcpy(pTask->data, pArg->pending_buff + pArg->pending_offset, remain);
+	pTask->offset = remain;
+	pArg->pending_offset = 0;
+	pArg->pending_length = 0;
+	if (remain >= sizeof(FDHTProtoHeader))
+	{
+		pTask->length = buff2int(((FDHTProtoHeader *) \
+				pTask->data)->pkg_len);
+		if (check_pkg_len(pTask, pTask->length) != 0)
+		{
+			task_finish_clean_up(pTask);
+			return;
+		}
+		pTask->length += sizeof(FDHTProtoHeader);
+	}
+}
+
+/* skip the iovecs sent, return the first one to send */
+static struct iovec *iov_skip_sent(struct iovec *iov, const int count, \
+		const int sent_bytes, int *remain_count)
+{
+	struct iovec *pIov;
+	struct iovec *pEnd;
+	int skip_bytes;
+
+	skip_bytes = sent_bytes;
+	pEnd = iov + count;
+	for (pIov=iov; pIov<pEnd; pIov++)
+	{
+		if (skip_bytes < (int)pIov->iov_len)
+		{
+			pIov->iov_base = (char *)pIov->iov_base + skip_bytes;
+			pIov->iov_len -= skip_bytes;
+			break;
+		}
+		skip_bytes -= pIov->iov_len;
+	}
+
+	*remain_count = pEnd - pIov;
+	return pIov;
+}
+
 static void client_sock_write(int sock, short event, void *arg)
 {
 	int bytes;
-	int result;
+	int total_length;
 	struct fast_task_info *pTask;
+	FDHTTaskArg *pArg;
 
 	pTask = (struct fast_task_info *)arg;
 	if (event & IOEVENT_TIMEOUT)
 	{
+		if (task_timer_rearm(pTask))
+		{
+			return;
+		}
+
 		logError("file: "__FILE__", line: %d, " \
 			"send timeout", __LINE__);
 
@@ -342,13 +875,32 @@ static void client_sock_write(int sock, short event, void *arg)
 		return;
 	}
 
+	pArg = TASK_ARG(pTask);
+	total_length = pArg->resp_length + pTask->length + pArg->value_length;
+	pTask->last_active = g_current_time;
 	while (1)
 	{
-		fast_timer_modify(&pTask->thread_data->timer,
-			&pTask->event.timer, g_current_time +
-			g_fdht_network_timeout);
-		bytes = send(sock, pTask->data + pTask->offset, \
+		if (pArg->resp_length == 0 && pArg->value_length == 0)
+		{
+			bytes = send(sock, pTask->data + pTask->offset, \
 				pTask->length - pTask->offset,  0);
+		}
+		else  //send the queued responses, the last one and its value
+		{
+			struct iovec iov[3];
+			struct iovec *pIov;
+			int iov_count;
+
+			iov[0].iov_base = pArg->resp_buff;
+			iov[0].iov_len = pArg->resp_length;
+			iov[1].iov_base = pTask->data;
+			iov[1].iov_len = pTask->length;
+			iov[2].iov_base = pArg->value_buff;
+			iov[2].iov_len = pArg->value_length;
+			pIov = iov_skip_sent(iov, 3, pTask->offset, &iov_count);
+			bytes = writev(sock, pIov, iov_count);
+		}
+
 		//printf("%08X sended %d bytes\n", (int)pTask, bytes);
 		if (bytes < 0)
 		{
@@ -380,26 +932,11 @@ static void client_sock_write(int sock, short event, void *arg)
 		}
 
 		pTask->offset += bytes;
-		if (pTask->offset >= pTask->length)
+		if (pTask->offset >= total_length)
 		{
-			if (((FDHTProtoHeader *)pTask->data)->keep_alive)
+			if (pArg->keep_alive)
 			{
-				pTask->offset = 0;
-				pTask->length  = 0;
-
-				pTask->event.callback = client_sock_read;
-				if (ioevent_modify(&pTask->thread_data->ev_puller,
-					pTask->event.fd, IOEVENT_READ, pTask) != 0)
-				{
-					result = errno != 0 ? errno : ENOENT;
-					task_finish_clean_up(pTask);
-
-					logError("file: "__FILE__", line: %d, "\
-						"ioevent_modify fail, " \
-						"errno: %d, error info: %s", \
-						__LINE__, result, STRERROR(result));
-					return;
-				}
+				deal_send_done(pTask);
 			}
 			else
 			{
@@ -410,4 +947,3 @@ static void client_sock_write(int sock, short event, void *arg)
 		}
 	}
 }
-
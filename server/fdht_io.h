@@ -16,15 +16,86 @@
 #include <string.h>
 #include "fdht_define.h"
 #include "fast_task_queue.h"
+#include "hash.h"
+
+#define FDHT_NIO_STAGE_INIT    0  //new connection, not attached yet
+#define FDHT_NIO_STAGE_RECV    1  //recv request
+#define FDHT_NIO_STAGE_STORE   2  //dealing by the store thread
+#define FDHT_NIO_STAGE_SEND    3  //send response
+
+typedef struct
+{
+	char *pending_buff;  //pipelined requests received but not dealt
+	int pending_size;    //alloc size
+	int pending_offset;  //offset of the next request
+	int pending_length;  //data length
+	char *resp_buff;     //responses queued before the last one
+	int resp_size;       //alloc size
+	int resp_length;     //data length
+	HashData *value_ref; //the referenced mpool data of the last response
+	char *value_buff;    //the value sent after the last response
+	int value_length;    //the value length
+	bool keep_alive;     //keep the connection after responses sent
+} FDHTTaskArg;  //the extra argument of the task
+
+#define TASK_ARG(pTask) ((FDHTTaskArg *)(pTask)->arg)
+
+/* the value written to the notify pipe of the nio thread:
+   < 0 for quit, odd for a new socket, otherwise the task address */
+#define FDHT_NOTIFY_NEW_SOCK(sock)   ((((long)(sock)) << 1) | 1)
+#define FDHT_NOTIFY_IS_SOCK(value)   (((value) & 1) != 0)
+#define FDHT_NOTIFY_GET_SOCK(value)  ((int)((value) >> 1))
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
 void recv_notify_read(int sock, short event, void *arg);
+void accept_sock_read(int sock, short event, void *arg);
 int send_add_event(struct fast_task_info *pTask);
 void task_finish_clean_up(struct fast_task_info *pTask);
 
+/**
+* close the connection and free the task after its nio thread exited,
+* called when the program exits
+* params:
+*	pTask: the task to release
+*/
+void task_release(struct fast_task_info *pTask);
+
+/**
+* count the connection accepted, the connection is closed when
+* max_connections reached
+* params:
+*	sock: the socket accepted
+* return: true for success, false when the socket closed
+*/
+bool task_connection_acquire(const int sock);
+
+/**
+* uncount the connection closed
+*/
+void task_connection_release();
+
+/**
+* notify the nio thread of the task, called by the store thread
+* when the request dealt done
+* params:
+*	pTask: the task to notify
+* return: error no, 0 for success, != 0 fail
+*/
+int task_notify_nio(struct fast_task_info *pTask);
+
+/**
+* deal the received request and the requests pipelined after it,
+* the responses are queued and sent together by the nio thread.
+* pTask->length and resp_length are both 0 when the connection
+* should be closed without response
+* params:
+*	pTask: the task which request received done
+*/
+void task_deal_requests(struct fast_task_info *pTask);
+
 #ifdef __cplusplus
 }
 #endif
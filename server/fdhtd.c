@@ -35,7 +35,9 @@
 #include "func.h"
 #include "sync.h"
 #include "db_recovery.h"
+#include "mpool_snapshot.h"
 #include "mpool_op.h"
+#include "hybrid_op.h"
 
 static ScheduleArray scheduleArray;
 static pthread_t schedule_tid;
@@ -58,6 +60,7 @@ int main(int argc, char *argv[])
 	char bind_addr[IP_ADDRESS_SIZE];
 	int result;
 	int sock;
+	int unix_sock;
 	struct sigaction act;
 	char pidFilename[MAX_PATH_SIZE];
 	bool stop;
@@ -117,7 +120,7 @@ int main(int argc, char *argv[])
 		return errno;
 	}
 
-	sock = socketServer(bind_addr, g_server_port, &result);
+	sock = socketServerEx(bind_addr, g_server_port, g_reuse_port, &result);
 	if (sock < 0)
 	{
 		fdht_func_destroy();
@@ -132,6 +135,21 @@ int main(int argc, char *argv[])
 		return result;
 	}
 
+	if (*g_unix_socket_path != '\0')
+	{
+		unix_sock = socketUnixServer(g_unix_socket_path, &result);
+		if (unix_sock < 0)
+		{
+			fdht_func_destroy();
+			log_destroy();
+			return result;
+		}
+	}
+	else
+	{
+		unix_sock = -1;
+	}
+
 	if ((result=write_to_pid_file(pidFilename)) != 0)
 	{
 		log_destroy();
@@ -206,7 +224,7 @@ int main(int argc, char *argv[])
 		return result;
 	}
 
-	if (g_store_type == FDHT_STORE_TYPE_BDB)
+	if (FDHT_STORE_TYPE_IS_BDB(g_store_type))
 	{
 		if ((result=fdht_db_recovery_init()) != 0)
 		{
@@ -222,9 +240,18 @@ int main(int argc, char *argv[])
 			log_destroy();
 			return result;
 		}
+	}	else if (g_store_type == FDHT_STORE_TYPE_MPOOL && \
+		g_mpool_snapshot_interval > 0)
+	{
+		if ((result=mp_snapshot_recovery_init()) != 0)
+		{
+			fdht_func_destroy();
+			log_destroy();
+			return result;
+		}
 	}
 
-	if ((result=work_thread_init()) != 0)
+	if ((result=work_thread_init(bind_addr, sock)) != 0)
 	{
 		g_continue_flag = false;
 		fdht_func_destroy();
@@ -243,20 +270,31 @@ int main(int argc, char *argv[])
 
 	log_set_cache(true);
 
-	fdht_accept_loop(sock);
+	fdht_accept_loop(sock, unix_sock);
 
 	work_thread_destroy();
 
 	close(sock);
+	if (unix_sock >= 0)
+	{
+		close(unix_sock);
+		unlink(g_unix_socket_path);
+	}
 
 	while (g_schedule_flag) //waiting for schedule thread exit
 	{
 		sleep(1);
 	}
 
+	if (g_store_type == FDHT_STORE_TYPE_MPOOL && \
+		g_mpool_snapshot_interval > 0)
+	{
+		mp_snapshot_write();
+	}
+
 	fdht_sync_destroy();
 
-	if (g_store_type == FDHT_STORE_TYPE_BDB)
+	if (FDHT_STORE_TYPE_IS_BDB(g_store_type))
 	{
 		fdht_memp_trickle_dbs((void *)1);
 	}
@@ -359,7 +397,7 @@ static int fdht_init_schedule()
 	ScheduleEntry *pScheduleEntry;
 
 	entry_count = 2;
-	if (g_store_type == FDHT_STORE_TYPE_BDB && g_sync_db_interval > 0)
+	if (FDHT_STORE_TYPE_IS_BDB(g_store_type) && g_sync_db_interval > 0)
 	{
 		entry_count++;
 	}
@@ -371,9 +409,23 @@ static int fdht_init_schedule()
 	{
 		entry_count++;
 	}
+	if (g_store_type == FDHT_STORE_TYPE_MPOOL && \
+		g_mpool_load_factor >= 0.10)
+	{
+		entry_count++;
+	}
+	if (g_store_type == FDHT_STORE_TYPE_MPOOL && g_need_clear_expired_data)
+	{
+		entry_count++;
+	}
+	if (g_store_type == FDHT_STORE_TYPE_MPOOL && \
+		g_mpool_snapshot_interval > 0)
+	{
+		entry_count++;
+	}
 	if (g_clear_expired_interval > 0)
 	{
-		if (g_store_type == FDHT_STORE_TYPE_BDB)
+		if (FDHT_STORE_TYPE_IS_BDB(g_store_type))
 		{
 			for (i=0; i<g_db_count; i++)
 			{
@@ -382,8 +434,12 @@ static int fdht_init_schedule()
 					entry_count++;
 				}
 			}
+			if (g_store_type == FDHT_STORE_TYPE_HYBRID)
+			{
+				entry_count++;  //the cache
+			}
 		}
-		else //mpool
+		else //mpool and mpool_flat
 		{
 			entry_count++;
 		}
@@ -421,7 +477,7 @@ static int fdht_init_schedule()
 	pScheduleEntry->func_args = NULL;
 	pScheduleEntry++;
 
-	if (g_store_type == FDHT_STORE_TYPE_BDB && g_sync_db_interval > 0)
+	if (FDHT_STORE_TYPE_IS_BDB(g_store_type) && g_sync_db_interval > 0)
 	{
 		pScheduleEntry->id = pScheduleEntry - scheduleArray.entries+1;
 		pScheduleEntry->time_base.hour = g_sync_db_time_base.hour;
@@ -454,9 +510,44 @@ static int fdht_init_schedule()
 		pScheduleEntry++;
 	}
 
+	if (g_store_type == FDHT_STORE_TYPE_MPOOL && \
+		g_mpool_load_factor >= 0.10)
+	{
+		pScheduleEntry->id = pScheduleEntry - scheduleArray.entries+1;
+		pScheduleEntry->time_base.hour = TIME_NONE;
+		pScheduleEntry->time_base.minute = TIME_NONE;
+		pScheduleEntry->interval = 1;
+		pScheduleEntry->task_func = mp_rehash_step;
+		pScheduleEntry->func_args = NULL;
+		pScheduleEntry++;
+	}
+
+	if (g_store_type == FDHT_STORE_TYPE_MPOOL && g_need_clear_expired_data)
+	{
+		pScheduleEntry->id = pScheduleEntry - scheduleArray.entries+1;
+		pScheduleEntry->time_base.hour = TIME_NONE;
+		pScheduleEntry->time_base.minute = TIME_NONE;
+		pScheduleEntry->interval = 1;
+		pScheduleEntry->task_func = mp_expire_step;
+		pScheduleEntry->func_args = NULL;
+		pScheduleEntry++;
+	}
+
+	if (g_store_type == FDHT_STORE_TYPE_MPOOL && \
+		g_mpool_snapshot_interval > 0)
+	{
+		pScheduleEntry->id = pScheduleEntry - scheduleArray.entries+1;
+		pScheduleEntry->time_base.hour = TIME_NONE;
+		pScheduleEntry->time_base.minute = TIME_NONE;
+		pScheduleEntry->interval = g_mpool_snapshot_interval;
+		pScheduleEntry->task_func = mp_snapshot_func;
+		pScheduleEntry->func_args = NULL;
+		pScheduleEntry++;
+	}
+
 	if (g_clear_expired_interval > 0 && g_need_clear_expired_data)
 	{
-		if (g_store_type == FDHT_STORE_TYPE_BDB)
+		if (FDHT_STORE_TYPE_IS_BDB(g_store_type))
 		{
 			for (i=0; i<g_db_count; i++)
 			{
@@ -478,6 +569,22 @@ static int fdht_init_schedule()
 				pScheduleEntry->func_args = (void *)(long)i;
 				pScheduleEntry++;
 			}
+
+			if (g_store_type == FDHT_STORE_TYPE_HYBRID)
+			{
+				pScheduleEntry->id = pScheduleEntry - \
+					scheduleArray.entries + 1;
+				pScheduleEntry->time_base.hour = \
+					g_clear_expired_time_base.hour;
+				pScheduleEntry->time_base.minute = \
+					g_clear_expired_time_base.minute;
+				pScheduleEntry->interval = \
+					g_clear_expired_interval;
+				pScheduleEntry->task_func = \
+					hy_clear_expired_keys;
+				pScheduleEntry->func_args = NULL;
+				pScheduleEntry++;
+			}
 		}
 		else
 		{
@@ -490,8 +597,8 @@ static int fdht_init_schedule()
 			pScheduleEntry->interval = \
 					g_clear_expired_interval;
 			pScheduleEntry->task_func = \
-					mp_clear_expired_keys;
-			pScheduleEntry->func_args = (void *)g_hash_array;
+					g_func_clear_expired_keys;
+			pScheduleEntry->func_args = NULL;
 			pScheduleEntry++;
 		}
 	}
@@ -0,0 +1,506 @@
+//flat_op.c
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include "logger.h"
+#include "global.h"
+#include "shared_func.h"
+#include "sched_thread.h"
+#include "flat_op.h"
+
+FlatHashTable *g_flat_table = NULL;
+static pthread_rwlock_t flat_pthread_rwlock;
+
+int fl_init(StoreHandle **ppHandle, const u_int64_t nCacheSize)
+{
+	int result;
+	if (g_flat_table != NULL)
+	{
+		*ppHandle = g_flat_table;
+		return 0;
+	}
+
+	g_flat_table = (FlatHashTable *)malloc(sizeof(FlatHashTable));
+	if (g_flat_table == NULL)
+	{
+		logError("file: "__FILE__", line: %d, " \
+			"malloc %d bytes fail, " \
+			"errno: %d, error info: %s", \
+			__LINE__, (int)sizeof(FlatHashTable), \
+			errno, STRERROR(errno));
+		return errno != 0 ? errno : ENOMEM;
+	}
+
+	if ((result=flat_hash_init(g_flat_table, g_mpool_hash_function == \
+			FDHT_MPOOL_HASH_WYHASH ? WyHash : Time33Hash, \
+			g_mpool_init_capacity, nCacheSize)) != 0)
+	{
+		logError("file: "__FILE__", line: %d, " \
+			"flat_hash_init fail, errno: %d, error info: %s", \
+			__LINE__, result, STRERROR(result));
+		return result;
+	}
+	if (g_mpool_slab_page_size > 0 && (result=flat_hash_set_slab( \
+			g_flat_table, g_mpool_slab_page_size)) != 0)
+	{
+		logError("file: "__FILE__", line: %d, " \
+			"flat_hash_set_slab fail, errno: %d, error info: %s", \
+			__LINE__, result, STRERROR(result));
+		return result;
+	}
+	*ppHandle = g_flat_table;
+
+	if ((result=pthread_rwlock_init(&flat_pthread_rwlock, NULL)) != 0)
+	{
+		logError("file: "__FILE__", line: %d, " \
+			"pthread_rwlock_init fail, errno: %d, error info: %s",\
+			__LINE__, result, STRERROR(result));
+		return result;
+	}
+
+	return 0;
+}
+
+int fl_destroy_instance(StoreHandle **ppHandle)
+{
+	return 0;
+}
+
+int fl_destroy()
+{
+	pthread_rwlock_destroy(&flat_pthread_rwlock);
+
+	return 0;
+}
+
+int fl_memp_trickle(int *nwrotep)
+{
+	*nwrotep = 0;
+	return 0;
+}
+
+#define RWLOCK_READ_LOCK(result) \
+	if ((result=pthread_rwlock_rdlock(&flat_pthread_rwlock)) != 0) \
+	{ \
+		logError("file: "__FILE__", line: %d, " \
+			"pthread_rwlock_rdlock fail, " \
+			"errno: %d, error info: %s", \
+			__LINE__, result, STRERROR(result)); \
+		return result; \
+	}
+
+#define RWLOCK_WRITE_LOCK(result) \
+	if ((result=pthread_rwlock_wrlock(&flat_pthread_rwlock)) != 0) \
+	{ \
+		logError("file: "__FILE__", line: %d, " \
+			"pthread_rwlock_wrlock fail, " \
+			"errno: %d, error info: %s", \
+			__LINE__, result, STRERROR(result)); \
+		return result; \
+	}
+
+#define RWLOCK_UNLOCK(result) \
+	if ((result=pthread_rwlock_unlock(&flat_pthread_rwlock)) != 0) \
+	{ \
+		logError("file: "__FILE__", line: %d, " \
+			"pthread_rwlock_unlock fail, " \
+			"errno: %d, error info: %s", \
+			__LINE__, result, STRERROR(result)); \
+	}
+
+int fl_get(StoreHandle *pHandle, const char *pKey, const int key_len, \
+		char **ppValue, int *size)
+{
+	FlatHashEntry *entry;
+	int result;
+	int lock_result;
+
+	g_server_stat.total_get_count++;
+
+	RWLOCK_READ_LOCK(lock_result)
+
+	do
+	{
+		entry = flat_hash_find(g_flat_table, pKey, key_len);
+		if (entry == NULL)
+		{
+			result = ENOENT;
+			break;
+		}
+
+		if (*ppValue != NULL)
+		{
+			if (*size < entry->value_len)
+			{
+				*size = entry->value_len;
+				result = ENOSPC;
+				break;
+			}
+		}
+		else
+		{
+			*ppValue = (char *)malloc(entry->value_len);
+			if (*ppValue == NULL)
+			{
+				logError("file: "__FILE__", line: %d, " \
+					"malloc %d bytes fail, " \
+					"errno: %d, error info: %s", \
+					__LINE__, entry->value_len, \
+					errno, STRERROR(errno));
+				result = errno != 0 ? errno : ENOMEM;
+				break;
+			}
+		}
+
+		*size = entry->value_len;
+		memcpy(*ppValue, FLAT_HASH_ENTRY_VALUE(entry), entry->value_len);
+		g_server_stat.success_get_count++;
+		result = 0;
+	} while (0);
+
+	RWLOCK_UNLOCK(lock_result)
+
+	return result;
+}
+
+/* the read lock is taken once for all the keys */
+int fl_batch_get(StoreHandle *pHandle, FDHTBatchGetItem *items, \
+		const int count, FDHTBatchGetBuffer *pBuffer)
+{
+	FlatHashEntry *entry;
+	FDHTBatchGetItem *pItem;
+	FDHTBatchGetItem *pEnd;
+	char *pValue;
+	int lock_result;
+
+	g_server_stat.total_get_count += count;
+
+	RWLOCK_READ_LOCK(lock_result)
+
+	pEnd = items + count;
+	for (pItem=items; pItem<pEnd; pItem++)
+	{
+		entry = flat_hash_find(g_flat_table, pItem->pKey, \
+				pItem->key_len);
+		if (entry == NULL)
+		{
+			pItem->status = ENOENT;
+			continue;
+		}
+
+		if ((pValue=store_batch_value_alloc(pBuffer, pItem, \
+				entry->value_len)) == NULL)
+		{
+			pItem->status = ENOMEM;
+			continue;
+		}
+
+		memcpy(pValue, FLAT_HASH_ENTRY_VALUE(entry), entry->value_len);
+		pItem->status = 0;
+		g_server_stat.success_get_count++;
+	}
+
+	RWLOCK_UNLOCK(lock_result)
+
+	return 0;
+}
+
+/* call with the write lock, the lock is released when clearing the
+   expired keys to make room */
+static int fl_do_set(const char *pKey, const int key_len, \
+	const char *pValue, const int value_len)
+{
+	int result;
+	int lock_result;
+	int i;
+
+	for (i=0; i<2; i++)
+	{
+		result = flat_hash_insert(g_flat_table, pKey, key_len, \
+				pValue, value_len);
+		if (result >= 0)
+		{
+			return 0;
+		}
+
+		result *= -1;
+		if (!(result == ENOSPC && g_need_clear_expired_data))
+		{
+			break;
+		}
+
+		RWLOCK_UNLOCK(lock_result)
+		if (fl_clear_expired_keys(NULL) > 0)
+		{
+			RWLOCK_WRITE_LOCK(lock_result)
+			continue;
+		}
+		RWLOCK_WRITE_LOCK(lock_result)
+		break;
+	}
+
+	return result;
+}
+
+int fl_set(StoreHandle *pHandle, const char *pKey, const int key_len, \
+	const char *pValue, const int value_len)
+{
+	int result;
+	int lock_result;
+
+	g_server_stat.total_set_count++;
+
+	RWLOCK_WRITE_LOCK(lock_result)
+
+	result = fl_do_set(pKey, key_len, pValue, value_len);
+	if (result == 0)
+	{
+		g_server_stat.success_set_count++;
+	}
+
+	RWLOCK_UNLOCK(lock_result)
+
+	return result;
+}
+
+int fl_partial_set(StoreHandle *pHandle, const char *pKey, const int key_len, \
+	const char *pValue, const int offset, const int value_len)
+{
+	FlatHashEntry *entry;
+	char *pNewBuff;
+	int new_len;
+	int result;
+	int lock_result;
+
+	RWLOCK_WRITE_LOCK(lock_result)
+
+	do
+	{
+		entry = flat_hash_find(g_flat_table, pKey, key_len);
+		if (entry == NULL)
+		{
+			result = offset == 0 ? fl_do_set(pKey, key_len, \
+					pValue, value_len) : ENOENT;
+			break;
+		}
+
+		if (offset < 0 || offset >= entry->value_len)
+		{
+			result = EINVAL;
+			break;
+		}
+
+		/* in place when the value buffer is large enough */
+		new_len = offset + value_len;
+		if (new_len <= entry->malloc_value_size)
+		{
+			memcpy(FLAT_HASH_ENTRY_VALUE(entry) + offset, \
+				pValue, value_len);
+			if (new_len > entry->value_len)
+			{
+				entry->value_len = new_len;
+			}
+			result = 0;
+			break;
+		}
+
+		pNewBuff = (char *)malloc(new_len);
+		if (pNewBuff == NULL)
+		{
+			result = errno != 0 ? errno : ENOMEM;
+			break;
+		}
+
+		memcpy(pNewBuff, FLAT_HASH_ENTRY_VALUE(entry), offset);
+		memcpy(pNewBuff + offset, pValue, value_len);
+		result = fl_do_set(pKey, key_len, pNewBuff, new_len);
+		free(pNewBuff);
+	} while (0);
+
+	RWLOCK_UNLOCK(lock_result)
+
+	return result;
+}
+
+int fl_delete(StoreHandle *pHandle, const char *pKey, const int key_len)
+{
+	int result;
+	int lock_result;
+
+	g_server_stat.total_delete_count++;
+
+	RWLOCK_WRITE_LOCK(lock_result)
+
+	result = flat_hash_delete(g_flat_table, pKey, key_len);
+	if (result == 0)
+	{
+		g_server_stat.success_delete_count++;
+	}
+
+	RWLOCK_UNLOCK(lock_result)
+
+	return result;
+}
+
+/* the value with expires is 4 bytes expires + the number */
+static int fl_do_inc(const char *pKey, const int key_len, const int inc, \
+	char *pValue, int *value_len, const int expires, \
+	const bool with_expires)
+{
+	FlatHashEntry *entry;
+	int64_t n;
+	int head_len;
+	int old_expires;
+	int result;
+	int lock_result;
+
+	g_server_stat.total_inc_count++;
+
+	head_len = with_expires ? 4 : 0;
+
+	RWLOCK_WRITE_LOCK(lock_result)
+
+	n = inc;
+	entry = flat_hash_find(g_flat_table, pKey, key_len);
+	if (entry != NULL && entry->value_len < *value_len)
+	{
+		if (with_expires)
+		{
+			old_expires = buff2int(FLAT_HASH_ENTRY_VALUE(entry));
+		}
+		else
+		{
+			old_expires = FDHT_EXPIRES_NEVER;
+		}
+
+		if (old_expires == FDHT_EXPIRES_NEVER || \
+			old_expires >= g_current_time)
+		{
+			memcpy(pValue, FLAT_HASH_ENTRY_VALUE(entry), \
+				entry->value_len);
+			pValue[entry->value_len] = '\0';
+			n += strtoll(pValue + head_len, NULL, 10);
+		}
+	}
+
+	if (with_expires)
+	{
+		int2buff(expires, pValue);
+	}
+	*value_len = head_len + sprintf(pValue + head_len, \
+				INT64_PRINTF_FORMAT, n);
+
+	result = fl_do_set(pKey, key_len, pValue, *value_len);
+	if (result == 0)
+	{
+		g_server_stat.success_inc_count++;
+	}
+	else
+	{
+		*pValue = '\0';
+		*value_len = 0;
+	}
+
+	RWLOCK_UNLOCK(lock_result)
+
+	return result;
+}
+
+int fl_inc(StoreHandle *pHandle, const char *pKey, const int key_len, \
+	const int inc, char *pValue, int *value_len)
+{
+	return fl_do_inc(pKey, key_len, inc, pValue, value_len, \
+			FDHT_EXPIRES_NEVER, false);
+}
+
+int fl_inc_ex(StoreHandle *pHandle, const char *pKey, const int key_len, \
+	const int inc, char *pValue, int *value_len, const int expires)
+{
+	return fl_do_inc(pKey, key_len, inc, pValue, value_len, \
+			expires, true);
+}
+
+static bool fl_expired_filter(const FlatHashEntry *entry, void *args)
+{
+	int expires;
+
+	expires = buff2int(FLAT_HASH_ENTRY_VALUE(entry));
+	return expires != FDHT_EXPIRES_NEVER && \
+		expires <= *((time_t *)args);
+}
+
+int fl_clear_expired_keys(void *arg)
+{
+	time_t current_time;
+	int lock_result;
+	struct timeval tv_start;
+	struct timeval tv_end;
+	unsigned int group_index;
+	int old_item_count;
+	int deleted_count;
+	bool done;
+	static time_t last_clear_time = 0;
+
+	if (gettimeofday(&tv_start, NULL) != 0)
+	{
+		logError("file: "__FILE__", line: %d, " \
+			"call gettimeofday fail, errno: %d, error info: %s", \
+			__LINE__, errno, STRERROR(errno));
+		return -1;
+	}
+
+	current_time = tv_start.tv_sec;
+	if (current_time - last_clear_time < g_mpool_clear_min_interval)
+	{
+		return 0;
+	}
+
+	/* the groups are cleared in batches, the write lock is released
+	   between them */
+	old_item_count = 0;
+	deleted_count = 0;
+	group_index = 0;
+	do
+	{
+		RWLOCK_WRITE_LOCK(lock_result)
+		if (group_index == 0)
+		{
+			old_item_count = g_flat_table->item_count;
+		}
+		deleted_count += flat_hash_delete_if_groups(g_flat_table, \
+			&group_index, FDHT_MPOOL_REHASH_BATCH_BUCKETS / \
+			FLAT_HASH_GROUP_WIDTH, fl_expired_filter, \
+			&current_time);
+		done = group_index > g_flat_table->group_mask;
+		RWLOCK_UNLOCK(lock_result)
+	} while (!done && g_continue_flag);
+
+	gettimeofday(&tv_end, NULL);
+
+	logInfo("clear expired keys, total key count: %d, " \
+		"expired key count: %d, time used: %dms, mpool free bytes: " \
+		INT64_PRINTF_FORMAT" bytes", old_item_count, deleted_count, \
+		(int)((tv_end.tv_sec - tv_start.tv_sec) * 1000 + \
+		(tv_end.tv_usec - tv_start.tv_usec) / 1000), \
+		g_flat_table->max_bytes - flat_hash_bytes_used(g_flat_table));
+
+	last_clear_time = tv_end.tv_sec;
+
+	return deleted_count;
+}
+
+int fl_hash_stat(FlatHashStat *pStat)
+{
+	int lock_result;
+	int result;
+
+	RWLOCK_READ_LOCK(lock_result)
+	result = flat_hash_stat(g_flat_table, pStat);
+	RWLOCK_UNLOCK(lock_result)
+
+	return result;
+}
+
@@ -0,0 +1,60 @@
+/**
+* Copyright (C) 2008 Happy Fish / YuQing
+*
+* FastDFS may be copied only under the terms of the GNU General
+* Public License V3, which may be found in the FastDFS source kit.
+* Please visit the FastDFS Home Page http://www.csource.org/ for more detail.
+**/
+
+//flat_op.h
+
+#ifndef _FLAT_OP_H
+#define _FLAT_OP_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "fdht_define.h"
+#include "flat_hash.h"
+#include "store.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+extern FlatHashTable *g_flat_table;
+
+int fl_init(StoreHandle **ppHandle, const u_int64_t nCacheSize);
+int fl_destroy_instance(StoreHandle **ppHandle);
+int fl_destroy();
+
+int fl_memp_trickle(int *nwrotep);
+
+int fl_get(StoreHandle *pHandle, const char *pKey, const int key_len, \
+		char **ppValue, int *size);
+int fl_batch_get(StoreHandle *pHandle, FDHTBatchGetItem *items, \
+		const int count, FDHTBatchGetBuffer *pBuffer);
+int fl_set(StoreHandle *pHandle, const char *pKey, const int key_len, \
+	const char *pValue, const int value_len);
+int fl_partial_set(StoreHandle *pHandle, const char *pKey, const int key_len, \
+	const char *pValue, const int offset, const int value_len);
+int fl_delete(StoreHandle *pHandle, const char *pKey, const int key_len);
+int fl_inc(StoreHandle *pHandle, const char *pKey, const int key_len, \
+	const int inc, char *pValue, int *value_len);
+int fl_inc_ex(StoreHandle *pHandle, const char *pKey, const int key_len, \
+	const int inc, char *pValue, int *value_len, const int expires);
+
+int fl_clear_expired_keys(void *arg);
+
+/**
+* stat the flat hash table under the read lock
+* return: error no, 0 for success, != 0 fail
+*/
+int fl_hash_stat(FlatHashStat *pStat);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
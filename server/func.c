@@ -27,6 +27,8 @@
 #include "store.h"
 #include "db_op.h"
 #include "mpool_op.h"
+#include "flat_op.h"
+#include "hybrid_op.h"
 #include "key_op.h"
 
 #define DB_FILE_PREFIX_MAX_SIZE  32
@@ -336,6 +338,173 @@ static int load_group_ids(GroupArray *pGroupArray, \
 	return 0;
 }
 
+static int load_evict_namespaces(IniContext *pIniContext)
+{
+	IniItem *pItems;
+	IniItem *pItem;
+	IniItem *pItemEnd;
+	FDHTEvictNameSpace *pNameSpace;
+	int item_count;
+	int len;
+
+	g_mpool_evict_namespace_count = 0;
+	pItems = iniGetValuesEx(NULL, "mpool_evict_namespace", \
+			pIniContext, &item_count);
+	if (pItems == NULL)
+	{
+		logError("file: "__FILE__", line: %d, " \
+			"mpool_evict_policy is clock, " \
+			"item \"mpool_evict_namespace\" not exist!", __LINE__);
+		return ENOENT;
+	}
+
+	if (item_count > FDHT_MPOOL_MAX_EVICT_NAMESPACES)
+	{
+		logError("file: "__FILE__", line: %d, " \
+			"too many item \"mpool_evict_namespace\", " \
+			"exceeds %d", __LINE__, FDHT_MPOOL_MAX_EVICT_NAMESPACES);
+		return EINVAL;
+	}
+
+	pItemEnd = pItems + item_count;
+	for (pItem=pItems; pItem<pItemEnd; pItem++)
+	{
+		len = strlen(pItem->value);
+		if (len == 0 || len > FDHT_MAX_NAMESPACE_LEN)
+		{
+			logError("file: "__FILE__", line: %d, " \
+				"mpool_evict_namespace: \"%s\" is invalid, " \
+				"length: %d", __LINE__, pItem->value, len);
+			return EINVAL;
+		}
+
+		pNameSpace = g_mpool_evict_namespaces + \
+				g_mpool_evict_namespace_count++;
+		strcpy(pNameSpace->szNameSpace, pItem->value);
+		pNameSpace->namespace_len = strcmp(pItem->value, "*") == 0 ? \
+						-1 : len;
+		pNameSpace->evicted_count = 0;
+	}
+
+	return 0;
+}
+
+/* format: namespace:bytes, such as app1:256MB */
+static int load_namespace_quotas(IniContext *pIniContext)
+{
+	IniItem *pItems;
+	IniItem *pItem;
+	IniItem *pItemEnd;
+	FDHTNameSpaceQuota *pQuota;
+	char *pSeperator;
+	int item_count;
+	int len;
+	int result;
+
+	g_mpool_namespace_quota_count = 0;
+	pItems = iniGetValuesEx(NULL, "mpool_namespace_quota", \
+			pIniContext, &item_count);
+	if (pItems == NULL)
+	{
+		return 0;
+	}
+
+	if (item_count > FDHT_MPOOL_MAX_QUOTA_NAMESPACES)
+	{
+		logError("file: "__FILE__", line: %d, " \
+			"too many item \"mpool_namespace_quota\", " \
+			"exceeds %d", __LINE__, FDHT_MPOOL_MAX_QUOTA_NAMESPACES);
+		return EINVAL;
+	}
+
+	pItemEnd = pItems + item_count;
+	for (pItem=pItems; pItem<pItemEnd; pItem++)
+	{
+		pSeperator = strrchr(pItem->value, ':');
+		len = pSeperator != NULL ? pSeperator - pItem->value : 0;
+		if (len == 0 || len > FDHT_MAX_NAMESPACE_LEN)
+		{
+			logError("file: "__FILE__", line: %d, " \
+				"mpool_namespace_quota: \"%s\" is invalid, " \
+				"the format is namespace:bytes", \
+				__LINE__, pItem->value);
+			return EINVAL;
+		}
+
+		pQuota = g_mpool_namespace_quotas + \
+				g_mpool_namespace_quota_count++;
+		memcpy(pQuota->szNameSpace, pItem->value, len);
+		pQuota->szNameSpace[len] = '\0';
+		if ((result=parse_bytes(pSeperator + 1, 1, \
+				&pQuota->max_bytes)) != 0)
+		{
+			return result;
+		}
+		if (pQuota->max_bytes <= 0)
+		{
+			logError("file: "__FILE__", line: %d, " \
+				"mpool_namespace_quota: \"%s\" is invalid, " \
+				"the bytes <= 0", __LINE__, pItem->value);
+			return EINVAL;
+		}
+	}
+
+	return 0;
+}
+
+/* the mpool cache of store_type HYBRID, the params appended to
+   szStoreParams */
+static int load_hybrid_params(IniContext *pIniContext, \
+		char *szStoreParams, const int size)
+{
+	char *pCacheSize;
+	char *pAdmitPolicy;
+	int len;
+	int result;
+
+	g_hybrid_cache_size = FDHT_DEFAULT_HYBRID_CACHE_SIZE;
+	pCacheSize = iniGetStrValue(NULL, "hybrid_cache_size", pIniContext);
+	if (pCacheSize != NULL && (result=parse_bytes(pCacheSize, 1, \
+			&g_hybrid_cache_size)) != 0)
+	{
+		return result;
+	}
+	if (g_hybrid_cache_size < 1024 * 1024)
+	{
+		logWarning("file: "__FILE__", line: %d, " \
+			"hybrid_cache_size: "INT64_PRINTF_FORMAT" is too " \
+			"small, set to 1MB", __LINE__, g_hybrid_cache_size);
+		g_hybrid_cache_size = 1024 * 1024;
+	}
+
+	pAdmitPolicy = iniGetStrValue(NULL, "hybrid_admit_policy", \
+			pIniContext);
+	if (pAdmitPolicy == NULL || *pAdmitPolicy == '\0' || \
+		strcasecmp(pAdmitPolicy, "second_hit") == 0)
+	{
+		g_hybrid_admit_policy = FDHT_HYBRID_ADMIT_SECOND_HIT;
+	}
+	else if (strcasecmp(pAdmitPolicy, "always") == 0)
+	{
+		g_hybrid_admit_policy = FDHT_HYBRID_ADMIT_ALWAYS;
+	}
+	else
+	{
+		logError("file: "__FILE__", line: %d, " \
+			"item \"hybrid_admit_policy\" is invalid, " \
+			"value: \"%s\"", __LINE__, pAdmitPolicy);
+		return EINVAL;
+	}
+
+	len = strlen(szStoreParams);
+	snprintf(szStoreParams + len, size - len, \
+		", hybrid_cache_size=%d MB, hybrid_admit_policy=%s", \
+		(int)(g_hybrid_cache_size / (1024 * 1024)), \
+		g_hybrid_admit_policy == FDHT_HYBRID_ADMIT_ALWAYS ? \
+		"always" : "second_hit");
+	return 0;
+}
+
 static char *fdht_get_stat_filename(const void *pArg, char *full_filename)
 {
 	static char buff[MAX_PATH_SIZE];
@@ -364,14 +533,22 @@ static int fdht_load_from_conf_file(const char *filename, char *bind_addr, \
 	char *pRunByUser;
 	char *pCacheSize;
 	char *pPageSize;
+	char *pSlabPageSize;
+	char *pEvictPolicy;
+	char *pHashFunction;
+	char *pShmFile;
+	const char *pShmIgnored;
 	char *pMaxPkgSize;
 	char *pMinBuffSize;
 	char *pStoreType;
+	char *pPlacement;
+	char *pUnixSocketPath;
 	char *pThreadStackSize;
 	char *pIfAliasPrefix;
 	IniContext iniContext;
 	int result;
 	int64_t nPageSize;
+	int64_t nSlabPageSize;
 	int64_t max_pkg_size;
 	int64_t min_buff_size;
 	int64_t thread_stack_size;
@@ -379,7 +556,7 @@ static int fdht_load_from_conf_file(const char *filename, char *bind_addr, \
 	char sz_sync_db_time_base[16];
 	char sz_clear_expired_time_base[16];
 	char sz_compress_binlog_time_base[16];
-	char szStoreParams[256];
+	char szStoreParams[1024];
 
 	if ((result=iniLoadFromFile(filename, &iniContext)) != 0)
 	{
@@ -499,6 +676,14 @@ static int fdht_load_from_conf_file(const char *filename, char *bind_addr, \
 		{
 			g_store_type = FDHT_STORE_TYPE_MPOOL;
 		}
+		else if (strcasecmp(pStoreType, "MPOOL_FLAT") == 0)
+		{
+			g_store_type = FDHT_STORE_TYPE_MPOOL_FLAT;
+		}
+		else if (strcasecmp(pStoreType, "HYBRID") == 0)
+		{
+			g_store_type = FDHT_STORE_TYPE_HYBRID;
+		}
 		else
 		{
 			logError("file: "__FILE__", line: %d, " \
@@ -508,7 +693,7 @@ static int fdht_load_from_conf_file(const char *filename, char *bind_addr, \
 			break;
 		}
 
-		if (g_store_type == FDHT_STORE_TYPE_MPOOL)
+		if (!FDHT_STORE_TYPE_IS_BDB(g_store_type))
 		{
 			g_mpool_init_capacity = iniGetIntValue(NULL,  \
 				"mpool_init_capacity", &iniContext, \
@@ -532,6 +717,16 @@ static int fdht_load_from_conf_file(const char *filename, char *bind_addr, \
 					FDHT_DEFAULT_MPOOL_CLEAR_MIN_INTEVAL;
 			}
 
+			g_mpool_clear_step_msec = iniGetIntValue(NULL,  \
+				"mpool_clear_step_msec", &iniContext, \
+				FDHT_DEFAULT_MPOOL_CLEAR_STEP_MSEC);
+			if (g_mpool_clear_step_msec <= 0 || \
+				g_mpool_clear_step_msec > 1000)
+			{
+				g_mpool_clear_step_msec = \
+					FDHT_DEFAULT_MPOOL_CLEAR_STEP_MSEC;
+			}
+
 			g_mpool_htable_lock_count = iniGetIntValue(NULL,  \
 				"mpool_htable_lock_count", &iniContext, \
 				FDHT_DEFAULT_MPOOL_HTABLE_LOCK_COUNT);
@@ -541,14 +736,227 @@ static int fdht_load_from_conf_file(const char *filename, char *bind_addr, \
 					FDHT_DEFAULT_MPOOL_HTABLE_LOCK_COUNT;
 			}
 
+			nSlabPageSize = FDHT_DEFAULT_MPOOL_SLAB_PAGE_SIZE;
+			pSlabPageSize = iniGetStrValue(NULL, \
+				"mpool_slab_page_size", &iniContext);
+			if (pSlabPageSize != NULL && (result=parse_bytes( \
+				pSlabPageSize, 1, &nSlabPageSize)) != 0)
+			{
+				break;
+			}
+
+			if (nSlabPageSize != 0 && (nSlabPageSize < 64 * 1024 \
+				|| nSlabPageSize > 64 * 1024 * 1024))
+			{
+				logError("file: "__FILE__", line: %d, " \
+					"mpool_slab_page_size: " \
+					INT64_PRINTF_FORMAT" is invalid, " \
+					"which < %d or > %d!", __LINE__, \
+					nSlabPageSize, 64 * 1024, \
+					64 * 1024 * 1024);
+				result = EINVAL;
+				break;
+			}
+			g_mpool_slab_page_size = (int)nSlabPageSize;
+
+			pEvictPolicy = iniGetStrValue(NULL, \
+				"mpool_evict_policy", &iniContext);
+			if (pEvictPolicy == NULL || *pEvictPolicy == '\0' || \
+				strcasecmp(pEvictPolicy, "none") == 0)
+			{
+				g_mpool_evict_policy = FDHT_MPOOL_EVICT_NONE;
+			}
+			else if (strcasecmp(pEvictPolicy, "clock") == 0)
+			{
+				g_mpool_evict_policy = FDHT_MPOOL_EVICT_CLOCK;
+			}
+			else
+			{
+				logError("file: "__FILE__", line: %d, " \
+					"item \"mpool_evict_policy\" is invalid, " \
+					"value: \"%s\"", __LINE__, pEvictPolicy);
+				result = EINVAL;
+				break;
+			}
+
+			/* the flat table does not evict */
+			if (g_store_type == FDHT_STORE_TYPE_MPOOL_FLAT && \
+				g_mpool_evict_policy != FDHT_MPOOL_EVICT_NONE)
+			{
+				logWarning("file: "__FILE__", line: %d, " \
+					"mpool_evict_policy is not supported " \
+					"by store_type MPOOL_FLAT, ignored", \
+					__LINE__);
+				g_mpool_evict_policy = FDHT_MPOOL_EVICT_NONE;
+			}
+
+			if (g_mpool_evict_policy != FDHT_MPOOL_EVICT_NONE && \
+				(result=load_evict_namespaces(&iniContext)) != 0)
+			{
+				break;
+			}
+
+			g_mpool_snapshot_interval = iniGetIntValue(NULL, \
+				"mpool_snapshot_interval", &iniContext, 0);
+			if (g_mpool_snapshot_interval < 0)
+			{
+				g_mpool_snapshot_interval = 0;
+			}
+
+			/* the flat table is not snapshotted */
+			if (g_store_type == FDHT_STORE_TYPE_MPOOL_FLAT && \
+				g_mpool_snapshot_interval > 0)
+			{
+				logWarning("file: "__FILE__", line: %d, " \
+					"mpool_snapshot_interval is not " \
+					"supported by store_type MPOOL_FLAT, " \
+					"ignored", __LINE__);
+				g_mpool_snapshot_interval = 0;
+			}
+
+			/* the key_hash_code of the clients is always Time33Hash,
+			   this one locates the keys in the local table only */
+			pHashFunction = iniGetStrValue(NULL, \
+				"mpool_hash_function", &iniContext);
+			if (pHashFunction == NULL || *pHashFunction == '\0' || \
+				strcasecmp(pHashFunction, "time33") == 0)
+			{
+				g_mpool_hash_function = FDHT_MPOOL_HASH_TIME33;
+			}
+			else if (strcasecmp(pHashFunction, "wyhash") == 0)
+			{
+				g_mpool_hash_function = FDHT_MPOOL_HASH_WYHASH;
+			}
+			else
+			{
+				logError("file: "__FILE__", line: %d, " \
+					"item \"mpool_hash_function\" is " \
+					"invalid, value: \"%s\"", \
+					__LINE__, pHashFunction);
+				result = EINVAL;
+				break;
+			}
+
+			g_mpool_lockfree_get = iniGetBoolValue(NULL, \
+				"mpool_lockfree_get", &iniContext, false);
+			if (g_mpool_lockfree_get && g_store_type == \
+				FDHT_STORE_TYPE_MPOOL_FLAT)
+			{
+				logWarning("file: "__FILE__", line: %d, " \
+					"mpool_lockfree_get is not supported " \
+					"by store_type MPOOL_FLAT, ignored", \
+					__LINE__);
+				g_mpool_lockfree_get = false;
+			}
+
+			/* the readers without lock can not follow the
+			   nodes migrated by the rehash */
+			if (g_mpool_lockfree_get && g_mpool_load_factor >= 0.10)
+			{
+				logWarning("file: "__FILE__", line: %d, " \
+					"mpool_lockfree_get needs " \
+					"mpool_load_factor < 0.10, ignored", \
+					__LINE__);
+				g_mpool_lockfree_get = false;
+			}
+
+			if ((result=load_namespace_quotas(&iniContext)) != 0)
+			{
+				break;
+			}
+			g_mpool_namespace_stat = iniGetBoolValue(NULL, \
+				"mpool_namespace_stat", &iniContext, false) || \
+				g_mpool_namespace_quota_count > 0;
+			if (g_mpool_namespace_stat && g_store_type == \
+				FDHT_STORE_TYPE_MPOOL_FLAT)
+			{
+				logWarning("file: "__FILE__", line: %d, " \
+					"mpool_namespace_stat and " \
+					"mpool_namespace_quota are not " \
+					"supported by store_type MPOOL_FLAT, " \
+					"ignored", __LINE__);
+				g_mpool_namespace_stat = false;
+				g_mpool_namespace_quota_count = 0;
+			}
+
+			pShmFile = iniGetStrValue(NULL, "mpool_shm_file", \
+					&iniContext);
+			if (pShmFile == NULL)
+			{
+				*g_mpool_shm_file = '\0';
+			}
+			else
+			{
+				snprintf(g_mpool_shm_file, \
+					sizeof(g_mpool_shm_file), \
+					"%s", pShmFile);
+			}
+
+			/* the buckets and the slab pages are kept in the
+			   file, the table must not be rehashed */
+			if (*g_mpool_shm_file != '\0')
+			{
+#ifdef FDHT_MPOOL_SHM_BASE_ADDR
+				if (g_store_type == FDHT_STORE_TYPE_MPOOL_FLAT)
+				{
+					pShmIgnored = "is not supported by " \
+						"store_type MPOOL_FLAT";
+				}
+				else if (g_mpool_load_factor >= 0.10)
+				{
+					pShmIgnored = "needs " \
+						"mpool_load_factor < 0.10";
+				}
+				else if (g_mpool_slab_page_size == 0)
+				{
+					pShmIgnored = "needs " \
+						"mpool_slab_page_size > 0";
+				}
+				else
+				{
+					pShmIgnored = NULL;
+				}
+#else
+				pShmIgnored = "needs 64 bits OS";
+#endif
+
+				if (pShmIgnored != NULL)
+				{
+					logWarning("file: "__FILE__", line: %d, " \
+						"mpool_shm_file %s, ignored", \
+						__LINE__, pShmIgnored);
+					*g_mpool_shm_file = '\0';
+				}
+			}
+
 			snprintf(szStoreParams, sizeof(szStoreParams), \
 				"mpool_init_capacity=%d, " \
 				"mpool_load_factor=%.2f, " \
 				"mpool_clear_min_interval=%ds, " \
-				"mpool_htable_lock_count=%d", \
+				"mpool_clear_step_msec=%dms, " \
+				"mpool_htable_lock_count=%d, " \
+				"mpool_slab_page_size=%d, " \
+				"mpool_evict_policy=%s, " \
+				"mpool_evict_namespace count=%d, " \
+				"mpool_snapshot_interval=%ds, " \
+				"mpool_hash_function=%s, " \
+				"mpool_lockfree_get=%d, " \
+				"mpool_namespace_stat=%d, " \
+				"mpool_namespace_quota count=%d, " \
+				"mpool_shm_file=%s", \
 				g_mpool_init_capacity, g_mpool_load_factor, \
-				g_mpool_clear_min_interval,
-				g_mpool_htable_lock_count);
+				g_mpool_clear_min_interval, \
+				g_mpool_clear_step_msec, \
+				g_mpool_htable_lock_count, \
+				g_mpool_slab_page_size, \
+				g_mpool_evict_policy == FDHT_MPOOL_EVICT_CLOCK ? \
+				"clock" : "none", g_mpool_evict_namespace_count, \
+				g_mpool_snapshot_interval, \
+				g_mpool_hash_function == FDHT_MPOOL_HASH_WYHASH ? \
+				"wyhash" : "time33", g_mpool_lockfree_get, \
+				g_mpool_namespace_stat, \
+				g_mpool_namespace_quota_count, \
+				g_mpool_shm_file);
 		}
 		else
 		{
@@ -628,17 +1036,28 @@ static int fdht_load_from_conf_file(const char *filename, char *bind_addr, \
 			g_db_dead_lock_detect_interval = iniGetIntValue(NULL,  \
 				"db_dead_lock_detect_interval", &iniContext, \
 				DEFAULT_DB_DEAD_LOCK_DETECT_INVERVAL);
+			g_db_expire_index = iniGetBoolValue(NULL, \
+				"db_expire_index", &iniContext, false);
 
 			snprintf(szStoreParams, sizeof(szStoreParams), \
 				"db_type=%s, " \
 				"db_prefix=%s, " \
 				"page_size=%d, " \
 				"sync_db_time_base=%s, sync_db_interval=%ds, " \
-				"db_dead_lock_detect_interval=%dms", \
+				"db_dead_lock_detect_interval=%dms, " \
+				"db_expire_index=%d", \
 				*db_type == DB_BTREE ? "btree" : "hash", \
 				db_file_prefix, *page_size, \
 				sz_sync_db_time_base, g_sync_db_interval, \
-				g_db_dead_lock_detect_interval);
+				g_db_dead_lock_detect_interval, \
+				g_db_expire_index);
+
+			if (g_store_type == FDHT_STORE_TYPE_HYBRID && \
+				(result=load_hybrid_params(&iniContext, \
+				szStoreParams, sizeof(szStoreParams))) != 0)
+			{
+				break;
+			}
 		}
 
 		g_max_threads = iniGetIntValue(NULL, "max_threads", &iniContext, \
@@ -663,6 +1082,53 @@ static int fdht_load_from_conf_file(const char *filename, char *bind_addr, \
 			break;
 		}
 
+		g_reuse_port = iniGetBoolValue(NULL, "reuse_port", \
+						&iniContext, false);
+
+		pUnixSocketPath = iniGetStrValue(NULL, "unix_socket_path", \
+						&iniContext);
+		if (pUnixSocketPath != NULL)
+		{
+			snprintf(g_unix_socket_path, \
+				sizeof(g_unix_socket_path), \
+				"%s", pUnixSocketPath);
+		}
+
+		pPlacement = iniGetStrValue(NULL, "connection_placement", \
+						&iniContext);
+		if (pPlacement == NULL || strcasecmp(pPlacement, \
+					"least_loaded") == 0)
+		{
+			g_connection_placement = FDHT_PLACEMENT_LEAST_LOADED;
+		}
+		else if (strcasecmp(pPlacement, "two_choices") == 0)
+		{
+			g_connection_placement = FDHT_PLACEMENT_TWO_CHOICES;
+		}
+		else if (strcasecmp(pPlacement, "fd_mod") == 0)
+		{
+			g_connection_placement = FDHT_PLACEMENT_FD_MOD;
+		}
+		else
+		{
+			logError("file: "__FILE__", line: %d, " \
+				"item \"connection_placement\" is invalid, " \
+				"value: \"%s\"", __LINE__, pPlacement);
+			result = EINVAL;
+			break;
+		}
+
+		g_store_threads = iniGetIntValue(NULL, "store_threads",
+					&iniContext, 0);
+		if (g_store_threads < 0)
+		{
+			logError("file: "__FILE__", line: %d, " \
+				"item \"store_threads\" is invalid, " \
+				"value: %d < 0!", __LINE__, g_store_threads);
+			result = EINVAL;
+			break;
+		}
+
 		pMaxPkgSize = iniGetStrValue(NULL, "max_pkg_size", &iniContext);
 		if (pMaxPkgSize == NULL)
 		{
@@ -887,8 +1353,11 @@ static int fdht_load_from_conf_file(const char *filename, char *bind_addr, \
 			"network_timeout=%d, "\
 			"port=%d, bind_addr=%s, " \
 			"max_connections=%d, "    \
-			"accept_threads=%d, "    \
+			"accept_threads=%d, reuse_port=%d, "    \
+			"unix_socket_path=%s, "    \
+			"connection_placement=%s, "    \
 			"max_threads=%d, "    \
+			"store_threads=%d, "    \
 			"max_pkg_size=%d KB, " \
 			"min_buff_size=%d KB, " \
 			"store_type=%s, " \
@@ -910,9 +1379,18 @@ static int fdht_load_from_conf_file(const char *filename, char *bind_addr, \
 			g_group_server_count, g_fdht_connect_timeout, \
 			g_fdht_network_timeout, \
 			g_server_port, bind_addr, g_max_connections, \
-			g_accept_threads, g_max_threads, g_max_pkg_size / 1024, \
+			g_accept_threads, g_reuse_port, \
+			g_unix_socket_path, g_connection_placement == FDHT_PLACEMENT_FD_MOD ? \
+			"fd_mod" : (g_connection_placement == \
+			FDHT_PLACEMENT_TWO_CHOICES ? "two_choices" : \
+			"least_loaded"), g_max_threads, \
+			g_store_threads, \
+			g_max_pkg_size / 1024, \
 			g_min_buff_size / 1024, \
-			g_store_type == FDHT_STORE_TYPE_BDB ? "BDB" : "MPOOL", \
+			g_store_type == FDHT_STORE_TYPE_BDB ? "BDB" : \
+			(g_store_type == FDHT_STORE_TYPE_MPOOL ? "MPOOL" : \
+			(g_store_type == FDHT_STORE_TYPE_HYBRID ? "HYBRID" : \
+			"MPOOL_FLAT")), \
 			(int)(*nCacheSize / (1024 * 1024)), szStoreParams, \
 			g_sync_wait_usec / 1000, \
 			g_allow_ip_count, g_sync_log_buff_interval, \
@@ -1120,7 +1598,16 @@ int fdht_func_init(const char *filename, char *bind_addr, const int addr_size)
 				break;
 			}
 		}
-		else
+		else if (g_store_type == FDHT_STORE_TYPE_HYBRID)
+		{
+			if ((result=hy_init(&g_db_list[*pGroupId], db_type, \
+						nCacheSize, page_size, \
+						g_fdht_base_path, db_filename)) != 0)
+			{
+				break;
+			}
+		}
+		else if (g_store_type == FDHT_STORE_TYPE_MPOOL)
 		{
 			if ((result=mp_init(&g_db_list[*pGroupId], \
 						nCacheSize)) != 0)
@@ -1128,6 +1615,14 @@ int fdht_func_init(const char *filename, char *bind_addr, const int addr_size)
 				break;
 			}
 		}
+		else
+		{
+			if ((result=fl_init(&g_db_list[*pGroupId], \
+						nCacheSize)) != 0)
+			{
+				break;
+			}
+		}
 	}
 
 	free(group_ids);
@@ -1258,11 +1753,11 @@ int fdht_terminate()
 {
 	struct nio_thread_data *pThreadData;
 	struct nio_thread_data *pDataEnd;
-	int quit_sock;
+	long quit_flag;
 
 	g_continue_flag = false;
 
-	if (g_store_type == FDHT_STORE_TYPE_BDB)
+	if (FDHT_STORE_TYPE_IS_BDB(g_store_type))
 	{
 		pthread_kill(dld_tid, SIGINT);
 	}
@@ -1270,13 +1765,13 @@ int fdht_terminate()
 	if (g_thread_data != NULL)
 	{
 		pDataEnd = g_thread_data + g_max_threads;
-		quit_sock = 0;
+		quit_flag = 0;
 		for (pThreadData=g_thread_data; pThreadData<pDataEnd; \
 			pThreadData++)
 		{
-			quit_sock--;
-			if (write(pThreadData->pipe_fds[1], &quit_sock, \
-					sizeof(quit_sock)) != sizeof(quit_sock))
+			quit_flag--;
+			if (write(pThreadData->pipe_fds[1], &quit_flag, \
+					sizeof(quit_flag)) != sizeof(quit_flag))
 			{
 			}
 		}
@@ -20,6 +20,10 @@ int g_server_port = FDHT_SERVER_DEFAULT_PORT;
 int g_max_connections = DEFAULT_MAX_CONNECTONS;
 int g_max_threads = 4;
 int g_accept_threads = 1;
+int g_store_threads = 0;
+bool g_reuse_port = false;
+int g_connection_placement = FDHT_PLACEMENT_LEAST_LOADED;
+char g_unix_socket_path[MAX_PATH_SIZE] = {0};
 int g_max_pkg_size = FDHT_MAX_PKG_SIZE;
 int g_min_buff_size = FDHT_MIN_BUFF_SIZE;
 int g_heart_beat_interval = DEFAULT_NETWORK_TIMEOUT / 2;
@@ -35,6 +39,7 @@ bool g_need_clear_expired_data = true;
 TimeInfo g_clear_expired_time_base = {TIME_NONE, TIME_NONE};
 int g_clear_expired_interval = DEFAULT_CLEAR_EXPIRED_INVERVAL;
 int g_db_dead_lock_detect_interval = DEFAULT_DB_DEAD_LOCK_DETECT_INVERVAL;
+bool g_db_expire_index = false;
 TimeInfo g_compress_binlog_time_base = {TIME_NONE, TIME_NONE};
 int g_compress_binlog_interval = COMPRESS_BINLOG_DEF_INTERVAL;
 int g_sync_stat_file_interval = DEFAULT_SYNC_STAT_FILE_INTERVAL;
@@ -64,6 +69,20 @@ int g_mpool_init_capacity = FDHT_DEFAULT_MPOOL_INIT_CAPACITY;
 double g_mpool_load_factor = FDHT_DEFAULT_MPOOL_LOAD_FACTOR;
 int g_mpool_clear_min_interval = FDHT_DEFAULT_MPOOL_CLEAR_MIN_INTEVAL;
 int g_mpool_htable_lock_count = FDHT_DEFAULT_MPOOL_HTABLE_LOCK_COUNT;
+int g_mpool_slab_page_size = FDHT_DEFAULT_MPOOL_SLAB_PAGE_SIZE;
+int g_mpool_clear_step_msec = FDHT_DEFAULT_MPOOL_CLEAR_STEP_MSEC;
+int g_mpool_evict_policy = FDHT_MPOOL_EVICT_NONE;
+FDHTEvictNameSpace g_mpool_evict_namespaces[FDHT_MPOOL_MAX_EVICT_NAMESPACES];
+int g_mpool_evict_namespace_count = 0;
+int g_mpool_snapshot_interval = 0;
+int g_mpool_hash_function = FDHT_MPOOL_HASH_TIME33;
+bool g_mpool_lockfree_get = false;
+bool g_mpool_namespace_stat = false;
+FDHTNameSpaceQuota g_mpool_namespace_quotas[FDHT_MPOOL_MAX_QUOTA_NAMESPACES];
+int g_mpool_namespace_quota_count = 0;
+char g_mpool_shm_file[MAX_PATH_SIZE] = {0};
+int64_t g_hybrid_cache_size = FDHT_DEFAULT_HYBRID_CACHE_SIZE;
+int g_hybrid_admit_policy = FDHT_HYBRID_ADMIT_SECOND_HIT;
 
 struct nio_thread_data *g_thread_data = NULL;
 int g_thread_stack_size = 1 * 1024 * 1024;
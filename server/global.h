@@ -30,12 +30,29 @@ extern "C" {
 
 #define FDHT_IF_ALIAS_PREFIX_MAX_SIZE 32
 
+typedef struct
+{
+	char szNameSpace[FDHT_MAX_NAMESPACE_LEN + 1];
+	int namespace_len;  //-1 for all namespaces
+	volatile int64_t evicted_count;
+} FDHTEvictNameSpace;
+
+typedef struct
+{
+	char szNameSpace[FDHT_MAX_NAMESPACE_LEN + 1];
+	int64_t max_bytes;
+} FDHTNameSpaceQuota;
+
 extern volatile bool g_continue_flag;
 
 extern int g_server_port;
 extern int g_max_connections;
 extern int g_max_threads;
 extern int g_accept_threads;
+extern int g_store_threads;  //0 for dealing requests in the nio threads
+extern bool g_reuse_port;    //each nio thread accepts on its own socket
+extern int g_connection_placement; //how to choose the nio thread
+extern char g_unix_socket_path[MAX_PATH_SIZE]; //empty for no unix listener
 extern int g_max_pkg_size;
 extern int g_min_buff_size;
 extern int g_heart_beat_interval;
@@ -51,6 +68,7 @@ extern bool g_need_clear_expired_data;
 extern TimeInfo g_clear_expired_time_base;
 extern int g_clear_expired_interval;
 extern int g_db_dead_lock_detect_interval;
+extern bool g_db_expire_index;  //index the BDB keys by the expires
 extern TimeInfo g_compress_binlog_time_base;
 extern int g_compress_binlog_interval;
 extern int g_sync_stat_file_interval;   //sync stat info to disk interval
@@ -80,6 +98,22 @@ extern int g_mpool_init_capacity;
 extern double g_mpool_load_factor;
 extern int g_mpool_clear_min_interval;
 extern int g_mpool_htable_lock_count;
+extern int g_mpool_slab_page_size;  //0 for malloc the nodes
+extern int g_mpool_clear_step_msec; //the max time of an expire step
+extern int g_mpool_evict_policy;
+extern FDHTEvictNameSpace g_mpool_evict_namespaces[ \
+		FDHT_MPOOL_MAX_EVICT_NAMESPACES];
+extern int g_mpool_evict_namespace_count;
+extern int g_mpool_snapshot_interval;  //0 for no snapshot
+extern int g_mpool_hash_function;  //the hash of the mpool table only
+extern bool g_mpool_lockfree_get;  //mp_get without lock
+extern bool g_mpool_namespace_stat;  //account the keys per namespace
+extern FDHTNameSpaceQuota g_mpool_namespace_quotas[ \
+		FDHT_MPOOL_MAX_QUOTA_NAMESPACES];
+extern int g_mpool_namespace_quota_count;
+extern char g_mpool_shm_file[MAX_PATH_SIZE];  //empty for no shared memory
+extern int64_t g_hybrid_cache_size;  //the mpool cache of store_type HYBRID
+extern int g_hybrid_admit_policy;
 extern struct nio_thread_data *g_thread_data;
 
 extern int g_thread_stack_size;
@@ -0,0 +1,621 @@
+//hybrid_op.c
+
+/* store_type HYBRID: the keys are stored by BDB, a bounded hash table in
+   front of the DB handles caches the hot keys, read through on the GET
+   misses and written through by the writes. the DB and the cache of a
+   key are changed under the key lock, so a GET miss never caches the
+   value replaced by a concurrent write. the GET hits take the bucket
+   lock of the cache only.
+   with the admission policy second_hit, the key is cached on its second
+   miss or write: the first one sets the bit of the key in the doorkeeper,
+   so the keys scanned once never evict the hot ones */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/time.h>
+#include <pthread.h>
+#include "logger.h"
+#include "shared_func.h"
+#include "pthread_func.h"
+#include "global.h"
+#include "hybrid_op.h"
+
+HashArray *g_hybrid_cache = NULL;
+static pthread_mutex_t *key_locks = NULL;
+
+/* the bits of the keys missed once, cleared when half of them set */
+static volatile uint64_t *doorkeeper = NULL;
+static unsigned int doorkeeper_bits = 0;
+static volatile int doorkeeper_count = 0;
+
+static FDHTHybridStat hybrid_stat;
+
+static int hy_cache_init()
+{
+	unsigned int capacity;
+	int result;
+	int i;
+
+	g_hybrid_cache = (HashArray *)malloc(sizeof(HashArray));
+	if (g_hybrid_cache == NULL)
+	{
+		logError("file: "__FILE__", line: %d, " \
+			"malloc %d bytes fail, " \
+			"errno: %d, error info: %s", \
+			__LINE__, (int)sizeof(HashArray), \
+			errno, STRERROR(errno));
+		return errno != 0 ? errno : ENOMEM;
+	}
+
+	/* the bucket locks without rehash, the hits need no global lock */
+	capacity = g_hybrid_cache_size / FDHT_HYBRID_AVG_ITEM_BYTES;
+	if ((result=hash_init_ex(g_hybrid_cache, Time33Hash, capacity, \
+			0.00, g_hybrid_cache_size, true)) != 0)
+	{
+		return result;
+	}
+	if ((result=hash_set_locks(g_hybrid_cache, \
+			FDHT_DEFAULT_MPOOL_HTABLE_LOCK_COUNT)) != 0)
+	{
+		return result;
+	}
+	if ((result=hash_set_slab(g_hybrid_cache, \
+			FDHT_DEFAULT_MPOOL_SLAB_PAGE_SIZE)) != 0)
+	{
+		logError("file: "__FILE__", line: %d, " \
+			"hash_set_slab fail, errno: %d, error info: %s", \
+			__LINE__, result, STRERROR(result));
+		return result;
+	}
+
+	key_locks = (pthread_mutex_t *)malloc(sizeof(pthread_mutex_t) * \
+			FDHT_HYBRID_KEY_LOCK_COUNT);
+	if (key_locks == NULL)
+	{
+		logError("file: "__FILE__", line: %d, " \
+			"malloc %d bytes fail, " \
+			"errno: %d, error info: %s", __LINE__, \
+			(int)sizeof(pthread_mutex_t) * \
+			FDHT_HYBRID_KEY_LOCK_COUNT, errno, STRERROR(errno));
+		return errno != 0 ? errno : ENOMEM;
+	}
+	for (i=0; i<FDHT_HYBRID_KEY_LOCK_COUNT; i++)
+	{
+		if ((result=init_pthread_lock(key_locks + i)) != 0)
+		{
+			return result;
+		}
+	}
+
+	if (g_hybrid_admit_policy == FDHT_HYBRID_ADMIT_SECOND_HIT)
+	{
+		doorkeeper_bits = (*g_hybrid_cache->capacity * \
+			FDHT_HYBRID_DOORKEEPER_BITS + 63) / 64 * 64;
+		doorkeeper = (volatile uint64_t *)calloc( \
+				doorkeeper_bits / 64, sizeof(uint64_t));
+		if (doorkeeper == NULL)
+		{
+			logError("file: "__FILE__", line: %d, " \
+				"malloc %d bytes fail, " \
+				"errno: %d, error info: %s", __LINE__, \
+				doorkeeper_bits / 8, errno, STRERROR(errno));
+			return errno != 0 ? errno : ENOMEM;
+		}
+	}
+
+	memset(&hybrid_stat, 0, sizeof(hybrid_stat));
+	return 0;
+}
+
+int hy_init(StoreHandle **ppHandle, const DBType type, \
+	const u_int64_t nCacheSize, const u_int32_t page_size, \
+	const char *base_path, const char *filename)
+{
+	int result;
+
+	if ((result=db_init(ppHandle, type, nCacheSize, page_size, \
+			base_path, filename)) != 0)
+	{
+		return result;
+	}
+
+	if (g_hybrid_cache != NULL)
+	{
+		return 0;
+	}
+
+	return hy_cache_init();
+}
+
+int hy_destroy_instance(StoreHandle **ppHandle)
+{
+	return db_destroy_instance(ppHandle);
+}
+
+int hy_destroy()
+{
+	int i;
+
+	if (g_hybrid_cache != NULL)
+	{
+		hash_destroy(g_hybrid_cache);
+		free(g_hybrid_cache);
+		g_hybrid_cache = NULL;
+	}
+
+	if (key_locks != NULL)
+	{
+		for (i=0; i<FDHT_HYBRID_KEY_LOCK_COUNT; i++)
+		{
+			pthread_mutex_destroy(key_locks + i);
+		}
+		free(key_locks);
+		key_locks = NULL;
+	}
+
+	if (doorkeeper != NULL)
+	{
+		free((void *)doorkeeper);
+		doorkeeper = NULL;
+	}
+
+	return db_destroy();
+}
+
+#define HY_KEY_LOCK(hash_code) \
+	(key_locks + (hash_code) % FDHT_HYBRID_KEY_LOCK_COUNT)
+
+/* return true for caching the key */
+static bool hy_admit(const unsigned int hash_code)
+{
+	volatile uint64_t *pWord;
+	uint64_t mask;
+	unsigned int bit;
+	int count;
+
+	if (doorkeeper == NULL)
+	{
+		return true;
+	}
+
+	/* the bits of the doorkeeper are not correlated to the buckets */
+	bit = (hash_code * 2654435761U) % doorkeeper_bits;
+	pWord = doorkeeper + bit / 64;
+	mask = (uint64_t)1 << (bit % 64);
+	if ((*pWord & mask) != 0 || \
+		(__sync_fetch_and_or(pWord, mask) & mask) != 0)
+	{
+		return true;
+	}
+
+	count = __sync_add_and_fetch(&doorkeeper_count, 1);
+	if (count == doorkeeper_bits / 2)
+	{
+		memset((void *)doorkeeper, 0, doorkeeper_bits / 8);
+		__sync_sub_and_fetch(&doorkeeper_count, count);
+	}
+
+	__sync_add_and_fetch(&hybrid_stat.reject_count, 1);
+	return false;
+}
+
+/* the value is the same as the DB after, the key is not cached when no
+   room. call with the key lock */
+static void hy_cache_set(const char *pKey, const int key_len, \
+		const char *pValue, const int value_len)
+{
+	int64_t bytes;
+	int result;
+	int count;
+	int i;
+
+	for (i=0; i<=FDHT_HYBRID_EVICT_TIMES; i++)
+	{
+		result = hash_insert_ex(g_hybrid_cache, pKey, key_len, \
+				(void *)pValue, value_len, true);
+		if (result >= 0)
+		{
+			if (result > 0)
+			{
+				__sync_add_and_fetch(&hybrid_stat.admit_count, 1);
+			}
+			return;
+		}
+
+		if (result != -ENOSPC)
+		{
+			break;
+		}
+
+		/* the evicted node must be the slab class of the new one */
+		count = hash_evict(g_hybrid_cache, key_len, value_len, \
+				FDHT_MPOOL_EVICT_MAX_BUCKETS, NULL, \
+				NULL, &bytes);
+		if (count == 0)
+		{
+			break;
+		}
+
+		__sync_add_and_fetch(&hybrid_stat.evicted_count, count);
+		__sync_add_and_fetch(&hybrid_stat.evicted_bytes, bytes);
+	}
+
+	/* the old value must not be read */
+	hash_delete(g_hybrid_cache, pKey, key_len);
+	__sync_add_and_fetch(&hybrid_stat.fill_fail_count, 1);
+}
+
+/* the written value is cached when the key is cached or admitted.
+   call with the key lock after the DB written */
+static void hy_cache_write(const unsigned int hash_code, const char *pKey, \
+		const int key_len, const char *pValue, const int value_len)
+{
+	if (hash_find_ex(g_hybrid_cache, pKey, key_len) != NULL || \
+		hy_admit(hash_code))
+	{
+		hy_cache_set(pKey, key_len, pValue, value_len);
+	}
+}
+
+static int hy_copy_value(const HashData *hash_data, char **ppValue, \
+		int *size)
+{
+	if (*ppValue != NULL)
+	{
+		if (*size < hash_data->value_len)
+		{
+			*size = hash_data->value_len;
+			return ENOSPC;
+		}
+
+		*size = hash_data->value_len;
+		memcpy(*ppValue, hash_data->value, hash_data->value_len);
+		return 0;
+	}
+
+	*size = hash_data->value_len;
+	*ppValue = (char *)malloc(hash_data->value_len);
+	if (*ppValue == NULL)
+	{
+		logError("file: "__FILE__", line: %d, " \
+			"malloc %d bytes fail, " \
+			"errno: %d, error info: %s", \
+			__LINE__, hash_data->value_len, \
+			errno, STRERROR(errno));
+		return errno != 0 ? errno : ENOMEM;
+	}
+
+	memcpy(*ppValue, hash_data->value, hash_data->value_len);
+	return 0;
+}
+
+int hy_get(StoreHandle *pHandle, const char *pKey, const int key_len, \
+		char **ppValue, int *size)
+{
+	HashData *hash_data;
+	pthread_mutex_t *pLock;
+	unsigned int hash_code;
+	int result;
+
+	hash_data = hash_find_ref(g_hybrid_cache, pKey, key_len);
+	if (hash_data != NULL)
+	{
+		__sync_add_and_fetch(&hybrid_stat.hit_count, 1);
+		g_server_stat.total_get_count++;
+		result = hy_copy_value(hash_data, ppValue, size);
+		hash_release(g_hybrid_cache, hash_data);
+		if (result == 0)
+		{
+			g_server_stat.success_get_count++;
+		}
+		return result;
+	}
+
+	/* the stat of the GET is counted by db_get */
+	__sync_add_and_fetch(&hybrid_stat.miss_count, 1);
+	hash_code = Time33Hash(pKey, key_len);
+	pLock = HY_KEY_LOCK(hash_code);
+	pthread_mutex_lock(pLock);
+	result = db_get(pHandle, pKey, key_len, ppValue, size);
+	if (result == 0 && hy_admit(hash_code))
+	{
+		hy_cache_set(pKey, key_len, *ppValue, *size);
+	}
+	pthread_mutex_unlock(pLock);
+
+	return result;
+}
+
+int hy_get_ex(StoreHandle *pHandle, const char *pKey, const int key_len, \
+		FDHTGetBuffer *pBuffer)
+{
+	HashData *hash_data;
+	pthread_mutex_t *pLock;
+	unsigned int hash_code;
+	int result;
+
+	hash_data = hash_find_ref(g_hybrid_cache, pKey, key_len);
+	if (hash_data != NULL)
+	{
+		__sync_add_and_fetch(&hybrid_stat.hit_count, 1);
+		g_server_stat.total_get_count++;
+		if ((result=store_get_buffer_reserve(pBuffer, \
+				hash_data->value_len)) == 0)
+		{
+			memcpy(pBuffer->buff, hash_data->value, \
+				hash_data->value_len);
+			pBuffer->value_len = hash_data->value_len;
+			g_server_stat.success_get_count++;
+		}
+		hash_release(g_hybrid_cache, hash_data);
+		return result;
+	}
+
+	/* the stat of the GET is counted by db_get_ex */
+	__sync_add_and_fetch(&hybrid_stat.miss_count, 1);
+	hash_code = Time33Hash(pKey, key_len);
+	pLock = HY_KEY_LOCK(hash_code);
+	pthread_mutex_lock(pLock);
+	result = db_get_ex(pHandle, pKey, key_len, pBuffer);
+	if (result == 0 && hy_admit(hash_code))
+	{
+		hy_cache_set(pKey, key_len, pBuffer->buff, pBuffer->value_len);
+	}
+	pthread_mutex_unlock(pLock);
+
+	return result;
+}
+
+int hy_set(StoreHandle *pHandle, const char *pKey, const int key_len, \
+	const char *pValue, const int value_len)
+{
+	pthread_mutex_t *pLock;
+	unsigned int hash_code;
+	int result;
+
+	hash_code = Time33Hash(pKey, key_len);
+	pLock = HY_KEY_LOCK(hash_code);
+	pthread_mutex_lock(pLock);
+	if ((result=db_set(pHandle, pKey, key_len, pValue, value_len)) == 0)
+	{
+		hy_cache_write(hash_code, pKey, key_len, pValue, value_len);
+	}
+	else
+	{
+		hash_delete(g_hybrid_cache, pKey, key_len);
+	}
+	pthread_mutex_unlock(pLock);
+
+	return result;
+}
+
+int hy_partial_set(StoreHandle *pHandle, const char *pKey, const int key_len, \
+	const char *pValue, const int offset, const int value_len)
+{
+	pthread_mutex_t *pLock;
+	int result;
+
+	pLock = HY_KEY_LOCK((unsigned int)Time33Hash(pKey, key_len));
+	pthread_mutex_lock(pLock);
+
+	/* the whole value is unknown, only the cached one is changed */
+	if ((result=db_partial_set(pHandle, pKey, key_len, pValue, \
+		offset, value_len)) != 0 || hash_partial_set(g_hybrid_cache, \
+		pKey, key_len, pValue, offset, value_len) != 0)
+	{
+		hash_delete(g_hybrid_cache, pKey, key_len);
+	}
+	pthread_mutex_unlock(pLock);
+
+	return result;
+}
+
+int hy_delete(StoreHandle *pHandle, const char *pKey, const int key_len)
+{
+	pthread_mutex_t *pLock;
+	int result;
+
+	pLock = HY_KEY_LOCK((unsigned int)Time33Hash(pKey, key_len));
+	pthread_mutex_lock(pLock);
+	result = db_delete(pHandle, pKey, key_len);
+	hash_delete(g_hybrid_cache, pKey, key_len);
+	pthread_mutex_unlock(pLock);
+
+	return result;
+}
+
+int hy_inc(StoreHandle *pHandle, const char *pKey, const int key_len, \
+	const int inc, char *pValue, int *value_len)
+{
+	pthread_mutex_t *pLock;
+	unsigned int hash_code;
+	int result;
+
+	hash_code = Time33Hash(pKey, key_len);
+	pLock = HY_KEY_LOCK(hash_code);
+	pthread_mutex_lock(pLock);
+	if ((result=db_inc(pHandle, pKey, key_len, inc, \
+			pValue, value_len)) == 0)
+	{
+		hy_cache_write(hash_code, pKey, key_len, pValue, *value_len);
+	}
+	else
+	{
+		hash_delete(g_hybrid_cache, pKey, key_len);
+	}
+	pthread_mutex_unlock(pLock);
+
+	return result;
+}
+
+int hy_inc_ex(StoreHandle *pHandle, const char *pKey, const int key_len, \
+	const int inc, char *pValue, int *value_len, const int expires)
+{
+	pthread_mutex_t *pLock;
+	unsigned int hash_code;
+	int result;
+
+	hash_code = Time33Hash(pKey, key_len);
+	pLock = HY_KEY_LOCK(hash_code);
+	pthread_mutex_lock(pLock);
+	if ((result=db_inc_ex(pHandle, pKey, key_len, inc, \
+			pValue, value_len, expires)) == 0)
+	{
+		hy_cache_write(hash_code, pKey, key_len, pValue, *value_len);
+	}
+	else
+	{
+		hash_delete(g_hybrid_cache, pKey, key_len);
+	}
+	pthread_mutex_unlock(pLock);
+
+	return result;
+}
+
+typedef struct
+{
+	int key_len;
+	char key[FDHT_MAX_FULL_KEY_LEN];
+} HybridExpiredKey;
+
+typedef struct
+{
+	time_t current_time;
+	int count;
+	HybridExpiredKey keys[FDHT_HYBRID_EXPIRE_BATCH_KEYS];
+} HybridExpiredKeys;
+
+static bool hy_is_expired(const HashData *hash_data, const time_t current_time)
+{
+	int expires;
+
+	if (hash_data->value_len < 4)
+	{
+		return false;
+	}
+
+	expires = buff2int(hash_data->value);
+	return expires != FDHT_EXPIRES_NEVER && expires < current_time;
+}
+
+/* collect the expired keys, the bucket is locked by hash_walk_buckets.
+   return ENOSPC when the batch full, the walk resumes from the bucket */
+static int hy_collect_expired_key(const int index, const HashData *hash_data, \
+		void *args)
+{
+	HybridExpiredKeys *pExpired;
+	HybridExpiredKey *pKey;
+
+	pExpired = (HybridExpiredKeys *)args;
+	if (!hy_is_expired(hash_data, pExpired->current_time) || \
+		hash_data->key_len > FDHT_MAX_FULL_KEY_LEN)
+	{
+		return 0;
+	}
+
+	if (pExpired->count == FDHT_HYBRID_EXPIRE_BATCH_KEYS)
+	{
+		return ENOSPC;
+	}
+
+	pKey = pExpired->keys + pExpired->count++;
+	pKey->key_len = hash_data->key_len;
+	memcpy(pKey->key, hash_data->key, hash_data->key_len);
+	return 0;
+}
+
+/* the key is checked again under the key lock, it may be written after
+   collected */
+static int hy_delete_expired_keys(HybridExpiredKeys *pExpired)
+{
+	HybridExpiredKey *pKey;
+	HybridExpiredKey *pEnd;
+	HashData *hash_data;
+	pthread_mutex_t *pLock;
+	bool expired;
+	int count;
+
+	count = 0;
+	pEnd = pExpired->keys + pExpired->count;
+	for (pKey=pExpired->keys; pKey<pEnd; pKey++)
+	{
+		pLock = HY_KEY_LOCK((unsigned int)Time33Hash( \
+				pKey->key, pKey->key_len));
+		pthread_mutex_lock(pLock);
+		hash_data = hash_find_ref(g_hybrid_cache, \
+				pKey->key, pKey->key_len);
+		if (hash_data != NULL)
+		{
+			expired = hy_is_expired(hash_data, \
+					pExpired->current_time);
+			hash_release(g_hybrid_cache, hash_data);
+			if (expired && hash_delete(g_hybrid_cache, \
+				pKey->key, pKey->key_len) == 0)
+			{
+				count++;
+			}
+		}
+		pthread_mutex_unlock(pLock);
+	}
+
+	pExpired->count = 0;
+	return count;
+}
+
+int hy_clear_expired_keys(void *arg)
+{
+	HybridExpiredKeys *pExpired;
+	struct timeval tv_start;
+	struct timeval tv_end;
+	unsigned int bucket_index;
+	int expired_count;
+	int result;
+
+	if (g_hybrid_cache == NULL)
+	{
+		return 0;
+	}
+
+	pExpired = (HybridExpiredKeys *)malloc(sizeof(HybridExpiredKeys));
+	if (pExpired == NULL)
+	{
+		logError("file: "__FILE__", line: %d, " \
+			"malloc %d bytes fail, " \
+			"errno: %d, error info: %s", \
+			__LINE__, (int)sizeof(HybridExpiredKeys), \
+			errno, STRERROR(errno));
+		return -1;
+	}
+
+	gettimeofday(&tv_start, NULL);
+	pExpired->current_time = tv_start.tv_sec;
+	pExpired->count = 0;
+	expired_count = 0;
+	bucket_index = 0;
+	do
+	{
+		result = hash_walk_buckets(g_hybrid_cache, &bucket_index, \
+			FDHT_MPOOL_REHASH_BATCH_BUCKETS, \
+			hy_collect_expired_key, pExpired);
+		expired_count += hy_delete_expired_keys(pExpired);
+	} while (result != 0 && g_continue_flag);
+
+	free(pExpired);
+	__sync_add_and_fetch(&hybrid_stat.expired_count, expired_count);
+
+	gettimeofday(&tv_end, NULL);
+	logInfo("clear expired keys of the cache, expired key count: %d, " \
+		"time used: %dms", expired_count, \
+		(int)((tv_end.tv_sec - tv_start.tv_sec) * 1000 + \
+		(tv_end.tv_usec - tv_start.tv_usec) / 1000));
+
+	return expired_count;
+}
+
+void hy_cache_stat(FDHTHybridStat *pStat)
+{
+	*pStat = hybrid_stat;
+}
+
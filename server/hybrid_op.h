@@ -0,0 +1,82 @@
+/**
+* Copyright (C) 2008 Happy Fish / YuQing
+*
+* FastDFS may be copied only under the terms of the GNU General
+* Public License V3, which may be found in the FastDFS source kit.
+* Please visit the FastDFS Home Page http://www.csource.org/ for more detail.
+**/
+
+//hybrid_op.h
+
+#ifndef _HYBRID_OP_H
+#define _HYBRID_OP_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "fdht_define.h"
+#include "hash.h"
+#include "store.h"
+#include "db_op.h"
+
+typedef struct
+{
+	int64_t hit_count;
+	int64_t miss_count;
+	int64_t admit_count;   //the keys cached by the GET misses and writes
+	int64_t reject_count;  //the keys not cached by the admission policy
+	int64_t evicted_count;
+	int64_t evicted_bytes;
+	int64_t fill_fail_count;  //no room after evicting
+	int64_t expired_count;    //the expired keys purged
+} FDHTHybridStat;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+extern HashArray *g_hybrid_cache;
+
+int hy_init(StoreHandle **ppHandle, const DBType type, \
+	const u_int64_t nCacheSize, const u_int32_t page_size, \
+	const char *base_path, const char *filename);
+int hy_destroy_instance(StoreHandle **ppHandle);
+int hy_destroy();
+
+int hy_get(StoreHandle *pHandle, const char *pKey, const int key_len, \
+		char **ppValue, int *size);
+int hy_get_ex(StoreHandle *pHandle, const char *pKey, const int key_len, \
+		FDHTGetBuffer *pBuffer);
+int hy_set(StoreHandle *pHandle, const char *pKey, const int key_len, \
+	const char *pValue, const int value_len);
+int hy_partial_set(StoreHandle *pHandle, const char *pKey, const int key_len, \
+	const char *pValue, const int offset, const int value_len);
+int hy_delete(StoreHandle *pHandle, const char *pKey, const int key_len);
+int hy_inc(StoreHandle *pHandle, const char *pKey, const int key_len, \
+	const int inc, char *pValue, int *value_len);
+int hy_inc_ex(StoreHandle *pHandle, const char *pKey, const int key_len, \
+	const int inc, char *pValue, int *value_len, const int expires);
+
+/**
+* delete the expired keys from the cache, the keys of the DB are cleared
+* by db_clear_expired_keys
+* params:
+*	arg: not used
+* return: the expired key count
+*/
+int hy_clear_expired_keys(void *arg);
+
+/**
+* get the stat of the cache
+* params:
+*	pStat: return the stat
+* return: none
+*/
+void hy_cache_stat(FDHTHybridStat *pStat);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
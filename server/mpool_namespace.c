@@ -0,0 +1,136 @@
+//mpool_namespace.c
+
+/* the keys and the bytes of the mpool accounted per namespace, the
+   namespace is the prefix of the full key before FDHT_FULL_KEY_SEPERATOR.
+   the stats are in an open addressing table, the slots are filled with
+   CAS and never removed, so the account function called under the
+   bucket locks needs no lock */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sched.h>
+#include "logger.h"
+#include "shared_func.h"
+#include "global.h"
+#include "mpool_namespace.h"
+
+/* the last one for the namespaces exceed the table */
+static FDHTNameSpaceStat *namespace_stats = NULL;
+
+static FDHTNameSpaceStat *mp_namespace_find(const char *szNameSpace, \
+		const int namespace_len)
+{
+	FDHTNameSpaceStat *pStat;
+	unsigned int index;
+	int i;
+
+	index = (unsigned int)Time33Hash(szNameSpace, namespace_len) % \
+		FDHT_MPOOL_MAX_NAMESPACES;
+	for (i=0; i<FDHT_MPOOL_MAX_NAMESPACES; i++)
+	{
+		pStat = namespace_stats + (index + i) % \
+			FDHT_MPOOL_MAX_NAMESPACES;
+		if (pStat->state == FDHT_NAMESPACE_SLOT_EMPTY && \
+			__sync_bool_compare_and_swap(&pStat->state, \
+			FDHT_NAMESPACE_SLOT_EMPTY, FDHT_NAMESPACE_SLOT_FILLING))
+		{
+			memcpy(pStat->szNameSpace, szNameSpace, namespace_len);
+			pStat->szNameSpace[namespace_len] = '\0';
+			pStat->namespace_len = namespace_len;
+			__sync_synchronize();
+			pStat->state = FDHT_NAMESPACE_SLOT_READY;
+			return pStat;
+		}
+
+		while (pStat->state == FDHT_NAMESPACE_SLOT_FILLING)
+		{
+			sched_yield();
+		}
+		__sync_synchronize();
+
+		if (pStat->namespace_len == namespace_len && \
+			memcmp(pStat->szNameSpace, szNameSpace, \
+				namespace_len) == 0)
+		{
+			return pStat;
+		}
+	}
+
+	return namespace_stats + FDHT_MPOOL_MAX_NAMESPACES;
+}
+
+FDHTNameSpaceStat *mp_namespace_get(const char *pKey, const int key_len)
+{
+	const char *pSeperator;
+
+	if (namespace_stats == NULL)
+	{
+		return NULL;
+	}
+
+	pSeperator = (const char *)memchr(pKey, FDHT_FULL_KEY_SEPERATOR, \
+			key_len);
+	if (pSeperator == NULL || pSeperator - pKey > FDHT_MAX_NAMESPACE_LEN)
+	{
+		return namespace_stats + FDHT_MPOOL_MAX_NAMESPACES;
+	}
+
+	return mp_namespace_find(pKey, pSeperator - pKey);
+}
+
+static void mp_namespace_account(const HashData *hash_data, const int sign, \
+		void *args)
+{
+	FDHTNameSpaceStat *pStat;
+
+	pStat = mp_namespace_get(hash_data->key, hash_data->key_len);
+	__sync_add_and_fetch(&pStat->key_count, sign);
+	__sync_add_and_fetch(&pStat->bytes_used, sign * (int64_t) \
+		(CALC_NODE_MALLOC_BYTES(hash_data->key_len, \
+		hash_data->malloc_value_size)));
+}
+
+int mp_namespace_init(HashArray *pHash)
+{
+	FDHTNameSpaceQuota *pQuota;
+	FDHTNameSpaceQuota *pQuotaEnd;
+	FDHTNameSpaceStat *pStat;
+	int bytes;
+
+	bytes = sizeof(FDHTNameSpaceStat) * (FDHT_MPOOL_MAX_NAMESPACES + 1);
+	namespace_stats = (FDHTNameSpaceStat *)malloc(bytes);
+	if (namespace_stats == NULL)
+	{
+		logError("file: "__FILE__", line: %d, " \
+			"malloc %d bytes fail, " \
+			"errno: %d, error info: %s", \
+			__LINE__, bytes, errno, STRERROR(errno));
+		return errno != 0 ? errno : ENOMEM;
+	}
+	memset(namespace_stats, 0, bytes);
+
+	pStat = namespace_stats + FDHT_MPOOL_MAX_NAMESPACES;
+	strcpy(pStat->szNameSpace, "*");
+	pStat->namespace_len = -1;
+	pStat->state = FDHT_NAMESPACE_SLOT_READY;
+
+	pQuotaEnd = g_mpool_namespace_quotas + g_mpool_namespace_quota_count;
+	for (pQuota=g_mpool_namespace_quotas; pQuota<pQuotaEnd; pQuota++)
+	{
+		pStat = mp_namespace_find(pQuota->szNameSpace, \
+				strlen(pQuota->szNameSpace));
+		pStat->max_bytes = pQuota->max_bytes;
+	}
+
+	hash_set_account(pHash, mp_namespace_account, NULL);
+	return 0;
+}
+
+FDHTNameSpaceStat *mp_namespace_stats(int *count)
+{
+	*count = namespace_stats != NULL ? FDHT_MPOOL_MAX_NAMESPACES + 1 : 0;
+	return namespace_stats;
+}
+
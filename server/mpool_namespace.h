@@ -0,0 +1,73 @@
+/**
+* Copyright (C) 2008 Happy Fish / YuQing
+*
+* FastDFS may be copied only under the terms of the GNU General
+* Public License V3, which may be found in the FastDFS source kit.
+* Please visit the FastDFS Home Page http://www.csource.org/ for more detail.
+**/
+
+//mpool_namespace.h
+
+#ifndef _MPOOL_NAMESPACE_H
+#define _MPOOL_NAMESPACE_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "fdht_define.h"
+#include "fdht_types.h"
+#include "hash.h"
+
+#define FDHT_NAMESPACE_SLOT_EMPTY    0
+#define FDHT_NAMESPACE_SLOT_FILLING  1
+#define FDHT_NAMESPACE_SLOT_READY    2
+
+typedef struct
+{
+	volatile int state;  //the slot is never emptied once filled
+	int namespace_len;
+	char szNameSpace[FDHT_MAX_NAMESPACE_LEN + 1];
+	int64_t max_bytes;  //the quota, 0 for no limit
+	volatile int64_t key_count;
+	volatile int64_t bytes_used;
+	volatile int64_t evicted_count;  //evicted by the quota
+	volatile int64_t reject_count;   //the SETs rejected by the quota
+} FDHTNameSpaceStat;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+* account the nodes of the hash table by the namespaces and load the
+* quotas, call when the table is empty
+* params:
+*	pHash: the hash table
+* return: error no, 0 for success, != 0 fail
+*/
+int mp_namespace_init(HashArray *pHash);
+
+/**
+* get the stat of the namespace of the full key, the namespaces exceed
+* FDHT_MPOOL_MAX_NAMESPACES share the stat named "*"
+* params:
+*	pKey: the full key
+*	key_len: the length of the full key
+* return: the namespace stat, NULL when not accounted
+*/
+FDHTNameSpaceStat *mp_namespace_get(const char *pKey, const int key_len);
+
+/**
+* get the namespace stats
+* params:
+*	count: return the stat count, including the empty slots
+* return: the namespace stat array, NULL when not accounted
+*/
+FDHTNameSpaceStat *mp_namespace_stats(int *count);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
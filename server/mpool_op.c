@@ -10,11 +10,100 @@
 #include "shared_func.h"
 #include "sched_thread.h"
 #include "mpool_op.h"
+#include "mpool_namespace.h"
+#include "mpool_shm.h"
+
+#define MP_EXPIRE_POP_BATCH  256  //the wheel items cleared per write lock
 
 HashArray *g_hash_array = NULL;
 static pthread_rwlock_t mpool_pthread_rwlock;
 static bool have_htable_lock = false;
 
+/* the expire index of the keys, NULL when the expired keys not cleared */
+static ExpireWheel *expire_wheel = NULL;
+
+/* the full sweep of the buckets started by mp_clear_expired_keys */
+static bool sweep_running = false;
+static unsigned int sweep_cursor = 0;
+static int sweep_item_count = 0;
+static int sweep_expired_count = 0;
+static int64_t sweep_time_used = 0;  //in us
+static time_t last_clear_time = 0;
+
+/* the eviction when the cache size reached */
+static volatile int64_t evicted_count = 0;
+static volatile int64_t evicted_bytes = 0;
+static volatile int64_t evict_fail_count = 0;
+
+static int64_t mp_get_time_us()
+{
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return (int64_t)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+static int mp_clear_due_keys(const time_t current_time, \
+		const int64_t deadline_us);
+
+/* the expires of the key before the write, FDHT_EXPIRES_NEVER for not
+   exist or the expires not indexed */
+static int mp_get_old_expires(const char *pKey, const int key_len)
+{
+	HashData *old_data;
+	int expires;
+
+	if (expire_wheel == NULL)
+	{
+		return FDHT_EXPIRES_NEVER;
+	}
+
+	if ((old_data=hash_find_ref(g_hash_array, pKey, key_len)) == NULL)
+	{
+		return FDHT_EXPIRES_NEVER;
+	}
+
+	expires = old_data->value_len >= 4 ? buff2int(old_data->value) : \
+			FDHT_EXPIRES_NEVER;
+	hash_release(g_hash_array, old_data);
+	return expires;
+}
+
+/* move the item of the key in the expire wheel to the new expires to
+   clear it in time, so the overwrites and the deletes leave no item */
+static void mp_index_expires(const char *pKey, const int key_len, \
+		const int old_expires, const int expires)
+{
+	unsigned int hash_code;
+
+	if (expire_wheel == NULL || (old_expires == expires && \
+		expires > g_current_time))
+	{
+		return;
+	}
+
+	hash_code = (unsigned int)g_hash_array->hash_func(pKey, key_len);
+	if (old_expires != FDHT_EXPIRES_NEVER)
+	{
+		expire_wheel_remove(expire_wheel, old_expires, hash_code);
+	}
+	if (expires != FDHT_EXPIRES_NEVER)
+	{
+		expire_wheel_add(expire_wheel, expires, hash_code);
+	}
+}
+
+/* index the expires of the keys attached from the shared memory */
+static int mp_index_expires_walk(const int index, const HashData *data, \
+		void *args)
+{
+	if (data->value_len >= 4)
+	{
+		mp_index_expires(data->key, data->key_len, \
+			FDHT_EXPIRES_NEVER, buff2int(data->value));
+	}
+	return 0;
+}
+
 int mp_init(StoreHandle **ppHandle, const u_int64_t nCacheSize)
 {
 	int result;
@@ -35,12 +124,42 @@ int mp_init(StoreHandle **ppHandle, const u_int64_t nCacheSize)
 		return errno != 0 ? errno : ENOMEM;
 	}
 
-	if ((result=hash_init_ex(g_hash_array, Time33Hash, g_mpool_init_capacity,\
-		g_mpool_load_factor, nCacheSize, true)) != 0)
+	if ((result=hash_init_ex(g_hash_array, g_mpool_hash_function == \
+		FDHT_MPOOL_HASH_WYHASH ? WyHash : Time33Hash, \
+		g_mpool_init_capacity, g_mpool_load_factor, \
+		nCacheSize, true)) != 0)
 	{
 		return result;
 	}
 	hash_set_locks(g_hash_array, g_mpool_htable_lock_count);
+	if (*g_mpool_shm_file != '\0')
+	{
+		if ((result=mp_shm_init(g_hash_array)) != 0)
+		{
+			return result;
+		}
+	}
+	else if (g_mpool_slab_page_size > 0 && (result=hash_set_slab( \
+			g_hash_array, g_mpool_slab_page_size)) != 0)
+	{
+		logError("file: "__FILE__", line: %d, " \
+			"hash_set_slab fail, errno: %d, error info: %s", \
+			__LINE__, result, STRERROR(result));
+		return result;
+	}
+	if (g_mpool_lockfree_get && (result=hash_set_epoch( \
+			g_hash_array)) != 0)
+	{
+		logError("file: "__FILE__", line: %d, " \
+			"hash_set_epoch fail, errno: %d, error info: %s", \
+			__LINE__, result, STRERROR(result));
+		return result;
+	}
+	if (g_mpool_namespace_stat && (result=mp_namespace_init( \
+			g_hash_array)) != 0)
+	{
+		return result;
+	}
 	have_htable_lock = g_hash_array->lock_count > 0;
 	*ppHandle = g_hash_array;
 
@@ -52,6 +171,33 @@ int mp_init(StoreHandle **ppHandle, const u_int64_t nCacheSize)
 		return result;
 	}
 
+	if (g_need_clear_expired_data)
+	{
+		expire_wheel = (ExpireWheel *)malloc(sizeof(ExpireWheel));
+		if (expire_wheel == NULL)
+		{
+			logError("file: "__FILE__", line: %d, " \
+				"malloc %d bytes fail, " \
+				"errno: %d, error info: %s", \
+				__LINE__, (int)sizeof(ExpireWheel), \
+				errno, STRERROR(errno));
+			return errno != 0 ? errno : ENOMEM;
+		}
+
+		if ((result=expire_wheel_init(expire_wheel, \
+			FDHT_MPOOL_EXPIRE_WHEEL_SLOTS, time(NULL))) != 0)
+		{
+			free(expire_wheel);
+			expire_wheel = NULL;
+			return result;
+		}
+
+		if (mp_shm_attached())
+		{
+			hash_walk(g_hash_array, mp_index_expires_walk, NULL);
+		}
+	}
+
 	return 0;
 }
 
@@ -63,6 +209,17 @@ int mp_destroy_instance(StoreHandle **ppHandle)
 int mp_destroy()
 {
 	pthread_rwlock_destroy(&mpool_pthread_rwlock);
+	if (expire_wheel != NULL)
+	{
+		expire_wheel_destroy(expire_wheel);
+		free(expire_wheel);
+		expire_wheel = NULL;
+	}
+
+	if (g_hash_array != NULL)
+	{
+		mp_shm_destroy(g_hash_array);
+	}
 
 	return 0;
 }
@@ -105,105 +262,455 @@ int mp_memp_trickle(int *nwrotep)
 			__LINE__, result, STRERROR(result)); \
 	}
 
+static int mp_copy_value(const HashData *hash_data, char **ppValue, \
+		int *size)
+{
+	if (hash_data == NULL)
+	{
+		return ENOENT;
+	}
+
+	if (*ppValue != NULL)
+	{
+		if (*size < hash_data->value_len)
+		{
+			*size = hash_data->value_len;
+			return ENOSPC;
+		}
+
+		*size = hash_data->value_len;
+		memcpy(*ppValue, hash_data->value, hash_data->value_len);
+		g_server_stat.success_get_count++;
+		return 0;
+	}
+
+	*size = hash_data->value_len;
+	*ppValue = (char *)malloc(hash_data->value_len);
+	if (*ppValue == NULL)
+	{
+		logError("file: "__FILE__", line: %d, " \
+			"malloc %d bytes fail, " \
+			"errno: %d, error info: %s", \
+			__LINE__, hash_data->value_len, \
+			errno, STRERROR(errno));
+		return errno != 0 ? errno : ENOMEM;
+	}
+
+	memcpy(*ppValue, hash_data->value, hash_data->value_len);
+	g_server_stat.success_get_count++;
+	return 0;
+}
+
 int mp_get(StoreHandle *pHandle, const char *pKey, const int key_len, \
 		char **ppValue, int *size)
 {
 	HashData *hash_data;
+	FastEpochThread *pThread;
 	int result;
 	int lock_result;
 
 	g_server_stat.total_get_count++;
 
+	/* without lock, the value is never changed in place and the node
+	   is not freed until the epoch left */
+	if (g_hash_array->epoch != NULL && (pThread=fast_epoch_enter( \
+			g_hash_array->epoch)) != NULL)
+	{
+		hash_data = hash_find_lockfree(g_hash_array, pKey, key_len);
+		result = mp_copy_value(hash_data, ppValue, size);
+		fast_epoch_leave(pThread);
+		return result;
+	}
+
 	RWLOCK_READ_LOCK(lock_result)
 
-	do
+	/* the bucket lock is released by the find, hold a reference to
+	   keep the value from being changed or freed by the other threads */
+	if (have_htable_lock)
+	{
+		hash_data = hash_find_ref(g_hash_array, pKey, key_len);
+	}
+	else
 	{
 		hash_data = hash_find_ex(g_hash_array, pKey, key_len);
-		if (hash_data == NULL)
+	}
+
+	result = mp_copy_value(hash_data, ppValue, size);
+	if (have_htable_lock && hash_data != NULL)
+	{
+		hash_release(g_hash_array, hash_data);
+	}
+
+	RWLOCK_UNLOCK(lock_result)
+
+	return result;
+}
+
+int mp_get_ref(StoreHandle *pHandle, const char *pKey, const int key_len, \
+		HashData **ppHashData)
+{
+	FastEpochThread *pThread;
+	int lock_result;
+
+	g_server_stat.total_get_count++;
+
+	if (g_hash_array->epoch != NULL && (pThread=fast_epoch_enter( \
+			g_hash_array->epoch)) != NULL)
+	{
+		*ppHashData = hash_find_ref_lockfree(g_hash_array, \
+				pKey, key_len);
+		fast_epoch_leave(pThread);
+	}
+	else
+	{
+		RWLOCK_READ_LOCK(lock_result)
+		*ppHashData = hash_find_ref(g_hash_array, pKey, key_len);
+		RWLOCK_UNLOCK(lock_result)
+	}
+
+	if (*ppHashData == NULL)
+	{
+		return ENOENT;
+	}
+
+	g_server_stat.success_get_count++;
+	return 0;
+}
+
+void mp_release(HashData *pHashData)
+{
+	hash_release(g_hash_array, pHashData);
+}
+
+/* copy the value to the batch buffer, the hash data must be held */
+static void mp_batch_copy_value(const HashData *hash_data, \
+		FDHTBatchGetItem *pItem, FDHTBatchGetBuffer *pBuffer)
+{
+	char *pValue;
+
+	if (hash_data == NULL)
+	{
+		pItem->status = ENOENT;
+		return;
+	}
+
+	if ((pValue=store_batch_value_alloc(pBuffer, pItem, \
+			hash_data->value_len)) == NULL)
+	{
+		pItem->status = ENOMEM;
+		return;
+	}
+
+	memcpy(pValue, hash_data->value, hash_data->value_len);
+	pItem->status = 0;
+	g_server_stat.success_get_count++;
+}
+
+int mp_batch_get(StoreHandle *pHandle, FDHTBatchGetItem *items, \
+		const int count, FDHTBatchGetBuffer *pBuffer)
+{
+	HashFindItem find_items[FDHT_MAX_KEY_COUNT_PER_REQ];
+	HashData *hash_data;
+	FastEpochThread *pThread;
+	int lock_result;
+	int i;
+
+	if (count > FDHT_MAX_KEY_COUNT_PER_REQ)
+	{
+		return store_batch_get(pHandle, items, count, pBuffer);
+	}
+
+	g_server_stat.total_get_count += count;
+
+	/* enter the epoch once for all the keys */
+	if (g_hash_array->epoch != NULL && (pThread=fast_epoch_enter( \
+			g_hash_array->epoch)) != NULL)
+	{
+		for (i=0; i<count; i++)
 		{
-			result = ENOENT;
-			break;
+			hash_data = hash_find_lockfree(g_hash_array, \
+					items[i].pKey, items[i].key_len);
+			mp_batch_copy_value(hash_data, items + i, pBuffer);
 		}
+		fast_epoch_leave(pThread);
+		return 0;
+	}
+
+	RWLOCK_READ_LOCK(lock_result)
+
+	if (have_htable_lock)
+	{
+		/* the keys of the same bucket lock are found under one lock,
+		   the values are copied after with the references held */
+		for (i=0; i<count; i++)
+		{
+			find_items[i].key = items[i].pKey;
+			find_items[i].key_len = items[i].key_len;
+		}
+		hash_find_ref_batch(g_hash_array, find_items, count);
 
-		if (*ppValue != NULL)
+		for (i=0; i<count; i++)
 		{
-			if (*size < hash_data->value_len)
+			mp_batch_copy_value(find_items[i].hash_data, \
+					items + i, pBuffer);
+			if (find_items[i].hash_data != NULL)
 			{
-				*size = hash_data->value_len;
-				result = ENOSPC;
-				break;
+				hash_release(g_hash_array, \
+					find_items[i].hash_data);
 			}
-
-			*size = hash_data->value_len;
-			memcpy(*ppValue, hash_data->value, hash_data->value_len);
-			g_server_stat.success_get_count++;
-			result = 0;
-			break;
 		}
+	}
+	else
+	{
+		for (i=0; i<count; i++)
+		{
+			hash_data = hash_find_ex(g_hash_array, \
+					items[i].pKey, items[i].key_len);
+			mp_batch_copy_value(hash_data, items + i, pBuffer);
+		}
+	}
 
-		*size = hash_data->value_len;
-		*ppValue = (char *)malloc(hash_data->value_len);
-		if (*ppValue == NULL)
+	RWLOCK_UNLOCK(lock_result)
+
+	return 0;
+}
+
+/* the keys of the namespaces in mpool_evict_namespace can be evicted */
+static bool mp_evict_filter(const HashData *hash_data, void *args)
+{
+	FDHTEvictNameSpace *pNameSpace;
+	FDHTEvictNameSpace *pEnd;
+	const char *pSeperator;
+	int namespace_len;
+
+	pSeperator = (const char *)memchr(hash_data->key, \
+			FDHT_FULL_KEY_SEPERATOR, hash_data->key_len);
+	if (pSeperator == NULL)
+	{
+		return false;
+	}
+
+	namespace_len = pSeperator - hash_data->key;
+	pEnd = g_mpool_evict_namespaces + g_mpool_evict_namespace_count;
+	for (pNameSpace=g_mpool_evict_namespaces; pNameSpace<pEnd; \
+		pNameSpace++)
+	{
+		if (pNameSpace->namespace_len < 0 || \
+			(pNameSpace->namespace_len == namespace_len && \
+			memcmp(pNameSpace->szNameSpace, hash_data->key, \
+				namespace_len) == 0))
 		{
-			logError("file: "__FILE__", line: %d, " \
-				"malloc %d bytes fail, " \
-				"errno: %d, error info: %s", \
-				__LINE__, hash_data->value_len, \
-				errno, STRERROR(errno));
-			result = errno != 0 ? errno : ENOMEM;
-			break;
+			__sync_add_and_fetch(&pNameSpace->evicted_count, 1);
+			return true;
 		}
+	}
 
-		memcpy(*ppValue, hash_data->value, hash_data->value_len);
-		g_server_stat.success_get_count++;
-		result = 0;
-	} while (0);
+	return false;
+}
 
-	RWLOCK_UNLOCK(lock_result)
+/* call with the write lock, return the evicted count */
+static int mp_evict_keys(const int key_len, const int value_len)
+{
+	int64_t bytes;
+	int count;
 
-	return result;
+	count = hash_evict(g_hash_array, key_len, value_len, \
+			FDHT_MPOOL_EVICT_MAX_BUCKETS, mp_evict_filter, \
+			NULL, &bytes);
+	if (count > 0)
+	{
+		__sync_add_and_fetch(&evicted_count, count);
+		__sync_add_and_fetch(&evicted_bytes, bytes);
+	}
+	else
+	{
+		__sync_add_and_fetch(&evict_fail_count, 1);
+	}
+
+	return count;
+}
+
+typedef struct
+{
+	FDHTNameSpaceStat *pStat;
+	const char *pKey;  //the key to set is kept
+	int key_len;
+} QuotaEvictArgs;
+
+/* the keys of the namespace over the quota can be evicted */
+static bool mp_quota_evict_filter(const HashData *hash_data, void *args)
+{
+	QuotaEvictArgs *pArgs;
+	FDHTNameSpaceStat *pStat;
+
+	pArgs = (QuotaEvictArgs *)args;
+	if (hash_data->key_len == pArgs->key_len && memcmp(hash_data->key, \
+		pArgs->pKey, pArgs->key_len) == 0)
+	{
+		return false;
+	}
+
+	pStat = pArgs->pStat;
+	return hash_data->key_len > pStat->namespace_len && \
+		hash_data->key[pStat->namespace_len] == \
+			FDHT_FULL_KEY_SEPERATOR && \
+		memcmp(hash_data->key, pStat->szNameSpace, \
+			pStat->namespace_len) == 0;
+}
+
+/* the bytes of the node to set, as alloced by hash_insert_ex */
+static int mp_node_bytes(HashArray *pHash, const int key_len, \
+		const int value_len)
+{
+	int bytes;
+
+	bytes = CALC_NODE_MALLOC_BYTES(key_len, MEM_ALIGN(value_len));
+	if (pHash->slab != NULL)
+	{
+		bytes = fast_slab_alloc_size(pHash->slab, bytes);
+	}
+	return bytes;
+}
+
+/* the namespace of the key is over the quota after the set */
+static bool mp_over_quota(FDHTNameSpaceStat *pStat, const int bytes, \
+		const int old_bytes)
+{
+	return pStat->bytes_used + bytes - old_bytes > pStat->max_bytes;
+}
+
+/* make room in the namespace of the key by evicting its cold keys,
+   or reject the set when mpool_evict_policy is none */
+static int mp_check_quota(HashArray *pHash, const char *pKey, \
+		const int key_len, const int value_len)
+{
+	FDHTNameSpaceStat *pStat;
+	HashData *old_data;
+	QuotaEvictArgs evict_args;
+	int64_t bytes;
+	int node_bytes;
+	int old_bytes;
+	int count;
+	int i;
+
+	pStat = mp_namespace_get(pKey, key_len);
+	if (pStat == NULL || pStat->max_bytes <= 0)
+	{
+		return 0;
+	}
+
+	node_bytes = mp_node_bytes(pHash, key_len, value_len);
+	if (!mp_over_quota(pStat, node_bytes, 0))
+	{
+		return 0;
+	}
+
+	/* the old value of the key is freed by the set */
+	old_bytes = 0;
+	if ((old_data=hash_find_ref(pHash, pKey, key_len)) != NULL)
+	{
+		old_bytes = CALC_NODE_MALLOC_BYTES(old_data->key_len, \
+				old_data->malloc_value_size);
+		hash_release(pHash, old_data);
+	}
+
+	if (g_mpool_evict_policy != FDHT_MPOOL_EVICT_NONE)
+	{
+		evict_args.pStat = pStat;
+		evict_args.pKey = pKey;
+		evict_args.key_len = key_len;
+		for (i=0; i<FDHT_MPOOL_QUOTA_EVICT_TIMES && mp_over_quota( \
+			pStat, node_bytes, old_bytes); i++)
+		{
+			count = hash_evict(pHash, key_len, value_len, \
+				FDHT_MPOOL_EVICT_MAX_BUCKETS, \
+				mp_quota_evict_filter, &evict_args, &bytes);
+			if (count == 0)
+			{
+				break;
+			}
+
+			__sync_add_and_fetch(&pStat->evicted_count, count);
+			__sync_add_and_fetch(&evicted_count, count);
+			__sync_add_and_fetch(&evicted_bytes, bytes);
+		}
+		hash_reclaim(pHash, true);
+	}
+
+	if (mp_over_quota(pStat, node_bytes, old_bytes))
+	{
+		__sync_add_and_fetch(&pStat->reject_count, 1);
+		return ENOSPC;
+	}
+
+	return 0;
 }
 
 static int mp_do_set(StoreHandle *pHandle, const char *pKey, const int key_len,\
 	const char *pValue, const int value_len)
 {
 	int result;
-	int i;
+	bool cleared;
+	bool evicted;
 
-	for (i=0; i<2; i++)
+	if (g_mpool_namespace_quota_count > 0 && (result=mp_check_quota( \
+		pHandle, pKey, key_len, value_len)) != 0)
+	{
+		return result;
+	}
+
+	/* make room by the expired keys first, then by the cold keys */
+	cleared = !g_need_clear_expired_data;
+	evicted = g_mpool_evict_policy == FDHT_MPOOL_EVICT_NONE;
+	while (1)
 	{
 		result = hash_insert_ex(pHandle, pKey, key_len, \
 				(void *)pValue, value_len, true);
-		if (result < 0)
+		if (result >= 0)
 		{
-			result *= -1;
-			if (result == ENOSPC && g_need_clear_expired_data)
-			{
-				int lock_result;
-
-				RWLOCK_UNLOCK(lock_result)
-				if (mp_clear_expired_keys(pHandle) > 0)
-				{
-					RWLOCK_WRITE_LOCK(lock_result)
-					continue;
-				}
-				RWLOCK_WRITE_LOCK(lock_result)
-			}
+			return 0;
+		}
 
-			break;
+		result *= -1;
+		if (result != ENOSPC)
+		{
+			return result;
 		}
-		else if (result == 0)
+
+		if (!cleared)
 		{
-			break;
+			int lock_result;
+			int count;
+
+			/* the due keys only, the full sweep is
+			   too slow for the request */
+			cleared = true;
+			RWLOCK_UNLOCK(lock_result)
+			count = mp_clear_due_keys(g_current_time, \
+				mp_get_time_us() + 1000 * \
+				FDHT_MPOOL_EXPIRE_ENOSPC_MSEC);
+			RWLOCK_WRITE_LOCK(lock_result)
+			if (count > 0)
+			{
+				hash_reclaim(pHandle, true);
+				continue;
+			}
 		}
-		else
+
+		if (!evicted)
 		{
-			result = 0;
-			break;
+			evicted = true;
+			if (mp_evict_keys(key_len, value_len) > 0)
+			{
+				/* the freed room is usable after the readers
+				   without lock leave */
+				hash_reclaim(pHandle, true);
+				continue;
+			}
 		}
-	}
 
-	return result;
+		return result;
+	}
 }
 
 int mp_set(StoreHandle *pHandle, const char *pKey, const int key_len, \
@@ -211,11 +718,13 @@ int mp_set(StoreHandle *pHandle, const char *pKey, const int key_len, \
 {
 	int result;
 	int lock_result;
+	int old_expires;
 
 	g_server_stat.total_set_count++;
 
 	RWLOCK_WRITE_LOCK(lock_result)
 
+	old_expires = mp_get_old_expires(pKey, key_len);
 	result = mp_do_set(g_hash_array, pKey, key_len, pValue, value_len);
 	if (result == 0)
 	{
@@ -224,6 +733,33 @@ int mp_set(StoreHandle *pHandle, const char *pKey, const int key_len, \
 
 	RWLOCK_UNLOCK(lock_result)
 
+	if (result == 0)
+	{
+		mp_index_expires(pKey, key_len, old_expires, value_len >= 4 ? \
+			buff2int(pValue) : FDHT_EXPIRES_NEVER);
+	}
+
+	return result;
+}
+
+int mp_load_set(const char *pKey, const int key_len, \
+	const char *pValue, const int value_len)
+{
+	int result;
+	int lock_result;
+	int old_expires;
+
+	RWLOCK_WRITE_LOCK(lock_result)
+	old_expires = mp_get_old_expires(pKey, key_len);
+	result = mp_do_set(g_hash_array, pKey, key_len, pValue, value_len);
+	RWLOCK_UNLOCK(lock_result)
+
+	if (result == 0)
+	{
+		mp_index_expires(pKey, key_len, old_expires, value_len >= 4 ? \
+			buff2int(pValue) : FDHT_EXPIRES_NEVER);
+	}
+
 	return result;
 }
 
@@ -232,14 +768,27 @@ int mp_partial_set(StoreHandle *pHandle, const char *pKey, const int key_len, \
 {
 	int result;
 	int lock_result;
+	int old_expires;
+	bool bIndexed;
+
+	/* such as the new expires of the GET */
+	bIndexed = offset == 0 && value_len >= 4;
 
 	RWLOCK_WRITE_LOCK(lock_result)
 
+	old_expires = bIndexed ? mp_get_old_expires(pKey, key_len) : \
+			FDHT_EXPIRES_NEVER;
 	result = hash_partial_set(g_hash_array, pKey, key_len,
 			pValue, offset, value_len);
 
 	RWLOCK_UNLOCK(lock_result)
 
+	if (result == 0 && bIndexed)
+	{
+		mp_index_expires(pKey, key_len, old_expires, \
+			buff2int(pValue));
+	}
+
 	return result;
 }
 
@@ -247,11 +796,13 @@ int mp_delete(StoreHandle *pHandle, const char *pKey, const int key_len)
 {
 	int result;
 	int lock_result;
+	int old_expires;
 
 	g_server_stat.total_delete_count++;
 	
 	RWLOCK_WRITE_LOCK(lock_result)
 
+	old_expires = mp_get_old_expires(pKey, key_len);
 	result = hash_delete(g_hash_array, pKey, key_len);
 	if (result == 0)
 	{
@@ -260,6 +811,12 @@ int mp_delete(StoreHandle *pHandle, const char *pKey, const int key_len)
 
 	RWLOCK_UNLOCK(lock_result)
 
+	if (result == 0)
+	{
+		mp_index_expires(pKey, key_len, old_expires, \
+			FDHT_EXPIRES_NEVER);
+	}
+
 	return result;
 }
 
@@ -268,11 +825,13 @@ int mp_inc(StoreHandle *pHandle, const char *pKey, const int key_len, \
 {
 	int result;
 	int lock_result;
+	int old_expires;
 
 	g_server_stat.total_inc_count++;
 
 	RWLOCK_WRITE_LOCK(lock_result)
 
+	old_expires = mp_get_old_expires(pKey, key_len);
 	result = hash_inc(g_hash_array, pKey, key_len, inc,
 			pValue, value_len);
 	if (result == 0)
@@ -282,6 +841,14 @@ int mp_inc(StoreHandle *pHandle, const char *pKey, const int key_len, \
 
 	RWLOCK_UNLOCK(lock_result)
 
+	/* the expires is read by the clear as the value of SET */
+	if (result == 0)
+	{
+		mp_index_expires(pKey, key_len, old_expires, \
+			*value_len >= 4 ? buff2int(pValue) : \
+			FDHT_EXPIRES_NEVER);
+	}
+
 	return result;
 }
 
@@ -330,11 +897,13 @@ int mp_inc_ex(StoreHandle *pHandle, const char *pKey, const int key_len, \
 {
 	int result;
 	int lock_result;
+	int old_expires;
 
 	g_server_stat.total_inc_count++;
 
 	RWLOCK_WRITE_LOCK(lock_result)
 
+	old_expires = mp_get_old_expires(pKey, key_len);
 	result = hash_inc_ex(g_hash_array, pKey, key_len, inc, pValue,
 		value_len, mp_inc_value, (void *)((long)expires));
 	if (result == 0)
@@ -344,129 +913,322 @@ int mp_inc_ex(StoreHandle *pHandle, const char *pKey, const int key_len, \
 
 	RWLOCK_UNLOCK(lock_result)
 
+	if (result == 0)
+	{
+		mp_index_expires(pKey, key_len, old_expires, expires);
+	}
+
 	return result;
 }
 
-int mp_clear_expired_keys(void *arg)
+static int mp_clear_bucket_expired_keys(HashData **ppBucket, \
+		const time_t current_time)
 {
-	HashData **ppBucket;
-	HashData **bucket_end;
 	HashData *hash_data;
 	HashData *pDeleted;
 	HashData *previous;
-	time_t current_time;
 	int expires;
-	int lock_result;
-	struct timeval tv_start;
-	struct timeval tv_end;
+	int count;
+
+	count = 0;
+	hash_data = *ppBucket;
+	previous = NULL;
+	while (hash_data != NULL)
+	{
+		expires = buff2int(hash_data->value);
+		if (expires == FDHT_EXPIRES_NEVER || \
+			expires > current_time)
+		{
+			previous = hash_data;
+			hash_data = hash_data->next;
+			continue;
+		}
+
+		/* unlinked before freed, the readers without lock
+		   may be walking through it */
+		pDeleted = hash_data;
+		hash_data = hash_data->next;
+		if (previous == NULL)
+		{
+			*ppBucket = hash_data;
+		}
+		else
+		{
+			previous->next = hash_data;
+		}
+
+		FREE_HASH_DATA(g_hash_array, pDeleted)
+		count++;
+	}
+
+	return count;
+}
+
+/* call with the write lock */
+static int mp_clear_hash_code_expired_keys(const unsigned int hash_code, \
+		const time_t current_time)
+{
+	HashData **ppBucket;
 	unsigned int bucket_index;
-	int old_item_count;
-	static time_t last_clear_time = 0;
-	static bool clearing = false;
+	int count;
 
-	if (clearing)
+	ppBucket = hash_bucket_of(g_hash_array, hash_code);
+	bucket_index = ppBucket - g_hash_array->buckets;
+	hash_bucket_lock(g_hash_array, bucket_index);
+	count = mp_clear_bucket_expired_keys(ppBucket, current_time);
+	hash_bucket_unlock(g_hash_array, bucket_index);
+
+	return count;
+}
+
+/* clear the buckets of the keys popped from the expire wheel in batches,
+   the write lock is released between them */
+static int mp_clear_due_keys(const time_t current_time, \
+		const int64_t deadline_us)
+{
+	ExpireWheelItem items[MP_EXPIRE_POP_BATCH];
+	int lock_result;
+	int expired_count;
+	int count;
+	int i;
+
+	expired_count = 0;
+	do
+	{
+		count = expire_wheel_pop(expire_wheel, current_time, \
+				items, MP_EXPIRE_POP_BATCH);
+		if (count == 0)
+		{
+			break;
+		}
+
+		RWLOCK_WRITE_LOCK(lock_result)
+		for (i=0; i<count; i++)
+		{
+			expired_count += mp_clear_hash_code_expired_keys( \
+					items[i].hash_code, current_time);
+		}
+		RWLOCK_UNLOCK(lock_result)
+	} while (count == MP_EXPIRE_POP_BATCH && \
+		mp_get_time_us() < deadline_us);
+
+	return expired_count;
+}
+
+/* continue the full sweep of the buckets in batches, the old buckets not
+   migrated by the incremental rehash follow the new ones.
+   return true when the sweep done */
+static bool mp_sweep_buckets(const time_t current_time, \
+		const int64_t deadline_us, int *expired_count)
+{
+	HashData **ppBucket;
+	unsigned int capacity;
+	unsigned int total_count;
+	unsigned int batch_end;
+	unsigned int old_index;
+	int lock_result;
+	bool done;
+
+	do
+	{
+		RWLOCK_WRITE_LOCK(lock_result)
+
+		capacity = *g_hash_array->capacity;
+		total_count = capacity;
+		if (hash_is_rehashing(g_hash_array))
+		{
+			total_count += g_hash_array->old_capacity;
+		}
+
+		batch_end = sweep_cursor + FDHT_MPOOL_REHASH_BATCH_BUCKETS;
+		for (; sweep_cursor<batch_end && sweep_cursor<total_count; \
+			sweep_cursor++)
+		{
+			if (sweep_cursor < capacity)
+			{
+				ppBucket = g_hash_array->buckets + sweep_cursor;
+				hash_bucket_lock(g_hash_array, sweep_cursor);
+				*expired_count += mp_clear_bucket_expired_keys( \
+						ppBucket, current_time);
+				hash_bucket_unlock(g_hash_array, sweep_cursor);
+				continue;
+			}
+
+			old_index = sweep_cursor - capacity;
+			if (old_index >= g_hash_array->rehash_index)
+			{
+				*expired_count += mp_clear_bucket_expired_keys( \
+					g_hash_array->old_buckets + old_index, \
+					current_time);
+			}
+		}
+		done = sweep_cursor >= total_count;
+
+		RWLOCK_UNLOCK(lock_result)
+	} while (!done && g_continue_flag && mp_get_time_us() < deadline_us);
+
+	return done;
+}
+
+int mp_clear_expired_keys(void *arg)
+{
+	if (sweep_running)
 	{
 		logInfo("file: "__FILE__", line: %d, " \
 			"clear proccess already running", __LINE__);
 		return 0;
 	}
 
-	if (gettimeofday(&tv_start, NULL) != 0)
+	if (g_current_time - last_clear_time < g_mpool_clear_min_interval)
 	{
-		logError("file: "__FILE__", line: %d, " \
-			"call gettimeofday fail, errno: %d, error info: %s", \
-			__LINE__, errno, STRERROR(errno));
-		return -1;
+		return 0;
 	}
 
-	current_time = tv_start.tv_sec;
-	if (current_time - last_clear_time < g_mpool_clear_min_interval)
+	/* the buckets are swept by mp_expire_step */
+	sweep_cursor = 0;
+	sweep_item_count = g_hash_array->item_count;
+	sweep_expired_count = 0;
+	sweep_time_used = 0;
+	sweep_running = true;
+	return 0;
+}
+
+int mp_expire_step(void *arg)
+{
+	int64_t start_time;
+	int64_t deadline;
+	time_t current_time;
+	int expired_count;
+
+	if (expire_wheel == NULL)
 	{
 		return 0;
 	}
 
-	pthread_rwlock_wrlock(&mpool_pthread_rwlock);
-	if (clearing)
+	start_time = mp_get_time_us();
+	deadline = start_time + 1000 * g_mpool_clear_step_msec;
+	current_time = g_current_time;
+
+	expired_count = mp_clear_due_keys(current_time, deadline);
+	if (expired_count > 0)
 	{
-		logInfo("file: "__FILE__", line: %d, " \
-			"clear proccess already running", __LINE__);
+		logDebug("file: "__FILE__", line: %d, " \
+			"clear due keys, expired key count: %d, " \
+			"time used: %dms", __LINE__, expired_count, \
+			(int)((mp_get_time_us() - start_time) / 1000));
+	}
 
-		pthread_rwlock_unlock(&mpool_pthread_rwlock);
+	if (!sweep_running || mp_get_time_us() >= deadline)
+	{
 		return 0;
 	}
-	clearing = true;
-	pthread_rwlock_unlock(&mpool_pthread_rwlock);
 
-	RWLOCK_WRITE_LOCK(lock_result)
+	start_time = mp_get_time_us();
+	if (mp_sweep_buckets(current_time, deadline, &sweep_expired_count))
+	{
+		sweep_running = false;
+		last_clear_time = current_time;
+	}
+	sweep_time_used += mp_get_time_us() - start_time;
 
-	old_item_count = g_hash_array->item_count;
-	bucket_end = g_hash_array->buckets + (*g_hash_array->capacity);
-	for (ppBucket=g_hash_array->buckets; ppBucket<bucket_end; ppBucket++)
+	if (!sweep_running)
 	{
-		bucket_index = ppBucket - g_hash_array->buckets;
-		hash_bucket_lock(g_hash_array, bucket_index);
-		if (*ppBucket == NULL)
-		{
-			hash_bucket_unlock(g_hash_array, bucket_index);
-			continue;
-		}
+		logInfo("clear expired keys, total key count: %d, " \
+			"expired key count: %d, time used: %dms, " \
+			"mpool free bytes: "INT64_PRINTF_FORMAT" bytes", \
+			sweep_item_count, sweep_expired_count, \
+			(int)(sweep_time_used / 1000), \
+			g_hash_array->max_bytes - \
+			hash_bytes_used(g_hash_array));
+	}
 
-		hash_data = *ppBucket;
-		previous = NULL;
-		do
-		{
-			expires = buff2int(hash_data->value);
-			if (expires == FDHT_EXPIRES_NEVER || \
-				expires > current_time)
-			{
-				if (previous == NULL)
-				{
-					*ppBucket = hash_data;
-				}
-				else
-				{
-					previous->next = hash_data;
-				}
-
-				previous = hash_data;
-				hash_data = hash_data->next;
-			}
-			else
-			{
-				pDeleted = hash_data;
-				hash_data = hash_data->next;
+	return 0;
+}
 
-				FREE_HASH_DATA(g_hash_array, pDeleted)
-			}
+int64_t mp_expire_index_count()
+{
+	return expire_wheel != NULL ? expire_wheel->item_count : 0;
+}
 
-		} while (hash_data != NULL);
+void mp_evict_stat(int64_t *count, int64_t *bytes, int64_t *fail_count)
+{
+	*count = evicted_count;
+	*bytes = evicted_bytes;
+	*fail_count = evict_fail_count;
+}
 
-		if (previous == NULL)
-		{
-			*ppBucket = NULL;
-		}
-		else
-		{
-			previous->next = NULL;
-		}
-		hash_bucket_unlock(g_hash_array, bucket_index);
+int mp_rehash_step(void *arg)
+{
+	struct timeval tv_start;
+	struct timeval tv_now;
+	int lock_result;
+	int result;
+	int time_used;
+
+	if (!hash_is_rehashing(g_hash_array) || g_hash_array->rehash_paused)
+	{
+		return 0;
 	}
 
+	/* migrate in batches, the write lock is released between them */
+	gettimeofday(&tv_start, NULL);
+	do
+	{
+		RWLOCK_WRITE_LOCK(lock_result)
+		result = hash_rehash_step(g_hash_array, \
+				FDHT_MPOOL_REHASH_BATCH_BUCKETS);
+		RWLOCK_UNLOCK(lock_result)
+
+		gettimeofday(&tv_now, NULL);
+		time_used = (tv_now.tv_sec - tv_start.tv_sec) * 1000 + \
+			(tv_now.tv_usec - tv_start.tv_usec) / 1000;
+	} while (result != 0 && g_continue_flag && \
+		time_used < FDHT_MPOOL_REHASH_MAX_MSEC);
+
+	if (result == 0)
+	{
+		logInfo("file: "__FILE__", line: %d, " \
+			"mpool rehash done, bucket count: %d", \
+			__LINE__, *g_hash_array->capacity);
+	}
+
+	return 0;
+}
+
+int mp_pause_rehash(const bool paused)
+{
+	int lock_result;
+
+	RWLOCK_WRITE_LOCK(lock_result)
+	hash_pause_rehash(g_hash_array, paused);
+	RWLOCK_UNLOCK(lock_result)
+
+	return 0;
+}
+
+int mp_walk_buckets(unsigned int *bucket_index, const int bucket_count, \
+		HashWalkFunc walkFunc, void *args)
+{
+	int lock_result;
+	int result;
+
+	RWLOCK_READ_LOCK(lock_result)
+	result = hash_walk_buckets(g_hash_array, bucket_index, bucket_count, \
+			walkFunc, args);
 	RWLOCK_UNLOCK(lock_result)
 
-	gettimeofday(&tv_end, NULL);
+	return result;
+}
 
-	logInfo("clear expired keys, total key count: %d, " \
-		"expired key count: %d, time used: %dms, mpool free bytes: " \
-		INT64_PRINTF_FORMAT" bytes", \
-		old_item_count, old_item_count - g_hash_array->item_count, \
-		(int)((tv_end.tv_sec - tv_start.tv_sec) * 1000 + \
-		(tv_end.tv_usec - tv_start.tv_usec) / 1000), \
-		g_hash_array->max_bytes - g_hash_array->bytes_used);
+int mp_hash_stat(HashStat *pStat, int *stat_by_lens, const int stat_size)
+{
+	int lock_result;
+	int result;
 
-	clearing = false;
-	last_clear_time = tv_end.tv_sec;
+	RWLOCK_READ_LOCK(lock_result)
+	result = hash_stat(g_hash_array, pStat, stat_by_lens, stat_size);
+	RWLOCK_UNLOCK(lock_result)
 
-	return old_item_count - g_hash_array->item_count;
+	return result;
 }
 
@@ -16,6 +16,7 @@
 #include <string.h>
 #include "fdht_define.h"
 #include "hash.h"
+#include "expire_wheel.h"
 #include "store.h"
 
 #ifdef __cplusplus
@@ -32,8 +33,35 @@ int mp_memp_trickle(int *nwrotep);
 
 int mp_get(StoreHandle *pHandle, const char *pKey, const int key_len, \
 		char **ppValue, int *size);
+/**
+* get the hash data of the key without copying the value,
+* the hash data should be released by mp_release after used
+* params:
+*	pHandle: the store handle
+*	pKey: the key
+*	key_len: the key length
+*	ppHashData: return the referenced hash data
+* return: error no, 0 for success, != 0 fail
+*/
+int mp_get_ref(StoreHandle *pHandle, const char *pKey, const int key_len, \
+		HashData **ppHashData);
+void mp_release(HashData *pHashData);
+/**
+* get the keys of a batch, one epoch or one lock of the buckets for them
+* return: error no, 0 for success, != 0 fail
+*/
+int mp_batch_get(StoreHandle *pHandle, FDHTBatchGetItem *items, \
+		const int count, FDHTBatchGetBuffer *pBuffer);
+
 int mp_set(StoreHandle *pHandle, const char *pKey, const int key_len, \
 	const char *pValue, const int value_len);
+/**
+* set the key loaded on startup, the same as mp_set without the stat
+* return: error no, 0 for success, != 0 fail
+*/
+int mp_load_set(const char *pKey, const int key_len, \
+	const char *pValue, const int value_len);
+
 int mp_partial_set(StoreHandle *pHandle, const char *pKey, const int key_len, \
 	const char *pValue, const int offset, const int value_len);
 int mp_delete(StoreHandle *pHandle, const char *pKey, const int key_len);
@@ -43,8 +71,73 @@ int mp_inc(StoreHandle *pHandle, const char *pKey, const int key_len, \
 int mp_inc_ex(StoreHandle *pHandle, const char *pKey, const int key_len, \
 	const int inc, char *pValue, int *value_len, const int expires);
 
+/**
+* start a full sweep of the buckets for the expired keys, the sweep
+* is done by mp_expire_step in slices
+* params:
+*	arg: not used
+* return: 0
+*/
 int mp_clear_expired_keys(void *arg);
 
+/**
+* clear the expired keys in a slice of mpool_clear_step_msec, scheduled
+* every second: the keys due by the expire wheel, then the buckets of
+* the full sweep if running
+* params:
+*	arg: not used
+* return: 0
+*/
+int mp_expire_step(void *arg);
+
+/**
+* the item count of the expire wheel
+*/
+int64_t mp_expire_index_count();
+
+/**
+* the counters of the eviction
+* params:
+*	count: return the evicted key count
+*	bytes: return the evicted bytes
+*	fail_count: return the times nothing evictable when no space to set
+*/
+void mp_evict_stat(int64_t *count, int64_t *bytes, int64_t *fail_count);
+
+/**
+* the background step of the incremental rehash, scheduled every second
+* params:
+*	arg: not used
+* return: 0
+*/
+int mp_rehash_step(void *arg);
+
+/**
+* pause or resume the incremental rehash under the write lock
+* params:
+*	paused: true for pause, false for resume
+* return: error no, 0 for success, != 0 fail
+*/
+int mp_pause_rehash(const bool paused);
+
+/**
+* walk a batch of the buckets under the read lock, see hash_walk_buckets
+* params:
+*	bucket_index: the bucket index to start, return the next one
+*	bucket_count: the max buckets to walk
+*	walkFunc: called for each key under the bucket lock
+*	args: passed to walkFunc
+* return: 1 for more buckets, 0 for done, < 0 for the error of walkFunc
+*/
+int mp_walk_buckets(unsigned int *bucket_index, const int bucket_count, \
+		HashWalkFunc walkFunc, void *args);
+
+/**
+* stat the hash table under the mpool read lock
+* return: error no, 0 for success, != 0 fail
+*/
+int mp_hash_stat(HashStat *pStat, int *stat_by_lens, const int stat_size);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,151 @@
+//mpool_shm.c
+
+/* the buckets and the nodes of the mpool kept in a shared memory file,
+   such as in /dev/shm, so the keys survive the restart of the process
+   without loading the snapshot. the file is mapped at the fixed address
+   FDHT_MPOOL_SHM_BASE_ADDR, the pointers of the nodes are valid when
+   attached again. the file is trusted only when closed cleanly, after a
+   crash it is discarded and the snapshot and the binlog are loaded */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include "logger.h"
+#include "shared_func.h"
+#include "global.h"
+#include "shm_arena.h"
+#include "mpool_shm.h"
+
+#define MP_SHM_RESERVED_BYTES  (1024 * 1024)  //the header and the root
+
+static ShmArena mpool_shm_arena;
+static bool mpool_shm_opened = false;
+static bool mpool_shm_attached = false;
+
+static void *mp_shm_alloc(void *args, const int bytes)
+{
+	return shm_arena_alloc_block((ShmArena *)args, bytes);
+}
+
+static void mp_shm_free(void *args, void *ptr, const int bytes)
+{
+	shm_arena_free_block((ShmArena *)args, ptr, bytes);
+}
+
+static bool mp_shm_check_root(FDHTMpoolShmRoot *pRoot, HashArray *pHash)
+{
+	return pRoot != NULL && pRoot->version == FDHT_MPOOL_SHM_VERSION && \
+		pRoot->node_size == (int)sizeof(HashData) && \
+		pRoot->root_size == (int)sizeof(FDHTMpoolShmRoot) && \
+		pRoot->hash_function == g_mpool_hash_function && \
+		pRoot->slab_page_size == g_mpool_slab_page_size && \
+		pRoot->max_bytes == pHash->max_bytes && \
+		pRoot->state.capacity == *pHash->capacity;
+}
+
+int mp_shm_init(HashArray *pHash)
+{
+#ifdef FDHT_MPOOL_SHM_BASE_ADDR
+	FDHTMpoolShmRoot *pRoot;
+	int64_t size;
+	int result;
+
+	if (pHash->max_bytes <= 0)
+	{
+		logError("file: "__FILE__", line: %d, " \
+			"mpool_shm_file needs cache_size > 0", __LINE__);
+		return EINVAL;
+	}
+
+	/* the slab classes waste 1/8 at most */
+	size = sizeof(HashData *) * (int64_t)(*pHash->capacity) + \
+		pHash->max_bytes + pHash->max_bytes / 8 + \
+		MP_SHM_RESERVED_BYTES;
+	if ((result=shm_arena_open(&mpool_shm_arena, g_mpool_shm_file, \
+		(void *)FDHT_MPOOL_SHM_BASE_ADDR, size, \
+		&mpool_shm_attached)) != 0)
+	{
+		return result;
+	}
+	mpool_shm_opened = true;
+
+	pRoot = (FDHTMpoolShmRoot *)mpool_shm_arena.header->root;
+	if (mpool_shm_attached && !mp_shm_check_root(pRoot, pHash))
+	{
+		logWarning("file: "__FILE__", line: %d, " \
+			"the mpool parameters of shm file \"%s\" are " \
+			"changed, discarded", __LINE__, g_mpool_shm_file);
+		shm_arena_reset(&mpool_shm_arena);
+		mpool_shm_attached = false;
+	}
+
+	if (!mpool_shm_attached)
+	{
+		pRoot = (FDHTMpoolShmRoot *)shm_arena_alloc( \
+				&mpool_shm_arena, sizeof(FDHTMpoolShmRoot));
+		if (pRoot == NULL)
+		{
+			return ENOSPC;
+		}
+
+		memset(pRoot, 0, sizeof(FDHTMpoolShmRoot));
+		pRoot->version = FDHT_MPOOL_SHM_VERSION;
+		pRoot->node_size = sizeof(HashData);
+		pRoot->root_size = sizeof(FDHTMpoolShmRoot);
+		pRoot->hash_function = g_mpool_hash_function;
+		pRoot->slab_page_size = g_mpool_slab_page_size;
+		pRoot->max_bytes = pHash->max_bytes;
+		mpool_shm_arena.header->root = pRoot;
+	}
+
+	if ((result=hash_set_shared(pHash, &pRoot->state, \
+		g_mpool_slab_page_size, mp_shm_alloc, mp_shm_free, \
+		&mpool_shm_arena)) != 0)
+	{
+		logError("file: "__FILE__", line: %d, " \
+			"hash_set_shared fail, errno: %d, error info: %s", \
+			__LINE__, result, STRERROR(result));
+		return result;
+	}
+
+	if (mpool_shm_attached)
+	{
+		logInfo("file: "__FILE__", line: %d, " \
+			"attach shm file \"%s\", key count: %d, " \
+			"bytes used: "INT64_PRINTF_FORMAT, __LINE__, \
+			g_mpool_shm_file, pHash->item_count, \
+			pHash->bytes_used);
+	}
+
+	return 0;
+#else
+	return EOPNOTSUPP;
+#endif
+}
+
+bool mp_shm_attached()
+{
+	return mpool_shm_attached;
+}
+
+void mp_shm_destroy(HashArray *pHash)
+{
+	if (!mpool_shm_opened)
+	{
+		return;
+	}
+
+	/* the table is consistent only when it was set shared */
+	if (pHash->shared != NULL)
+	{
+		hash_destroy(pHash);
+		shm_arena_close(&mpool_shm_arena, true);
+	}
+	else
+	{
+		shm_arena_close(&mpool_shm_arena, false);
+	}
+	mpool_shm_opened = false;
+}
+
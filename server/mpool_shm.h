@@ -0,0 +1,69 @@
+/**
+* Copyright (C) 2008 Happy Fish / YuQing
+*
+* FastDFS may be copied only under the terms of the GNU General
+* Public License V3, which may be found in the FastDFS source kit.
+* Please visit the FastDFS Home Page http://www.csource.org/ for more detail.
+**/
+
+//mpool_shm.h
+
+#ifndef _MPOOL_SHM_H
+#define _MPOOL_SHM_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "fdht_define.h"
+#include "hash.h"
+
+#define FDHT_MPOOL_SHM_VERSION  1
+
+/* the root object of the shared memory file, the table is attached when
+   the layout and the parameters are not changed */
+typedef struct
+{
+	int version;
+	int node_size;   //sizeof(HashData)
+	int root_size;   //sizeof(FDHTMpoolShmRoot)
+	int hash_function;
+	int slab_page_size;
+	int64_t max_bytes;
+	HashSharedState state;
+} FDHTMpoolShmRoot;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+* keep the buckets and the nodes of the hash table in the shared memory
+* file g_mpool_shm_file, the table is attached when the file was closed
+* cleanly by the last process, call when the table is empty
+* params:
+*	pHash: the hash table
+* return: error no, 0 for success, != 0 fail
+*/
+int mp_shm_init(HashArray *pHash);
+
+/**
+* the nodes of the table are attached from the shared memory file
+* return: true for attached
+*/
+bool mp_shm_attached();
+
+/**
+* detach the hash table and close the shared memory file cleanly, the
+* writers must be stopped
+* params:
+*	pHash: the hash table
+* return: none
+*/
+void mp_shm_destroy(HashArray *pHash);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
@@ -0,0 +1,732 @@
+//mpool_snapshot.c
+
+/* the snapshot file of the mpool:
+   header:  8 bytes magic, 4 bytes version, 4 bytes binlog index,
+            8 bytes binlog offset, 4 bytes create time, 4 bytes reserved
+   records: 4 bytes key length, 4 bytes value length, key, value
+   trailer: 8 bytes key count, 8 bytes end magic
+   the keys are walked in batches after the binlog position got, so
+   the snapshot is fuzzy: the keys changed when walking are written to
+   the binlog after the position, and replayed on startup */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include "logger.h"
+#include "shared_func.h"
+#include "pthread_func.h"
+#include "global.h"
+#include "sync.h"
+#include "db_recovery.h"
+#include "mpool_snapshot.h"
+#include "mpool_shm.h"
+
+#define MP_SNAPSHOT_FILENAME          "mpool_snapshot.dat"
+#define MP_SNAPSHOT_FILENAME_SIZE     (MAX_PATH_SIZE + sizeof("/data/") + \
+					sizeof(MP_SNAPSHOT_FILENAME))
+#define MP_SNAPSHOT_MAGIC             "FDHTSNAP"
+#define MP_SNAPSHOT_END_MAGIC         "FDHTSEND"
+#define MP_SNAPSHOT_MAGIC_LEN         8
+#define MP_SNAPSHOT_VERSION           1
+#define MP_SNAPSHOT_HEADER_SIZE       32
+#define MP_SNAPSHOT_TRAILER_SIZE      16
+#define MP_SNAPSHOT_RECORD_HEAD_SIZE  8
+#define MP_SNAPSHOT_BUFF_SIZE         (256 * 1024)  //write when reached
+
+/* the binlog files before it are rewritten by fdht_compress */
+#define BINLOG_COMPRESSED_INDEX_FILENAME  \
+	SYNC_BINLOG_FILE_PREFIX".compressed.index"
+
+typedef struct
+{
+	char *buff;
+	int size;
+	int length;
+	int64_t key_count;
+	time_t current_time;
+} MpSnapshotWriter;
+
+typedef struct
+{
+	const char *start;
+	const char *end;
+	int64_t load_count;
+	int64_t fail_count;
+	int result;
+} MpSnapshotLoadChunk;
+
+static volatile bool snapshot_running = false;
+
+static char *mp_snapshot_get_filename(char *full_filename)
+{
+	snprintf(full_filename, MP_SNAPSHOT_FILENAME_SIZE, "%s/data/%s", \
+		g_fdht_base_path, MP_SNAPSHOT_FILENAME);
+	return full_filename;
+}
+
+/* call under the bucket lock, the expired keys are skipped */
+static int mp_snapshot_walk_func(const int index, const HashData *data, \
+		void *args)
+{
+	MpSnapshotWriter *pWriter;
+	char *pNewBuff;
+	char *p;
+	int record_len;
+	int new_size;
+	int expires;
+
+	pWriter = (MpSnapshotWriter *)args;
+	if (data->value_len >= 4)
+	{
+		expires = buff2int(data->value);
+		if (expires != FDHT_EXPIRES_NEVER && \
+			expires < pWriter->current_time)
+		{
+			return 0;
+		}
+	}
+
+	record_len = MP_SNAPSHOT_RECORD_HEAD_SIZE + data->key_len + \
+			data->value_len;
+	if (pWriter->length + record_len > pWriter->size)
+	{
+		new_size = 2 * pWriter->size;
+		if (new_size < pWriter->length + record_len)
+		{
+			new_size = pWriter->length + record_len;
+		}
+
+		pNewBuff = (char *)realloc(pWriter->buff, new_size);
+		if (pNewBuff == NULL)
+		{
+			logError("file: "__FILE__", line: %d, " \
+				"realloc %d bytes fail, " \
+				"errno: %d, error info: %s", \
+				__LINE__, new_size, errno, STRERROR(errno));
+			return errno != 0 ? errno : ENOMEM;
+		}
+
+		pWriter->buff = pNewBuff;
+		pWriter->size = new_size;
+	}
+
+	p = pWriter->buff + pWriter->length;
+	int2buff(data->key_len, p);
+	int2buff(data->value_len, p + 4);
+	p += MP_SNAPSHOT_RECORD_HEAD_SIZE;
+	memcpy(p, data->key, data->key_len);
+	p += data->key_len;
+	memcpy(p, data->value, data->value_len);
+
+	pWriter->length += record_len;
+	pWriter->key_count++;
+	return 0;
+}
+
+static int mp_snapshot_write_buff(const int fd, const char *filename, \
+		const char *buff, const int length)
+{
+	if (write(fd, buff, length) != length)
+	{
+		logError("file: "__FILE__", line: %d, " \
+			"write to file \"%s\" fail, " \
+			"errno: %d, error info: %s", \
+			__LINE__, filename, errno, STRERROR(errno));
+		return errno != 0 ? errno : EIO;
+	}
+
+	return 0;
+}
+
+/* walk the buckets to the temp file, the rehash is paused when walking,
+   so the keys are not moved between the batches */
+static int mp_snapshot_write_file(const int fd, const char *filename, \
+		MpSnapshotWriter *pWriter, const bool bExiting)
+{
+	unsigned int bucket_index;
+	int result;
+	int write_result;
+
+	mp_pause_rehash(true);
+
+	bucket_index = 0;
+	write_result = 0;
+	do
+	{
+		if (!(bExiting || g_continue_flag))
+		{
+			result = EINTR;
+			break;
+		}
+
+		result = mp_walk_buckets(&bucket_index, \
+			FDHT_MPOOL_REHASH_BATCH_BUCKETS, \
+			mp_snapshot_walk_func, pWriter);
+		if (result < 0)
+		{
+			result *= -1;
+			break;
+		}
+
+		if (pWriter->length >= MP_SNAPSHOT_BUFF_SIZE || \
+			(result == 0 && pWriter->length > 0))
+		{
+			write_result = mp_snapshot_write_buff(fd, filename, \
+					pWriter->buff, pWriter->length);
+			pWriter->length = 0;
+		}
+	} while (result == 1 && write_result == 0);
+
+	mp_pause_rehash(false);
+
+	return write_result != 0 ? write_result : result;
+}
+
+static int mp_snapshot_do_write(const bool bExiting)
+{
+	MpSnapshotWriter writer;
+	char full_filename[MP_SNAPSHOT_FILENAME_SIZE];
+	char tmp_filename[MP_SNAPSHOT_FILENAME_SIZE + sizeof(".tmp")];
+	char buff[MP_SNAPSHOT_HEADER_SIZE];
+	char *p;
+	struct timeval tvStart;
+	struct timeval tvEnd;
+	int binlog_index;
+	int64_t binlog_offset;
+	int fd;
+	int result;
+
+	gettimeofday(&tvStart, NULL);
+
+	/* the keys changed after the position are replayed from the binlog */
+	fdht_binlog_get_position(&binlog_index, &binlog_offset);
+
+	mp_snapshot_get_filename(full_filename);
+	snprintf(tmp_filename, sizeof(tmp_filename), "%s.tmp", full_filename);
+	fd = open(tmp_filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0)
+	{
+		logError("file: "__FILE__", line: %d, " \
+			"open file \"%s\" fail, " \
+			"errno: %d, error info: %s", \
+			__LINE__, tmp_filename, errno, STRERROR(errno));
+		return errno != 0 ? errno : EACCES;
+	}
+
+	memset(&writer, 0, sizeof(writer));
+	writer.size = 2 * MP_SNAPSHOT_BUFF_SIZE;
+	writer.buff = (char *)malloc(writer.size);
+	if (writer.buff == NULL)
+	{
+		logError("file: "__FILE__", line: %d, " \
+			"malloc %d bytes fail, " \
+			"errno: %d, error info: %s", \
+			__LINE__, writer.size, errno, STRERROR(errno));
+		close(fd);
+		unlink(tmp_filename);
+		return errno != 0 ? errno : ENOMEM;
+	}
+	writer.current_time = tvStart.tv_sec;
+
+	p = buff;
+	memcpy(p, MP_SNAPSHOT_MAGIC, MP_SNAPSHOT_MAGIC_LEN);
+	p += MP_SNAPSHOT_MAGIC_LEN;
+	int2buff(MP_SNAPSHOT_VERSION, p);
+	p += 4;
+	int2buff(binlog_index, p);
+	p += 4;
+	long2buff(binlog_offset, p);
+	p += 8;
+	int2buff((int)tvStart.tv_sec, p);
+	p += 4;
+	int2buff(0, p);  //reserved
+
+	do
+	{
+		if ((result=mp_snapshot_write_buff(fd, tmp_filename, buff, \
+				MP_SNAPSHOT_HEADER_SIZE)) != 0)
+		{
+			break;
+		}
+
+		if ((result=mp_snapshot_write_file(fd, tmp_filename, \
+				&writer, bExiting)) != 0)
+		{
+			break;
+		}
+
+		long2buff(writer.key_count, buff);
+		memcpy(buff + 8, MP_SNAPSHOT_END_MAGIC, MP_SNAPSHOT_MAGIC_LEN);
+		if ((result=mp_snapshot_write_buff(fd, tmp_filename, buff, \
+				MP_SNAPSHOT_TRAILER_SIZE)) != 0)
+		{
+			break;
+		}
+
+		if (fsync(fd) != 0)
+		{
+			logError("file: "__FILE__", line: %d, " \
+				"sync file \"%s\" to disk fail, " \
+				"errno: %d, error info: %s", __LINE__, \
+				tmp_filename, errno, STRERROR(errno));
+			result = errno != 0 ? errno : EIO;
+			break;
+		}
+	} while (0);
+
+	free(writer.buff);
+	close(fd);
+
+	if (result != 0)
+	{
+		unlink(tmp_filename);
+		if (result != EINTR)
+		{
+			logError("file: "__FILE__", line: %d, " \
+				"write mpool snapshot fail, " \
+				"errno: %d, error info: %s", \
+				__LINE__, result, STRERROR(result));
+		}
+		return result;
+	}
+
+	if (rename(tmp_filename, full_filename) != 0)
+	{
+		logError("file: "__FILE__", line: %d, " \
+			"rename file \"%s\" to \"%s\" fail, " \
+			"errno: %d, error info: %s", __LINE__, \
+			tmp_filename, full_filename, errno, STRERROR(errno));
+		result = errno != 0 ? errno : EPERM;
+		unlink(tmp_filename);
+		return result;
+	}
+
+	gettimeofday(&tvEnd, NULL);
+	logInfo("file: "__FILE__", line: %d, " \
+		"write mpool snapshot, key count: "INT64_PRINTF_FORMAT", " \
+		"binlog index: %d, binlog offset: "INT64_PRINTF_FORMAT", " \
+		"time used: %dms", __LINE__, writer.key_count, \
+		binlog_index, binlog_offset, \
+		(int)((tvEnd.tv_sec - tvStart.tv_sec) * 1000 + \
+		(tvEnd.tv_usec - tvStart.tv_usec) / 1000));
+
+	return 0;
+}
+
+static void *mp_snapshot_thread_entrance(void *arg)
+{
+	mp_snapshot_do_write(false);
+	snapshot_running = false;
+	return NULL;
+}
+
+int mp_snapshot_func(void *args)
+{
+	pthread_attr_t thread_attr;
+	pthread_t tid;
+	int result;
+
+	if (snapshot_running)
+	{
+		logInfo("file: "__FILE__", line: %d, " \
+			"mpool snapshot already running", __LINE__);
+		return 0;
+	}
+
+	if ((result=init_pthread_attr(&thread_attr, g_thread_stack_size)) != 0)
+	{
+		return result;
+	}
+
+	snapshot_running = true;
+	if ((result=pthread_create(&tid, &thread_attr, \
+			mp_snapshot_thread_entrance, NULL)) != 0)
+	{
+		snapshot_running = false;
+		logError("file: "__FILE__", line: %d, " \
+			"create mpool snapshot thread fail, " \
+			"errno: %d, error info: %s", \
+			__LINE__, result, STRERROR(result));
+	}
+
+	pthread_attr_destroy(&thread_attr);
+	return result;
+}
+
+int mp_snapshot_write()
+{
+	while (snapshot_running)
+	{
+		usleep(10 * 1000);
+	}
+
+	return mp_snapshot_do_write(true);
+}
+
+static void *mp_snapshot_load_entrance(void *arg)
+{
+	MpSnapshotLoadChunk *pChunk;
+	const char *p;
+	int key_len;
+	int value_len;
+	int result;
+
+	pChunk = (MpSnapshotLoadChunk *)arg;
+	p = pChunk->start;
+	while (p < pChunk->end)
+	{
+		key_len = buff2int(p);
+		value_len = buff2int(p + 4);
+		p += MP_SNAPSHOT_RECORD_HEAD_SIZE;
+
+		result = mp_load_set(p, key_len, p + key_len, value_len);
+		if (result == 0)
+		{
+			pChunk->load_count++;
+		}
+		else if (result == ENOSPC)  //the cache size is smaller
+		{
+			pChunk->fail_count++;
+		}
+		else
+		{
+			pChunk->result = result;
+			break;
+		}
+
+		p += key_len + value_len;
+	}
+
+	return NULL;
+}
+
+/* check the records and split them to the chunks of the load threads */
+static int mp_snapshot_check(const char *filename, const char *data, \
+		const int64_t file_size, MpSnapshotLoadChunk *chunks, \
+		const int chunk_count, int64_t *key_count)
+{
+	const char *p;
+	const char *pEnd;
+	const char *pChunkEnd;
+	int64_t chunk_bytes;
+	int64_t count;
+	int key_len;
+	int value_len;
+	int i;
+
+	if (file_size < MP_SNAPSHOT_HEADER_SIZE + MP_SNAPSHOT_TRAILER_SIZE || \
+		memcmp(data, MP_SNAPSHOT_MAGIC, MP_SNAPSHOT_MAGIC_LEN) != 0 || \
+		memcmp(data + file_size - MP_SNAPSHOT_MAGIC_LEN, \
+			MP_SNAPSHOT_END_MAGIC, MP_SNAPSHOT_MAGIC_LEN) != 0)
+	{
+		logError("file: "__FILE__", line: %d, " \
+			"snapshot file \"%s\" is invalid or not completed", \
+			__LINE__, filename);
+		return EINVAL;
+	}
+
+	if (buff2int(data + MP_SNAPSHOT_MAGIC_LEN) != MP_SNAPSHOT_VERSION)
+	{
+		logError("file: "__FILE__", line: %d, " \
+			"snapshot file \"%s\", version: %d is not supported", \
+			__LINE__, filename, \
+			buff2int(data + MP_SNAPSHOT_MAGIC_LEN));
+		return EINVAL;
+	}
+
+	p = data + MP_SNAPSHOT_HEADER_SIZE;
+	pEnd = data + file_size - MP_SNAPSHOT_TRAILER_SIZE;
+	chunk_bytes = (pEnd - p) / chunk_count + 1;
+	count = 0;
+	i = 0;
+	chunks[0].start = p;
+	pChunkEnd = p + chunk_bytes;
+	while (p < pEnd)
+	{
+		if (pEnd - p < MP_SNAPSHOT_RECORD_HEAD_SIZE)
+		{
+			break;
+		}
+
+		key_len = buff2int(p);
+		value_len = buff2int(p + 4);
+		if (key_len <= 0 || key_len > FDHT_MAX_FULL_KEY_LEN || \
+			value_len < 0 || value_len > (pEnd - p) - \
+			MP_SNAPSHOT_RECORD_HEAD_SIZE - key_len)
+		{
+			break;
+		}
+
+		p += MP_SNAPSHOT_RECORD_HEAD_SIZE + key_len + value_len;
+		count++;
+		if (p >= pChunkEnd && i < chunk_count - 1)
+		{
+			chunks[i].end = p;
+			chunks[++i].start = p;
+			pChunkEnd += chunk_bytes;
+		}
+	}
+
+	*key_count = buff2long(pEnd);
+	if (p != pEnd || count != *key_count)
+	{
+		logError("file: "__FILE__", line: %d, " \
+			"snapshot file \"%s\" is invalid, offset: %d, " \
+			"key count: "INT64_PRINTF_FORMAT" != " \
+			INT64_PRINTF_FORMAT, __LINE__, filename, \
+			(int)(p - data), count, *key_count);
+		return EINVAL;
+	}
+
+	chunks[i].end = pEnd;
+	for (i++; i<chunk_count; i++)
+	{
+		chunks[i].start = chunks[i].end = pEnd;
+	}
+
+	return 0;
+}
+
+/* load the records by the threads when the table has the bucket locks,
+   the write lock serializes the sets otherwise */
+static int mp_snapshot_load_chunks(MpSnapshotLoadChunk *chunks, \
+		const int chunk_count)
+{
+	pthread_attr_t thread_attr;
+	pthread_t tids[FDHT_MPOOL_SNAPSHOT_LOAD_THREADS];
+	int thread_count;
+	int result;
+	int i;
+
+	if (chunk_count == 1)
+	{
+		mp_snapshot_load_entrance(chunks);
+		return chunks[0].result;
+	}
+
+	if ((result=init_pthread_attr(&thread_attr, g_thread_stack_size)) != 0)
+	{
+		return result;
+	}
+
+	/* the threads are joined before the snapshot unmapped */
+	if ((result=pthread_attr_setdetachstate(&thread_attr, \
+			PTHREAD_CREATE_JOINABLE)) != 0)
+	{
+		logError("file: "__FILE__", line: %d, " \
+			"call pthread_attr_setdetachstate fail, " \
+			"errno: %d, error info: %s", \
+			__LINE__, result, STRERROR(result));
+		pthread_attr_destroy(&thread_attr);
+		return result;
+	}
+
+	for (thread_count=0; thread_count<chunk_count; thread_count++)
+	{
+		if ((result=pthread_create(tids + thread_count, &thread_attr, \
+			mp_snapshot_load_entrance, chunks + thread_count)) != 0)
+		{
+			logError("file: "__FILE__", line: %d, " \
+				"create thread fail, " \
+				"errno: %d, error info: %s", \
+				__LINE__, result, STRERROR(result));
+			break;
+		}
+	}
+	pthread_attr_destroy(&thread_attr);
+
+	for (i=0; i<thread_count; i++)
+	{
+		pthread_join(tids[i], NULL);
+		if (chunks[i].result != 0 && result == 0)
+		{
+			result = chunks[i].result;
+		}
+	}
+
+	return result;
+}
+
+static int mp_snapshot_load(const char *filename, int *binlog_index, \
+		int64_t *binlog_offset)
+{
+	MpSnapshotLoadChunk chunks[FDHT_MPOOL_SNAPSHOT_LOAD_THREADS];
+	struct stat file_stat;
+	struct timeval tvStart;
+	struct timeval tvEnd;
+	char *data;
+	int64_t key_count;
+	int64_t load_count;
+	int64_t fail_count;
+	int chunk_count;
+	int fd;
+	int result;
+	int i;
+
+	gettimeofday(&tvStart, NULL);
+	fd = open(filename, O_RDONLY);
+	if (fd < 0)
+	{
+		logError("file: "__FILE__", line: %d, " \
+			"open file \"%s\" fail, " \
+			"errno: %d, error info: %s", \
+			__LINE__, filename, errno, STRERROR(errno));
+		return errno != 0 ? errno : ENOENT;
+	}
+
+	if (fstat(fd, &file_stat) != 0)
+	{
+		logError("file: "__FILE__", line: %d, " \
+			"stat file \"%s\" fail, " \
+			"errno: %d, error info: %s", \
+			__LINE__, filename, errno, STRERROR(errno));
+		result = errno != 0 ? errno : EIO;
+		close(fd);
+		return result;
+	}
+
+	if (file_stat.st_size < MP_SNAPSHOT_HEADER_SIZE)
+	{
+		close(fd);
+		logError("file: "__FILE__", line: %d, " \
+			"snapshot file \"%s\" is invalid, file size: " \
+			INT64_PRINTF_FORMAT, __LINE__, filename, \
+			(int64_t)file_stat.st_size);
+		return EINVAL;
+	}
+
+	data = (char *)mmap(NULL, file_stat.st_size, PROT_READ, \
+			MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (data == MAP_FAILED)
+	{
+		logError("file: "__FILE__", line: %d, " \
+			"mmap file \"%s\" fail, " \
+			"errno: %d, error info: %s", \
+			__LINE__, filename, errno, STRERROR(errno));
+		return errno != 0 ? errno : ENOMEM;
+	}
+	madvise(data, file_stat.st_size, MADV_SEQUENTIAL);
+
+	chunk_count = g_hash_array->lock_count > 0 ? \
+			FDHT_MPOOL_SNAPSHOT_LOAD_THREADS : 1;
+	memset(chunks, 0, sizeof(chunks));
+	if ((result=mp_snapshot_check(filename, data, file_stat.st_size, \
+			chunks, chunk_count, &key_count)) == 0)
+	{
+		*binlog_index = buff2int(data + MP_SNAPSHOT_MAGIC_LEN + 4);
+		*binlog_offset = buff2long(data + MP_SNAPSHOT_MAGIC_LEN + 8);
+		result = mp_snapshot_load_chunks(chunks, chunk_count);
+	}
+
+	munmap(data, file_stat.st_size);
+	if (result != 0)
+	{
+		return result;
+	}
+
+	load_count = 0;
+	fail_count = 0;
+	for (i=0; i<chunk_count; i++)
+	{
+		load_count += chunks[i].load_count;
+		fail_count += chunks[i].fail_count;
+	}
+
+	gettimeofday(&tvEnd, NULL);
+	logInfo("file: "__FILE__", line: %d, " \
+		"load mpool snapshot, key count: "INT64_PRINTF_FORMAT", " \
+		"success count: "INT64_PRINTF_FORMAT", no space count: " \
+		INT64_PRINTF_FORMAT", thread count: %d, time used: %dms", \
+		__LINE__, key_count, load_count, fail_count, chunk_count, \
+		(int)((tvEnd.tv_sec - tvStart.tv_sec) * 1000 + \
+		(tvEnd.tv_usec - tvStart.tv_usec) / 1000));
+
+	return 0;
+}
+
+static int mp_snapshot_get_compressed_index()
+{
+	char full_filename[MAX_PATH_SIZE + sizeof("/data/"SYNC_DIR_NAME"/") + \
+			sizeof(BINLOG_COMPRESSED_INDEX_FILENAME)];
+	char *file_buff;
+	int64_t file_size;
+	int compressed_index;
+
+	snprintf(full_filename, sizeof(full_filename), \
+			"%s/data/"SYNC_DIR_NAME"/%s", g_fdht_base_path, \
+			BINLOG_COMPRESSED_INDEX_FILENAME);
+	if (!fileExists(full_filename) || getFileContent(full_filename, \
+			&file_buff, &file_size) != 0)
+	{
+		return 0;
+	}
+
+	compressed_index = atoi(file_buff);
+	free(file_buff);
+	return compressed_index;
+}
+
+int mp_snapshot_recovery_init()
+{
+	char full_filename[MP_SNAPSHOT_FILENAME_SIZE];
+	int binlog_index;
+	int64_t binlog_offset;
+	int result;
+
+	/* the keys are attached from the shared memory file which was
+	   closed cleanly, they are newer than the snapshot */
+	if (mp_shm_attached())
+	{
+		logInfo("file: "__FILE__", line: %d, " \
+			"the mpool is attached from the shm file, " \
+			"skip loading the snapshot", __LINE__);
+		return 0;
+	}
+
+	mp_snapshot_get_filename(full_filename);
+	if (!fileExists(full_filename))
+	{
+		return 0;
+	}
+
+	if ((result=mp_snapshot_load(full_filename, &binlog_index, \
+			&binlog_offset)) != 0)
+	{
+		return result;
+	}
+
+	if (binlog_index > g_binlog_index || (binlog_index == \
+		g_binlog_index && binlog_offset > g_binlog_file_size))
+	{
+		logWarning("file: "__FILE__", line: %d, " \
+			"the binlog position of the snapshot: %d, " \
+			INT64_PRINTF_FORMAT" is after the binlog end: %d, " \
+			INT64_PRINTF_FORMAT", the binlog is not replayed", \
+			__LINE__, binlog_index, binlog_offset, \
+			g_binlog_index, (int64_t)g_binlog_file_size);
+		return 0;
+	}
+
+	/* the offsets of the compressed binlog file are changed, replay
+	   the whole file, the records before the snapshot are harmless */
+	if (binlog_offset > 0 && binlog_index < \
+		mp_snapshot_get_compressed_index())
+	{
+		logInfo("file: "__FILE__", line: %d, " \
+			"binlog file index: %d of the snapshot is compressed, " \
+			"replay from the file start", __LINE__, binlog_index);
+		binlog_offset = 0;
+	}
+
+	return fdht_recover_data(binlog_index, binlog_offset, -1);
+}
+
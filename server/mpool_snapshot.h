@@ -0,0 +1,52 @@
+/**
+* Copyright (C) 2008 Happy Fish / YuQing
+*
+* FastDFS may be copied only under the terms of the GNU General
+* Public License V3, which may be found in the FastDFS source kit.
+* Please visit the FastDFS Home Page http://www.csource.org/ for more detail.
+**/
+
+//mpool_snapshot.h
+
+#ifndef _MPOOL_SNAPSHOT_H
+#define _MPOOL_SNAPSHOT_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "fdht_define.h"
+#include "mpool_op.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+* load the keys from the snapshot file, then replay the local binlog after
+* the binlog position of the snapshot. nothing loaded when no snapshot
+* return: error no, 0 for success, != 0 fail
+*/
+int mp_snapshot_recovery_init();
+
+/**
+* start a thread to write the snapshot, scheduled every
+* mpool_snapshot_interval seconds
+* params:
+*	args: not used
+* return: error no, 0 for success, != 0 fail
+*/
+int mp_snapshot_func(void *args);
+
+/**
+* write the snapshot in the caller thread, such as on exit. wait for the
+* snapshot thread first
+* return: error no, 0 for success, != 0 fail
+*/
+int mp_snapshot_write();
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
@@ -1,18 +1,26 @@
-
+#include <errno.h>
+#include "logger.h"
+#include "shared_func.h"
 #include "store.h"
 #include "global.h"
 #include "db_op.h"
 #include "mpool_op.h"
+#include "flat_op.h"
+#include "hybrid_op.h"
+
+#define STORE_BATCH_BUFF_INIT_SIZE  (4 * 1024)
 
 func_destroy_instance g_func_destroy_instance = NULL;
 func_destroy g_func_destroy = NULL;
 func_memp_trickle g_func_memp_trickle = NULL;
 func_get g_func_get = NULL;
+func_get_ex g_func_get_ex = NULL;
 func_set g_func_set = NULL;
 func_partial_set g_func_partial_set = NULL;
 func_delete g_func_delete = NULL;
 func_inc g_func_inc = NULL;
 func_inc_ex g_func_inc_ex = NULL;
+func_batch_get g_func_batch_get = NULL;
 func_clear_expired_keys g_func_clear_expired_keys = NULL;
 
 void store_init()
@@ -23,25 +31,203 @@ void store_init()
 		g_func_destroy = db_destroy;
 		g_func_memp_trickle = db_memp_trickle;
 		g_func_get = db_get;
+		g_func_get_ex = db_get_ex;
 		g_func_set = db_set;
 		g_func_partial_set = db_partial_set;
 		g_func_delete = db_delete;
 		g_func_inc = db_inc;
 		g_func_inc_ex = db_inc_ex;
+		g_func_batch_get = db_batch_get;
 		g_func_clear_expired_keys = db_clear_expired_keys;
 	}
-	else
+	else if (g_store_type == FDHT_STORE_TYPE_HYBRID)
+	{
+		g_func_destroy_instance = hy_destroy_instance;
+		g_func_destroy = hy_destroy;
+		g_func_memp_trickle = db_memp_trickle;
+		g_func_get = hy_get;
+		g_func_get_ex = hy_get_ex;
+		g_func_set = hy_set;
+		g_func_partial_set = hy_partial_set;
+		g_func_delete = hy_delete;
+		g_func_inc = hy_inc;
+		g_func_inc_ex = hy_inc_ex;
+		g_func_batch_get = store_batch_get;
+		g_func_clear_expired_keys = db_clear_expired_keys;
+	}
+	else if (g_store_type == FDHT_STORE_TYPE_MPOOL)
 	{
 		g_func_destroy_instance = mp_destroy_instance;
 		g_func_destroy = mp_destroy;
 		g_func_memp_trickle = mp_memp_trickle;
 		g_func_get = mp_get;
+		g_func_get_ex = store_get_ex;
 		g_func_set = mp_set;
 		g_func_partial_set = mp_partial_set;
 		g_func_delete = mp_delete;
 		g_func_inc = mp_inc;
 		g_func_inc_ex = mp_inc_ex;
+		g_func_batch_get = mp_batch_get;
 		g_func_clear_expired_keys = mp_clear_expired_keys;
 	}
+	else
+	{
+		g_func_destroy_instance = fl_destroy_instance;
+		g_func_destroy = fl_destroy;
+		g_func_memp_trickle = fl_memp_trickle;
+		g_func_get = fl_get;
+		g_func_get_ex = store_get_ex;
+		g_func_set = fl_set;
+		g_func_partial_set = fl_partial_set;
+		g_func_delete = fl_delete;
+		g_func_inc = fl_inc;
+		g_func_inc_ex = fl_inc_ex;
+		g_func_batch_get = fl_batch_get;
+		g_func_clear_expired_keys = fl_clear_expired_keys;
+	}
+}
+
+int store_get_buffer_reserve(FDHTGetBuffer *pBuffer, const int value_len)
+{
+	if (pBuffer->buff != NULL && value_len <= pBuffer->size)
+	{
+		return 0;
+	}
+
+	return pBuffer->alloc_func(pBuffer, value_len);
 }
 
+int store_get_ex(StoreHandle *pHandle, const char *pKey, const int key_len, \
+		FDHTGetBuffer *pBuffer)
+{
+	char *pValue;
+	int value_len;
+	int result;
+
+	if ((result=store_get_buffer_reserve(pBuffer, 0)) != 0)
+	{
+		return result;
+	}
+
+	pValue = pBuffer->buff;
+	value_len = pBuffer->size;
+	while ((result=g_func_get(pHandle, pKey, key_len, \
+		&pValue, &value_len)) == ENOSPC)
+	{
+		/* the value may be enlarged by other thread, retry */
+		if ((result=pBuffer->alloc_func(pBuffer, value_len)) != 0)
+		{
+			return result;
+		}
+
+		pValue = pBuffer->buff;
+		value_len = pBuffer->size;
+	}
+
+	if (result == 0)
+	{
+		pBuffer->value_len = value_len;
+	}
+	return result;
+}
+
+/* make room for size bytes more at least */
+static int store_batch_buffer_reserve(FDHTBatchGetBuffer *pBuffer, \
+		const int size)
+{
+	char *new_data;
+	int alloc_size;
+
+	if (pBuffer->data != NULL && pBuffer->length + size <= \
+			pBuffer->alloc_size)
+	{
+		return 0;
+	}
+
+	alloc_size = pBuffer->alloc_size > 0 ? pBuffer->alloc_size : \
+			STORE_BATCH_BUFF_INIT_SIZE;
+	while (alloc_size < pBuffer->length + size)
+	{
+		alloc_size *= 2;
+	}
+
+	new_data = (char *)realloc(pBuffer->data, alloc_size);
+	if (new_data == NULL)
+	{
+		logError("file: "__FILE__", line: %d, " \
+			"realloc %d bytes fail, " \
+			"errno: %d, error info: %s", __LINE__, \
+			alloc_size, errno, STRERROR(errno));
+		return errno != 0 ? errno : ENOMEM;
+	}
+
+	pBuffer->data = new_data;
+	pBuffer->alloc_size = alloc_size;
+	return 0;
+}
+
+char *store_batch_value_alloc(FDHTBatchGetBuffer *pBuffer, \
+		FDHTBatchGetItem *pItem, const int value_len)
+{
+	if (store_batch_buffer_reserve(pBuffer, value_len) != 0)
+	{
+		return NULL;
+	}
+
+	pItem->value_offset = pBuffer->length;
+	pItem->value_len = value_len;
+	pBuffer->length += value_len;
+	return pBuffer->data + pItem->value_offset;
+}
+
+int store_batch_get(StoreHandle *pHandle, FDHTBatchGetItem *items, \
+		const int count, FDHTBatchGetBuffer *pBuffer)
+{
+	FDHTBatchGetItem *pItem;
+	FDHTBatchGetItem *pEnd;
+	char *pValue;
+	int value_len;
+	int result;
+
+	pEnd = items + count;
+	for (pItem=items; pItem<pEnd; pItem++)
+	{
+		/* get to the free space of the buffer, enlarge the buffer
+		   and get again when not enough */
+		value_len = 0;
+		do
+		{
+			if ((result=store_batch_buffer_reserve(pBuffer, \
+					value_len)) != 0)
+			{
+				pItem->status = result;
+				break;
+			}
+
+			pValue = pBuffer->data + pBuffer->length;
+			value_len = pBuffer->alloc_size - pBuffer->length;
+			pItem->status = g_func_get(pHandle, pItem->pKey, \
+				pItem->key_len, &pValue, &value_len);
+		} while (pItem->status == ENOSPC);
+
+		if (pItem->status == 0)
+		{
+			pItem->value_offset = pBuffer->length;
+			pItem->value_len = value_len;
+			pBuffer->length += value_len;
+		}
+	}
+
+	return 0;
+}
+
+void store_batch_buffer_free(FDHTBatchGetBuffer *pBuffer)
+{
+	if (pBuffer->data != NULL)
+	{
+		free(pBuffer->data);
+		pBuffer->data = NULL;
+	}
+	pBuffer->alloc_size = 0;
+	pBuffer->length = 0;
+}
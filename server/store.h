@@ -18,6 +18,34 @@
 
 typedef void StoreHandle;
 
+/* a key of the batch get, the value is copied to the batch buffer */
+typedef struct
+{
+	const char *pKey;  //the full key
+	int key_len;
+	int status;        //0 for found, errno for fail, such as ENOENT
+	int value_offset;  //the offset of the value in the batch buffer
+	int value_len;
+} FDHTBatchGetItem;
+
+typedef struct
+{
+	char *data;
+	int alloc_size;
+	int length;  //the bytes used
+} FDHTBatchGetBuffer;
+
+/* the value buffer of the get ex, the value is read by one lookup and
+   the buffer is enlarged by alloc_func when the value is larger */
+typedef struct fdht_get_buffer
+{
+	char *buff;
+	int size;       //the buffer size
+	int value_len;  //the value length returned
+	int (*alloc_func)(struct fdht_get_buffer *pBuffer, const int value_len);
+	void *alloc_arg;
+} FDHTGetBuffer;
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -29,6 +57,8 @@ typedef int (*func_memp_trickle)(int *nwrotep);
 
 typedef int (*func_get)(StoreHandle *pHandle, const char *pKey, \
 		const int key_len, char **ppValue, int *size);
+typedef int (*func_get_ex)(StoreHandle *pHandle, const char *pKey, \
+		const int key_len, FDHTGetBuffer *pBuffer);
 typedef int (*func_set)(StoreHandle *pHandle, const char *pKey, \
 		const int key_len, const char *pValue, const int value_len);
 typedef int (*func_partial_set)(StoreHandle *pHandle, const char *pKey, \
@@ -43,21 +73,78 @@ typedef int (*func_inc_ex)(StoreHandle *pHandle, const char *pKey, \
 		const int key_len, const int inc, char *pValue, \
 		int *value_len, const int timeout);
 
+typedef int (*func_batch_get)(StoreHandle *pHandle, \
+		FDHTBatchGetItem *items, const int count, \
+		FDHTBatchGetBuffer *pBuffer);
+
 typedef int (*func_clear_expired_keys)(void *arg);
 
 extern func_destroy_instance g_func_destroy_instance;
 extern func_destroy g_func_destroy;
 extern func_memp_trickle g_func_memp_trickle;
 extern func_get g_func_get;
+extern func_get_ex g_func_get_ex;
 extern func_set g_func_set;
 extern func_partial_set g_func_partial_set;
 extern func_delete g_func_delete;
 extern func_inc g_func_inc;
 extern func_inc_ex g_func_inc_ex;
+extern func_batch_get g_func_batch_get;
 extern func_clear_expired_keys g_func_clear_expired_keys;
 
 void store_init();
 
+/**
+ * enlarge the value buffer of the get ex when smaller than the value
+ * parameters:
+ *         pBuffer: the value buffer
+ *         value_len: the value length
+ * return 0 for success, != 0 for fail (out of memory)
+*/
+int store_get_buffer_reserve(FDHTGetBuffer *pBuffer, const int value_len);
+
+/**
+ * get ex by g_func_get, the key is looked up again when the buffer
+ * is enlarged, for the store without get ex
+ * parameters:
+ *         pHandle: the store handle
+ *         pKey: the key
+ *         key_len: the key length
+ *         pBuffer: the value buffer, the value_len is returned
+ * return 0 for success, != 0 for error such as ENOENT
+*/
+int store_get_ex(StoreHandle *pHandle, const char *pKey, const int key_len, \
+		FDHTGetBuffer *pBuffer);
+
+/**
+ * alloc the value space of the batch get item from the batch buffer,
+ * the buffer is enlarged when full
+ * parameters:
+ *         pBuffer: the batch buffer
+ *         pItem: the item, its value_offset and value_len are set
+ *         value_len: the value length
+ * return the value space, NULL for fail (out of memory)
+*/
+char *store_batch_value_alloc(FDHTBatchGetBuffer *pBuffer, \
+		FDHTBatchGetItem *pItem, const int value_len);
+
+/**
+ * batch get by g_func_get key by key, for the store without batch get
+ * parameters:
+ *         pHandle: the store handle
+ *         items: the keys to get, the status of each key is returned
+ *         count: the key count
+ *         pBuffer: the batch buffer to store the values
+ * return 0 for success, != 0 for error such as out of memory
+*/
+int store_batch_get(StoreHandle *pHandle, FDHTBatchGetItem *items, \
+		const int count, FDHTBatchGetBuffer *pBuffer);
+
+/**
+ * free the batch buffer
+*/
+void store_batch_buffer_free(FDHTBatchGetBuffer *pBuffer);
+
 #ifdef __cplusplus
 }
 #endif
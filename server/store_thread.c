@@ -0,0 +1,208 @@
+/**
+* Copyright (C) 2008 Happy Fish / YuQing
+*
+* FastDFS may be copied only under the terms of the GNU General
+* Public License V3, which may be found in the FastDFS source kit.
+* Please visit the FastDFS Home Page http://www.csource.org/ for more detail.
+**/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include "fdht_define.h"
+#include "shared_func.h"
+#include "pthread_func.h"
+#include "logger.h"
+#include "global.h"
+#include "fast_task_queue.h"
+#include "fdht_io.h"
+#include "store_thread.h"
+
+static struct fast_task_queue store_queue;
+static pthread_mutex_t store_thread_mutex;
+static pthread_cond_t store_thread_cond;
+static pthread_t *store_tids = NULL;
+static int store_thread_count = 0;
+
+static void *store_thread_entrance(void* arg);
+
+int store_thread_init()
+{
+	int result;
+	int i;
+	pthread_attr_t thread_attr;
+
+	if (g_store_threads == 0)
+	{
+		return 0;
+	}
+
+	if ((result=task_queue_init(&store_queue)) != 0)
+	{
+		return result;
+	}
+
+	if ((result=init_pthread_lock(&store_thread_mutex)) != 0)
+	{
+		logError("file: "__FILE__", line: %d, " \
+			"init_pthread_lock fail, program exit!", __LINE__);
+		return result;
+	}
+
+	if ((result=pthread_cond_init(&store_thread_cond, NULL)) != 0)
+	{
+		logError("file: "__FILE__", line: %d, " \
+			"pthread_cond_init fail, " \
+			"errno: %d, error info: %s", \
+			__LINE__, result, STRERROR(result));
+		return result;
+	}
+
+	store_tids = (pthread_t *)malloc(sizeof(pthread_t) * g_store_threads);
+	if (store_tids == NULL)
+	{
+		logError("file: "__FILE__", line: %d, " \
+			"malloc %d bytes fail, " \
+			"errno: %d, error info: %s", __LINE__, \
+			(int)sizeof(pthread_t) * g_store_threads, \
+			errno, STRERROR(errno));
+		return errno != 0 ? errno : ENOMEM;
+	}
+
+	if ((result=init_pthread_attr(&thread_attr, g_thread_stack_size)) != 0)
+	{
+		logError("file: "__FILE__", line: %d, " \
+			"init_pthread_attr fail, program exit!", __LINE__);
+		return result;
+	}
+
+	/* the threads are joined by store_thread_destroy */
+	if ((result=pthread_attr_setdetachstate(&thread_attr, \
+			PTHREAD_CREATE_JOINABLE)) != 0)
+	{
+		logError("file: "__FILE__", line: %d, " \
+			"call pthread_attr_setdetachstate fail, " \
+			"errno: %d, error info: %s", \
+			__LINE__, result, STRERROR(result));
+		pthread_attr_destroy(&thread_attr);
+		return result;
+	}
+
+	for (i=0; i<g_store_threads; i++)
+	{
+		if ((result=pthread_create(store_tids + i, &thread_attr, \
+			store_thread_entrance, NULL)) != 0)
+		{
+			logError("file: "__FILE__", line: %d, " \
+				"create store thread failed, " \
+				"startup threads: %d, " \
+				"errno: %d, error info: %s", \
+				__LINE__, i, result, STRERROR(result));
+			break;
+		}
+		store_thread_count++;
+	}
+
+	pthread_attr_destroy(&thread_attr);
+
+	return result;
+}
+
+void store_thread_destroy()
+{
+	struct fast_task_info *pTask;
+	int count;
+	int i;
+
+	if (g_store_threads == 0 || store_tids == NULL)
+	{
+		return;
+	}
+
+	pthread_mutex_lock(&store_thread_mutex);
+	pthread_cond_broadcast(&store_thread_cond);
+	pthread_mutex_unlock(&store_thread_mutex);
+
+	for (i=0; i<store_thread_count; i++)
+	{
+		pthread_join(store_tids[i], NULL);
+	}
+	store_thread_count = 0;
+	free(store_tids);
+	store_tids = NULL;
+
+	/* the nio threads exited before, the tasks left are released here */
+	count = 0;
+	while ((pTask=task_queue_pop(&store_queue)) != NULL)
+	{
+		task_release(pTask);
+		count++;
+	}
+	if (count > 0)
+	{
+		logWarning("file: "__FILE__", line: %d, " \
+			"%d tasks in the store queue are released " \
+			"without response", __LINE__, count);
+	}
+
+	pthread_cond_destroy(&store_thread_cond);
+	pthread_mutex_destroy(&store_thread_mutex);
+	pthread_mutex_destroy(&(store_queue.lock));
+}
+
+int store_thread_push(struct fast_task_info *pTask)
+{
+	int result;
+
+	if ((result=task_queue_push(&store_queue, pTask)) != 0)
+	{
+		return result;
+	}
+
+	if ((result=pthread_mutex_lock(&store_thread_mutex)) != 0)
+	{
+		logError("file: "__FILE__", line: %d, " \
+			"call pthread_mutex_lock fail, " \
+			"errno: %d, error info: %s", \
+			__LINE__, result, STRERROR(result));
+	}
+
+	pthread_cond_signal(&store_thread_cond);
+
+	if ((result=pthread_mutex_unlock(&store_thread_mutex)) != 0)
+	{
+		logError("file: "__FILE__", line: %d, " \
+			"call pthread_mutex_unlock fail, " \
+			"errno: %d, error info: %s", \
+			__LINE__, result, STRERROR(result));
+	}
+
+	return 0;
+}
+
+static void *store_thread_entrance(void* arg)
+{
+	struct fast_task_info *pTask;
+
+	while (g_continue_flag)
+	{
+		pthread_mutex_lock(&store_thread_mutex);
+		while ((pTask=task_queue_pop(&store_queue)) == NULL && \
+			g_continue_flag)
+		{
+			pthread_cond_wait(&store_thread_cond, \
+					&store_thread_mutex);
+		}
+		pthread_mutex_unlock(&store_thread_mutex);
+
+		if (pTask != NULL)
+		{
+			task_deal_requests(pTask);
+			task_notify_nio(pTask);
+		}
+	}
+
+	return NULL;
+}
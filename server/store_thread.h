@@ -0,0 +1,48 @@
+/**
+* Copyright (C) 2008 Happy Fish / YuQing
+*
+* FastDFS may be copied only under the terms of the GNU General
+* Public License V3, which may be found in the FastDFS source kit.
+* Please visit the FastDFS Home Page http://www.csource.org/ for more detail.
+**/
+
+//store_thread.h
+
+#ifndef _STORE_THREAD_H
+#define _STORE_THREAD_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "fdht_define.h"
+#include "fast_task_queue.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+* start the store threads, do nothing when store_threads is 0
+* return: error no, 0 for success, != 0 fail
+*/
+int store_thread_init();
+
+/**
+* wake up the store threads and wait for them to exit
+*/
+void store_thread_destroy();
+
+/**
+* push the task to the store threads, the task will be dealt by
+* task_deal_requests and the responses sent by its nio thread
+* params:
+*	pTask: the task which request received done
+* return: error no, 0 for success, != 0 fail
+*/
+int store_thread_push(struct fast_task_info *pTask);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
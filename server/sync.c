@@ -1273,6 +1273,30 @@ int fdht_binlog_write(const time_t timestamp, const char op_type, \
 	return write_ret;
 }
 
+void fdht_binlog_get_position(int *binlog_index, int64_t *binlog_offset)
+{
+	int result;
+
+	if ((result=pthread_mutex_lock(&sync_thread_lock)) != 0)
+	{
+		logError("file: "__FILE__", line: %d, " \
+			"call pthread_mutex_lock fail, " \
+			"errno: %d, error info: %s", \
+			__LINE__, result, STRERROR(result));
+	}
+
+	*binlog_index = g_binlog_index;
+	*binlog_offset = g_binlog_file_size;
+
+	if ((result=pthread_mutex_unlock(&sync_thread_lock)) != 0)
+	{
+		logError("file: "__FILE__", line: %d, " \
+			"call pthread_mutex_unlock fail, " \
+			"errno: %d, error info: %s", \
+			__LINE__, result, STRERROR(result));
+	}
+}
+
 #define CHECK_FIELD_VALUE(pRecord, value, max_length, caption) \
 	if (value < 0) \
 	{ \
@@ -1336,8 +1360,8 @@ int fdht_binlog_read(BinLogReader *pReader, \
 					return result;
 				}
 
-				if ((result=fdht_write_to_mark_file( \
-						pReader)) != 0)
+				if (pReader->mark_fd >= 0 && (result= \
+					fdht_write_to_mark_file(pReader)) != 0)
 				{
 					return result;
 				}
@@ -86,6 +86,16 @@ int fdht_binlog_read(BinLogReader *pReader, \
 		BinLogRecord *pRecord, int *record_length);
 int fdht_open_readable_binlog(BinLogReader *pReader);
 
+/**
+* get the binlog position of the records written, the records in the
+* write cache are after it
+* params:
+*	binlog_index: return the binlog file index
+*	binlog_offset: return the offset in the binlog file
+* return: none
+*/
+void fdht_binlog_get_position(int *binlog_index, int64_t *binlog_offset);
+
 int fdht_binlog_sync_func(void *args);
 int write_to_sync_ini_file();
 int kill_fdht_sync_threads();
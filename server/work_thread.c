@@ -39,16 +39,21 @@
 #include "key_op.h"
 #include "sync.h"
 #include "mpool_op.h"
+#include "mpool_namespace.h"
+#include "flat_op.h"
+#include "hybrid_op.h"
 #include "ioevent_loop.h"
+#include "store_thread.h"
 #include "work_thread.h"
 
 #define SYNC_REQ_WAIT_SECONDS	60
 
 static pthread_mutex_t work_thread_mutex;
-static pthread_mutex_t inc_thread_mutex;
+static IOEventEntry *listen_entries = NULL;  //for reuse_port
 static time_t first_sync_req_time = 0;
 
 static void *work_thread_entrance(void* arg);
+static int init_listen_entries(const char *bind_addr, const int server_sock);
 static void wait_for_work_threads_exit();
 
 static int deal_cmd_get(struct fast_task_info *pTask);
@@ -60,10 +65,11 @@ static int deal_cmd_sync_done(struct fast_task_info *pTask);
 static int deal_cmd_batch_get(struct fast_task_info *pTask);
 static int deal_cmd_batch_set(struct fast_task_info *pTask);
 static int deal_cmd_batch_del(struct fast_task_info *pTask);
+static char *stat_mpool_namespaces(char *p);
 static int deal_cmd_stat(struct fast_task_info *pTask);
 static int deal_cmd_get_sub_keys(struct fast_task_info *pTask);
 
-int work_thread_init()
+int work_thread_init(const char *bind_addr, const int server_sock)
 {
 	int result;
 	struct nio_thread_data *pThreadData;
@@ -78,22 +84,24 @@ int work_thread_init()
 		return result;
 	}
 
-	if ((result=init_pthread_lock(&inc_thread_mutex)) != 0)
+	if ((result=init_pthread_attr(&thread_attr, g_thread_stack_size)) != 0)
 	{
 		logError("file: "__FILE__", line: %d, " \
-			"init_pthread_lock fail, program exit!", __LINE__);
+			"init_pthread_attr fail, program exit!", __LINE__);
 		return result;
 	}
 
-	if ((result=init_pthread_attr(&thread_attr, g_thread_stack_size)) != 0)
+	/* the free tasks cached by the nio threads are not available
+	   for other threads, so alloc more tasks for them. the connections
+	   are limited to max_connections when accepted */
+	if ((result=free_queue_init(g_max_connections + g_max_threads * \
+		FAST_TASK_LOCAL_FREE_MAX, g_min_buff_size, \
+                g_max_pkg_size, sizeof(FDHTTaskArg))) != 0)
 	{
-		logError("file: "__FILE__", line: %d, " \
-			"init_pthread_attr fail, program exit!", __LINE__);
 		return result;
 	}
 
-	if ((result=free_queue_init(g_max_connections, g_min_buff_size,
-                g_max_pkg_size, 0)) != 0)
+	if ((result=store_thread_init()) != 0)
 	{
 		return result;
 	}
@@ -108,6 +116,14 @@ int work_thread_init()
 			g_max_threads, errno, STRERROR(errno));
 		return errno != 0 ? errno : ENOMEM;
 	}
+	memset(g_thread_data, 0, sizeof(struct nio_thread_data) * \
+		g_max_threads);
+
+	if (g_reuse_port && (result=init_listen_entries(bind_addr, \
+			server_sock)) != 0)
+	{
+		return result;
+	}
 
 	g_thread_count = 0;
 	pDataEnd = g_thread_data + g_max_threads;
@@ -159,6 +175,24 @@ int work_thread_init()
 		}
 #endif
 
+		if (listen_entries != NULL)
+		{
+			IOEventEntry *pEntry;
+
+			pEntry = listen_entries + (pThreadData - g_thread_data);
+			pEntry->timer.data = pThreadData;
+			if (ioevent_attach(&pThreadData->ev_puller, \
+				pEntry->fd, IOEVENT_READ, pEntry) != 0)
+			{
+				result = errno != 0 ? errno : ENOMEM;
+				logError("file: "__FILE__", line: %d, " \
+					"ioevent_attach fail, " \
+					"errno: %d, error info: %s", \
+					__LINE__, result, STRERROR(result));
+				break;
+			}
+		}
+
 		if ((result=pthread_create(&tid, &thread_attr, \
 			work_thread_entrance, pThreadData)) != 0)
 		{
@@ -194,15 +228,59 @@ int work_thread_init()
 	return result;
 }
 
+#define NIO_THREAD_LOAD(pThreadData) \
+	((pThreadData)->connection_count + (pThreadData)->in_flight_count)
+
+static struct nio_thread_data *choose_work_thread(const int incomesock, \
+		unsigned int *seed)
+{
+	struct nio_thread_data *pThreadData;
+	struct nio_thread_data *pDataEnd;
+	struct nio_thread_data *pChosen;
+	struct nio_thread_data *pOther;
+
+	if (g_max_threads == 1)
+	{
+		return g_thread_data;
+	}
+
+	switch (g_connection_placement)
+	{
+		case FDHT_PLACEMENT_LEAST_LOADED:
+			pChosen = g_thread_data;
+			pDataEnd = g_thread_data + g_max_threads;
+			for (pThreadData=g_thread_data + 1; \
+				pThreadData<pDataEnd; pThreadData++)
+			{
+				if (NIO_THREAD_LOAD(pThreadData) < \
+					NIO_THREAD_LOAD(pChosen))
+				{
+					pChosen = pThreadData;
+				}
+			}
+			return pChosen;
+		case FDHT_PLACEMENT_TWO_CHOICES:
+			pChosen = g_thread_data + rand_r(seed) % g_max_threads;
+			pOther = g_thread_data + rand_r(seed) % g_max_threads;
+			return NIO_THREAD_LOAD(pOther) < \
+				NIO_THREAD_LOAD(pChosen) ? pOther : pChosen;
+		default:
+			return g_thread_data + incomesock % g_max_threads;
+	}
+}
+
 static void *accept_thread_entrance(void* arg)
 {
 	int server_sock;
 	int incomesock;
+	long notify_value;
 	struct sockaddr_in inaddr;
 	unsigned int sockaddr_len;
 	struct nio_thread_data *pThreadData;
+	unsigned int seed;
 
 	server_sock = (long)arg;
+	seed = (unsigned int)g_current_time ^ (unsigned int)(long)&seed;
 	while (g_continue_flag)
 	{
 		sockaddr_len = sizeof(inaddr);
@@ -221,23 +299,133 @@ static void *accept_thread_entrance(void* arg)
 			continue;
 		}
 
-		pThreadData = g_thread_data + incomesock % g_max_threads;
-		if (write(pThreadData->pipe_fds[1], &incomesock, \
-			sizeof(incomesock)) != sizeof(incomesock))
+		if (!task_connection_acquire(incomesock))
+		{
+			continue;
+		}
+
+		/* the task is popped by the nio thread from its free list */
+		pThreadData = choose_work_thread(incomesock, &seed);
+		__sync_add_and_fetch(&pThreadData->connection_count, 1);
+
+		notify_value = FDHT_NOTIFY_NEW_SOCK(incomesock);
+		if (write(pThreadData->pipe_fds[1], &notify_value, \
+			sizeof(notify_value)) != sizeof(notify_value))
 		{
-			close(incomesock);
 			logError("file: "__FILE__", line: %d, " \
 				"call write failed, " \
 				"errno: %d, error info: %s", \
 				__LINE__, errno, STRERROR(errno));
+			close(incomesock);
+			__sync_sub_and_fetch(&pThreadData->connection_count, 1);
+			task_connection_release();
 		}
 	}
 
 	return NULL;
 }
 
-void fdht_accept_loop(int server_sock)
+static int init_listen_entries(const char *bind_addr, const int server_sock)
+{
+	IOEventEntry *pEntry;
+	IOEventEntry *pEnd;
+	int result;
+
+	listen_entries = (IOEventEntry *)malloc(sizeof(IOEventEntry) * \
+				g_max_threads);
+	if (listen_entries == NULL)
+	{
+		logError("file: "__FILE__", line: %d, " \
+			"malloc %d bytes fail, errno: %d, error info: %s", \
+			__LINE__, (int)sizeof(IOEventEntry) * g_max_threads, \
+			errno, STRERROR(errno));
+		return errno != 0 ? errno : ENOMEM;
+	}
+	memset(listen_entries, 0, sizeof(IOEventEntry) * g_max_threads);
+
+	pEnd = listen_entries + g_max_threads;
+	for (pEntry=listen_entries; pEntry<pEnd; pEntry++)
+	{
+		pEntry->fd = -1;
+	}
+
+	for (pEntry=listen_entries; pEntry<pEnd; pEntry++)
+	{
+		pEntry->callback = accept_sock_read;
+		if (pEntry == listen_entries)
+		{
+			pEntry->fd = server_sock;
+		}
+		else
+		{
+			pEntry->fd = socketServerEx(bind_addr, g_server_port, \
+					true, &result);
+			if (pEntry->fd < 0)
+			{
+				return result;
+			}
+
+			if ((result=tcpsetserveropt(pEntry->fd, \
+				g_fdht_network_timeout)) != 0)
+			{
+				return result;
+			}
+		}
+
+		if ((result=tcpsetnonblockopt(pEntry->fd)) != 0)
+		{
+			return result;
+		}
+	}
+
+	return 0;
+}
+
+static int start_unix_accept_thread(int unix_sock)
+{
+	pthread_t tid;
+	pthread_attr_t thread_attr;
+	int result;
+
+	if ((result=init_pthread_attr(&thread_attr, g_thread_stack_size)) != 0)
+	{
+		logError("file: "__FILE__", line: %d, " \
+			"init_pthread_attr fail!", __LINE__);
+		return result;
+	}
+
+	if ((result=pthread_create(&tid, &thread_attr, \
+		accept_thread_entrance, (void *)(long)unix_sock)) != 0)
+	{
+		logError("file: "__FILE__", line: %d, " \
+			"create unix socket accept thread failed, " \
+			"errno: %d, error info: %s", \
+			__LINE__, result, STRERROR(result));
+	}
+
+	pthread_attr_destroy(&thread_attr);
+	return result;
+}
+
+void fdht_accept_loop(int server_sock, int unix_sock)
 {
+	/* the unix socket connections are passed to the work threads
+	   by the accept thread as the TCP connections */
+	if (unix_sock >= 0 && start_unix_accept_thread(unix_sock) != 0)
+	{
+		g_continue_flag = false;
+		return;
+	}
+
+	if (g_reuse_port)  //accept in the work threads
+	{
+		while (g_continue_flag)
+		{
+			sleep(1);
+		}
+		return;
+	}
+
 	if (g_accept_threads > 1)
 	{
 		pthread_t tid;
@@ -305,9 +493,28 @@ static void *work_thread_entrance(void* arg)
 void work_thread_destroy()
 {
 	wait_for_work_threads_exit();
+	store_thread_destroy();
+
+	if (listen_entries != NULL)
+	{
+		IOEventEntry *pEntry;
+		IOEventEntry *pEnd;
+
+		//the first one is the server socket closed by the caller
+		pEnd = listen_entries + g_max_threads;
+		for (pEntry=listen_entries + 1; pEntry<pEnd; pEntry++)
+		{
+			if (pEntry->fd >= 0)
+			{
+				close(pEntry->fd);
+			}
+		}
+
+		free(listen_entries);
+		listen_entries = NULL;
+	}
 
 	pthread_mutex_destroy(&work_thread_mutex);
-	pthread_mutex_destroy(&inc_thread_mutex);
 }
 
 static void wait_for_work_threads_exit()
@@ -352,7 +559,7 @@ int work_deal_task(struct fast_task_info *pTask)
 			result = 0;
 			break;
 		case FDHT_PROTO_CMD_QUIT:
-			task_finish_clean_up(pTask);
+			pTask->length = 0;  //no response
 			return 0;
 		case FDHT_PROTO_CMD_BATCH_GET:
 			result = deal_cmd_batch_get(pTask);
@@ -390,9 +597,8 @@ int work_deal_task(struct fast_task_info *pTask)
 	pHeader->status = result;
 	int2buff((int)g_current_time, pHeader->timestamp);
 	pHeader->cmd = FDHT_PROTO_CMD_RESP;
-	int2buff(pTask->length - sizeof(FDHTProtoHeader), pHeader->pkg_len);
-
-	send_add_event(pTask);
+	int2buff(pTask->length + TASK_ARG(pTask)->value_length - \
+		sizeof(FDHTProtoHeader), pHeader->pkg_len);
 
 	return 0;
 }
@@ -530,6 +736,60 @@ int work_deal_task(struct fast_task_info *pTask)
 		return EINVAL; \
 	}
 
+/* the value is sent from the hash data directly without copying,
+   the reference is released after the response sent */
+static int mpool_get_by_ref(struct fast_task_info *pTask, const int group_id, \
+		const char *full_key, const int full_key_len)
+{
+	FDHTTaskArg *pArg;
+	HashData *pHashData;
+	int old_expires;
+	int result;
+
+	if ((result=mp_get_ref(g_db_list[group_id], full_key, full_key_len, \
+               	&pHashData)) != 0)
+	{
+		pTask->length = sizeof(FDHTProtoHeader);
+		return result;
+	}
+
+	old_expires = buff2int(pHashData->value);
+	if (old_expires != FDHT_EXPIRES_NEVER && old_expires < g_current_time)
+	{
+		mp_release(pHashData);
+		pTask->length = sizeof(FDHTProtoHeader);
+		return ENOENT;
+	}
+
+	pArg = TASK_ARG(pTask);
+	pArg->value_ref = pHashData;
+	pArg->value_buff = pHashData->value + 4;
+	pArg->value_length = pHashData->value_len - 4;
+
+	pTask->length = sizeof(FDHTProtoHeader) + 4;
+	memcpy(((FDHTProtoHeader *)pTask->data)->expires, pHashData->value, 4);
+	int2buff(pArg->value_length, pTask->data+sizeof(FDHTProtoHeader));
+
+	return 0;
+}
+
+/* enlarge the task buffer for the value of the get ex */
+static int task_get_buffer_alloc(FDHTGetBuffer *pBuffer, const int value_len)
+{
+	struct fast_task_info *pTask;
+
+	pTask = (struct fast_task_info *)pBuffer->alloc_arg;
+	if (free_queue_alloc_buffer(pTask, \
+		sizeof(FDHTProtoHeader) + value_len) != 0)
+	{
+		return ENOMEM;
+	}
+
+	pBuffer->buff = pTask->data + sizeof(FDHTProtoHeader);
+	pBuffer->size = pTask->size - sizeof(FDHTProtoHeader);
+	return 0;
+}
+
 /**
 * request body format:
 *       namespace_len:  4 bytes big endian integer
@@ -557,6 +817,7 @@ static int deal_cmd_get(struct fast_task_info *pTask)
 	char full_key[FDHT_MAX_FULL_KEY_LEN];
 	char *pValue;
 	char *p;  //tmp var
+	FDHTGetBuffer get_buffer;
 	int full_key_len;
 	int value_len;
 	int result;
@@ -584,49 +845,28 @@ static int deal_cmd_get(struct fast_task_info *pTask)
 	CHECK_SUB_KEY_NAME(key_info)
 	FDHT_PACK_FULL_KEY(key_info, full_key, full_key_len, p)
 
-	pValue = pTask->data + sizeof(FDHTProtoHeader);
-	value_len = pTask->size - sizeof(FDHTProtoHeader);
-	if ((result=g_func_get(g_db_list[group_id], full_key, full_key_len, \
-               	&pValue, &value_len)) != 0)
+	if (g_store_type == FDHT_STORE_TYPE_MPOOL && \
+		new_expires == FDHT_EXPIRES_NONE)
 	{
-		if (result == ENOSPC)
-		{
-			char *pTemp;
-
-			pTemp = (char *)pTask->data;
-			pTask->data = malloc(sizeof(FDHTProtoHeader) + value_len);
-			if (pTask->data == NULL)
-			{
-				logError("file: "__FILE__", line: %d, " \
-					"malloc %d bytes failed, " \
-					"errno: %d, error info: %s", \
-					__LINE__, pTask->size, \
-					errno, STRERROR(errno));
-
-				pTask->data = pTemp;  //restore old data
-				pTask->length = sizeof(FDHTProtoHeader);
-				return ENOMEM;
-			}
-
-			memcpy(pTask->data, pTemp, sizeof(FDHTProtoHeader));
-			free(pTemp);
-			pTask->size = sizeof(FDHTProtoHeader) + value_len;
+		return mpool_get_by_ref(pTask, group_id, \
+				full_key, full_key_len);
+	}
 
-			pValue = pTask->data + sizeof(FDHTProtoHeader);
-			if ((result=g_func_get(g_db_list[group_id], full_key, \
-				full_key_len, &pValue, &value_len)) != 0)
-			{
-				pTask->length = sizeof(FDHTProtoHeader);
-				return result;
-			}
-		}
-		else
-		{
-			pTask->length = sizeof(FDHTProtoHeader);
-			return result;
-		}
+	get_buffer.buff = pTask->data + sizeof(FDHTProtoHeader);
+	get_buffer.size = pTask->size - sizeof(FDHTProtoHeader);
+	get_buffer.value_len = 0;
+	get_buffer.alloc_func = task_get_buffer_alloc;
+	get_buffer.alloc_arg = pTask;
+	if ((result=g_func_get_ex(g_db_list[group_id], full_key, \
+		full_key_len, &get_buffer)) != 0)
+	{
+		pTask->length = sizeof(FDHTProtoHeader);
+		return result;
 	}
 
+	pValue = get_buffer.buff;
+	value_len = get_buffer.value_len;
+
 	old_expires = buff2int(pValue);
 	if (old_expires != FDHT_EXPIRES_NEVER && old_expires < g_current_time)
 	{
@@ -650,24 +890,13 @@ static int deal_cmd_get(struct fast_task_info *pTask)
 }
 
 
-#define CHECK_BUFF_SIZE(pTask, old_len, value_len, new_size, pTemp) \
+#define CHECK_BUFF_SIZE(pTask, old_len, value_len, new_size) \
 			new_size = old_len + value_len + 8 * 1024; \
-			pTemp = (char *)pTask->data; \
-			pTask->data = realloc(pTask->data, new_size); \
-			if (pTask->data == NULL) \
+			if (free_queue_alloc_buffer(pTask, new_size) != 0) \
 			{ \
-				logError("file: "__FILE__", line: %d, " \
-					"realloc %d bytes failed, " \
-					"errno: %d, error info: %s", \
-					__LINE__, new_size, \
-					errno, STRERROR(errno)); \
- \
-				pTask->data = pTemp;  /* restore old data */ \
 				pTask->length = sizeof(FDHTProtoHeader); \
 				return ENOMEM; \
 			} \
- \
-			pTask->size = new_size; \
 
 static int compare_sub_key(const void *p1, const void *p2)
 {
@@ -891,17 +1120,22 @@ static int deal_cmd_batch_get(struct fast_task_info *pTask)
 	int common_fileds_len;
 	char *pObjectId;
 	char in_buff[(4 + FDHT_MAX_SUB_KEY_LEN) * FDHT_MAX_KEY_COUNT_PER_REQ];
-	char full_key[FDHT_MAX_FULL_KEY_LEN];
+	char full_keys[FDHT_MAX_FULL_KEY_LEN * FDHT_MAX_KEY_COUNT_PER_REQ];
+	FDHTBatchGetItem items[FDHT_MAX_KEY_COUNT_PER_REQ];
+	FDHTBatchGetItem *pItem;
+	FDHTBatchGetBuffer batch_buffer;
 	char szExpired[4];
+	char *pFullKey;
 	char *pValue;
 	char *pSrc;
 	char *pDest;
 	char *p;  //tmp var
 	int full_key_len;
+	int prefix_len;
+	int sub_key_len;
 	int value_len;
 	time_t current_time;
 	int result;
-	char *pTemp;
 	int old_len;
 	int new_size;
 
@@ -943,17 +1177,13 @@ static int deal_cmd_batch_get(struct fast_task_info *pTask)
 		memset(szExpired, 0, sizeof(szExpired));
 	}
 
-	success_count = 0;
-	result = 0;
-	current_time = g_current_time;
-
 	memcpy(in_buff, pObjectId + key_info.obj_id_len + 4, \
 		nInBodyLen - common_fileds_len);
 	pSrc = in_buff;
 
-	pDest = pTask->data + sizeof(FDHTProtoHeader);
-	int2buff(key_count, pDest);
-	pDest += 8;
+	/* the full keys of the batch: namespace, object id, then sub key */
+	prefix_len = key_info.namespace_len + key_info.obj_id_len + 2;
+	pFullKey = full_keys;
 	for (i=0; i<key_count; i++)
 	{
 		key_info.key_len = buff2int(pSrc);
@@ -983,53 +1213,73 @@ static int deal_cmd_batch_get(struct fast_task_info *pTask)
 
 		CHECK_SUB_KEY_NAME(key_info)
 
+		FDHT_PACK_FULL_KEY(key_info, pFullKey, full_key_len, p)
+		items[i].pKey = pFullKey;
+		items[i].key_len = full_key_len;
+		pFullKey += full_key_len;
+	}
+
+	if (nInBodyLen != common_fileds_len + (pSrc - in_buff))
+	{
+		logError("file: "__FILE__", line: %d, " \
+			"client ip: %s, body length: %d != %d", \
+			__LINE__, pTask->client_ip, nInBodyLen, \
+			common_fileds_len + (int)(pSrc - in_buff));
+		pTask->length = sizeof(FDHTProtoHeader);
+		return EINVAL;
+	}
+
+	/* all the keys are got by the store at once, the store reads them
+	   in one pass, such as one cursor walk of BDB */
+	memset(&batch_buffer, 0, sizeof(batch_buffer));
+	if ((result=g_func_batch_get(g_db_list[group_id], items, key_count, \
+			&batch_buffer)) != 0)
+	{
+		store_batch_buffer_free(&batch_buffer);
+		pTask->length = sizeof(FDHTProtoHeader);
+		return result;
+	}
+
+	success_count = 0;
+	result = 0;
+	current_time = g_current_time;
+
+	pDest = pTask->data + sizeof(FDHTProtoHeader);
+	int2buff(key_count, pDest);
+	pDest += 8;
+	for (i=0; i<key_count; i++)
+	{
+		pItem = items + i;
+		sub_key_len = pItem->key_len - prefix_len;
+
 		old_len = pDest - pTask->data;
-		value_len = 9 + key_info.key_len;
+		value_len = 9 + sub_key_len + (pItem->status == 0 ? \
+				pItem->value_len : 0);
 		if (pTask->size <= old_len + value_len)
 		{
-			CHECK_BUFF_SIZE(pTask, old_len, value_len, \
-					new_size, pTemp)
+			new_size = old_len + value_len + 8 * 1024;
+			if (free_queue_alloc_buffer(pTask, new_size) != 0)
+			{
+				store_batch_buffer_free(&batch_buffer);
+				pTask->length = sizeof(FDHTProtoHeader);
+				return ENOMEM;
+			}
 			pDest = pTask->data + old_len;
 		}
 
-		int2buff(key_info.key_len, pDest);
+		int2buff(sub_key_len, pDest);
 		pDest += 4;
-		memcpy(pDest, key_info.szKey, key_info.key_len);
-		pDest += key_info.key_len + 1;
+		memcpy(pDest, pItem->pKey + prefix_len, sub_key_len);
+		pDest += sub_key_len + 1;
 
-		FDHT_PACK_FULL_KEY(key_info, full_key, full_key_len, p)
-
-		pValue = pDest;
-		value_len = pTask->size - (pDest - pTask->data);
-		result = g_func_get(g_db_list[group_id], full_key, full_key_len, \
-				&pValue, &value_len);
-		if (result != 0)
+		if (pItem->status != 0)
 		{
-			if (result == ENOSPC)
-			{
-				old_len = pDest - pTask->data;
-
-				CHECK_BUFF_SIZE(pTask, old_len, value_len, \
-						new_size, pTemp)
-
-				pDest = pTask->data + old_len;
-
-				pValue = pDest;
-				if ((result=g_func_get(g_db_list[group_id], \
-						full_key, full_key_len, \
-						&pValue, &value_len)) != 0)
-				{
-					*(pDest-1) = result;
-					continue;
-				}
-			}
-			else
-			{
-				*(pDest-1) = result;
-				continue;
-			}
+			*(pDest-1) = result = pItem->status;
+			continue;
 		}
 
+		pValue = batch_buffer.data + pItem->value_offset;
+		value_len = pItem->value_len;
 		old_expires = buff2int(pValue);
 		if (old_expires != FDHT_EXPIRES_NEVER && \
 			old_expires < current_time)
@@ -1041,7 +1291,8 @@ static int deal_cmd_batch_get(struct fast_task_info *pTask)
 		if (new_expires != FDHT_EXPIRES_NONE)
 		{
 			if ((result = g_func_partial_set(g_db_list[group_id], \
-				full_key, full_key_len, szExpired, 0, 4)) != 0)
+				pItem->pKey, pItem->key_len, \
+				szExpired, 0, 4)) != 0)
 			{
 				*(pDest-1) = result;
 				continue;
@@ -1068,19 +1319,12 @@ static int deal_cmd_batch_get(struct fast_task_info *pTask)
 
 		success_count++;
 		*(pDest-1) = 0;
+		memcpy(pDest, pValue, value_len);
 		int2buff(value_len - 4, pDest);
 		pDest += value_len;
 	}
 
-	if (nInBodyLen != common_fileds_len + (pSrc - in_buff))
-	{
-		logError("file: "__FILE__", line: %d, " \
-			"client ip: %s, body length: %d != %d", \
-			__LINE__, pTask->client_ip, nInBodyLen, \
-			common_fileds_len + (int)(pSrc - in_buff));
-		pTask->length = sizeof(FDHTProtoHeader);
-		return EINVAL;
-	}
+	store_batch_buffer_free(&batch_buffer);
 
 	if (success_count > 0)
 	{
@@ -1799,7 +2043,6 @@ static int deal_cmd_inc(struct fast_task_info *pTask)
 	int inc;
 	char *p;  //tmp var
 	int result;
-	int lock_res;
 
 	memset(&key_info, 0, sizeof(key_info));
 	CHECK_GROUP_ID(pTask, key_hash_code, group_id, timestamp, new_expires)
@@ -1827,28 +2070,12 @@ static int deal_cmd_inc(struct fast_task_info *pTask)
 
 	FDHT_PACK_FULL_KEY(key_info, full_key, full_key_len, p)
 
-	if (g_max_threads > 1 && (lock_res=pthread_mutex_lock( \
-			&inc_thread_mutex)) != 0)
-	{
-		logError("file: "__FILE__", line: %d, " \
-			"call pthread_mutex_lock fail, " \
-			"errno: %d, error info: %s", \
-			__LINE__, lock_res, STRERROR(lock_res));
-	}
-
+	/* the store serializes the INCs of the same key: the hash bucket
+	   lock (or the mpool rwlock) for mpool, DB_RMW cursor for BDB */
 	value_len = sizeof(value) - 1;
 	result = g_func_inc_ex(g_db_list[group_id], full_key, full_key_len, inc, \
 			value, &value_len, new_expires);
 
-	if (g_max_threads > 1 && (lock_res=pthread_mutex_unlock( \
-			&inc_thread_mutex)) != 0)
-	{
-		logError("file: "__FILE__", line: %d, " \
-			"call pthread_mutex_unlock fail, " \
-			"errno: %d, error info: %s", \
-			__LINE__, lock_res, STRERROR(lock_res));
-	}
-
 	if (result == 0)
 	{
 		value_len -= 4;  //skip expires
@@ -1884,6 +2111,152 @@ static int deal_cmd_inc(struct fast_task_info *pTask)
 * response body format:
 *      key value pair: key=value, row seperate by new line (\n)
 */
+static char *stat_mpool_bytes(const int64_t bytes_used, \
+		const int64_t max_bytes, char *p)
+{
+	p += sprintf(p, "used_bytes="INT64_PRINTF_FORMAT" (%.2f%%)\n",\
+		bytes_used, (100.00 * bytes_used) / max_bytes);
+	p += sprintf(p, "max bytes="INT64_PRINTF_FORMAT" (100.00%%)\n",\
+		max_bytes);
+	p += sprintf(p, "free bytes="INT64_PRINTF_FORMAT" (%.2f%%)\n", \
+		max_bytes - bytes_used, \
+		(100.00 * (max_bytes - bytes_used)) / max_bytes);
+	return p;
+}
+
+/* the namespace is the name of the stat line, the bytes not printable,
+   the space, '=' and '%' are escaped as %XX */
+static void stat_escape_namespace(const char *szNameSpace, char *szEscaped)
+{
+	const unsigned char *pSrc;
+	char *pDest;
+
+	pDest = szEscaped;
+	for (pSrc=(const unsigned char *)szNameSpace; *pSrc!='\0'; pSrc++)
+	{
+		if (*pSrc <= ' ' || *pSrc >= 0x7F || *pSrc == '=' || \
+			*pSrc == '%')
+		{
+			pDest += sprintf(pDest, "%%%02X", *pSrc);
+		}
+		else
+		{
+			*pDest++ = *pSrc;
+		}
+	}
+	*pDest = '\0';
+}
+
+static char *stat_mpool_namespaces(char *p)
+{
+	FDHTNameSpaceStat *stats;
+	FDHTNameSpaceStat *pStat;
+	FDHTNameSpaceStat *pStatEnd;
+	char szNameSpace[3 * FDHT_MAX_NAMESPACE_LEN + 1];
+	int count;
+
+	stats = mp_namespace_stats(&count);
+	pStatEnd = stats + count;
+	for (pStat=stats; pStat<pStatEnd; pStat++)
+	{
+		if (pStat->state != FDHT_NAMESPACE_SLOT_READY || \
+			(pStat->key_count == 0 && pStat->max_bytes == 0))
+		{
+			continue;
+		}
+
+		stat_escape_namespace(pStat->szNameSpace, szNameSpace);
+		p += sprintf(p, "namespace_%s=keys: "INT64_PRINTF_FORMAT \
+			", bytes: "INT64_PRINTF_FORMAT", max_bytes: " \
+			INT64_PRINTF_FORMAT", evicted_count: " \
+			INT64_PRINTF_FORMAT", reject_count: " \
+			INT64_PRINTF_FORMAT"\n", szNameSpace, \
+			pStat->key_count, pStat->bytes_used, \
+			pStat->max_bytes, pStat->evicted_count, \
+			pStat->reject_count);
+	}
+
+	return p;
+}
+
+static char *stat_mpool_slab(FastSlabAllocator *slab, char *p)
+{
+	FastSlabClassStat stats[FAST_SLAB_MAX_CLASSES];
+	FastSlabClassStat *pStat;
+	FastSlabClassStat *pStatEnd;
+	int64_t page_bytes;
+	int64_t chunk_bytes;
+	int64_t used_bytes;
+	int count;
+
+	count = fast_slab_stat(slab, stats, FAST_SLAB_MAX_CLASSES);
+	pStatEnd = stats + count;
+	chunk_bytes = 0;
+	used_bytes = 0;
+	for (pStat=stats; pStat<pStatEnd; pStat++)
+	{
+		chunk_bytes += pStat->total_chunks * pStat->chunk_size;
+		used_bytes += pStat->used_chunks * pStat->chunk_size;
+	}
+	page_bytes = slab->total_bytes - slab->large_bytes;
+
+	p += sprintf(p, "slab_page_size=%d\n", slab->page_size);
+	p += sprintf(p, "slab_page_bytes="INT64_PRINTF_FORMAT"\n", page_bytes);
+	p += sprintf(p, "slab_used_bytes="INT64_PRINTF_FORMAT" (%.2f%%)\n", \
+		used_bytes, chunk_bytes > 0 ? \
+		(100.00 * used_bytes) / chunk_bytes : 0.00);
+	p += sprintf(p, "slab_large_count=%d\n", slab->large_count);
+	p += sprintf(p, "slab_large_bytes="INT64_PRINTF_FORMAT"\n", \
+		slab->large_bytes);
+	for (pStat=stats; pStat<pStatEnd; pStat++)
+	{
+		p += sprintf(p, "slab_class_%d=pages: %d, chunks: " \
+			INT64_PRINTF_FORMAT"/"INT64_PRINTF_FORMAT \
+			" (%.2f%%)\n", pStat->chunk_size, pStat->page_count, \
+			pStat->used_chunks, pStat->total_chunks, \
+			(100.00 * pStat->used_chunks) / pStat->total_chunks);
+	}
+
+	return p;
+}
+
+#define STAT_THREAD_LINE_SIZE  64
+
+static char *stat_connections(char *p)
+{
+	struct nio_thread_data *pThreadData;
+	struct nio_thread_data *pDataEnd;
+	int curr_connections;
+
+	curr_connections = 0;
+	pDataEnd = g_thread_data + g_max_threads;
+	for (pThreadData=g_thread_data; pThreadData<pDataEnd; pThreadData++)
+	{
+		curr_connections += pThreadData->connection_count;
+	}
+	p += sprintf(p, "curr_connections=%d\n", curr_connections);
+
+	return p;
+}
+
+/* one line of STAT_THREAD_LINE_SIZE bytes at most per work thread */
+static char *stat_thread_loads(char *p)
+{
+	struct nio_thread_data *pThreadData;
+	struct nio_thread_data *pDataEnd;
+
+	pDataEnd = g_thread_data + g_max_threads;
+	for (pThreadData=g_thread_data; pThreadData<pDataEnd; pThreadData++)
+	{
+		p += sprintf(p, "thread_%d_load=%d connections, " \
+			"%d in flight\n", (int)(pThreadData - g_thread_data), \
+			pThreadData->connection_count, \
+			pThreadData->in_flight_count);
+	}
+
+	return p;
+}
+
 static int deal_cmd_stat(struct fast_task_info *pTask)
 {
 	int nInBodyLen;
@@ -1901,6 +2274,17 @@ static int deal_cmd_stat(struct fast_task_info *pTask)
 		return EINVAL;
 	}
 
+	/* one line per slab class, namespace and work thread at most */
+	if (free_queue_alloc_buffer(pTask, sizeof(FDHTProtoHeader) + \
+			4 * 1024 + 128 * FAST_SLAB_MAX_CLASSES + \
+			128 * FDHT_MPOOL_MAX_EVICT_NAMESPACES + \
+			512 * (FDHT_MPOOL_MAX_NAMESPACES + 1) + \
+			STAT_THREAD_LINE_SIZE * g_max_threads) != 0)
+	{
+		pTask->length = sizeof(FDHTProtoHeader);
+		return ENOMEM;
+	}
+
 	p = pTask->data + sizeof(FDHTProtoHeader);
 	current_time = g_current_time;
 
@@ -1910,8 +2294,8 @@ static int deal_cmd_stat(struct fast_task_info *pTask)
 	p += sprintf(p, "uptime=%d\n", (int)(current_time-g_server_start_time));
 	p += sprintf(p, "curr_time=%d\n", (int)current_time);
 	p += sprintf(p, "max_connections=%d\n", g_max_connections);
-	p += sprintf(p, "curr_connections=%d\n", \
-			g_max_connections - free_queue_count());
+	p = stat_connections(p);
+	p = stat_thread_loads(p);
 	p += sprintf(p, "total_set_count="INT64_PRINTF_FORMAT"\n", \
 			g_server_stat.total_set_count);
 	p += sprintf(p, "success_set_count="INT64_PRINTF_FORMAT"\n", \
@@ -1935,8 +2319,7 @@ static int deal_cmd_stat(struct fast_task_info *pTask)
 		HashStat hs;
 		int stats[STAT_MAX_NUM];
 
-		if ((result=hash_stat(g_hash_array, &hs, stats, \
-					STAT_MAX_NUM)) != 0)
+		if ((result=mp_hash_stat(&hs, stats, STAT_MAX_NUM)) != 0)
 		{
 			logError("file: "__FILE__", line: %d, " \
 				"client ip: %s, call hash_stat fail, " \
@@ -1948,20 +2331,111 @@ static int deal_cmd_stat(struct fast_task_info *pTask)
 
 		p += sprintf(p, "total_items=%d\n", hs.item_count);
 		p += sprintf(p, "bucket count=%d\n", hs.capacity);
-		p += sprintf(p, "used_bytes="INT64_PRINTF_FORMAT" (%.2f%%)\n",\
-			g_hash_array->bytes_used, \
-			(100.00 * g_hash_array->bytes_used) / \
-			g_hash_array->max_bytes);
-		p += sprintf(p, "max bytes="INT64_PRINTF_FORMAT" (100.00%%)\n",\
-			g_hash_array->max_bytes);
-		p += sprintf(p, "free bytes="INT64_PRINTF_FORMAT" (%.2f%%)\n", \
-			g_hash_array->max_bytes - g_hash_array->bytes_used, \
-			(100.00 * (g_hash_array->max_bytes - \
-			g_hash_array->bytes_used)) / g_hash_array->max_bytes);
+		p = stat_mpool_bytes(hash_bytes_used(g_hash_array), \
+			g_hash_array->max_bytes, p);
 		p += sprintf(p, "bucket_used=%d\n", hs.bucket_used);
 		p += sprintf(p, "bucket_max_length=%d\n", hs.bucket_max_length);
 		p += sprintf(p, "bucket_avg_length=%.4f\n", \
 				hs.bucket_avg_length);
+		p += sprintf(p, "expire_index_items="INT64_PRINTF_FORMAT"\n", \
+				mp_expire_index_count());
+
+		if (g_mpool_evict_policy != FDHT_MPOOL_EVICT_NONE)
+		{
+			int64_t evicted_count;
+			int64_t evicted_bytes;
+			int64_t evict_fail_count;
+			int k;
+
+			mp_evict_stat(&evicted_count, &evicted_bytes, \
+					&evict_fail_count);
+			p += sprintf(p, "evicted_count="INT64_PRINTF_FORMAT \
+				"\n", evicted_count);
+			p += sprintf(p, "evicted_bytes="INT64_PRINTF_FORMAT \
+				"\n", evicted_bytes);
+			p += sprintf(p, "evict_fail_count="INT64_PRINTF_FORMAT \
+				"\n", evict_fail_count);
+			for (k=0; k<g_mpool_evict_namespace_count; k++)
+			{
+				p += sprintf(p, "evict_namespace_%d=%s, " \
+					"evicted_count: "INT64_PRINTF_FORMAT \
+					"\n", k, g_mpool_evict_namespaces[k]. \
+					szNameSpace, g_mpool_evict_namespaces[k]. \
+					evicted_count);
+			}
+		}
+
+		if (g_hash_array->slab != NULL)
+		{
+			p = stat_mpool_slab(g_hash_array->slab, p);
+		}
+
+		if (g_mpool_namespace_stat)
+		{
+			p = stat_mpool_namespaces(p);
+		}
+	}
+	else if (g_store_type == FDHT_STORE_TYPE_MPOOL_FLAT)
+	{
+		FlatHashStat fs;
+
+		if ((result=fl_hash_stat(&fs)) != 0)
+		{
+			logError("file: "__FILE__", line: %d, " \
+				"client ip: %s, call flat_hash_stat fail, " \
+				"errno: %d, error info: %s", __LINE__, \
+				pTask->client_ip, result, STRERROR(result));
+			pTask->length = sizeof(FDHTProtoHeader);
+			return result;
+		}
+
+		p += sprintf(p, "total_items=%d\n", fs.item_count);
+		p += sprintf(p, "slot count=%u\n", fs.capacity);
+		p = stat_mpool_bytes(flat_hash_bytes_used(g_flat_table), \
+			g_flat_table->max_bytes, p);
+		p += sprintf(p, "slot_deleted=%d\n", fs.deleted_count);
+		p += sprintf(p, "group_used=%d\n", fs.group_used);
+		p += sprintf(p, "probe_max_groups=%d\n", fs.probe_max_groups);
+		p += sprintf(p, "probe_avg_groups=%.4f\n", \
+				fs.probe_avg_groups);
+
+		if (g_flat_table->slab != NULL)
+		{
+			p = stat_mpool_slab(g_flat_table->slab, p);
+		}
+	}
+	else if (g_store_type == FDHT_STORE_TYPE_HYBRID)
+	{
+		FDHTHybridStat hs;
+		int64_t get_count;
+
+		hy_cache_stat(&hs);
+		get_count = hs.hit_count + hs.miss_count;
+		p += sprintf(p, "cache_items=%d\n", hash_count(g_hybrid_cache));
+		p = stat_mpool_bytes(hash_bytes_used(g_hybrid_cache), \
+			g_hybrid_cache->max_bytes, p);
+		p += sprintf(p, "cache_hit_count="INT64_PRINTF_FORMAT \
+			" (%.2f%%)\n", hs.hit_count, get_count > 0 ? \
+			(100.00 * hs.hit_count) / get_count : 0.00);
+		p += sprintf(p, "cache_miss_count="INT64_PRINTF_FORMAT"\n", \
+			hs.miss_count);
+		p += sprintf(p, "cache_admit_count="INT64_PRINTF_FORMAT"\n", \
+			hs.admit_count);
+		p += sprintf(p, "cache_reject_count="INT64_PRINTF_FORMAT"\n",\
+			hs.reject_count);
+		p += sprintf(p, "cache_evicted_count="INT64_PRINTF_FORMAT \
+			"\n", hs.evicted_count);
+		p += sprintf(p, "cache_evicted_bytes="INT64_PRINTF_FORMAT \
+			"\n", hs.evicted_bytes);
+		p += sprintf(p, "cache_fill_fail_count="INT64_PRINTF_FORMAT \
+			"\n", hs.fill_fail_count);
+		p += sprintf(p, "cache_expired_count="INT64_PRINTF_FORMAT \
+			"\n", hs.expired_count);
+
+		if (g_hybrid_cache->slab != NULL)
+		{
+			p = stat_mpool_slab(g_hybrid_cache->slab, p);
+		}
 	}
 
 	pTask->length = p - pTask->data;
@@ -21,8 +21,8 @@
 extern "C" {
 #endif
 
-int work_thread_init();
-void fdht_accept_loop(int server_sock);
+int work_thread_init(const char *bind_addr, const int server_sock);
+void fdht_accept_loop(int server_sock, int unix_sock);
 void work_thread_destroy();
 int work_deal_task(struct fast_task_info *pTask);
 
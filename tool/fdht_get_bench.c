@@ -0,0 +1,351 @@
+/**
+* Copyright (C) 2008 Happy Fish / YuQing
+*
+* FastDHT may be copied only under the terms of the GNU General
+* Public License V3.  Please visit the FastDHT Home Page
+* http://www.csource.org/ for more detail.
+**/
+
+/* scaling benchmark of the GET path of the mpool store, mixed with SETs:
+   rwlock:   the reads under the global rwlock (mpool_htable_lock_count
+             is 0), the writes under the write lock
+   bucket:   the reads under the hash bucket lock and a reference
+   lockfree: the reads without lock in an epoch (mpool_lockfree_get),
+             the writes under the hash bucket lock */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include "hash.h"
+#include "fast_epoch.h"
+
+#define BENCH_MODE_RWLOCK    0
+#define BENCH_MODE_BUCKET    1
+#define BENCH_MODE_LOCKFREE  2
+
+#define BENCH_MAX_THREADS  256
+#define BENCH_VALUE_SIZE   64
+
+typedef struct
+{
+	int thread_index;
+	int mode;
+	int64_t get_count;
+	int64_t set_count;
+	int64_t bad_count;  //the values torn or freed
+} BenchThreadArg;
+
+static HashArray bench_hash;
+static pthread_rwlock_t bench_rwlock;
+static int key_count = 100000;
+static int64_t ops_per_thread = 1000000;
+static int set_percent = 5;
+static int lock_count = 1361;
+
+static const char *mode_captions[] = {"rwlock", "bucket", "lockfree"};
+
+static int64_t get_current_time_us()
+{
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return (int64_t)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+/* value: the stamp, the key, then the fill char decided by the stamp */
+static int make_value(char *value, const char *key, const int key_len, \
+		const unsigned int stamp)
+{
+	memcpy(value, &stamp, sizeof(stamp));
+	memcpy(value + sizeof(stamp), key, key_len);
+	memset(value + sizeof(stamp) + key_len, 'a' + stamp % 26, \
+		BENCH_VALUE_SIZE - (sizeof(stamp) + key_len));
+	return BENCH_VALUE_SIZE;
+}
+
+static bool check_value(const char *value, const int value_len, \
+		const char *key, const int key_len)
+{
+	unsigned int stamp;
+	const char *p;
+	const char *pEnd;
+
+	if (value_len != BENCH_VALUE_SIZE)
+	{
+		return false;
+	}
+
+	memcpy(&stamp, value, sizeof(stamp));
+	if (memcmp(value + sizeof(stamp), key, key_len) != 0)
+	{
+		return false;
+	}
+
+	pEnd = value + value_len;
+	for (p=value + sizeof(stamp) + key_len; p<pEnd; p++)
+	{
+		if (*p != 'a' + stamp % 26)
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+static bool bench_get(const int mode, const char *key, const int key_len, \
+		char *value, int *value_len)
+{
+	HashData *hash_data;
+	FastEpochThread *pThread;
+	bool found;
+
+	found = false;
+	if (mode == BENCH_MODE_RWLOCK)
+	{
+		pthread_rwlock_rdlock(&bench_rwlock);
+		hash_data = hash_find_ex(&bench_hash, key, key_len);
+		if (hash_data != NULL)
+		{
+			*value_len = hash_data->value_len;
+			memcpy(value, hash_data->value, hash_data->value_len);
+			found = true;
+		}
+		pthread_rwlock_unlock(&bench_rwlock);
+	}
+	else if (mode == BENCH_MODE_BUCKET)
+	{
+		hash_data = hash_find_ref(&bench_hash, key, key_len);
+		if (hash_data != NULL)
+		{
+			*value_len = hash_data->value_len;
+			memcpy(value, hash_data->value, hash_data->value_len);
+			hash_release(&bench_hash, hash_data);
+			found = true;
+		}
+	}
+	else
+	{
+		if ((pThread=fast_epoch_enter(bench_hash.epoch)) == NULL)
+		{
+			return false;
+		}
+		hash_data = hash_find_lockfree(&bench_hash, key, key_len);
+		if (hash_data != NULL)
+		{
+			*value_len = hash_data->value_len;
+			memcpy(value, hash_data->value, hash_data->value_len);
+			found = true;
+		}
+		fast_epoch_leave(pThread);
+	}
+
+	return found;
+}
+
+static void *bench_thread_entrance(void *arg)
+{
+	BenchThreadArg *pArg;
+	char key[32];
+	char value[BENCH_VALUE_SIZE];
+	int key_len;
+	int value_len;
+	unsigned int seed;
+	int64_t i;
+
+	pArg = (BenchThreadArg *)arg;
+	seed = pArg->thread_index + 1;
+	for (i=0; i<ops_per_thread; i++)
+	{
+		key_len = sprintf(key, "user_%d", rand_r(&seed) % key_count);
+		if (rand_r(&seed) % 100 < set_percent)
+		{
+			value_len = make_value(value, key, key_len, \
+					rand_r(&seed));
+			if (pArg->mode == BENCH_MODE_RWLOCK)
+			{
+				pthread_rwlock_wrlock(&bench_rwlock);
+			}
+			hash_insert_ex(&bench_hash, key, key_len, \
+				value, value_len, true);
+			if (pArg->mode == BENCH_MODE_RWLOCK)
+			{
+				pthread_rwlock_unlock(&bench_rwlock);
+			}
+			pArg->set_count++;
+			continue;
+		}
+
+		if (!bench_get(pArg->mode, key, key_len, value, &value_len) \
+			|| !check_value(value, value_len, key, key_len))
+		{
+			pArg->bad_count++;
+		}
+		pArg->get_count++;
+	}
+
+	return NULL;
+}
+
+static int run_bench(const int mode, const int thread_count)
+{
+	pthread_t tids[BENCH_MAX_THREADS];
+	BenchThreadArg args[BENCH_MAX_THREADS];
+	char key[32];
+	char value[BENCH_VALUE_SIZE];
+	int64_t start_time;
+	int64_t time_used;
+	int64_t get_count;
+	int64_t set_count;
+	int64_t bad_count;
+	int key_len;
+	int result;
+	int i;
+
+	if ((result=hash_init_ex(&bench_hash, Time33Hash, key_count, \
+			0.00, 0, true)) != 0)
+	{
+		fprintf(stderr, "hash_init_ex fail, " \
+			"errno: %d, error info: %s\n", \
+			result, strerror(result));
+		return result;
+	}
+	if (mode != BENCH_MODE_RWLOCK && (result=hash_set_locks( \
+			&bench_hash, lock_count)) != 0)
+	{
+		fprintf(stderr, "hash_set_locks fail, " \
+			"errno: %d, error info: %s\n", \
+			result, strerror(result));
+		hash_destroy(&bench_hash);
+		return result;
+	}
+	if (mode == BENCH_MODE_LOCKFREE && (result=hash_set_epoch( \
+			&bench_hash)) != 0)
+	{
+		fprintf(stderr, "hash_set_epoch fail, " \
+			"errno: %d, error info: %s\n", \
+			result, strerror(result));
+		hash_destroy(&bench_hash);
+		return result;
+	}
+
+	for (i=0; i<key_count; i++)
+	{
+		key_len = sprintf(key, "user_%d", i);
+		make_value(value, key, key_len, i);
+		if ((result=hash_insert_ex(&bench_hash, key, key_len, \
+			value, BENCH_VALUE_SIZE, true)) < 0)
+		{
+			fprintf(stderr, "hash_insert_ex fail, errno: %d\n", \
+				-1 * result);
+			hash_destroy(&bench_hash);
+			return -1 * result;
+		}
+	}
+
+	memset(args, 0, sizeof(BenchThreadArg) * thread_count);
+	start_time = get_current_time_us();
+	for (i=0; i<thread_count; i++)
+	{
+		args[i].thread_index = i;
+		args[i].mode = mode;
+		if ((result=pthread_create(tids + i, NULL, \
+			bench_thread_entrance, args + i)) != 0)
+		{
+			fprintf(stderr, "pthread_create fail, " \
+				"errno: %d, error info: %s\n", \
+				result, strerror(result));
+			exit(result);
+		}
+	}
+	for (i=0; i<thread_count; i++)
+	{
+		pthread_join(tids[i], NULL);
+	}
+	time_used = get_current_time_us() - start_time;
+
+	get_count = 0;
+	set_count = 0;
+	bad_count = 0;
+	for (i=0; i<thread_count; i++)
+	{
+		get_count += args[i].get_count;
+		set_count += args[i].set_count;
+		bad_count += args[i].bad_count;
+	}
+
+	printf("%-8s: threads=%d, keys=%d, gets=%"PRId64", sets=%"PRId64", " \
+		"time used=%"PRId64" ms, %.0f gets/s%s\n", \
+		mode_captions[mode], thread_count, key_count, get_count, \
+		set_count, time_used / 1000, time_used > 0 ? \
+		(double)get_count * 1000000 / time_used : 0, \
+		bad_count == 0 ? "" : ", BAD VALUES!");
+
+	hash_destroy(&bench_hash);
+	return bad_count == 0 ? 0 : EFAULT;
+}
+
+int main(int argc, char *argv[])
+{
+	int max_threads;
+	int thread_count;
+	int mode;
+	int result;
+
+	if (argc >= 2 && (strcmp(argv[1], "-h") == 0 || \
+		strcmp(argv[1], "--help") == 0))
+	{
+		printf("Usage: %s [max_threads=32] [keys=100000] " \
+			"[ops_per_thread=1000000] [set_percent=5] " \
+			"[lock_count=1361]\n", argv[0]);
+		return 0;
+	}
+
+	max_threads = argc >= 2 ? atoi(argv[1]) : 32;
+	if (argc >= 3)
+	{
+		key_count = atoi(argv[2]);
+	}
+	if (argc >= 4)
+	{
+		ops_per_thread = strtoll(argv[3], NULL, 10);
+	}
+	if (argc >= 5)
+	{
+		set_percent = atoi(argv[4]);
+	}
+	if (argc >= 6)
+	{
+		lock_count = atoi(argv[5]);
+	}
+	if (max_threads <= 0 || max_threads > BENCH_MAX_THREADS || \
+		key_count <= 0 || ops_per_thread <= 0 || set_percent < 0 || \
+		set_percent > 100 || lock_count <= 0)
+	{
+		fprintf(stderr, "invalid parameters!\n");
+		return EINVAL;
+	}
+
+	if ((result=pthread_rwlock_init(&bench_rwlock, NULL)) != 0)
+	{
+		return result;
+	}
+
+	for (thread_count=1; thread_count<=max_threads; thread_count*=2)
+	{
+		for (mode=BENCH_MODE_RWLOCK; mode<=BENCH_MODE_LOCKFREE; mode++)
+		{
+			if ((result=run_bench(mode, thread_count)) != 0)
+			{
+				return result;
+			}
+		}
+	}
+
+	pthread_rwlock_destroy(&bench_rwlock);
+	return 0;
+}
+
@@ -0,0 +1,313 @@
+/**
+* Copyright (C) 2008 Happy Fish / YuQing
+*
+* FastDHT may be copied only under the terms of the GNU General
+* Public License V3.  Please visit the FastDHT Home Page
+* http://www.csource.org/ for more detail.
+**/
+
+/* micro benchmark of the mpool hash tables:
+   chained: the chained hash table of hash.c (store_type = MPOOL)
+   flat:    the open addressing table of flat_hash.c
+            (store_type = MPOOL_FLAT)
+   the hash function is time33 or wyhash as mpool_hash_function */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <sys/time.h>
+#include "hash.h"
+#include "flat_hash.h"
+
+#define BENCH_KEY_SIZE    64
+#define BENCH_VALUE_SIZE  16
+
+typedef struct
+{
+	char key[BENCH_KEY_SIZE];
+	int key_len;
+} BenchKey;
+
+static HashFunc bench_hash_func = Time33Hash;
+
+static int64_t get_current_time_us()
+{
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return (int64_t)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+/* the full key of fdhtd: namespace + object id + key */
+static BenchKey *make_keys(const int key_count, const int start)
+{
+	BenchKey *keys;
+	int i;
+
+	keys = (BenchKey *)malloc(sizeof(BenchKey) * key_count);
+	if (keys == NULL)
+	{
+		fprintf(stderr, "malloc %d bytes fail\n", \
+			(int)sizeof(BenchKey) * key_count);
+		return NULL;
+	}
+
+	for (i=0; i<key_count; i++)
+	{
+		keys[i].key_len = sprintf(keys[i].key, "user%dprofile%dname", \
+				(start + i) / 16, (start + i) % 16);
+	}
+
+	/* random order, the lookups do not walk the memory sequentially */
+	for (i=key_count-1; i>0; i--)
+	{
+		BenchKey temp;
+		int k;
+
+		k = rand() % (i + 1);
+		temp = keys[i];
+		keys[i] = keys[k];
+		keys[k] = temp;
+	}
+
+	return keys;
+}
+
+static void print_result(const char *caption, const char *op, \
+		const int count, const int64_t time_used, const int found)
+{
+	printf("%s %-6s count=%d, found=%d, time used=%"PRId64" ms, " \
+		"%.2f ns per op\n", caption, op, count, found, \
+		time_used / 1000, (double)time_used * 1000 / count);
+}
+
+static int bench_chained(BenchKey *keys, BenchKey *miss_keys, \
+		const int key_count, const int loops)
+{
+	HashArray hash;
+	char value[BENCH_VALUE_SIZE];
+	int64_t start_time;
+	int found;
+	int result;
+	int i;
+	int k;
+
+	if ((result=hash_init_ex(&hash, bench_hash_func, 10000, 0.75, \
+			0, true)) != 0)
+	{
+		fprintf(stderr, "hash_init_ex fail, errno: %d\n", result);
+		return result;
+	}
+
+	memset(value, 'v', sizeof(value));
+	start_time = get_current_time_us();
+	for (i=0; i<key_count; i++)
+	{
+		if ((result=hash_insert_ex(&hash, keys[i].key, \
+			keys[i].key_len, value, sizeof(value), false)) < 0)
+		{
+			fprintf(stderr, "hash_insert_ex fail, errno: %d\n", \
+				-1 * result);
+			hash_destroy(&hash);
+			return -1 * result;
+		}
+	}
+	print_result("chained", "insert", key_count, \
+		get_current_time_us() - start_time, key_count);
+
+	/* the incremental rehash is completed before the lookups */
+	while (hash_rehash_step(&hash, 1024) != 0)
+	{
+	}
+
+	found = 0;
+	start_time = get_current_time_us();
+	for (k=0; k<loops; k++)
+	{
+		for (i=0; i<key_count; i++)
+		{
+			if (hash_find_ex(&hash, keys[i].key, \
+				keys[i].key_len) != NULL)
+			{
+				found++;
+			}
+		}
+	}
+	print_result("chained", "hit", key_count * loops, \
+		get_current_time_us() - start_time, found);
+
+	found = 0;
+	start_time = get_current_time_us();
+	for (k=0; k<loops; k++)
+	{
+		for (i=0; i<key_count; i++)
+		{
+			if (hash_find_ex(&hash, miss_keys[i].key, \
+				miss_keys[i].key_len) != NULL)
+			{
+				found++;
+			}
+		}
+	}
+	print_result("chained", "miss", key_count * loops, \
+		get_current_time_us() - start_time, found);
+
+	found = 0;
+	start_time = get_current_time_us();
+	for (i=0; i<key_count; i++)
+	{
+		if (hash_delete(&hash, keys[i].key, keys[i].key_len) == 0)
+		{
+			found++;
+		}
+	}
+	print_result("chained", "delete", key_count, \
+		get_current_time_us() - start_time, found);
+
+	hash_destroy(&hash);
+	return 0;
+}
+
+static int bench_flat(BenchKey *keys, BenchKey *miss_keys, \
+		const int key_count, const int loops)
+{
+	FlatHashTable table;
+	FlatHashStat stat;
+	char value[BENCH_VALUE_SIZE];
+	int64_t start_time;
+	int found;
+	int result;
+	int i;
+	int k;
+
+	if ((result=flat_hash_init(&table, bench_hash_func, 10000, 0)) != 0)
+	{
+		fprintf(stderr, "flat_hash_init fail, errno: %d\n", result);
+		return result;
+	}
+
+	memset(value, 'v', sizeof(value));
+	start_time = get_current_time_us();
+	for (i=0; i<key_count; i++)
+	{
+		if ((result=flat_hash_insert(&table, keys[i].key, \
+			keys[i].key_len, value, sizeof(value))) < 0)
+		{
+			fprintf(stderr, "flat_hash_insert fail, errno: %d\n", \
+				-1 * result);
+			flat_hash_destroy(&table);
+			return -1 * result;
+		}
+	}
+	print_result("flat   ", "insert", key_count, \
+		get_current_time_us() - start_time, key_count);
+
+	found = 0;
+	start_time = get_current_time_us();
+	for (k=0; k<loops; k++)
+	{
+		for (i=0; i<key_count; i++)
+		{
+			if (flat_hash_find(&table, keys[i].key, \
+				keys[i].key_len) != NULL)
+			{
+				found++;
+			}
+		}
+	}
+	print_result("flat   ", "hit", key_count * loops, \
+		get_current_time_us() - start_time, found);
+
+	found = 0;
+	start_time = get_current_time_us();
+	for (k=0; k<loops; k++)
+	{
+		for (i=0; i<key_count; i++)
+		{
+			if (flat_hash_find(&table, miss_keys[i].key, \
+				miss_keys[i].key_len) != NULL)
+			{
+				found++;
+			}
+		}
+	}
+	print_result("flat   ", "miss", key_count * loops, \
+		get_current_time_us() - start_time, found);
+
+	flat_hash_stat(&table, &stat);
+	printf("flat    slots=%u, items=%d, probe_avg_groups=%.4f, " \
+		"probe_max_groups=%d\n", stat.capacity, stat.item_count, \
+		stat.probe_avg_groups, stat.probe_max_groups);
+
+	found = 0;
+	start_time = get_current_time_us();
+	for (i=0; i<key_count; i++)
+	{
+		if (flat_hash_delete(&table, keys[i].key, keys[i].key_len) == 0)
+		{
+			found++;
+		}
+	}
+	print_result("flat   ", "delete", key_count, \
+		get_current_time_us() - start_time, found);
+
+	flat_hash_destroy(&table);
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	BenchKey *keys;
+	BenchKey *miss_keys;
+	int key_count;
+	int loops;
+	int result;
+
+	if (argc >= 2 && (strcmp(argv[1], "-h") == 0 || \
+		strcmp(argv[1], "--help") == 0))
+	{
+		printf("Usage: %s [keys=1000000] [lookup_loops=5] " \
+			"[hash_function=time33|wyhash]\n", argv[0]);
+		return 0;
+	}
+
+	key_count = argc >= 2 ? atoi(argv[1]) : 1000000;
+	loops = argc >= 3 ? atoi(argv[2]) : 5;
+	if (key_count <= 0 || loops <= 0)
+	{
+		fprintf(stderr, "invalid parameters!\n");
+		return EINVAL;
+	}
+
+	if (argc >= 4)
+	{
+		if (strcmp(argv[3], "wyhash") == 0)
+		{
+			bench_hash_func = WyHash;
+		}
+		else if (strcmp(argv[3], "time33") != 0)
+		{
+			fprintf(stderr, "invalid hash function: %s\n", argv[3]);
+			return EINVAL;
+		}
+	}
+
+	srand(1);
+	keys = make_keys(key_count, 0);
+	miss_keys = make_keys(key_count, key_count);
+	if (keys == NULL || miss_keys == NULL)
+	{
+		return ENOMEM;
+	}
+
+	if ((result=bench_chained(keys, miss_keys, key_count, loops)) == 0)
+	{
+		result = bench_flat(keys, miss_keys, key_count, loops);
+	}
+
+	free(keys);
+	free(miss_keys);
+	return result;
+}
+
@@ -0,0 +1,220 @@
+/**
+* Copyright (C) 2008 Happy Fish / YuQing
+*
+* FastDHT may be copied only under the terms of the GNU General
+* Public License V3.  Please visit the FastDHT Home Page
+* http://www.csource.org/ for more detail.
+**/
+
+/* scaling benchmark of the INC path of the mpool store:
+   global: every INC is serialized by one mutex (the old inc_thread_mutex)
+   bucket: the INC runs under the hash bucket lock only */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include "hash.h"
+
+#define BENCH_MODE_GLOBAL  0
+#define BENCH_MODE_BUCKET  1
+
+#define BENCH_MAX_THREADS  256
+
+typedef struct
+{
+	int thread_index;
+	int mode;
+} BenchThreadArg;
+
+static HashArray bench_hash;
+static pthread_mutex_t global_inc_lock;
+static int key_count = 100000;
+static int64_t incs_per_thread = 1000000;
+static int lock_count = 163;
+
+static int64_t get_current_time_us()
+{
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return (int64_t)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+static void *bench_thread_entrance(void *arg)
+{
+	BenchThreadArg *pArg;
+	char key[32];
+	char value[32];
+	int key_len;
+	int value_len;
+	unsigned int seed;
+	int64_t i;
+
+	pArg = (BenchThreadArg *)arg;
+	seed = pArg->thread_index + 1;
+	for (i=0; i<incs_per_thread; i++)
+	{
+		key_len = sprintf(key, "counter_%d", rand_r(&seed) % key_count);
+		value_len = sizeof(value) - 1;
+		if (pArg->mode == BENCH_MODE_GLOBAL)
+		{
+			pthread_mutex_lock(&global_inc_lock);
+			hash_inc(&bench_hash, key, key_len, 1, value, &value_len);
+			pthread_mutex_unlock(&global_inc_lock);
+		}
+		else
+		{
+			hash_inc(&bench_hash, key, key_len, 1, value, &value_len);
+		}
+	}
+
+	return NULL;
+}
+
+static int64_t sum_counters()
+{
+	char key[32];
+	char value[32];
+	HashData *hash_data;
+	int64_t total;
+	int key_len;
+	int i;
+
+	total = 0;
+	for (i=0; i<key_count; i++)
+	{
+		key_len = sprintf(key, "counter_%d", i);
+		hash_data = hash_find_ex(&bench_hash, key, key_len);
+		if (hash_data == NULL || hash_data->value_len >= sizeof(value))
+		{
+			continue;
+		}
+
+		memcpy(value, hash_data->value, hash_data->value_len);
+		value[hash_data->value_len] = '\0';
+		total += strtoll(value, NULL, 10);
+	}
+
+	return total;
+}
+
+static int run_bench(const int mode, const int thread_count)
+{
+	pthread_t tids[BENCH_MAX_THREADS];
+	BenchThreadArg args[BENCH_MAX_THREADS];
+	int64_t start_time;
+	int64_t time_used;
+	int64_t total_incs;
+	int64_t total;
+	int result;
+	int i;
+
+	if ((result=hash_init_ex(&bench_hash, Time33Hash, key_count, \
+			0.00, 0, true)) != 0)
+	{
+		fprintf(stderr, "hash_init_ex fail, " \
+			"errno: %d, error info: %s\n", \
+			result, strerror(result));
+		return result;
+	}
+	if (mode == BENCH_MODE_BUCKET && (result=hash_set_locks( \
+			&bench_hash, lock_count)) != 0)
+	{
+		fprintf(stderr, "hash_set_locks fail, " \
+			"errno: %d, error info: %s\n", \
+			result, strerror(result));
+		hash_destroy(&bench_hash);
+		return result;
+	}
+
+	start_time = get_current_time_us();
+	for (i=0; i<thread_count; i++)
+	{
+		args[i].thread_index = i;
+		args[i].mode = mode;
+		if ((result=pthread_create(tids + i, NULL, \
+			bench_thread_entrance, args + i)) != 0)
+		{
+			fprintf(stderr, "pthread_create fail, " \
+				"errno: %d, error info: %s\n", \
+				result, strerror(result));
+			exit(result);
+		}
+	}
+	for (i=0; i<thread_count; i++)
+	{
+		pthread_join(tids[i], NULL);
+	}
+	time_used = get_current_time_us() - start_time;
+
+	total_incs = incs_per_thread * thread_count;
+	total = sum_counters();
+	printf("%s: threads=%d, keys=%d, incs=%"PRId64", " \
+		"time used=%"PRId64" ms, %.0f incs/s%s\n", \
+		mode == BENCH_MODE_GLOBAL ? "global" : "bucket", \
+		thread_count, key_count, total_incs, time_used / 1000, \
+		time_used > 0 ? (double)total_incs * 1000000 / time_used : 0, \
+		total == total_incs ? "" : ", LOST UPDATES!");
+
+	hash_destroy(&bench_hash);
+	return total == total_incs ? 0 : EFAULT;
+}
+
+int main(int argc, char *argv[])
+{
+	int max_threads;
+	int thread_count;
+	int result;
+
+	if (argc >= 2 && (strcmp(argv[1], "-h") == 0 || \
+		strcmp(argv[1], "--help") == 0))
+	{
+		printf("Usage: %s [max_threads=8] [keys=100000] " \
+			"[incs_per_thread=1000000] [lock_count=163]\n", \
+			argv[0]);
+		return 0;
+	}
+
+	max_threads = argc >= 2 ? atoi(argv[1]) : 8;
+	if (argc >= 3)
+	{
+		key_count = atoi(argv[2]);
+	}
+	if (argc >= 4)
+	{
+		incs_per_thread = strtoll(argv[3], NULL, 10);
+	}
+	if (argc >= 5)
+	{
+		lock_count = atoi(argv[4]);
+	}
+	if (max_threads <= 0 || max_threads > BENCH_MAX_THREADS || \
+		key_count <= 0 || incs_per_thread <= 0 || lock_count <= 0)
+	{
+		fprintf(stderr, "invalid parameters!\n");
+		return EINVAL;
+	}
+
+	if ((result=pthread_mutex_init(&global_inc_lock, NULL)) != 0)
+	{
+		return result;
+	}
+
+	for (thread_count=1; thread_count<=max_threads; thread_count*=2)
+	{
+		if ((result=run_bench(BENCH_MODE_GLOBAL, thread_count)) != 0)
+		{
+			return result;
+		}
+		if ((result=run_bench(BENCH_MODE_BUCKET, thread_count)) != 0)
+		{
+			return result;
+		}
+	}
+
+	pthread_mutex_destroy(&global_inc_lock);
+	return 0;
+}
@@ -0,0 +1,198 @@
+/**
+* Copyright (C) 2008 Happy Fish / YuQing
+*
+* FastDHT may be copied only under the terms of the GNU General
+* Public License V3.  Please visit the FastDHT Home Page
+* http://www.csource.org/ for more detail.
+**/
+
+/* micro benchmark of the idle timeout tracking of the nio threads:
+   eager: the timer entry is modified on every recv / send loop
+   lazy:  only the last active time is recorded, the timer entry
+          is re-armed when it expires */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <inttypes.h>
+#include <sys/time.h>
+#include "fast_timer.h"
+
+#define BENCH_MODE_EAGER  0
+#define BENCH_MODE_LAZY   1
+
+#define BENCH_LOOPS_PER_REQUEST  3  //recv twice (the last one EAGAIN), send once
+
+typedef struct
+{
+	FastTimerEntry timer;
+	int64_t last_active;
+} BenchConnection;
+
+static int network_timeout = 30;
+
+static int64_t get_current_time_us()
+{
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return (int64_t)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+static void deal_timeouts(FastTimer *timer, FastTimerEntry *head, \
+		const int64_t current_time, const int mode, int *rearm_count)
+{
+	FastTimerEntry *entry;
+	FastTimerEntry *current;
+	BenchConnection *pConn;
+
+	entry = head->next;
+	while (entry != NULL)
+	{
+		current = entry;
+		entry = entry->next;
+
+		pConn = (BenchConnection *)current->data;
+		if (mode == BENCH_MODE_LAZY && pConn->last_active + \
+			network_timeout >= current_time)
+		{
+			(*rearm_count)++;
+			current->expires = pConn->last_active + network_timeout;
+		}
+		else  //the idle connection, keep alive
+		{
+			current->expires = current_time + network_timeout;
+		}
+		fast_timer_add(timer, current);
+	}
+}
+
+static int run_bench(const int mode, const int conn_count, \
+		const int64_t request_count, const int reqs_per_second)
+{
+	FastTimer timer;
+	FastTimerEntry head;
+	BenchConnection *connections;
+	BenchConnection *pConn;
+	int64_t current_time;
+	int64_t start_time;
+	int64_t time_used;
+	int64_t i;
+	unsigned int seed;
+	int rearm_count;
+	int k;
+	int result;
+
+	current_time = time(NULL);
+	if ((result=fast_timer_init(&timer, 2 * network_timeout, \
+			current_time)) != 0)
+	{
+		fprintf(stderr, "fast_timer_init fail, " \
+			"errno: %d, error info: %s\n", \
+			result, strerror(result));
+		return result;
+	}
+
+	connections = (BenchConnection *)malloc(sizeof(BenchConnection) * \
+				conn_count);
+	if (connections == NULL)
+	{
+		fprintf(stderr, "malloc %d bytes fail\n", \
+			(int)sizeof(BenchConnection) * conn_count);
+		fast_timer_destroy(&timer);
+		return ENOMEM;
+	}
+	memset(connections, 0, sizeof(BenchConnection) * conn_count);
+	for (pConn=connections; pConn<connections + conn_count; pConn++)
+	{
+		pConn->timer.data = pConn;
+		pConn->timer.expires = current_time + network_timeout;
+		pConn->last_active = current_time;
+		fast_timer_add(&timer, &pConn->timer);
+	}
+
+	seed = 1;
+	rearm_count = 0;
+	start_time = get_current_time_us();
+	for (i=0; i<request_count; i++)
+	{
+		if (i > 0 && i % reqs_per_second == 0)
+		{
+			current_time++;
+			if (fast_timer_timeouts_get(&timer, current_time, \
+					&head) > 0)
+			{
+				deal_timeouts(&timer, &head, current_time, \
+						mode, &rearm_count);
+			}
+		}
+
+		pConn = connections + rand_r(&seed) % conn_count;
+		for (k=0; k<BENCH_LOOPS_PER_REQUEST; k++)
+		{
+			if (mode == BENCH_MODE_EAGER)
+			{
+				fast_timer_modify(&timer, &pConn->timer, \
+					current_time + network_timeout);
+			}
+			else if (k != 1)  //once per recv / send callback
+			{
+				pConn->last_active = current_time;
+			}
+		}
+	}
+	time_used = get_current_time_us() - start_time;
+
+	printf("%s: connections=%d, requests=%"PRId64", " \
+		"requests/second=%d, rearm count=%d, " \
+		"time used=%"PRId64" ms, %.2f ns per request\n", \
+		mode == BENCH_MODE_EAGER ? "eager" : "lazy ", \
+		conn_count, request_count, reqs_per_second, rearm_count, \
+		time_used / 1000, (double)time_used * 1000 / request_count);
+
+	free(connections);
+	fast_timer_destroy(&timer);
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	int conn_count;
+	int64_t request_count;
+	int reqs_per_second;
+	int result;
+
+	if (argc >= 2 && (strcmp(argv[1], "-h") == 0 || \
+		strcmp(argv[1], "--help") == 0))
+	{
+		printf("Usage: %s [connections=10000] [requests=50000000] " \
+			"[requests_per_second=100000] [network_timeout=30]\n", \
+			argv[0]);
+		return 0;
+	}
+
+	conn_count = argc >= 2 ? atoi(argv[1]) : 10000;
+	request_count = argc >= 3 ? strtoll(argv[2], NULL, 10) : 50000000;
+	reqs_per_second = argc >= 4 ? atoi(argv[3]) : 100000;
+	if (argc >= 5)
+	{
+		network_timeout = atoi(argv[4]);
+	}
+	if (conn_count <= 0 || request_count <= 0 || reqs_per_second <= 0 \
+		|| network_timeout <= 0)
+	{
+		fprintf(stderr, "invalid parameters!\n");
+		return EINVAL;
+	}
+
+	if ((result=run_bench(BENCH_MODE_EAGER, conn_count, request_count, \
+			reqs_per_second)) != 0)
+	{
+		return result;
+	}
+
+	return run_bench(BENCH_MODE_LAZY, conn_count, request_count, \
+			reqs_per_second);
+}
+